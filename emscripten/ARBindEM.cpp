@@ -12,6 +12,13 @@ EMSCRIPTEN_BINDINGS(constant_bindings) {
 	function("_addMarker", &addMarker);
 	function("_addMultiMarker", &addMultiMarker);
 	function("_addNFTMarker", &addNFTMarker);
+	function("_allocNFTBundle", &allocNFTBundle);
+	function("_freeNFTBundle", &freeNFTBundle);
+	function("_getNFTBundleHeadSize", &getNFTBundleHeadSize);
+	function("_addNFTMarkerBundle", &addNFTMarkerBundle);
+	function("_updateNFTMarkerBundle", &updateNFTMarkerBundle);
+	function("_serializeNFTMarker", &serializeNFTMarker);
+	function("shareNFTMarkers", &shareNFTMarkers);
 
 	function("getMultiMarkerNum", &getMultiMarkerNum);
 	function("getMultiMarkerCount", &getMultiMarkerCount);
@@ -27,10 +34,63 @@ EMSCRIPTEN_BINDINGS(constant_bindings) {
 	function("getTransMatMultiSquare", &getTransMatMultiSquare);
 	function("getTransMatMultiSquareRobust", &getTransMatMultiSquareRobust);
 
+	function("setVideoPixelFormat", &setVideoPixelFormat);
+	function("setVideoSource", &setVideoSource);
+	function("getVideoPixelFormat", &getVideoPixelFormat);
+	function("setVideoSize", &setVideoSize);
+	function("setFrameRing", &setFrameRing);
+	function("takeFrameSlot", &takeFrameSlot);
+
+	function("prepareFrame", &prepareFrame);
 	function("detectMarker", &detectMarker);
 	function("getMarkerNum", &getMarkerNum);
+	function("setSquareMarkerROI", &setSquareMarkerROI);
+	function("getSquareMarkerROI", &getSquareMarkerROI);
+
+	function("setStatsEnabled", &setStatsEnabled);
+	function("getStatsEnabled", &getStatsEnabled);
+	function("resetStats", &resetStats);
+	function("getStatsPointer", &getStatsPointer);
+
+	function("detect", &detect);
+	register_vector<int>("VectorInt");
+	function("_detectBatch", &detectBatch);
+	function("getResultsPointer", &getResultsPointer);
+	function("getResultsLength", &getResultsLength);
+	function("setPoseFilter", &setPoseFilter);
+	function("getPoseFilterEnabled", &getPoseFilterEnabled);
+	function("predictResults", &predictResults);
+	function("setSquareMarkerWidth", &setSquareMarkerWidth);
+	function("setDefaultMarkerWidth", &setDefaultMarkerWidth);
 
 	function("detectNFTMarker", &detectNFTMarker);
+	function("commitNFTMarkers", &commitNFTMarkers);
+	function("setNFTAsyncMatching", &setNFTAsyncMatching);
+	function("getNFTAsyncMatching", &getNFTAsyncMatching);
+	function("setNFTMatchingScale", &setNFTMatchingScale);
+	function("getNFTMatchingScale", &getNFTMatchingScale);
+	function("setNFTMaxPages", &setNFTMaxPages);
+	function("getNFTMaxPages", &getNFTMaxPages);
+	function("setNFTPoseEstimation", &setNFTPoseEstimation);
+	function("getNFTPoseMode", &getNFTPoseMode);
+	function("getNFTPoseMaxIterations", &getNFTPoseMaxIterations);
+	function("setNFTTrackingMode", &setNFTTrackingMode);
+	function("getNFTTrackingMode", &getNFTTrackingMode);
+	function("setNFTTrackingBudget", &setNFTTrackingBudget);
+	function("getNFTTrackingBudget", &getNFTTrackingBudget);
+	function("addNFTTrackingTime", &addNFTTrackingTime);
+	function("setNFTQualityLevel", &setNFTQualityLevel);
+	function("getNFTQualityLevel", &getNFTQualityLevel);
+	function("setFrameScheduler", &setFrameScheduler);
+	function("getFrameSchedulerEnabled", &getFrameSchedulerEnabled);
+	function("getFramePath", &getFramePath);
+	function("setNFTMemoryBudget", &setNFTMemoryBudget);
+	function("getNFTMemoryBudget", &getNFTMemoryBudget);
+	function("setNFTTrackingDistance", &setNFTTrackingDistance);
+	function("getNFTNearDistance", &getNFTNearDistance);
+	function("getNFTFarDistance", &getNFTFarDistance);
+	function("getNFTMarkerResidentBytes", &getNFTMarkerResidentBytes);
+	function("getNFTResidentBytes", &getNFTResidentBytes);
 
 	function("getMultiEachMarker", &getMultiEachMarkerInfo);
 	function("getMarker", &getMarkerInfo);
@@ -122,6 +182,12 @@ EMSCRIPTEN_BINDINGS(constant_bindings) {
 	constant("AR_LOG_LEVEL_ERROR", AR_LOG_LEVEL_ERROR + 0);
 	constant("AR_LOG_LEVEL_REL_INFO", AR_LOG_LEVEL_REL_INFO + 0);
 
+	constant("AR_PIXEL_FORMAT_RGBA", AR_PIXEL_FORMAT_RGBA + 0);
+	constant("AR_PIXEL_FORMAT_MONO", AR_PIXEL_FORMAT_MONO + 0);
+	constant("AR_PIXEL_FORMAT_420v", AR_PIXEL_FORMAT_420v + 0);
+	constant("AR_PIXEL_FORMAT_420f", AR_PIXEL_FORMAT_420f + 0);
+	constant("AR_PIXEL_FORMAT_NV21", AR_PIXEL_FORMAT_NV21 + 0);
+
 	constant("AR_MATRIX_CODE_3x3", AR_MATRIX_CODE_3x3 + 0);
 	constant("AR_MATRIX_CODE_3x3_HAMMING63", AR_MATRIX_CODE_3x3_HAMMING63 + 0);
 	constant("AR_MATRIX_CODE_3x3_PARITY65", AR_MATRIX_CODE_3x3_PARITY65 + 0);
@@ -129,6 +195,15 @@ EMSCRIPTEN_BINDINGS(constant_bindings) {
 	constant("AR_MATRIX_CODE_4x4_BCH_13_9_3", AR_MATRIX_CODE_4x4_BCH_13_9_3 + 0);
 	constant("AR_MATRIX_CODE_4x4_BCH_13_5_5", AR_MATRIX_CODE_4x4_BCH_13_5_5 + 0);
 
+	constant("AR2_POSE_CASCADE", AR2_POSE_CASCADE + 0);
+	constant("AR2_POSE_ROBUST", AR2_POSE_ROBUST + 0);
+	constant("AR2_TRACKING_6DOF", AR2_TRACKING_6DOF + 0);
+	constant("AR2_TRACKING_HOMOGRAPHY", AR2_TRACKING_HOMOGRAPHY + 0);
+
+	constant("AR_FRAME_PATH_FULL", FRAME_PATH_FULL);
+	constant("AR_FRAME_PATH_TRACK", FRAME_PATH_TRACK);
+	constant("AR_FRAME_PATH_PREDICT", FRAME_PATH_PREDICT);
+
 	constant("AR_LABELING_THRESH_MODE_MANUAL", AR_LABELING_THRESH_MODE_MANUAL + 0);
 	constant("AR_LABELING_THRESH_MODE_AUTO_MEDIAN", AR_LABELING_THRESH_MODE_AUTO_MEDIAN + 0);
 	constant("AR_LABELING_THRESH_MODE_AUTO_OTSU", AR_LABELING_THRESH_MODE_AUTO_OTSU + 0);
@@ -0,0 +1,297 @@
+/*
+ *  ARToolKitBench.cpp
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Native benchmark of the controller code in ARToolKitJS.cpp, built by tools/makenative.js.
+ *
+ *  Replays a recorded sequence of raw frames through prepareFrame(), detectMarker(),
+ *  detectNFTMarker() and trackNFTMarker(), the tracking of getNFTMarkerInfo(), and reports the
+ *  mean, p50 and p99 time of each stage and of the whole frame, and the NFT tracking-loss rate.
+ *
+ *  Record a sequence with e.g.
+ *      ffmpeg -i examples/Data/video.mp4 -vf scale=640:480 -pix_fmt gray -f rawvideo video.gray
+ *  (-pix_fmt rgba for --format rgba) and replay it with
+ *      build/native/artoolkit_bench --camera examples/Data/camera_para.dat --size 640x480 \
+ *          --frames video.gray --nft examples/DataNFT/pinball --patt examples/Data/patt.hiro
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ARToolKitJS.cpp"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+enum {
+	STAGE_LUMA,
+	STAGE_SQUARE,
+	STAGE_KPM,
+	STAGE_AR2,
+	STAGE_TOTAL,
+	STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] = { "luma", "square", "kpm", "ar2", "total" };
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> samples, double p) {
+	if (samples.empty()) return 0;
+	std::sort(samples.begin(), samples.end());
+	size_t i = (size_t)(p * (samples.size() - 1) + 0.5);
+	return samples[i];
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"Usage: %s --camera <camera_para.dat> --size <WxH> --frames <raw frames> [options]\n"
+		"  --format mono|rgba   Pixel format of the raw frames (default mono).\n"
+		"  --nft <dataset>      NFT marker, as the path without extension. Repeatable.\n"
+		"  --patt <file>        Pattern marker. Repeatable.\n"
+		"  --max-pages <n>      Number of NFT pages tracked at the same time (default 1).\n"
+		"  --async              Run KPM matching on a background thread (HAVE_THREADS builds).\n"
+		"  --robust-pose        Refit NFT poses with a single robust ICP pass (AR2_POSE_ROBUST).\n"
+		"  --nft-mode <mode>    NFT tracking mode, 6dof (default) or homography (AR2_TRACKING_HOMOGRAPHY).\n"
+		"  --compare-modes      Also track the NFT markers in 6dof mode, untimed, and report how far the poses differ.\n"
+		"  --kpm-scale <n>      Downscale the frame by n (1 to 4) for KPM matching (default 1).\n"
+		"  --nft-budget <ms>    NFT tracking time per frame for the quality governor (default 0, off).\n"
+		"  --frame-skip <n>     Run the frame scheduler, predicting NFT poses for up to n frames in a row.\n"
+		"  --frame-budget <ms>  NFT time per frame the frame scheduler aims for (default 0).\n"
+		"  --roi <n>            Track square markers in regions of interest, scanning the full frame every n frames.\n"
+		"  --loops <n>          Replay the sequence n times (default 1).\n"
+		"  --warmup <n>         Leave the first n frames out of the statistics (default 0).\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	const char *cameraPath = NULL;
+	const char *framesPath = NULL;
+	int width = 0, height = 0;
+	bool rgba = false;
+	std::vector<std::string> nftPaths, pattPaths;
+	int maxPages = 1;
+	bool async = false;
+	int poseMode = AR2_POSE_CASCADE;
+	int trackingMode = AR2_TRACKING_6DOF;
+	bool compareModes = false;
+	int roiInterval = 0;
+	int kpmScale = 1;
+	double nftBudget = 0;
+	int frameSkip = -1;
+	double frameBudget = 0;
+	int loops = 1;
+	int warmup = 0;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--camera") && hasValue) cameraPath = argv[++i];
+		else if (!strcmp(argv[i], "--frames") && hasValue) framesPath = argv[++i];
+		else if (!strcmp(argv[i], "--size") && hasValue) sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (!strcmp(argv[i], "--format") && hasValue) rgba = !strcmp(argv[++i], "rgba");
+		else if (!strcmp(argv[i], "--nft") && hasValue) nftPaths.push_back(argv[++i]);
+		else if (!strcmp(argv[i], "--patt") && hasValue) pattPaths.push_back(argv[++i]);
+		else if (!strcmp(argv[i], "--max-pages") && hasValue) maxPages = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--async")) async = true;
+		else if (!strcmp(argv[i], "--robust-pose")) poseMode = AR2_POSE_ROBUST;
+		else if (!strcmp(argv[i], "--nft-mode") && hasValue) {
+			trackingMode = !strcmp(argv[++i], "homography") ? AR2_TRACKING_HOMOGRAPHY : AR2_TRACKING_6DOF;
+		}
+		else if (!strcmp(argv[i], "--compare-modes")) compareModes = true;
+		else if (!strcmp(argv[i], "--roi") && hasValue) roiInterval = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--kpm-scale") && hasValue) kpmScale = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--nft-budget") && hasValue) nftBudget = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--frame-skip") && hasValue) frameSkip = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--frame-budget") && hasValue) frameBudget = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--loops") && hasValue) loops = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--warmup") && hasValue) warmup = atoi(argv[++i]);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!cameraPath || !framesPath || width <= 0 || height <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	setLogLevel(AR_LOG_LEVEL_ERROR);
+
+	// Load the whole sequence up front so file reads are not timed.
+	size_t frameSize = (size_t)width * height * (rgba ? 4 : 1);
+	std::vector<ARUint8> frames;
+	FILE *fp = fopen(framesPath, "rb");
+	if (!fp) {
+		fprintf(stderr, "Unable to open %s.\n", framesPath);
+		return 1;
+	}
+	std::vector<ARUint8> frame(frameSize);
+	while (fread(frame.data(), 1, frameSize, fp) == frameSize) {
+		frames.insert(frames.end(), frame.begin(), frame.end());
+	}
+	fclose(fp);
+	int frameCount = frames.size() / frameSize;
+	if (frameCount == 0) {
+		fprintf(stderr, "No %dx%d %s frames in %s.\n", width, height, rgba ? "rgba" : "mono", framesPath);
+		return 1;
+	}
+
+	int cameraID = loadCamera(cameraPath);
+	if (cameraID < 0) return 1;
+	int id = setup(width, height, cameraID);
+	if (setNFTMatchingScale(id, kpmScale) < 0) return 1;
+	setupAR2(id);
+	if (!rgba && setVideoPixelFormat(id, AR_PIXEL_FORMAT_MONO) < 0) return 1;
+	for (int i = 0; i < pattPaths.size(); i++) {
+		if (addMarker(id, pattPaths[i]) < 0) return 1;
+	}
+	for (int i = 0; i < nftPaths.size(); i++) {
+		if (addNFTMarker(id, nftPaths[i]) < 0) return 1;
+	}
+	setNFTMaxPages(id, maxPages);
+	setNFTPoseEstimation(id, poseMode, 0);
+	if (setNFTTrackingMode(id, trackingMode) < 0) return 1;
+	if (setNFTTrackingBudget(id, nftBudget) < 0) return 1;
+	if (frameSkip >= 0 && setFrameScheduler(id, 1, frameBudget, frameSkip) < 0) return 1;
+	if (setSquareMarkerROI(id, roiInterval) < 0) return 1;
+	if (async && setNFTAsyncMatching(id, 1) < 0) {
+		fprintf(stderr, "Asynchronous matching needs a HAVE_THREADS build.\n");
+		return 1;
+	}
+	// The reference controller tracks the same frames in 6dof mode, outside the timings.
+	int refId = -1;
+	if (compareModes && !nftPaths.empty()) {
+		refId = setup(width, height, cameraID);
+		if (setNFTMatchingScale(refId, kpmScale) < 0) return 1;
+		setupAR2(refId);
+		if (!rgba && setVideoPixelFormat(refId, AR_PIXEL_FORMAT_MONO) < 0) return 1;
+		for (int i = 0; i < nftPaths.size(); i++) {
+			if (addNFTMarker(refId, nftPaths[i]) < 0) return 1;
+		}
+		setNFTMaxPages(refId, maxPages);
+		setNFTPoseEstimation(refId, poseMode, 0);
+	}
+	arController *arc = &(arControllers[id]);
+	arController *ref = refId >= 0 ? &(arControllers[refId]) : NULL;
+
+	std::vector<double> samples[STAGE_COUNT];
+	std::vector<bool> found(nftPaths.size(), false);
+	std::vector<float> poses(nftPaths.size() * 12);
+	std::vector<double> translationDiffs, rotationDiffs;
+	std::vector<bool> wasTracked(nftPaths.size(), false);
+	int trackedFrames = 0, losses = 0;
+	int pathFrames[3] = { 0, 0, 0 };
+
+	for (int n = 0; n < loops * frameCount; n++) {
+		double ms[STAGE_COUNT] = {0};
+		auto frameStart = std::chrono::steady_clock::now();
+
+		auto start = std::chrono::steady_clock::now();
+		memcpy(arc->videoFrame, frames.data() + (n % frameCount) * frameSize, frameSize);
+		prepareFrame(id);
+		ms[STAGE_LUMA] = elapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		detectMarker(id);
+		ms[STAGE_SQUARE] = elapsedMs(start);
+
+		if (!nftPaths.empty()) {
+			start = std::chrono::steady_clock::now();
+			detectNFTMarker(id);
+			ms[STAGE_KPM] = elapsedMs(start);
+
+			// trackNFTMarker() is what getNFTMarkerInfo() runs, keeping the pose for the comparison.
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < nftPaths.size(); i++) {
+				float err;
+				found[i] = trackNFTMarker(arc, i, (float (*)[4])&poses[i * 12], &err);
+			}
+			ms[STAGE_AR2] = elapsedMs(start);
+		}
+		ms[STAGE_TOTAL] = elapsedMs(frameStart);
+
+		if (ref) {
+			memcpy(ref->videoFrame, frames.data() + (n % frameCount) * frameSize, frameSize);
+			prepareFrame(refId);
+			detectNFTMarker(refId);
+			for (int i = 0; i < nftPaths.size(); i++) {
+				float trans[3][4], err;
+				if (!trackNFTMarker(ref, i, trans, &err) || !found[i] || n < warmup) continue;
+				const float *pose = &poses[i * 12];
+				double dt = 0, trace = 0;
+				for (int j = 0; j < 3; j++) {
+					double d = pose[j * 4 + 3] - trans[j][3];
+					dt += d * d;
+					for (int k = 0; k < 3; k++) trace += pose[k * 4 + j] * trans[k][j];
+				}
+				double c = (trace - 1) / 2;
+				translationDiffs.push_back(sqrt(dt));
+				rotationDiffs.push_back(acos(c > 1 ? 1 : (c < -1 ? -1 : c)) * 180 / M_PI);
+			}
+		}
+
+		if (n < warmup) continue;
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			samples[s].push_back(ms[s]);
+		}
+		pathFrames[arc->framePath]++;
+		for (int i = 0; i < nftPaths.size(); i++) {
+			bool tracked = arc->nftMarkers[i].tracked;
+			if (wasTracked[i]) {
+				trackedFrames++;
+				if (!tracked) losses++;
+			}
+			wasTracked[i] = tracked;
+		}
+	}
+
+	size_t measured = samples[STAGE_TOTAL].size();
+	printf("frames: %d x %d loops, %zu measured\n", frameCount, loops, measured);
+	printf("%-8s %10s %10s %10s\n", "stage", "mean ms", "p50 ms", "p99 ms");
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		double sum = 0;
+		for (size_t i = 0; i < samples[s].size(); i++) sum += samples[s][i];
+		printf("%-8s %10.3f %10.3f %10.3f\n", stageNames[s], measured ? sum / measured : 0,
+			percentile(samples[s], 0.50), percentile(samples[s], 0.99));
+	}
+	if (!nftPaths.empty()) {
+		printf("nft tracking: %d tracked frames, %d losses, loss rate %.2f%%\n", trackedFrames, losses,
+			trackedFrames ? 100.0 * losses / trackedFrames : 0);
+		if (nftBudget > 0) {
+			printf("nft quality level: %d\n", getNFTQualityLevel(id));
+		}
+		if (frameSkip >= 0) {
+			printf("frame paths: %d full, %d track, %d predict\n", pathFrames[FRAME_PATH_FULL],
+				pathFrames[FRAME_PATH_TRACK], pathFrames[FRAME_PATH_PREDICT]);
+		}
+		if (ref) {
+			size_t compared = translationDiffs.size();
+			double tSum = 0, rSum = 0;
+			for (size_t i = 0; i < compared; i++) {
+				tSum += translationDiffs[i];
+				rSum += rotationDiffs[i];
+			}
+			printf("pose difference to 6dof: %zu poses, translation mean %.2f p99 %.2f mm, rotation mean %.3f p99 %.3f deg\n",
+				compared, compared ? tSum / compared : 0, percentile(translationDiffs, 0.99),
+				compared ? rSum / compared : 0, percentile(rotationDiffs, 0.99));
+		}
+	}
+
+	return 0;
+}
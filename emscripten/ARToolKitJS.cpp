@@ -10,14 +10,17 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <AR/ar.h>
 //#include <AR/gsub_lite.h>
 // #include <AR/gsub_es2.h>
 #include <AR/arMulti.h>
-#include <emscripten.h>
+#include "emscriptenShim.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
+#include <algorithm>
 #include <AR/config.h>
 #include <AR/arFilterTransMat.h>
 #include <AR2/tracking.h>
@@ -25,23 +28,163 @@
 #include <AR/video.h>
 #include <KPM/kpm.h>
 #include "trackingMod.h"
+#include "videoLuma.h"
+#include "trackingSub.h"
+#include "markerROI.h"
+#include "nftBundle.h"
+#include <math.h>
+#include <stdint.h>
+#ifdef AR_SCRATCH_CHECK
+#include <malloc.h>
+#endif
+
+// Layout of the results arena filled by detect(), in ARdouble elements.
+// Keep in sync with the RESULTS_* offsets in artoolkit.api.js.
+#define RESULTS_HEADER_SIZE      8      // detectMarker result, square count, NFT count, multi count, NFT offset, multi offset, arena size, KPM result count.
+#define RESULTS_SQUARE_SIZE      48     // ARMarkerInfo (33), marker type, tracked id, transform error, pose (12).
+#define RESULTS_NFT_SIZE         14     // found, error, pose (12).
+#define RESULTS_MULTI_SIZE       13     // sub-marker count, pose (12), followed by the sub-markers.
+#define RESULTS_MULTI_EACH_SIZE  16     // visible, pattId, pattType, width, pose (12).
+
+// Square marker regions of interest (see setSquareMarkerROI()).
+#define ROI_PADDING_MIN          16     // Pixels added on each side of a predicted marker box.
+#define ROI_PADDING_RATIO        0.25   // Padding as a share of the larger side of the box.
+#define ROI_MAX_AREA_RATIO       0.5    // Scan the full frame when the regions cover more than this share of it.
+
+// Frame ring (see setFrameRing()). Keep in sync with artoolkit.api.js and artoolkit.frame_ring.js.
+#define FRAME_RING_SLOTS         3
+#define FRAME_RING_READY         0      // frameRing word: slot of the newest frame, ORed with FRAME_RING_FRESH until taken.
+#define FRAME_RING_COUNT         1      // frameRing word: number of frames published, for Atomics.wait().
+#define FRAME_RING_FRESH         0x100
+
+// Pose filtering (see setPoseFilter()).
+#define POSE_PREDICT_MAX_MS      250    // Poses are extrapolated at most this far past the last detection.
+
+// Frame scheduler (see setFrameScheduler()). Bound as AR_FRAME_PATH_* for artoolkit.api.js.
+#define FRAME_PATH_FULL          0      // KPM matching and AR2 tracking.
+#define FRAME_PATH_TRACK         1      // AR2 tracking of the tracked NFT pages only.
+#define FRAME_PATH_PREDICT       2      // Poses of the tracked NFT pages extrapolated, no NFT image work.
+#define SCHEDULE_ERROR_RATIO     0.5    // Poses are only predicted after tracking errors under this share of trackingThresh,
+#define SCHEDULE_FEATURE_RATIO   0.75   // with at least this share of searchFeatureNum features matched.
+#define SCHEDULE_MATCH_INTERVAL  30     // Frames between KPM matches for more pages while matching is over budget.
+#define SCHEDULE_SMOOTHING       0.1
+
+// NFT quality governor (see setNFTTrackingBudget()).
+#define NFT_QUALITY_LEVEL_NUM       5
+#define NFT_QUALITY_LEVEL_DEFAULT   2
+#define NFT_GOVERNOR_HOLD           30     // Tracked frames between two level changes.
+#define NFT_GOVERNOR_RAISE_RATIO    0.6    // Raise the level while tracking takes less than this share of the budget.
+#define NFT_GOVERNOR_SMOOTHING      0.1    // Weight of a frame in the running mean of the tracking time.
+
+// Builds with AR_SCRATCH_CHECK warn about detect() calls that grow the heap after this many calls.
+#define SCRATCH_WARMUP_FRAMES       30
+
+// Stage timings in milliseconds and counters of a controller, accumulated while stats are enabled
+// with setStatsEnabled(). Every field is a double; keep in sync with STATS_FIELDS in artoolkit.api.js.
+struct controller_stats {
+	double frames = 0; // Calls to prepareFrame().
+	double lumaMs = 0;
+	double detectMarkerMs = 0;
+	double kpmMs = 0; // Blocking kpmMatching() only; asynchronous matching runs off the detection thread.
+	AR2TrackingStatsT ar2 = {0}; // ar2TrackingMod() stages and counters, all NFT pages together.
+	double relocalizations = 0; // NFT pages (re)initialised from KPM results.
+	double trackingLosses = 0;
+	double squareROIFrames = 0; // detectMarker() calls that scanned regions of interest only.
+};
 
-#define PAGES_MAX               10          // Maximum number of pages expected. You can change this down (to save memory) or up (to accomodate more pages.)
+// Low pass filter of the published pose of a marker, with its last two filtered poses
+// for predicting the pose at a later time (see setPoseFilter()).
+struct pose_filter {
+	ARFilterTransMatInfo *ftmi = NULL; // Created on the first filtered pose.
+	int samples = 0; // Filtered poses of the current sighting, up to 2.
+	double time[2]; // Detection time of trans[0] (the newest pose) and trans[1], in ms.
+	ARdouble trans[2][3][4];
+};
 
 struct multi_marker {
 	int id;
 	ARMultiMarkerInfoT *multiMarkerHandle;
 };
 
+struct nft_marker {
+	std::string datasetPathname;
+	AR2SurfaceSetT *surfaceSet = NULL; // AR2 image pyramid and feature set, NULL while not resident.
+	size_t surfaceSetBytes = 0; // Estimated heap size of surfaceSet, measured on its first load.
+	ARUint8 *bundle = NULL; // NFT bundle surfaceSet points into, see addNFTMarkerBundle(). Never evicted.
+	size_t bundleSize = 0;
+	size_t bundleAvailable = 0; // Bytes of the bundle received so far.
+	AR2SurfaceSetT *sharedSurfaceSet = NULL; // Surface set of another controller surfaceSet is a view of, see shareNFTMarkers(). Never evicted.
+	bool tracked = false; // The per-page pose history lives in surfaceSet, which stays resident while tracked.
+	int lastUsed = 0; // Frame of the last match or tracking of this page, for LRU eviction.
+	float error = -1; // Tracking error of the last tracked frame, reported for predicted frames.
+	pose_filter filter;
+};
+
+struct square_marker {
+	ARdouble width;
+	bool inPrevious = false;
+	bool inCurrent = false;
+	ARdouble trans[3][4]; // Unfiltered pose, continued by arGetTransMatSquareCont().
+	pose_filter filter;
+};
+
+// A square marker found in the last frame, for predicting its region in the next.
+struct roi_marker {
+	int id;
+	ARdouble pos[2];
+	ARdouble vel[2]; // Motion of pos since the frame before, in pixels.
+	ARdouble box[4]; // Bounding box of the vertices: left, top, right, bottom.
+};
+
+// AR2 tracking settings of an NFT quality level.
+struct nft_quality_level {
+	int searchFeatureNum;
+	int searchSize;
+	int templateSize;
+};
+
+// From the cheapest to the most stable poses.
+static const nft_quality_level nftQualityLevels[NFT_QUALITY_LEVEL_NUM] = {
+	{  8,  4, 4 },
+	{ 12,  5, 5 },
+	{ 16,  6, 6 }, // The settings for devices with single-core CPUs, used until a budget is set.
+	{ 24,  8, 7 },
+	{ 32, 10, 8 },
+};
+
+struct arController;
+extern "C" void releaseController(arController *arc);
+
+// Owns every handle and buffer it points to, released by its destructor when erased from arControllers.
 struct arController {
+	arController() {}
+	arController(const arController&) = delete;
+	arController& operator=(const arController&) = delete;
+	~arController() { releaseController(this); }
+
 	int id;
 
+	int cameraID = -1;
 	ARParam param;
-	ARParamLT *paramLT = NULL;
+	ARParamLT *paramLT = NULL; // Shared with the other controllers using the camera at this size, see acquireCameraLT().
 
+	ARUint8 *videoFrameSlots = NULL; // frameSlotNum frames of videoFrameSize bytes.
+	int frameSlotNum = 1;
+	int frameSlot = 0; // Slot of videoFrame.
+	int32_t frameRing[2] = { 0, 0 }; // Shared with the thread writing frames, see setFrameRing().
 	ARUint8 *videoFrame = NULL;
-	int videoFrameSize;
-	ARUint8 *videoLuma = NULL;
+	int videoFrameSize = 0;
+	ARUint8 *videoLuma = NULL; // Aliases videoFrame for the formats whose frames start with the Y plane.
+
+	// Frames in camera orientation and resolution, see setVideoSource(); NULL when frames are written to videoFrame.
+	ARUint8 *videoSource = NULL;
+	int videoSourceSize = 0;
+	int sourceWidth = 0; // 0 without a source.
+	int sourceHeight = 0;
+	int sourceRotation = 0;
+	AR_PIXEL_FORMAT sourceFormat = AR_PIXEL_FORMAT_RGBA;
+	AR_PIXEL_FORMAT pixFormatBeforeSource = AR_PIXEL_FORMAT_RGBA; // Restored when the source is detached.
+	ARVideoLumaOrientT *sourceOrient = NULL;
 
 	int width = 0;
 	int height = 0;
@@ -49,16 +192,56 @@ struct arController {
 	ARHandle *arhandle = NULL;
 	ARPattHandle *arPattHandle = NULL;
 	ARMultiMarkerInfoT *arMultiMarkerHandle = NULL;
-	AR3DHandle* ar3DHandle;
-
-	KpmHandle* kpmHandle;
-	AR2HandleT* ar2Handle;
-
-	int detectedPage = -2;  // -2 Tracking not inited, -1 tracking inited OK, >= 0 tracking online on page.
-
-	int surfaceSetCount = 0; // Running NFT marker id
-	AR2SurfaceSetT      *surfaceSet[PAGES_MAX];
-	std::unordered_map<int, AR2SurfaceSetT*> surfaceSets;
+	AR3DHandle* ar3DHandle = NULL; // Shared along with paramLT.
+
+	KpmHandle* kpmHandle = NULL;
+	int kpmScale = 1; // KPM matches a luma image downscaled by this factor, see setNFTMatchingScale().
+	ARParamLT *kpmParamLT = NULL; // Camera of the downscaled image, NULL when kpmScale is 1. Shared as paramLT.
+	ARUint8 *kpmLuma = NULL;
+	AR2HandleT* ar2Handle = NULL;
+
+	int maxTrackedPages = 1; // Number of NFT pages tracked at the same time.
+	AR2PoseParamT nftPoseParam = { AR2_POSE_CASCADE, 0 }; // NFT pose estimation mode and ICP iteration limit.
+	int nftTrackingMode = AR2_TRACKING_6DOF; // With AR2_TRACKING_HOMOGRAPHY, the pose histories of the pages hold homographies.
+
+	double nftBudgetMs = 0; // NFT tracking time per frame the governor aims for, 0 to keep nftQuality fixed.
+	int nftQuality = NFT_QUALITY_LEVEL_DEFAULT; // Index in nftQualityLevels.
+	double nftFrameMs = 0; // NFT tracking time in the current frame.
+	double nftMeanMs = 0; // Running mean of nftFrameMs over frames with tracking, restarted on level changes.
+	int nftGovernorHold = 0;
+
+	bool schedulerEnabled = false;
+	double scheduleBudgetMs = 0; // NFT time per frame the scheduler aims for, 0 to predict whenever tracking is steady.
+	int scheduleMaxSkip = 2; // Consecutive frames whose NFT poses may be predicted.
+	int framePath = FRAME_PATH_FULL; // Path of the NFT pipeline in the current frame.
+	int framesPredicted = 0; // Predicted frames since the last tracked one.
+	int framesSinceMatch = 0;
+	bool trackingSteady = false; // All pages tracked in the last tracked frame had low errors and enough features.
+	bool frameSteady = true; // trackingSteady of the current frame, while it is tracked.
+	double trackMeanMs = 0; // Running means of the AR2 and KPM time of the frames running them.
+	double matchMeanMs = 0;
+	double matchFrameMs = 0; // KPM time in the current frame.
+
+	KpmResult *kpmResult = NULL; // Results of the last detectNFTMarker() call, owned by kpmHandle.
+	int kpmResultNum = -1;
+
+	bool asyncMatching = false; // Run KPM matching on kpmThread instead of blocking detectNFTMarker().
+	bool kpmThreadBusy = false; // A match is running on kpmThread; kpmHandle belongs to the thread.
+#ifdef HAVE_THREADS
+	THREAD_HANDLE_T *kpmThread = NULL;
+	int ar2ThreadNum = 0; // Threads of the thread budget held by the workers of ar2Handle.
+#endif
+
+	KpmRefDataSet *refDataSet = NULL; // Merged KPM data of all loaded NFT pages.
+	bool refDataSetDirty = false; // True when refDataSet has pages not yet committed to kpmHandle.
+
+	std::vector<nft_marker> nftMarkers; // NFT marker registry, indexed by marker id (the KPM page number).
+	std::vector<int> skipPages; // Pages excluded from KPM matching by needsNFTMatching(), kept for its storage.
+	size_t nftMemoryBudget = 0; // Byte budget for resident surface sets, 0 for no limit.
+	size_t nftResidentBytes = 0;
+	int nftFrame = 0;
+	ARdouble nftNearDistance = 0; // Range of camera distances the NFT pages are tracked at, 0 for any;
+	ARdouble nftFarDistance = 0; // image levels only used outside of it are not kept in memory.
 
 	ARdouble nearPlane = 0.0001;
 	ARdouble farPlane = 1000.0;
@@ -67,20 +250,108 @@ struct arController {
 
 	int patt_id = 0; // Running pattern marker id
 
+	ARdouble defaultMarkerWidth = 1.0;
+	std::unordered_map<int, square_marker> patternMarkers; // Continuity state of square markers, by pattern id.
+	std::unordered_map<int, square_marker> barcodeMarkers; // Continuity state of square markers, by barcode id.
+
+	int roiFullScanInterval = 0; // Frames between full-frame square marker scans, 0 to always scan the full frame.
+	int roiFramesToFullScan = 0;
+	std::vector<roi_marker> roiMarkers;
+	std::vector<roi_marker> roiMarkersNext; // Built by updateSquareROIMarkers(), then swapped with roiMarkers.
+	std::vector<int> rois; // { x, y, xsize, ysize } of each region of interest.
+	std::vector<int> roiBoxes; // Working boxes of predictSquareROIs(), kept so their storage is reused.
+	ARUint8 *roiLuma = NULL;
+
+	std::vector<ARdouble> results; // Results arena filled by detect().
+#ifdef AR_SCRATCH_CHECK
+	int scratchWarmup = SCRATCH_WARMUP_FRAMES; // detect() calls left that may still grow the heap.
+#endif
+
+	bool poseFilterEnabled = false;
+	ARdouble poseFilterSampleRate = AR_FILTER_TRANS_MAT_SAMPLE_RATE_DEFAULT;
+	ARdouble poseFilterCutoffFreq = AR_FILTER_TRANS_MAT_CUTOFF_FREQ_DEFAULT;
+	double frameTime = 0; // Time of the last detection, in ms.
+
+	bool statsEnabled = false;
+	controller_stats stats;
+
 	ARdouble cameraLens[16];
 	AR_PIXEL_FORMAT pixFormat = AR_PIXEL_FORMAT_RGBA;
+
+	ARdouble transform[3][4]; // Transform exchanged with JS as artoolkit.frameMalloc.transform.
+	ARMarkerInfo markerInfo; // Custom marker, addressed by markerIndex -1.
+};
+
+// The distortion lookup table and 3D handle of a camera at one resolution. Both are read-only
+// once built, so the controllers using the camera at that size share them.
+struct camera_lt {
+	ARParamLT *paramLT = NULL;
+	AR3DHandle *ar3DHandle = NULL;
+	int refCount = 0;
 };
 
+std::unordered_map<uint64_t, camera_lt> cameraLTs; // By camera ID and resolution, see cameraLTKey().
+
+// The AR2 data of an NFT page shared between controllers by shareNFTMarkers(). The image and
+// feature sets are read-only once loaded, so each controller tracks the page with its own view
+// of them, and the last controller to release the page frees them.
+struct shared_surface_set {
+	int refCount = 0;
+	ARUint8 *bundle = NULL; // Bundle the surface set points into, freed with it.
+};
+
+std::unordered_map<AR2SurfaceSetT *, shared_surface_set> sharedSurfaceSets;
+// Held for every use of sharedSurfaceSets: the controllers of a detectBatch() call load and
+// evict their pages on their own threads.
+std::mutex sharedSurfaceSetsMutex;
+
+// Declared after the caches above, which the controllers release into when destroyed:
+// statics are destroyed in reverse order, so controllers alive at exit go first.
 std::unordered_map<int, arController> arControllers;
 std::unordered_map<int, ARParam> cameraParams;
 
+#ifdef HAVE_THREADS
+// A share of the controllers of a detectBatch() call: ids[first], ids[first + stride], ...
+struct batch_task {
+	const int *ids = NULL;
+	int count = 0;
+	int first = 0;
+	int stride = 1;
+};
+
+static THREAD_HANDLE_T *batchThreads[TRACKING_THREAD_POOL_SIZE]; // Started on the first batch with threads to spare.
+static batch_task batchTasks[TRACKING_THREAD_POOL_SIZE];
+static int batchThreadNum = 0;
+
+// Threads the controllers and detectBatch() may start together, 0 for no limit. Builds with
+// a preallocated pthread pool set it to the pool size: the pool cannot grow while the main
+// thread waits on a thread, so a thread beyond it would never start.
+#ifndef TRACKING_PTHREAD_POOL_SIZE
+#define TRACKING_PTHREAD_POOL_SIZE 0
+#endif
+static int threadBudgetUsed = 0;
+
+// Takes up to num threads from the budget and returns how many were granted. Work that
+// gets no thread runs on the calling thread instead.
+static int acquireThreads(int num) {
+	if (TRACKING_PTHREAD_POOL_SIZE > 0 && threadBudgetUsed + num > TRACKING_PTHREAD_POOL_SIZE) {
+		num = TRACKING_PTHREAD_POOL_SIZE - threadBudgetUsed;
+	}
+	if (num < 0) num = 0;
+	threadBudgetUsed += num;
+	return num;
+}
+
+static void releaseThreads(int num) {
+	threadBudgetUsed -= num;
+}
+#endif
+
 
 // ============================================================================
 //	Global variables
 // ============================================================================
 
-static ARdouble	gTransform[3][4];
-
 static int gARControllerID = 0;
 static int gCameraID = 0;
 
@@ -88,999 +359,3304 @@ static int ARCONTROLLER_NOT_FOUND = -1;
 static int MULTIMARKER_NOT_FOUND = -2;
 static int MARKER_INDEX_OUT_OF_BOUNDS = -3;
 
-static ARMarkerInfo gMarkerInfo;
+static int UNKNOWN_MARKER = -1;
+static int PATTERN_MARKER = 0;
+static int BARCODE_MARKER = 1;
 
 extern "C" {
 
 	/**
-		NFT API bindings
+		Camera lookup tables
 	*/
 
-	int getNFTMarkerInfo(int id, int markerIndex) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
+	static uint64_t cameraLTKey(int cameraID, int xsize, int ysize) {
+		return ((uint64_t)(uint32_t)cameraID << 32) | ((uint64_t)(xsize & 0xffff) << 16) | (uint64_t)(ysize & 0xffff);
+	}
 
-		if (arc->surfaceSetCount <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+	/**
+		Returns the lookup table of the given camera at xsize by ysize, building it on first use.
+		Every call must be paired with releaseCameraLT() on the returned paramLT.
+	*/
+	camera_lt *acquireCameraLT(int cameraID, int xsize, int ysize) {
+		if (cameraParams.find(cameraID) == cameraParams.end()) { return NULL; }
+		uint64_t key = cameraLTKey(cameraID, xsize, ysize);
+		camera_lt *lt = &(cameraLTs[key]);
+
+		if (lt->refCount == 0) {
+			ARParam param = cameraParams[cameraID];
+			if (param.xsize != xsize || param.ysize != ysize) {
+				ARLOGw("*** Camera Parameter resized from %d, %d. ***\n", param.xsize, param.ysize);
+				arParamChangeSize(&param, xsize, ysize, &param);
+			}
+			if ((lt->paramLT = arParamLTCreate(&param, AR_PARAM_LT_DEFAULT_OFFSET)) == NULL) {
+				ARLOGe("acquireCameraLT(): Error: arParamLTCreate.\n");
+				cameraLTs.erase(key);
+				return NULL;
+			}
+			if ((lt->ar3DHandle = ar3DCreateHandle(&param)) == NULL) {
+				ARLOGe("acquireCameraLT(): Error creating 3D handle.\n");
+				arParamLTFree(&lt->paramLT);
+				cameraLTs.erase(key);
+				return NULL;
+			}
 		}
+		lt->refCount++;
+		return lt;
+	}
 
-		KpmResult *kpmResult = NULL;
-		int kpmResultNum = -1;
-
-		float trans[3][4];
-		float err = -1;
-		if (arc->detectedPage == -2) {
-			kpmMatching( arc->kpmHandle, arc->videoLuma );
-			kpmGetResult( arc->kpmHandle, &kpmResult, &kpmResultNum );
-			int i, j, k;
-			int flag = -1;
-			for( i = 0; i < kpmResultNum; i++ ) {
-				if (kpmResult[i].pageNo == markerIndex && kpmResult[i].camPoseF == 0 ) {
-					if( flag == -1 || err > kpmResult[i].error ) { // Take the first or best result.
-						flag = i;
-						err = kpmResult[i].error;
-					}
-				}
+	void releaseCameraLT(ARParamLT **paramLT_p) {
+		for (auto it = cameraLTs.begin(); it != cameraLTs.end(); ++it) {
+			camera_lt *lt = &(it->second);
+			if (lt->paramLT != *paramLT_p) continue;
+			if (--lt->refCount == 0) {
+				ar3DDeleteHandle(&lt->ar3DHandle);
+				arParamLTFree(&lt->paramLT);
+				cameraLTs.erase(it);
 			}
+			break;
+		}
+		*paramLT_p = NULL;
+	}
+
+	/**
+		Pose filtering
+	*/
+
+	/**
+		Runs a pose being published through the marker's low pass filter, restarting the filter
+		when reset is true (the marker was not found in the previous frame), and keeps the
+		filtered pose for predictPose().
+	*/
+	void filterPose(arController *arc, pose_filter *filter, ARdouble trans[3][4], bool reset) {
+		if (!arc->poseFilterEnabled) return;
+		if (!filter->ftmi && (filter->ftmi = arFilterTransMatInit(arc->poseFilterSampleRate, arc->poseFilterCutoffFreq)) == NULL) {
+			return;
+		}
+		if (reset) filter->samples = 0;
+		arFilterTransMat(filter->ftmi, trans, reset ? 1 : 0);
+
+		memcpy(filter->trans[1], filter->trans[0], sizeof(filter->trans[0]));
+		memcpy(filter->trans[0], trans, sizeof(filter->trans[0]));
+		filter->time[1] = filter->time[0];
+		filter->time[0] = arc->frameTime;
+		if (filter->samples < 2) filter->samples++;
+	}
+
+	void freePoseFilter(pose_filter *filter) {
+		if (filter->ftmi) {
+			arFilterTransMatFinal(filter->ftmi);
+			filter->ftmi = NULL;
+		}
+		filter->samples = 0;
+	}
 
-			if (flag > -1) {
-				arc->detectedPage = kpmResult[0].pageNo;
+	void freePoseFilters(arController *arc) {
+		for (auto it = arc->patternMarkers.begin(); it != arc->patternMarkers.end(); ++it) {
+			freePoseFilter(&(it->second.filter));
+		}
+		for (auto it = arc->barcodeMarkers.begin(); it != arc->barcodeMarkers.end(); ++it) {
+			freePoseFilter(&(it->second.filter));
+		}
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			freePoseFilter(&(arc->nftMarkers[i].filter));
+		}
+	}
 
+	/**
+		Continues the motion from pose t1 to pose t0 for s more such steps, at constant linear and
+		angular velocity, into trans.
+	*/
+	void extrapolatePose(const ARdouble t0[3][4], const ARdouble t1[3][4], double s, ARdouble trans[3][4]) {
+		int i, j, k;
+		memcpy(trans, t0, sizeof(ARdouble) * 12);
+
+		// The rotation from the previous to the newest pose, R0 R1^T, raised to the power s.
+		ARdouble delta[3][4] = {{0}};
+		for (i = 0; i < 3; i++) {
+			for (j = 0; j < 3; j++) {
+				for (k = 0; k < 3; k++) delta[i][j] += t0[i][k] * t1[j][k];
+			}
+		}
+		ARdouble q[4], pos[3] = { 0, 0, 0 };
+		arUtilMat2QuatPos(delta, q, pos);
+		if (q[3] < 0) {
+			for (i = 0; i < 4; i++) q[i] = -q[i];
+		}
+		double half = acos(q[3] > 1 ? 1 : q[3]);
+		if (half > 1e-6) {
+			double scale = sin(half * s) / sin(half);
+			for (i = 0; i < 3; i++) q[i] *= scale;
+			q[3] = cos(half * s);
+			arUtilQuatPos2Mat(q, pos, delta);
+			for (i = 0; i < 3; i++) {
 				for (j = 0; j < 3; j++) {
-					for (k = 0; k < 4; k++) {
-						trans[j][k] = kpmResult[flag].camPose[j][k];
-					}
+					trans[i][j] = 0;
+					for (k = 0; k < 3; k++) trans[i][j] += delta[i][k] * t0[k][j];
 				}
-				ar2SetInitTrans(arc->surfaceSet[arc->detectedPage], trans);
-			} else {
-				arc->detectedPage = -2;
 			}
 		}
-
-		if (arc->detectedPage >= 0) {
-			int trackResult = ar2TrackingMod(arc->ar2Handle, arc->surfaceSet[arc->detectedPage], arc->videoFrame, trans, &err);
-			if( trackResult < 0 ) {
-				ARLOGi("Tracking lost. %d\n", trackResult);
-				arc->detectedPage = -2;
-			} else {
-				ARLOGi("Tracked page %d (max %d).\n",arc->surfaceSet[arc->detectedPage], arc->surfaceSetCount - 1);
-			}
+		for (i = 0; i < 3; i++) {
+			trans[i][3] = t0[i][3] + s * (t0[i][3] - t1[i][3]);
 		}
+	}
 
-		if (arc->detectedPage >= 0) {
-			EM_ASM_({
-				var $a = arguments;
-				var i = 0;
-				if (!artoolkit["NFTMarkerInfo"]) {
-					artoolkit["NFTMarkerInfo"] = ({
-						id: 0,
-						error: -1,
-						found: 0,
-						pose: [0,0,0,0, 0,0,0,0, 0,0,0,0]
-					});
-				}
-				var markerInfo = artoolkit["NFTMarkerInfo"];
-				markerInfo["id"] = $a[i++];
-				markerInfo["error"] = $a[i++];
-				markerInfo["found"] = 1;
-				markerInfo["pose"][0] = $a[i++];
-				markerInfo["pose"][1] = $a[i++];
-				markerInfo["pose"][2] = $a[i++];
-				markerInfo["pose"][3] = $a[i++];
-				markerInfo["pose"][4] = $a[i++];
-				markerInfo["pose"][5] = $a[i++];
-				markerInfo["pose"][6] = $a[i++];
-				markerInfo["pose"][7] = $a[i++];
-				markerInfo["pose"][8] = $a[i++];
-				markerInfo["pose"][9] = $a[i++];
-				markerInfo["pose"][10] = $a[i++];
-				markerInfo["pose"][11] = $a[i++];
-			},
-				markerIndex,
-				err,
+	/**
+		Extrapolates the last two filtered poses of a marker to time, at most POSE_PREDICT_MAX_MS
+		past the newest one. With a single pose, trans is that pose. Returns false if the marker
+		has no filtered pose.
+	*/
+	bool predictPose(pose_filter *filter, double time, ARdouble trans[3][4]) {
+		if (filter->samples == 0) return false;
+		memcpy(trans, filter->trans[0], sizeof(filter->trans[0]));
 
-				trans[0][0],
-				trans[0][1],
-				trans[0][2],
-				trans[0][3],
+		double interval = filter->time[0] - filter->time[1];
+		double ahead = time - filter->time[0];
+		if (filter->samples < 2 || interval <= 0 || ahead <= 0) return true;
+		if (ahead > POSE_PREDICT_MAX_MS) ahead = POSE_PREDICT_MAX_MS;
 
-				trans[1][0],
-				trans[1][1],
-				trans[1][2],
-				trans[1][3],
+		extrapolatePose(filter->trans[0], filter->trans[1], ahead / interval, trans);
+		return true;
+	}
 
-				trans[2][0],
-				trans[2][1],
-				trans[2][2],
-				trans[2][3]
-			);
-        } else {
-			EM_ASM_({
-				var $a = arguments;
-				var i = 0;
-				if (!artoolkit["NFTMarkerInfo"]) {
-					artoolkit["NFTMarkerInfo"] = ({
-						id: 0,
-						error: -1,
-						found: 0,
-						pose: [0,0,0,0, 0,0,0,0, 0,0,0,0]
-					});
-				}
-				var markerInfo = artoolkit["NFTMarkerInfo"];
-				markerInfo["id"] = $a[i++];
-				markerInfo["error"] = -1;
-				markerInfo["found"] = 0;
-				markerInfo["pose"][0] = 0;
-				markerInfo["pose"][1] = 0;
-				markerInfo["pose"][2] = 0;
-				markerInfo["pose"][3] = 0;
-				markerInfo["pose"][4] = 0;
-				markerInfo["pose"][5] = 0;
-				markerInfo["pose"][6] = 0;
-				markerInfo["pose"][7] = 0;
-				markerInfo["pose"][8] = 0;
-				markerInfo["pose"][9] = 0;
-				markerInfo["pose"][10] = 0;
-				markerInfo["pose"][11] = 0;
-			},
-				markerIndex
-			);
-        }
+	/**
+		NFT API bindings
+	*/
 
-		return 0;
+	int getTrackedPageCount(arController *arc) {
+		int count = 0;
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			if (arc->nftMarkers[i].tracked) count++;
+		}
+		return count;
 	}
 
-	int detectNFTMarker(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
-
-		KpmResult *kpmResult = NULL;
-		int kpmResultNum = -1;
-		return kpmResultNum;
+	size_t getSurfaceSetBytes(AR2SurfaceSetT *surfaceSet) {
+		size_t bytes = sizeof(AR2SurfaceSetT);
+		for (int i = 0; i < surfaceSet->num; i++) {
+			AR2ImageSetT *imageSet = surfaceSet->surface[i].imageSet;
+			for (int j = 0; j < imageSet->num; j++) {
+				bytes += sizeof(AR2ImageT);
+#if !AR2_CAPABLE_ADAPTIVE_TEMPLATE
+				if (imageSet->scale[j]->imgBW == NULL) continue; // Pruned by pruneSurfaceSet().
+#endif
+				bytes += (size_t)imageSet->scale[j]->xsize * imageSet->scale[j]->ysize;
+			}
+			AR2FeatureSetT *featureSet = surfaceSet->surface[i].featureSet;
+			for (int j = 0; j < featureSet->num; j++) {
+				bytes += sizeof(AR2FeaturePointsT) + featureSet->list[j].num * sizeof(AR2FeatureCoordT);
+			}
+		}
+		return bytes;
 	}
 
-	KpmHandle *createKpmHandle(ARParamLT *cparamLT) {
-		KpmHandle *kpmHandle;
-	    kpmHandle = kpmCreateHandle(cparamLT);
-		return kpmHandle;
+	/**
+		Returns a view of a surface set for another controller: its own tracking state over the
+		surfaces, image and feature sets of surfaceSet, which stays allocated until the view and
+		the controller it was loaded by both released it. bundle is the bundle surfaceSet points
+		into, if any.
+	*/
+	AR2SurfaceSetT *shareSurfaceSet(AR2SurfaceSetT *surfaceSet, ARUint8 *bundle) {
+		AR2SurfaceSetT *view = (AR2SurfaceSetT *)malloc(sizeof(AR2SurfaceSetT));
+		AR2SurfaceT *surface = (AR2SurfaceT *)malloc(surfaceSet->num * sizeof(AR2SurfaceT));
+		if (!view || !surface) {
+			free(view);
+			free(surface);
+			return NULL;
+		}
+		memcpy(view, surfaceSet, sizeof(AR2SurfaceSetT));
+		memcpy(surface, surfaceSet->surface, surfaceSet->num * sizeof(AR2SurfaceT));
+		view->surface = surface;
+		view->contNum = 0;
+		view->prevFeature[0].flag = -1;
+
+		std::lock_guard<std::mutex> lock(sharedSurfaceSetsMutex);
+		shared_surface_set *shared = &(sharedSurfaceSets[surfaceSet]);
+		if (shared->refCount == 0) {
+			shared->refCount = 1; // The hold of the controller that loaded it.
+			shared->bundle = bundle;
+		}
+		shared->refCount++;
+		return view;
 	}
 
-	int getKpmImageWidth(KpmHandle *kpmHandle) {
-		return kpmHandleGetXSize(kpmHandle);
+	bool isSharedSurfaceSet(AR2SurfaceSetT *surfaceSet) {
+		std::lock_guard<std::mutex> lock(sharedSurfaceSetsMutex);
+		return sharedSurfaceSets.find(surfaceSet) != sharedSurfaceSets.end();
 	}
 
-	int getKpmImageHeight(KpmHandle *kpmHandle) {
-		return kpmHandleGetYSize(kpmHandle);
+	/**
+		Drops a hold on a shared surface set, freeing it with the last. Returns false if the
+		surface set is not shared, for the caller to free it.
+	*/
+	bool releaseSharedSurfaceSet(AR2SurfaceSetT *surfaceSet) {
+		ARUint8 *bundle;
+		{
+			std::lock_guard<std::mutex> lock(sharedSurfaceSetsMutex);
+			auto it = sharedSurfaceSets.find(surfaceSet);
+			if (it == sharedSurfaceSets.end()) return false;
+			if (--it->second.refCount > 0) return true;
+
+			bundle = it->second.bundle;
+			sharedSurfaceSets.erase(it);
+		}
+		// The last hold is gone, so no other thread can reach the surface set any more.
+		if (bundle) {
+			nftBundleFreeSurfaceSet(&surfaceSet);
+			free(bundle);
+		} else {
+			ar2FreeSurfaceSet(&surfaceSet);
+		}
+		return true;
 	}
-	// disbling this; maybe a very old implementation?
-	//int getKpmPixelSize(KpmHandle *kpmHandle) {
-	//	return arUtilGetPixelSize(GetPixelFormat(kpmHandle));
-	//}
 
-	int setupAR2(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
-		//arc->pixFormat = arVideoGetPixelFormat();
+	void unloadNFTSurfaceSet(arController *arc, int markerIndex) {
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		if (marker->surfaceSet) {
+			if (marker->sharedSurfaceSet) {
+				free(marker->surfaceSet->surface);
+				free(marker->surfaceSet);
+				releaseSharedSurfaceSet(marker->sharedSurfaceSet);
+				marker->sharedSurfaceSet = NULL;
+			} else if (releaseSharedSurfaceSet(marker->surfaceSet)) {
+				// Still used by other controllers, or freed with its bundle.
+			} else if (marker->bundle) {
+				nftBundleFreeSurfaceSet(&marker->surfaceSet);
+			} else {
+				ar2FreeSurfaceSet(&marker->surfaceSet);
+			}
+			marker->surfaceSet = NULL;
+			arc->nftResidentBytes -= marker->surfaceSetBytes;
+		}
+		marker->tracked = false;
+	}
 
-		if ((arc->ar2Handle = ar2CreateHandleMod(arc->paramLT, arc->pixFormat)) == NULL) {
-			ARLOGe("Error: ar2CreateHandle.\n");
-			kpmDeleteHandle(&arc->kpmHandle);
+	/**
+		Evicts the least recently used untracked surface sets until bytes more fit in nftMemoryBudget.
+		Tracked pages are never evicted, so the budget can be exceeded while they are on screen.
+	*/
+	void evictNFTSurfaceSets(arController *arc, size_t bytes) {
+		if (arc->nftMemoryBudget == 0) return;
+		while (arc->nftResidentBytes + bytes > arc->nftMemoryBudget) {
+			int lru = -1;
+			for (int i = 0; i < arc->nftMarkers.size(); i++) {
+				nft_marker *marker = &(arc->nftMarkers[i]);
+				if (marker->surfaceSet && !marker->tracked && !marker->bundle && !marker->sharedSurfaceSet && (lru == -1 || marker->lastUsed < arc->nftMarkers[lru].lastUsed)) {
+					lru = i;
+				}
+			}
+			if (lru == -1) return;
+			ARLOGi("Evicting NFT surface set %d.\n", lru);
+			unloadNFTSurfaceSet(arc, lru);
 		}
-		// Settings for devices with single-core CPUs.
-		ar2SetTrackingThresh(arc->ar2Handle, 5.0);
-		ar2SetSimThresh(arc->ar2Handle, 0.50);
-		ar2SetSearchFeatureNum(arc->ar2Handle, 16);
-		ar2SetSearchSize(arc->ar2Handle, 6);
-		ar2SetTemplateSize1(arc->ar2Handle, 6);
-		ar2SetTemplateSize2(arc->ar2Handle, 6);
+	}
 
-		arc->kpmHandle = createKpmHandle(arc->paramLT);
+// Image level pruning by camera distance (see setNFTTrackingDistance()).
+#define NFT_DISTANCE_TILT_RATIO     0.5    // Share of the frontal resolution left along the surface at 60 degrees of tilt.
 
-		return 0;
+	/**
+		Frees the image levels of a surface set read from a dataset that tracking never samples at
+		camera distances between nftNearDistance and nftFarDistance, with their features. A level is
+		only sampled for the features of the levels whose resolution range holds the resolution of
+		the page in the frame, so features outside the distance range are dropped first, then the
+		image levels no remaining feature is on.
+	*/
+	void pruneSurfaceSet(arController *arc, AR2SurfaceSetT *surfaceSet) {
+#if !AR2_CAPABLE_ADAPTIVE_TEMPLATE
+		if (arc->nftNearDistance <= 0 || arc->nftFarDistance <= 0 || !arc->paramLT) return;
+
+		// Resolution of a surface facing the camera, in dots per inch, at the ends of the range.
+		ARdouble focal = arc->paramLT->param.mat[0][0];
+		float maxDpi = (float)(focal * 25.4 / arc->nftNearDistance);
+		float minDpi = (float)(focal * 25.4 / arc->nftFarDistance * NFT_DISTANCE_TILT_RATIO);
+
+		for (int i = 0; i < surfaceSet->num; i++) {
+			AR2ImageSetT *imageSet = surfaceSet->surface[i].imageSet;
+			AR2FeatureSetT *featureSet = surfaceSet->surface[i].featureSet;
+			std::vector<bool> used(imageSet->num, false);
+			for (int j = 0; j < featureSet->num; j++) {
+				AR2FeaturePointsT *points = &(featureSet->list[j]);
+				if (points->maxdpi < minDpi || points->mindpi > maxDpi) {
+					free(points->coord);
+					points->coord = NULL;
+					points->num = 0;
+				} else if (points->num > 0 && points->scale >= 0 && points->scale < imageSet->num) {
+					used[points->scale] = true;
+				}
+			}
+			for (int j = 0; j < imageSet->num; j++) {
+				if (!used[j]) {
+					free(imageSet->scale[j]->imgBW);
+					imageSet->scale[j]->imgBW = NULL;
+				}
+			}
+		}
+#endif
 	}
 
-	int loadNFTMarker(arController *arc, int surfaceSetCount, const char* datasetPathname) {
-		int i, pageNo;
-		KpmRefDataSet *refDataSet;
-
-		KpmHandle *kpmHandle = arc->kpmHandle;
+	/**
+		Makes the AR2 data (.iset and .fset) of the given page resident, reading it on its first
+		KPM match or after it was evicted. Returns the surface set or NULL if it could not be read.
+	*/
+	AR2SurfaceSetT *loadNFTSurfaceSet(arController *arc, int markerIndex) {
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		if (marker->surfaceSet) return marker->surfaceSet;
 
-		refDataSet = NULL;
+		evictNFTSurfaceSets(arc, marker->surfaceSetBytes);
 
-		// Load KPM data.
-		KpmRefDataSet  *refDataSet2;
-		ARLOGi("Reading %s.fset3\n", datasetPathname);
-		if (kpmLoadRefDataSet(datasetPathname, "fset3", &refDataSet2) < 0 ) {
-			ARLOGe("Error reading KPM data from %s.fset3\n", datasetPathname);
-			pageNo = -1;
-			return (FALSE);
-		}
-		pageNo = surfaceSetCount;
-		ARLOGi("  Assigned page no. %d.\n", surfaceSetCount);
-		if (kpmChangePageNoOfRefDataSet(refDataSet2, KpmChangePageNoAllPages, surfaceSetCount) < 0) {
-		    ARLOGe("Error: kpmChangePageNoOfRefDataSet\n");
-		    return (FALSE);
-		}
-		if (kpmMergeRefDataSet(&refDataSet, &refDataSet2) < 0) {
-		    ARLOGe("Error: kpmMergeRefDataSet\n");
-		    return (FALSE);
+		if (marker->bundle) {
+			if ((marker->surfaceSet = nftBundleAdoptSurfaceSet(marker->bundle, marker->bundleAvailable)) == NULL) {
+				return NULL;
+			}
+		} else {
+			ARLOGi("Reading %s.fset\n", marker->datasetPathname.c_str());
+			if ((marker->surfaceSet = ar2ReadSurfaceSet(marker->datasetPathname.c_str(), "fset", NULL)) == NULL ) {
+			    ARLOGe("Error reading data from %s.fset\n", marker->datasetPathname.c_str());
+			    return NULL;
+			}
+			pruneSurfaceSet(arc, marker->surfaceSet);
 		}
+		marker->surfaceSetBytes = getSurfaceSetBytes(marker->surfaceSet);
+		arc->nftResidentBytes += marker->surfaceSetBytes;
 		ARLOGi("  Done.\n");
 
-		// Load AR2 data.
-		ARLOGi("Reading %s.fset\n", datasetPathname);
+		// The size of a page is only known once read, so evict again for pages loaded the first time.
+		evictNFTSurfaceSets(arc, 0);
 
-		if ((arc->surfaceSet[surfaceSetCount] = ar2ReadSurfaceSet(datasetPathname, "fset", NULL)) == NULL ) {
-		    ARLOGe("Error reading data from %s.fset\n", datasetPathname);
-		}
-		ARLOGi("  Done.\n");
+		return marker->surfaceSet;
+	}
 
-	if (surfaceSetCount == PAGES_MAX) exit(-1);
+	void addTrackingStats(AR2TrackingStatsT *total, const AR2TrackingStatsT *stats) {
+		total->extractMs += stats->extractMs;
+		total->matchMs += stats->matchMs;
+		total->icpMs += stats->icpMs;
+		total->featuresAttempted += stats->featuresAttempted;
+		total->featuresAccepted += stats->featuresAccepted;
+		total->icpRetries += stats->icpRetries;
+	}
 
-		if (kpmSetRefDataSet(kpmHandle, refDataSet) < 0) {
-		    ARLOGe("Error: kpmSetRefDataSet\n");
-		    return (FALSE);
+	/**
+		Advances the pose history of a tracked NFT page by one frame without tracking it: the
+		pose is extrapolated from the last two, and pushed to the history as a tracked pose would
+		be, so tracking resumes searching where the page is expected to be.
+		In AR2_TRACKING_HOMOGRAPHY mode the history holds homographies, extrapolated as poses.
+	*/
+	void predictNFTMarker(arController *arc, AR2SurfaceSetT *surfaceSet, float trans[3][4]) {
+		float h0[3][4], h1[3][4];
+		ARdouble t0[3][4], t1[3][4], pose[3][4];
+		int j, k;
+		bool homography = arc->nftTrackingMode == AR2_TRACKING_HOMOGRAPHY;
+		if (homography) {
+			ar2HomographyToPoseMod(arc->paramLT, surfaceSet->trans1, h0);
+			ar2HomographyToPoseMod(arc->paramLT, surfaceSet->trans2, h1);
+		} else {
+			memcpy(h0, surfaceSet->trans1, sizeof(h0));
+			memcpy(h1, surfaceSet->trans2, sizeof(h1));
+		}
+		for (j = 0; j < 3; j++) {
+			for (k = 0; k < 4; k++) {
+				t0[j][k] = h0[j][k];
+				t1[j][k] = h1[j][k];
+			}
+		}
+		if (surfaceSet->contNum > 1) {
+			extrapolatePose(t0, t1, 1.0, pose);
+		} else {
+			memcpy(pose, t0, sizeof(pose));
 		}
-		kpmDeleteRefDataSet(&refDataSet);
 
-		ARLOGi("Loading of NFT data complete.\n");
-		return (TRUE);
-	}
-
-	/***************
-	 * Set Log Level
-	 ****************/
-	void setLogLevel(int level) {
-		arLogLevel = level;
-	}
-
-	int getLogLevel() {
-		return arLogLevel;
-	}
-
-	/***********
-	* Teardown *
-	***********/
-
-	void deleteHandle(arController *arc) {
-		if (arc->arhandle != NULL) {
-			arPattDetach(arc->arhandle);
-			arDeleteHandle(arc->arhandle);
-			arc->arhandle = NULL;
-		}
-		if (arc->ar3DHandle != NULL) {
-			ar3DDeleteHandle(&(arc->ar3DHandle));
-			arc->ar3DHandle = NULL;
+		for (j = 0; j < 3; j++) {
+			for (k = 0; k < 4; k++) {
+				trans[j][k] = pose[j][k];
+			}
 		}
-		if (arc->paramLT != NULL) {
-			arParamLTFree(&(arc->paramLT));
-			arc->paramLT = NULL;
+		memcpy(surfaceSet->trans3, surfaceSet->trans2, sizeof(surfaceSet->trans3));
+		memcpy(surfaceSet->trans2, surfaceSet->trans1, sizeof(surfaceSet->trans2));
+		if (homography) {
+			ar2PoseToHomographyMod(arc->paramLT, trans, surfaceSet->trans1);
+		} else {
+			memcpy(surfaceSet->trans1, trans, sizeof(surfaceSet->trans1));
 		}
+		surfaceSet->contNum++;
 	}
 
-	int teardown(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Initialises tracking of the given NFT page from the cached KPM results if it is not
+		tracked yet and fewer than maxTrackedPages pages are tracked, then tracks it in the
+		current frame, or on FRAME_PATH_PREDICT frames extrapolates its pose.
+		Returns 1 and the pose in trans if the page is tracked, 0 otherwise.
+	*/
+	int trackNFTMarker(arController *arc, int markerIndex, float trans[3][4], float *err) {
+		*err = -1;
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		bool newlyTracked = !marker->tracked;
+		if (!marker->tracked && getTrackedPageCount(arc) < arc->maxTrackedPages) {
+			// Pick the best pose for this page out of the matching results cached by detectNFTMarker().
+			int i, j, k;
+			int flag = -1;
+			for( i = 0; i < arc->kpmResultNum; i++ ) {
+				if (arc->kpmResult[i].pageNo == markerIndex && arc->kpmResult[i].camPoseF == 0 ) {
+					if( flag == -1 || *err > arc->kpmResult[i].error ) { // Take the first or best result.
+						flag = i;
+						*err = arc->kpmResult[i].error;
+					}
+				}
+			}
 
-        //TODO: Fix Cleanup luma.
-        // if(arc->videoLuma) {
-        //     free(arc->videoLuma);
-        //     arc->videoLuma = NULL;
-        // }
+			if (flag > -1 && loadNFTSurfaceSet(arc, markerIndex)) {
+				marker->tracked = true;
+				if (arc->statsEnabled) arc->stats.relocalizations++;
 
-		if (arc->videoFrame) {
-			free(arc->videoFrame);
-			arc->videoFrame = NULL;
-			arc->videoFrameSize = 0;
+				for (j = 0; j < 3; j++) {
+					for (k = 0; k < 4; k++) {
+						trans[j][k] = arc->kpmResult[flag].camPose[j][k];
+					}
+				}
+				if (arc->nftTrackingMode == AR2_TRACKING_HOMOGRAPHY) {
+					float homography[3][4];
+					ar2PoseToHomographyMod(arc->paramLT, trans, homography);
+					ar2SetInitTrans(marker->surfaceSet, homography);
+				} else {
+					ar2SetInitTrans(marker->surfaceSet, trans);
+				}
+			}
 		}
 
-		deleteHandle(arc);
-
-		arPattDeleteHandle(arc->arPattHandle);
-
-		arControllers.erase(id);
+		if (marker->tracked && arc->framePath == FRAME_PATH_PREDICT && !newlyTracked) {
+			marker->lastUsed = arc->nftFrame;
+			predictNFTMarker(arc, marker->surfaceSet, trans);
+			*err = marker->error;
+		} else if (marker->tracked) {
+			marker->lastUsed = arc->nftFrame;
+			bool timed = arc->nftBudgetMs > 0 || arc->schedulerEnabled;
+			double start = timed ? ar2GetTimeMod() : 0;
+			// The scheduler needs the matched feature count of this page alone.
+			AR2TrackingStatsT pageStats = {0};
+			AR2TrackingStatsT *stats = arc->schedulerEnabled ? &pageStats : (arc->statsEnabled ? &arc->stats.ar2 : NULL);
+			int trackResult = ar2TrackingModEx(arc->ar2Handle, marker->surfaceSet, arc->videoFrame, trans, err,
+				&arc->nftPoseParam, stats);
+			if (timed) arc->nftFrameMs += ar2GetTimeMod() - start;
+			if (stats == &pageStats) {
+				if (arc->statsEnabled) addTrackingStats(&arc->stats.ar2, &pageStats);
+				arc->frameSteady = arc->frameSteady && trackResult >= 0
+					&& *err < SCHEDULE_ERROR_RATIO * arc->ar2Handle->trackingThresh
+					&& pageStats.featuresAccepted >= SCHEDULE_FEATURE_RATIO * arc->ar2Handle->searchFeatureNum;
+			}
+			if( trackResult < 0 ) {
+				ARLOGi("Tracking lost. %d\n", trackResult);
+				marker->tracked = false;
+				if (arc->statsEnabled) arc->stats.trackingLosses++;
+			} else {
+				ARLOGd("Tracked page %d (max %d).\n", markerIndex, (int)arc->nftMarkers.size() - 1);
+				marker->error = *err;
+				if (arc->nftTrackingMode == AR2_TRACKING_HOMOGRAPHY) {
+					float homography[3][4];
+					memcpy(homography, trans, sizeof(homography));
+					ar2HomographyToPoseMod(arc->paramLT, homography, trans);
+				}
+			}
+		}
 
-		for (int i=0; i<arc->multi_markers.size(); i++) {
-			arMultiFreeConfig(arc->multi_markers[i].multiMarkerHandle);
+		if (marker->tracked && arc->poseFilterEnabled) {
+			// Only the published pose is filtered; the tracking history in surfaceSet is not.
+			ARdouble pose[3][4];
+			int j, k;
+			for (j = 0; j < 3; j++) for (k = 0; k < 4; k++) pose[j][k] = trans[j][k];
+			filterPose(arc, &marker->filter, pose, newlyTracked);
+			for (j = 0; j < 3; j++) for (k = 0; k < 4; k++) trans[j][k] = pose[j][k];
 		}
 
-		delete &arc->multi_markers;
-		delete arc;
+		return marker->tracked;
+	}
+
+	/**
+		Sets how many NFT pages can be tracked at the same time (1 by default).
+		Each page keeps its own pose history; the AR2 handle scratch is shared as pages are tracked in turn.
+	*/
+	int setNFTMaxPages(int id, int maxPages) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
+		if (maxPages < 1) {
+			return -1;
+		}
+		arc->maxTrackedPages = maxPages;
 		return 0;
 	}
 
+	int getNFTMaxPages(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
+		return arc->maxTrackedPages;
+	}
 
-	/*****************
-	* Camera loading *
-	*****************/
+	/**
+		Sets how NFT tracking refits a pose whose least squares error is above the tracking threshold:
+		AR2_POSE_CASCADE (the default) with up to four robust ICP passes, AR2_POSE_ROBUST with one.
+		maxIterations limits the iterations of each ICP pass, 0 for the ICP default.
+	*/
+	int setNFTPoseEstimation(int id, int mode, int maxIterations) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
-	int loadCamera(std::string cparam_name) {
-		ARParam param;
-		if (arParamLoad(cparam_name.c_str(), 1, &param) < 0) {
-			ARLOGe("loadCamera(): Error loading parameter file %s for camera.\n", cparam_name.c_str());
+		if ((mode != AR2_POSE_CASCADE && mode != AR2_POSE_ROBUST) || maxIterations < 0) {
 			return -1;
 		}
-		int cameraID = gCameraID++;
-		cameraParams[cameraID] = param;
+		arc->nftPoseParam.mode = mode;
+		arc->nftPoseParam.maxLoop = maxIterations;
 
-		return cameraID;
+		return 0;
 	}
 
-	int setCamera(int id, int cameraID) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	int getNFTPoseMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (cameraParams.find(cameraID) == cameraParams.end()) { return -1; }
-
-		arc->param = cameraParams[cameraID];
+		return arc->nftPoseParam.mode;
+	}
 
-		if (arc->param.xsize != arc->width || arc->param.ysize != arc->height) {
-			ARLOGw("*** Camera Parameter resized from %d, %d. ***\n", arc->param.xsize, arc->param.ysize);
-			arParamChangeSize(&(arc->param), arc->width, arc->height, &(arc->param));
-		}
+	int getNFTPoseMaxIterations(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
-		// ARLOGi("*** Camera Parameter ***\n");
-		// arParamDisp(&(arc->param));
+		return arc->nftPoseParam.maxLoop;
+	}
 
-		deleteHandle(arc);
+	/**
+		Sets how NFT pages are tracked: AR2_TRACKING_6DOF (the default) fits a pose to the
+		undistorted feature positions with ICP, AR2_TRACKING_HOMOGRAPHY fits a homography to the
+		observed positions, cheaper but assuming a flat page and a camera of low distortion.
+		Poses are still reported as 3x4 matrices, decomposed from the homographies.
+		Tracked pages are lost and found again by KPM in the new mode.
+	*/
+	int setNFTTrackingMode(int id, int mode) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
-		if ((arc->paramLT = arParamLTCreate(&(arc->param), AR_PARAM_LT_DEFAULT_OFFSET)) == NULL) {
-			ARLOGe("setCamera(): Error: arParamLTCreate.\n");
+		if (mode != AR2_TRACKING_6DOF && mode != AR2_TRACKING_HOMOGRAPHY) {
 			return -1;
 		}
-
-		// ARLOGi("setCamera(): arParamLTCreated\n..%d, %d\n", (arc->paramLT->param).xsize, (arc->paramLT->param).ysize);
-
-		// setup camera
-		if ((arc->arhandle = arCreateHandle(arc->paramLT)) == NULL) {
-			ARLOGe("setCamera(): Error: arCreateHandle.\n");
+		if (mode == arc->nftTrackingMode) return 0;
+		if (arc->ar2Handle && ar2SetTrackingModeMod(arc->ar2Handle, mode) < 0) {
 			return -1;
 		}
-		// AR_DEFAULT_PIXEL_FORMAT
-		int set = arSetPixelFormat(arc->arhandle, arc->pixFormat);
-
-		// ARLOGi("setCamera(): arCreateHandle done\n");
-
-		arc->ar3DHandle = ar3DCreateHandle(&(arc->param));
-		if (arc->ar3DHandle == NULL) {
-			ARLOGe("setCamera(): Error creating 3D handle");
-			return -1;
+		arc->nftTrackingMode = mode;
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			arc->nftMarkers[i].tracked = false;
 		}
-
-		// ARLOGi("setCamera(): ar3DCreateHandle done\n");
-
-		arPattAttach(arc->arhandle, arc->arPattHandle);
-		// ARLOGi("setCamera(): Pattern handler attached.\n");
-
-		arglCameraFrustumRH(&((arc->paramLT)->param), arc->nearPlane, arc->farPlane, arc->cameraLens);
-
-		arc->kpmHandle = createKpmHandle(arc->paramLT);
-
 		return 0;
 	}
 
+	int getNFTTrackingMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
+		return arc->nftTrackingMode;
+	}
 
-
-	/*****************
-	* Marker loading *
-	*****************/
-
-
-	static int loadMarker(const char *patt_name, int *patt_id, ARHandle *arhandle, ARPattHandle **pattHandle_p) {
-		// Loading only 1 pattern in this example.
-		if ((*patt_id = arPattLoad(*pattHandle_p, patt_name)) < 0) {
-			ARLOGe("loadMarker(): Error loading pattern file %s.\n", patt_name);
-			arPattDeleteHandle(*pattHandle_p);
-			return (FALSE);
+	int applyNFTQuality(arController *arc, int level) {
+		arc->nftQuality = level;
+		if (arc->ar2Handle) {
+			const nft_quality_level *q = &nftQualityLevels[level];
+			ar2SetSearchFeatureNum(arc->ar2Handle, q->searchFeatureNum);
+			ar2SetSearchSize(arc->ar2Handle, q->searchSize);
+			if (ar2SetTemplateSizeMod(arc->ar2Handle, q->templateSize, q->templateSize) < 0) {
+				ARLOGe("Error: ar2SetTemplateSizeMod.\n");
+				return -1;
+			}
 		}
-
-		return (TRUE);
+		return 0;
 	}
 
-	static int loadMultiMarker(const char *patt_name, ARHandle *arHandle, ARPattHandle **pattHandle_p, ARMultiMarkerInfoT **arMultiConfig) {
-		if( (*arMultiConfig = arMultiReadConfigFile(patt_name, *pattHandle_p)) == NULL ) {
-			ARLOGe("config data load error !!\n");
-			arPattDeleteHandle(*pattHandle_p);
-			return (FALSE);
-		}
-		if( (*arMultiConfig)->patt_type == AR_MULTI_PATTERN_DETECTION_MODE_TEMPLATE ) {
-			arSetPatternDetectionMode( arHandle, AR_TEMPLATE_MATCHING_COLOR );
-		} else if( (*arMultiConfig)->patt_type == AR_MULTI_PATTERN_DETECTION_MODE_MATRIX ) {
-			arSetPatternDetectionMode( arHandle, AR_MATRIX_CODE_DETECTION );
-		} else { // AR_MULTI_PATTERN_DETECTION_MODE_TEMPLATE_AND_MATRIX
-			arSetPatternDetectionMode( arHandle, AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX );
+	/**
+		Closes the NFT tracking time of the last frame, and moves the quality level one step
+		when it leaves the budget: down when the running mean is over the budget, up when it is
+		under NFT_GOVERNOR_RAISE_RATIO of it. Frames without tracking are not counted, and a
+		new level is held NFT_GOVERNOR_HOLD frames before it can change again.
+	*/
+	void governNFTQuality(arController *arc) {
+		double frameMs = arc->nftFrameMs;
+		arc->nftFrameMs = 0;
+		if (arc->nftBudgetMs <= 0 || frameMs == 0) return;
+
+		arc->nftMeanMs = (arc->nftMeanMs == 0) ? frameMs : arc->nftMeanMs + NFT_GOVERNOR_SMOOTHING * (frameMs - arc->nftMeanMs);
+		if (arc->nftGovernorHold > 0) {
+			arc->nftGovernorHold--;
+			return;
 		}
 
-		return (TRUE);
+		int level = arc->nftQuality;
+		if (arc->nftMeanMs > arc->nftBudgetMs && level > 0) {
+			level--;
+		} else if (arc->nftMeanMs < NFT_GOVERNOR_RAISE_RATIO * arc->nftBudgetMs && level < NFT_QUALITY_LEVEL_NUM - 1) {
+			level++;
+		}
+		if (level != arc->nftQuality) {
+			ARLOGd("NFT quality level %d, %.2f ms per frame for a %.2f ms budget.\n", level, arc->nftMeanMs, arc->nftBudgetMs);
+			applyNFTQuality(arc, level);
+			arc->nftMeanMs = 0;
+			arc->nftGovernorHold = NFT_GOVERNOR_HOLD;
+		}
 	}
 
-
-	int addMarker(int id, std::string patt_name) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	/**
+		Sets the NFT tracking time per frame, in milliseconds, that the quality governor aims for.
+		The governor then trades the number of tracked features, the search size and the template
+		size against time, between quality levels 0 and NFT_QUALITY_LEVEL_NUM - 1: slow devices keep
+		their frame rate and fast ones get steadier poses. 0 (the default) turns the governor off
+		and keeps the current level.
+	*/
+	int setNFTTrackingBudget(int id, double budgetMs) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		// const char *patt_name
-		// Load marker(s).
-		if (!loadMarker(patt_name.c_str(), &(arc->patt_id), arc->arhandle, &(arc->arPattHandle))) {
-			ARLOGe("ARToolKitJS(): Unable to set up AR marker.\n");
+		if (budgetMs < 0) {
 			return -1;
 		}
-
-		return arc->patt_id;
+		arc->nftBudgetMs = budgetMs;
+		arc->nftFrameMs = 0;
+		arc->nftMeanMs = 0;
+		arc->nftGovernorHold = 0;
+		return 0;
 	}
 
-	int addNFTMarker(int id, std::string datasetPathname) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	double getNFTTrackingBudget(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		// Load marker(s).
-		int patt_id = arc->surfaceSetCount;
-		if (!loadNFTMarker(arc, patt_id, datasetPathname.c_str())) {
-			ARLOGe("ARToolKitJS(): Unable to set up NFT marker.\n");
-			return -1;
-		}
-
-		arc->surfaceSetCount++;
-
-		return patt_id;
+		return arc->nftBudgetMs;
 	}
 
-	int addMultiMarker(int id, std::string patt_name) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	/**
+		Adds frameMs to the NFT tracking time of the current frame, which the governor closes in
+		the next detect(). Tracking the controller does not time itself, in a worker for example,
+		then counts against the budget too.
+	*/
+	int addNFTTrackingTime(int id, double frameMs) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		// const char *patt_name
-		// Load marker(s).
-		if (!loadMultiMarker(patt_name.c_str(), arc->arhandle, &(arc->arPattHandle), &(arc->arMultiMarkerHandle))) {
-			ARLOGe("ARToolKitJS(): Unable to set up AR multimarker.\n");
+		if (frameMs < 0) {
 			return -1;
 		}
-
-		int multiMarker_id = arc->multi_markers.size();
-		multi_marker marker = multi_marker();
-		marker.id = multiMarker_id;
-		marker.multiMarkerHandle = arc->arMultiMarkerHandle;
-
-		arc->multi_markers.push_back(marker);
-
-		return marker.id;
+		arc->nftFrameMs += frameMs;
+		return 0;
 	}
 
-	int getMultiMarkerNum(int id, int multiMarker_id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	/**
+		Sets the NFT quality level, from 0 (cheapest) to NFT_QUALITY_LEVEL_NUM - 1 (steadiest),
+		2 by default. With a tracking budget set the governor moves on from this level.
+	*/
+	int setNFTQualityLevel(int id, int level) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		int mId = multiMarker_id;
-		if (mId < 0 || arc->multi_markers.size() <= mId) {
+		if (level < 0 || level >= NFT_QUALITY_LEVEL_NUM) {
 			return -1;
 		}
-		return (arc->multi_markers[mId].multiMarkerHandle)->marker_num;
+		arc->nftMeanMs = 0;
+		arc->nftGovernorHold = 0;
+		return applyNFTQuality(arc, level);
 	}
 
-	int getMultiMarkerCount(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	int getNFTQualityLevel(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		return arc->multi_markers.size();
+		return arc->nftQuality;
 	}
 
+	/**
+		Closes the last frame's NFT timings and picks the path of the NFT pipeline in the new frame:
+		FRAME_PATH_FULL while pages can still be matched, FRAME_PATH_PREDICT for up to scheduleMaxSkip
+		frames after steady tracking when the time of a tracked frame is over budget, and
+		FRAME_PATH_TRACK otherwise. With more pages to match than budget for it, KPM runs every
+		SCHEDULE_MATCH_INTERVAL frames. Without the scheduler the path only reports whether KPM runs.
+	*/
+	int scheduleNFTFrame(arController *arc) {
+		int tracked = getTrackedPageCount(arc);
+		if (!arc->schedulerEnabled) {
+			return tracked < arc->maxTrackedPages ? FRAME_PATH_FULL : FRAME_PATH_TRACK;
+		}
 
+		if (arc->framePath != FRAME_PATH_PREDICT) {
+			if (arc->nftFrameMs > 0) {
+				arc->trackMeanMs = (arc->trackMeanMs == 0) ? arc->nftFrameMs : arc->trackMeanMs + SCHEDULE_SMOOTHING * (arc->nftFrameMs - arc->trackMeanMs);
+			}
+			if (arc->matchFrameMs > 0) {
+				arc->matchMeanMs = (arc->matchMeanMs == 0) ? arc->matchFrameMs : arc->matchMeanMs + SCHEDULE_SMOOTHING * (arc->matchFrameMs - arc->matchMeanMs);
+			}
+			arc->trackingSteady = arc->frameSteady && arc->nftFrameMs > 0;
+		}
+		arc->matchFrameMs = 0;
+		arc->frameSteady = true;
 
-	/**********************
-	* Setters and getters *
-	**********************/
+		if (tracked == 0) {
+			arc->framesPredicted = 0;
+			arc->framesSinceMatch = 0;
+			return FRAME_PATH_FULL;
+		}
 
-	void setProjectionNearPlane(int id, const ARdouble projectionNearPlane) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
-		arController *arc = &(arControllers[id]);
-		arc->nearPlane = projectionNearPlane;
+		// Predict enough frames to bring the mean time per frame within budget.
+		int maxSkip = arc->scheduleMaxSkip;
+		if (arc->scheduleBudgetMs > 0) {
+			maxSkip = std::min(maxSkip, std::max(0, (int)ceil(arc->trackMeanMs / arc->scheduleBudgetMs) - 1));
+		}
+		if (arc->trackingSteady && arc->framesPredicted < maxSkip) {
+			arc->framesPredicted++;
+			return FRAME_PATH_PREDICT;
+		}
+		arc->framesPredicted = 0;
+
+		if (tracked < arc->maxTrackedPages) {
+			arc->framesSinceMatch++;
+			if (arc->scheduleBudgetMs <= 0 || arc->trackMeanMs + arc->matchMeanMs <= arc->scheduleBudgetMs
+					|| arc->framesSinceMatch >= SCHEDULE_MATCH_INTERVAL) {
+				arc->framesSinceMatch = 0;
+				return FRAME_PATH_FULL;
+			}
+		}
+		return FRAME_PATH_TRACK;
 	}
 
-	ARdouble getProjectionNearPlane(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	/**
+		Turns the frame scheduler on or off. With it, each frame runs one of three NFT paths:
+		KPM matching and AR2 tracking (FRAME_PATH_FULL), AR2 tracking only (FRAME_PATH_TRACK), or
+		only extrapolating the poses of the tracked pages from their motion (FRAME_PATH_PREDICT).
+		Poses are predicted for at most maxSkip frames in a row, only after frames with low tracking
+		errors and most searched features found, and only as often as needed to keep the mean NFT
+		time per frame within budgetMs (0 to predict maxSkip frames out of every maxSkip + 1).
+		Square markers are detected in every frame.
+	*/
+	int setFrameScheduler(int id, int enable, double budgetMs, int maxSkip) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
-		return arc->nearPlane;
+
+		if (budgetMs < 0 || maxSkip < 0) {
+			return -1;
+		}
+		arc->schedulerEnabled = (enable != 0);
+		arc->scheduleBudgetMs = budgetMs;
+		arc->scheduleMaxSkip = maxSkip;
+		arc->framePath = FRAME_PATH_FULL;
+		arc->framesPredicted = 0;
+		arc->framesSinceMatch = 0;
+		arc->trackingSteady = false;
+		arc->frameSteady = true;
+		arc->trackMeanMs = 0;
+		arc->matchMeanMs = 0;
+		arc->matchFrameMs = 0;
+		return 0;
 	}
 
-	void setProjectionFarPlane(int id, const ARdouble projectionFarPlane) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
+	int getFrameSchedulerEnabled(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
-		arc->farPlane = projectionFarPlane;
+
+		return arc->schedulerEnabled;
 	}
 
-	ARdouble getProjectionFarPlane(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	/**
+		Returns the FRAME_PATH_* the NFT pipeline ran in the last frame.
+	*/
+	int getFramePath(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
-		return arc->farPlane;
+
+		return arc->framePath;
 	}
 
-	void setPatternDetectionMode(int id, int mode) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
+	int getNFTMarkerInfo(int id, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
-		if (arSetPatternDetectionMode(arc->arhandle, mode) == 0) {
-			ARLOGi("Pattern detection mode set to %d.\n", mode);
+
+		if (markerIndex < 0 || arc->nftMarkers.size() <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
 		}
-	}
 
-	int getPatternDetectionMode(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		float trans[3][4];
+		float err = -1;
+		if (trackNFTMarker(arc, markerIndex, trans, &err)) {
+			EM_ASM_({
+				var $a = arguments;
+				var i = 0;
+				if (!artoolkit["NFTMarkerInfo"]) {
+					artoolkit["NFTMarkerInfo"] = ({
+						id: 0,
+						error: -1,
+						found: 0,
+						pose: [0,0,0,0, 0,0,0,0, 0,0,0,0]
+					});
+				}
+				var markerInfo = artoolkit["NFTMarkerInfo"];
+				markerInfo["id"] = $a[i++];
+				markerInfo["error"] = $a[i++];
+				markerInfo["found"] = 1;
+				markerInfo["pose"][0] = $a[i++];
+				markerInfo["pose"][1] = $a[i++];
+				markerInfo["pose"][2] = $a[i++];
+				markerInfo["pose"][3] = $a[i++];
+				markerInfo["pose"][4] = $a[i++];
+				markerInfo["pose"][5] = $a[i++];
+				markerInfo["pose"][6] = $a[i++];
+				markerInfo["pose"][7] = $a[i++];
+				markerInfo["pose"][8] = $a[i++];
+				markerInfo["pose"][9] = $a[i++];
+				markerInfo["pose"][10] = $a[i++];
+				markerInfo["pose"][11] = $a[i++];
+			},
+				markerIndex,
+				err,
+
+				trans[0][0],
+				trans[0][1],
+				trans[0][2],
+				trans[0][3],
+
+				trans[1][0],
+				trans[1][1],
+				trans[1][2],
+				trans[1][3],
+
+				trans[2][0],
+				trans[2][1],
+				trans[2][2],
+				trans[2][3]
+			);
+        } else {
+			EM_ASM_({
+				var $a = arguments;
+				var i = 0;
+				if (!artoolkit["NFTMarkerInfo"]) {
+					artoolkit["NFTMarkerInfo"] = ({
+						id: 0,
+						error: -1,
+						found: 0,
+						pose: [0,0,0,0, 0,0,0,0, 0,0,0,0]
+					});
+				}
+				var markerInfo = artoolkit["NFTMarkerInfo"];
+				markerInfo["id"] = $a[i++];
+				markerInfo["error"] = -1;
+				markerInfo["found"] = 0;
+				markerInfo["pose"][0] = 0;
+				markerInfo["pose"][1] = 0;
+				markerInfo["pose"][2] = 0;
+				markerInfo["pose"][3] = 0;
+				markerInfo["pose"][4] = 0;
+				markerInfo["pose"][5] = 0;
+				markerInfo["pose"][6] = 0;
+				markerInfo["pose"][7] = 0;
+				markerInfo["pose"][8] = 0;
+				markerInfo["pose"][9] = 0;
+				markerInfo["pose"][10] = 0;
+				markerInfo["pose"][11] = 0;
+			},
+				markerIndex
+			);
+        }
+
+		return 0;
+	}
+
+	/**
+		Sets the merged KPM data of all loaded NFT pages on the controller's kpmHandle,
+		rebuilding the matcher index. Does nothing if no page was added since the last commit.
+	*/
+	int commitNFTMarkerData(arController *arc) {
+		if (!arc->refDataSetDirty || arc->kpmThreadBusy) {
+			return 0; // While a background match is running, the commit waits for the next frame.
+		}
+		if (arc->kpmHandle == NULL || arc->refDataSet == NULL) {
+			return -1;
+		}
+		if (kpmSetRefDataSet(arc->kpmHandle, arc->refDataSet) < 0) {
+		    ARLOGe("Error: kpmSetRefDataSet\n");
+		    return -1;
+		}
+		arc->refDataSetDirty = false;
+		return 0;
+	}
+
+	/**
+		Commits the NFT markers added since the last commit to the matcher.
+		Call this after registering a batch of markers; otherwise the commit
+		happens on the next detectNFTMarker() call.
+	*/
+	int commitNFTMarkers(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return commitNFTMarkerData(arc);
+	}
+
+	/**
+		Returns true if fewer than maxTrackedPages NFT pages are tracked. In that case the
+		pages already tracked are excluded from the next KPM match, which only seeds the others.
+	*/
+	bool needsNFTMatching(arController *arc) {
+		if (arc->nftMarkers.size() == 0 || getTrackedPageCount(arc) >= arc->maxTrackedPages) {
+			return false;
+		}
+		arc->skipPages.clear();
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			if (arc->nftMarkers[i].tracked) arc->skipPages.push_back(i);
+		}
+		kpmSetMatchingSkipPage(arc->kpmHandle, arc->skipPages.data(), arc->skipPages.size());
+		return true;
+	}
+
+	/**
+		Returns the luma image KPM matches: videoLuma, or with a kpmScale above 1 videoLuma
+		downscaled into kpmLuma.
+	*/
+	ARUint8 *getKpmLuma(arController *arc) {
+		if (arc->kpmScale == 1) {
+			return arc->videoLuma;
+		}
+		arVideoLumaDownscale(arc->kpmLuma, arc->videoLuma, arc->width, arc->height, arc->kpmScale);
+		return arc->kpmLuma;
+	}
+
+	/**
+		Runs KPM matching once on the current luma frame for all loaded NFT markers.
+		The results are cached on the controller and read by getNFTMarkerInfo() for each page,
+		so the matching cost does not depend on the number of markers.
+		With asynchronous matching (setNFTAsyncMatching) the match runs on a background thread
+		against a snapshot of the frame, and its results are returned by the first call after it finishes.
+		Returns the number of KPM results, or -1 if no results are available in this frame.
+	*/
+	int detectNFTMarker(int id) {
+		// Run by detect(), so no operator[], which detectBatch() threads must not call at once.
+		auto it = arControllers.find(id);
+		if (it == arControllers.end()) { return -1; }
+		arController *arc = &(it->second);
+
+		arc->kpmResult = NULL;
+		arc->kpmResultNum = -1;
+		arc->nftFrame++;
+		arc->frameTime = ar2GetTimeMod();
+		arc->framePath = scheduleNFTFrame(arc);
+		governNFTQuality(arc);
+		bool matching = (arc->framePath == FRAME_PATH_FULL);
+
+		if (commitNFTMarkerData(arc) < 0) {
+			return -1;
+		}
+
+#ifdef HAVE_THREADS
+		if (arc->kpmThread) {
+			// Pick up the results of a finished background match. They were computed on an earlier
+			// frame and only seed tracking, which then runs on the current frame.
+			if (arc->kpmThreadBusy && trackingInitGetResult(arc->kpmThread, &arc->kpmResult, &arc->kpmResultNum) != 0) {
+				arc->kpmThreadBusy = false;
+			} else if (!arc->kpmThreadBusy && matching && needsNFTMatching(arc)) {
+				if (trackingInitStart(arc->kpmThread, getKpmLuma(arc)) == 0) {
+					arc->kpmThreadBusy = true;
+				}
+			}
+			return arc->kpmResultNum;
+		}
+#endif
+
+		if (matching && needsNFTMatching(arc)) {
+			bool timed = arc->statsEnabled || arc->schedulerEnabled;
+			double start = timed ? ar2GetTimeMod() : 0;
+			kpmMatching( arc->kpmHandle, getKpmLuma(arc) );
+			kpmGetResult( arc->kpmHandle, &arc->kpmResult, &arc->kpmResultNum );
+			if (timed) {
+				double ms = ar2GetTimeMod() - start;
+				if (arc->statsEnabled) arc->stats.kpmMs += ms;
+				arc->matchFrameMs += ms;
+			}
+		}
+
+		return arc->kpmResultNum;
+	}
+
+	KpmHandle *createKpmHandle(ARParamLT *cparamLT) {
+		KpmHandle *kpmHandle;
+	    kpmHandle = kpmCreateHandle(cparamLT);
+		return kpmHandle;
+	}
+
+	void stopKpmThread(arController *arc) {
+#ifdef HAVE_THREADS
+		if (arc->kpmThread) {
+			// Blocks until a running match finishes and the thread has exited.
+			trackingInitQuit(&arc->kpmThread);
+			releaseThreads(1);
+		}
+#endif
+		arc->kpmThreadBusy = false;
+		arc->kpmResult = NULL;
+		arc->kpmResultNum = -1;
+	}
+
+	void startKpmThread(arController *arc) {
+#ifdef HAVE_THREADS
+		// Without a thread to spare, matching stays synchronous.
+		if (arc->asyncMatching && arc->kpmHandle && !arc->kpmThread && acquireThreads(1) == 1) {
+			arc->kpmThread = trackingInitInit(arc->kpmHandle);
+			if (!arc->kpmThread) releaseThreads(1);
+		}
+#endif
+	}
+
+	void deleteKpmHandle(arController *arc) {
+		stopKpmThread(arc);
+		if (arc->kpmHandle) {
+			kpmDeleteHandle(&arc->kpmHandle);
+		}
+		if (arc->kpmParamLT) {
+			releaseCameraLT(&arc->kpmParamLT);
+		}
+		if (arc->kpmLuma) {
+			free(arc->kpmLuma);
+			arc->kpmLuma = NULL;
+		}
+	}
+
+	/**
+		Replaces the controller's kpmHandle with one for the current camera parameters,
+		downscaled by kpmScale. The poses KPM finds are camera poses, so they seed tracking
+		on the full resolution frame unchanged. Returns -1, leaving no handle, on failure.
+	*/
+	int resetKpmHandle(arController *arc) {
+		// Acquire the downscaled camera before releasing the current one, so it is not rebuilt when unchanged.
+		camera_lt *kpmLT = NULL;
+		if (arc->kpmScale != 1) {
+			kpmLT = acquireCameraLT(arc->cameraID, arc->width / arc->kpmScale, arc->height / arc->kpmScale);
+		}
+		deleteKpmHandle(arc);
+		if (arc->kpmScale == 1) {
+			arc->kpmHandle = createKpmHandle(arc->paramLT);
+		} else {
+			if (kpmLT == NULL) {
+				ARLOGe("resetKpmHandle(): Error: no camera lookup table.\n");
+				return -1;
+			}
+			arc->kpmParamLT = kpmLT->paramLT;
+			arc->kpmLuma = (ARUint8*) malloc(arc->kpmParamLT->param.xsize * arc->kpmParamLT->param.ysize);
+			if (!arc->kpmLuma) {
+				ARLOGe("resetKpmHandle(): Error: out of memory.\n");
+				deleteKpmHandle(arc);
+				return -1;
+			}
+			arc->kpmHandle = createKpmHandle(arc->kpmParamLT);
+		}
+		if (!arc->kpmHandle) {
+			ARLOGe("resetKpmHandle(): Error: kpmCreateHandle.\n");
+			deleteKpmHandle(arc);
+			return -1;
+		}
+		// A new handle has an empty matcher index; recommit the already loaded pages.
+		arc->refDataSetDirty = (arc->refDataSet != NULL);
+		startKpmThread(arc);
+		return 0;
+	}
+
+	/**
+		Enables or disables KPM matching on a background thread (threaded builds only).
+		While enabled, detectNFTMarker() never blocks on matching; NFT markers are found
+		a few frames later instead.
+	*/
+	int setNFTAsyncMatching(int id, int enable) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+#ifdef HAVE_THREADS
+		arc->asyncMatching = (enable != 0);
+		if (arc->asyncMatching) {
+			startKpmThread(arc);
+		} else {
+			stopKpmThread(arc);
+		}
+		return 0;
+#else
+		ARLOGe("setNFTAsyncMatching(): Error: built without thread support.\n");
+		return -1;
+#endif
+	}
+
+	int getNFTAsyncMatching(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->asyncMatching;
+	}
+
+	/**
+		Sets the factor (1 by default, up to 4) by which the frame is downscaled for KPM matching.
+		Matching cost follows the pixel count, so 2 makes finding NFT markers about four times
+		cheaper, at the cost of the smallest and most distant markers. Tracking found markers
+		still runs on the full resolution frame.
+	*/
+	int setNFTMatchingScale(int id, int scale) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (scale < 1 || scale > 4) {
+			return -1;
+		}
+		if (scale != arc->kpmScale) {
+			arc->kpmScale = scale;
+			if (arc->kpmHandle) {
+				return resetKpmHandle(arc);
+			}
+		}
+		return 0;
+	}
+
+	int getNFTMatchingScale(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->kpmScale;
+	}
+
+	int getKpmImageWidth(KpmHandle *kpmHandle) {
+		return kpmHandleGetXSize(kpmHandle);
+	}
+
+	int getKpmImageHeight(KpmHandle *kpmHandle) {
+		return kpmHandleGetYSize(kpmHandle);
+	}
+	// disbling this; maybe a very old implementation?
+	//int getKpmPixelSize(KpmHandle *kpmHandle) {
+	//	return arUtilGetPixelSize(GetPixelFormat(kpmHandle));
+	//}
+
+	void deleteAR2Handle(arController *arc) {
+		if (arc->ar2Handle) {
+			ar2DeleteHandleMod(&arc->ar2Handle);
+		}
+#ifdef HAVE_THREADS
+		releaseThreads(arc->ar2ThreadNum);
+		arc->ar2ThreadNum = 0;
+#endif
+	}
+
+	int setupAR2(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+		//arc->pixFormat = arVideoGetPixelFormat();
+
+		deleteAR2Handle(arc);
+
+		int threadNum = 1;
+#ifdef HAVE_THREADS
+		// Never use more workers than the build's pool holds, or than the thread budget has left.
+		// A single thread needs no worker, as ar2TrackingModEx() then runs it inline.
+		threadNum = threadGetCPU();
+		if (threadNum > TRACKING_THREAD_POOL_SIZE) threadNum = TRACKING_THREAD_POOL_SIZE;
+		if (threadNum > 1) {
+			threadNum = acquireThreads(threadNum);
+			if (threadNum < 2) {
+				releaseThreads(threadNum);
+				threadNum = 1;
+			} else {
+				arc->ar2ThreadNum = threadNum;
+			}
+		}
+#endif
+
+		if ((arc->ar2Handle = ar2CreateHandleMod(arc->paramLT, arc->pixFormat, threadNum)) == NULL) {
+			ARLOGe("Error: ar2CreateHandle.\n");
+			deleteAR2Handle(arc);
+			deleteKpmHandle(arc);
+			return -1;
+		}
+		ar2SetTrackingThresh(arc->ar2Handle, 5.0);
+		ar2SetSimThresh(arc->ar2Handle, 0.50);
+		ar2SetTrackingModeMod(arc->ar2Handle, arc->nftTrackingMode);
+		if (applyNFTQuality(arc, arc->nftQuality) < 0) {
+			deleteAR2Handle(arc);
+			deleteKpmHandle(arc);
+			return -1;
+		}
+
+		if (resetKpmHandle(arc) < 0) {
+			deleteAR2Handle(arc);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	/**
+		Appends the KPM data of a page to the controller's data set and the page to its registry.
+		Frees refDataSet2.
+	*/
+	int registerNFTMarker(arController *arc, int pageNo, KpmRefDataSet *refDataSet2, const nft_marker &marker) {
+		ARLOGi("  Assigned page no. %d.\n", pageNo);
+		if (kpmChangePageNoOfRefDataSet(refDataSet2, KpmChangePageNoAllPages, pageNo) < 0) {
+		    ARLOGe("Error: kpmChangePageNoOfRefDataSet\n");
+		    kpmDeleteRefDataSet(&refDataSet2);
+		    return (FALSE);
+		}
+		ARLOGi("  Done.\n");
+
+		// Append the page to the persistent data set. The matcher index is rebuilt
+		// once by commitNFTMarkerData(), not for every added page.
+		if (kpmMergeRefDataSet(&arc->refDataSet, &refDataSet2) < 0) {
+		    ARLOGe("Error: kpmMergeRefDataSet\n");
+		    if (refDataSet2) kpmDeleteRefDataSet(&refDataSet2);
+		    return (FALSE);
+		}
+		arc->refDataSetDirty = true;
+
+		arc->nftMarkers.push_back(marker);
+		return (TRUE);
+	}
+
+	/**
+		Registers an NFT marker. Only its compact KPM data (.fset3) is loaded here; the AR2 data
+		(.iset and .fset) is read by loadNFTSurfaceSet() when KPM first matches the page.
+	*/
+	int loadNFTMarker(arController *arc, int pageNo, const char* datasetPathname) {
+		// Load KPM data.
+		KpmRefDataSet  *refDataSet2;
+		ARLOGi("Reading %s.fset3\n", datasetPathname);
+		if (kpmLoadRefDataSet(datasetPathname, "fset3", &refDataSet2) < 0 ) {
+			ARLOGe("Error reading KPM data from %s.fset3\n", datasetPathname);
+			return (FALSE);
+		}
+
+		nft_marker marker;
+		marker.datasetPathname = datasetPathname;
+		if (!registerNFTMarker(arc, pageNo, refDataSet2, marker)) {
+			return (FALSE);
+		}
+
+		ARLOGi("Loading of NFT data complete.\n");
+		return (TRUE);
+	}
+
+	/**
+		Sets the budget in bytes for the AR2 data of NFT markers kept in memory (0, the default, for no limit).
+		The least recently used pages that are not tracked are evicted to stay within it.
+	*/
+	int setNFTMemoryBudget(int id, int bytes) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (bytes < 0) {
+			return -1;
+		}
+		arc->nftMemoryBudget = bytes;
+		evictNFTSurfaceSets(arc, 0);
+		return 0;
+	}
+
+	int getNFTMemoryBudget(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->nftMemoryBudget;
+	}
+
+	/**
+		Sets the range of camera distances, in the units of the marker size (mm for the usual
+		datasets), NFT pages are tracked at. The image levels of a page, and their features, that
+		tracking cannot use within it are freed when the page is read, so a page tracked at arm's
+		length keeps only its coarse levels. 0 for both, the default, keeps all levels. Untracked
+		pages in memory are unloaded to be read again with the new range; tracked ones are pruned
+		in place, so widening the range applies to them once they are evicted.
+	*/
+	int setNFTTrackingDistance(int id, float nearDistance, float farDistance) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (nearDistance < 0 || farDistance < 0 || (farDistance > 0 && farDistance < nearDistance)
+		 || ((nearDistance > 0) != (farDistance > 0))) {
+			return -1;
+		}
+		arc->nftNearDistance = nearDistance;
+		arc->nftFarDistance = farDistance;
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			nft_marker *marker = &(arc->nftMarkers[i]);
+			if (!marker->surfaceSet || marker->bundle || marker->sharedSurfaceSet) continue;
+			if (!marker->tracked) {
+				unloadNFTSurfaceSet(arc, i);
+				continue;
+			}
+			if (isSharedSurfaceSet(marker->surfaceSet)) continue; // Other controllers track it too.
+			pruneSurfaceSet(arc, marker->surfaceSet);
+			size_t bytes = getSurfaceSetBytes(marker->surfaceSet);
+			arc->nftResidentBytes = arc->nftResidentBytes - marker->surfaceSetBytes + bytes;
+			marker->surfaceSetBytes = bytes;
+		}
+		return 0;
+	}
+
+	float getNFTNearDistance(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->nftNearDistance;
+	}
+
+	float getNFTFarDistance(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->nftFarDistance;
+	}
+
+	/**
+		Returns the size in bytes of the AR2 data of an NFT marker currently in memory, 0 while
+		it is not resident.
+	*/
+	int getNFTMarkerResidentBytes(int id, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (markerIndex < 0 || arc->nftMarkers.size() <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		return marker->surfaceSet ? marker->surfaceSetBytes : 0;
+	}
+
+	/**
+		Returns the estimated size in bytes of the NFT AR2 data currently in memory.
+	*/
+	int getNFTResidentBytes(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->nftResidentBytes;
+	}
+
+
+
+	/***************
+	 * Set Log Level
+	 ****************/
+	void setLogLevel(int level) {
+		arLogLevel = level;
+	}
+
+	int getLogLevel() {
+		return arLogLevel;
+	}
+
+	/***********
+	* Teardown *
+	***********/
+
+	void deleteHandle(arController *arc) {
+		if (arc->arhandle != NULL) {
+			arPattDetach(arc->arhandle);
+			arDeleteHandle(arc->arhandle);
+			arc->arhandle = NULL;
+		}
+		// The 3D handle is owned by the lookup table entry.
+		arc->ar3DHandle = NULL;
+		if (arc->paramLT != NULL) {
+			releaseCameraLT(&(arc->paramLT));
+		}
+	}
+
+	void freeFrameBuffers(arController *arc) {
+		if (arc->videoLuma != arc->videoFrame) {
+			free(arc->videoLuma);
+		}
+		arc->videoLuma = NULL;
+		free(arc->videoFrameSlots);
+		arc->videoFrameSlots = NULL;
+		arc->videoFrame = NULL;
+		arc->videoFrameSize = 0;
+		free(arc->roiLuma);
+		arc->roiLuma = NULL;
+	}
+
+	void freeVideoSource(arController *arc) {
+		free(arc->videoSource);
+		arc->videoSource = NULL;
+		arc->videoSourceSize = 0;
+		arVideoLumaOrientDelete(&arc->sourceOrient);
+	}
+
+	/**
+		Frees everything the controller owns. Called by its destructor, so teardown() only
+		has to erase it from arControllers.
+	*/
+	void releaseController(arController *arc) {
+		freeFrameBuffers(arc);
+		freeVideoSource(arc);
+
+		// The KPM thread reads the camera table deleteHandle() may free, so it is stopped first.
+		deleteKpmHandle(arc);
+
+		deleteHandle(arc);
+
+		freePoseFilters(arc);
+
+		if (arc->refDataSet) {
+			kpmDeleteRefDataSet(&arc->refDataSet);
+		}
+
+		for (int i = 0; i < arc->nftMarkers.size(); i++) {
+			// A shared bundle is freed along with its surface set by the last controller using it.
+			nft_marker *marker = &(arc->nftMarkers[i]);
+			bool shared = marker->surfaceSet && isSharedSurfaceSet(marker->surfaceSet);
+			unloadNFTSurfaceSet(arc, i);
+			if (!shared) free(marker->bundle);
+		}
+
+		deleteAR2Handle(arc);
+
+		if (arc->arPattHandle) {
+			arPattDeleteHandle(arc->arPattHandle);
+			arc->arPattHandle = NULL;
+		}
+
+		for (int i=0; i<arc->multi_markers.size(); i++) {
+			arMultiFreeConfig(arc->multi_markers[i].multiMarkerHandle);
+		}
+		arc->multi_markers.clear();
+		arc->arMultiMarkerHandle = NULL;
+	}
+
+	int teardown(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+
+		arControllers.erase(id);
+
+		return 0;
+	}
+
+
+
+	/*****************
+	* Camera loading *
+	*****************/
+
+	static bool sameCameraParam(const ARParam *a, const ARParam *b) {
+		return a->xsize == b->xsize && a->ysize == b->ysize && a->dist_function_version == b->dist_function_version
+			&& memcmp(a->mat, b->mat, sizeof(a->mat)) == 0 && memcmp(a->dist_factor, b->dist_factor, sizeof(a->dist_factor)) == 0;
+	}
+
+	int loadCamera(std::string cparam_name) {
+		ARParam param;
+		if (arParamLoad(cparam_name.c_str(), 1, &param) < 0) {
+			ARLOGe("loadCamera(): Error loading parameter file %s for camera.\n", cparam_name.c_str());
+			return -1;
+		}
+		// A camera loaded again gets its first ID back, so its lookup tables are shared.
+		for (auto it = cameraParams.begin(); it != cameraParams.end(); ++it) {
+			if (sameCameraParam(&(it->second), &param)) {
+				return it->first;
+			}
+		}
+		int cameraID = gCameraID++;
+		cameraParams[cameraID] = param;
+
+		return cameraID;
+	}
+
+	int setCamera(int id, int cameraID) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		// Acquired before deleteHandle() releases the current table, so resetting the same camera reuses it.
+		camera_lt *lt = acquireCameraLT(cameraID, arc->width, arc->height);
+		if (lt == NULL) {
+			ARLOGe("setCamera(): Error: no lookup table for camera %d.\n", cameraID);
+			return -1;
+		}
+
+		// The KPM handle and its thread use the current table, so they go before it is released.
+		// Both paths below create a new one.
+		deleteKpmHandle(arc);
+		deleteHandle(arc);
+#ifdef AR_SCRATCH_CHECK
+		arc->scratchWarmup = SCRATCH_WARMUP_FRAMES;
+#endif
+
+		arc->cameraID = cameraID;
+		arc->paramLT = lt->paramLT;
+		arc->ar3DHandle = lt->ar3DHandle;
+		arc->param = arc->paramLT->param;
+
+		// ARLOGi("*** Camera Parameter ***\n");
+		// arParamDisp(&(arc->param));
+
+		// setup camera
+		if ((arc->arhandle = arCreateHandle(arc->paramLT)) == NULL) {
+			ARLOGe("setCamera(): Error: arCreateHandle.\n");
+			return -1;
+		}
+		// AR_DEFAULT_PIXEL_FORMAT
+		int set = arSetPixelFormat(arc->arhandle, arc->pixFormat);
+
+		// ARLOGi("setCamera(): arCreateHandle done\n");
+
+		arPattAttach(arc->arhandle, arc->arPattHandle);
+		// ARLOGi("setCamera(): Pattern handler attached.\n");
+
+		// The lens depends on the controller's near and far planes, so it is not part of the shared entry.
+		arglCameraFrustumRH(&((arc->paramLT)->param), arc->nearPlane, arc->farPlane, arc->cameraLens);
+
+		// The AR2 handle keeps a pointer to the lookup table it was created with.
+		if (arc->ar2Handle) {
+			return setupAR2(id);
+		}
+
+		return resetKpmHandle(arc);
+	}
+
+
+
+
+	/*****************
+	* Marker loading *
+	*****************/
+
+
+	static int loadMarker(const char *patt_name, int *patt_id, ARHandle *arhandle, ARPattHandle **pattHandle_p) {
+		// Loading only 1 pattern in this example.
+		if ((*patt_id = arPattLoad(*pattHandle_p, patt_name)) < 0) {
+			ARLOGe("loadMarker(): Error loading pattern file %s.\n", patt_name);
+			return (FALSE);
+		}
+
+		return (TRUE);
+	}
+
+	static int loadMultiMarker(const char *patt_name, ARHandle *arHandle, ARPattHandle **pattHandle_p, ARMultiMarkerInfoT **arMultiConfig) {
+		if( (*arMultiConfig = arMultiReadConfigFile(patt_name, *pattHandle_p)) == NULL ) {
+			ARLOGe("config data load error !!\n");
+			return (FALSE);
+		}
+		if( (*arMultiConfig)->patt_type == AR_MULTI_PATTERN_DETECTION_MODE_TEMPLATE ) {
+			arSetPatternDetectionMode( arHandle, AR_TEMPLATE_MATCHING_COLOR );
+		} else if( (*arMultiConfig)->patt_type == AR_MULTI_PATTERN_DETECTION_MODE_MATRIX ) {
+			arSetPatternDetectionMode( arHandle, AR_MATRIX_CODE_DETECTION );
+		} else { // AR_MULTI_PATTERN_DETECTION_MODE_TEMPLATE_AND_MATRIX
+			arSetPatternDetectionMode( arHandle, AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX );
+		}
+
+		return (TRUE);
+	}
+
+
+	int addMarker(int id, std::string patt_name) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		// const char *patt_name
+		// Load marker(s).
+		if (!loadMarker(patt_name.c_str(), &(arc->patt_id), arc->arhandle, &(arc->arPattHandle))) {
+			ARLOGe("ARToolKitJS(): Unable to set up AR marker.\n");
+			return -1;
+		}
+
+		return arc->patt_id;
+	}
+
+	int addNFTMarker(int id, std::string datasetPathname) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		// Load marker(s).
+		int patt_id = arc->nftMarkers.size();
+		if (!loadNFTMarker(arc, patt_id, datasetPathname.c_str())) {
+			ARLOGe("ARToolKitJS(): Unable to set up NFT marker.\n");
+			return -1;
+		}
+
+		return patt_id;
+	}
+
+	/**
+		NFT bundles (nftBundle.h), streamed by artoolkit.addNFTMarkerBundle() straight into a heap
+		block from allocNFTBundle(): the page is registered with addNFTMarkerBundle() once the block
+		holds getNFTBundleHeadSize() bytes, and its image levels are added as they arrive with
+		updateNFTMarkerBundle().
+	*/
+	intptr_t allocNFTBundle(int size) {
+		if (size <= 0) {
+			return 0;
+		}
+		return (intptr_t)malloc(size);
+	}
+
+	void freeNFTBundle(intptr_t bundle) {
+		free((void *)bundle);
+	}
+
+	int getNFTBundleHeadSize(intptr_t bundle, int available) {
+		return nftBundleHeadSize((const ARUint8 *)bundle, available);
+	}
+
+	/**
+		Registers the NFT page of a bundle of size bytes, the first available of which have arrived.
+		The controller owns the bundle once this succeeds. Returns the marker id, or -1.
+	*/
+	int addNFTMarkerBundle(int id, intptr_t bundle, int size, int available) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		ARUint8 *data = (ARUint8 *)bundle;
+		if (available < 0 || available > size || nftBundleSize(data, available) != size) {
+			ARLOGe("addNFTMarkerBundle(): Error: invalid NFT bundle.\n");
+			return -1;
+		}
+		KpmRefDataSet *refDataSet2 = nftBundleReadRefDataSet(data, available);
+		if (refDataSet2 == NULL) {
+			ARLOGe("addNFTMarkerBundle(): Error reading KPM data.\n");
+			return -1;
+		}
+		// The image data is in the bundle already, so the page is resident from the start.
+		AR2SurfaceSetT *surfaceSet = nftBundleAdoptSurfaceSet(data, available);
+		if (surfaceSet == NULL) {
+			kpmDeleteRefDataSet(&refDataSet2);
+			return -1;
+		}
+
+		int patt_id = arc->nftMarkers.size();
+		nft_marker marker;
+		marker.bundle = data;
+		marker.bundleSize = size;
+		marker.bundleAvailable = available;
+		marker.surfaceSet = surfaceSet;
+		marker.surfaceSetBytes = getSurfaceSetBytes(surfaceSet);
+		if (!registerNFTMarker(arc, patt_id, refDataSet2, marker)) {
+			nftBundleFreeSurfaceSet(&surfaceSet);
+			return -1;
+		}
+		arc->nftResidentBytes += marker.surfaceSetBytes;
+		evictNFTSurfaceSets(arc, 0);
+
+		return patt_id;
+	}
+
+	/**
+		Adds the image levels of an NFT bundle that arrived since the last call, available being
+		the bytes received so far. Returns the number of image levels in use.
+	*/
+	int updateNFTMarkerBundle(int id, int markerIndex, int available) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (markerIndex < 0 || arc->nftMarkers.size() <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		if (!marker->bundle || available < marker->bundleAvailable || available > marker->bundleSize) {
+			return -1;
+		}
+		marker->bundleAvailable = available;
+		if (!marker->surfaceSet) {
+			return 0;
+		}
+		return nftBundleUpdateSurfaceSet(marker->surfaceSet, marker->bundle, marker->bundleAvailable);
+	}
+
+	/**
+		Snapshots the prepared data of an NFT page, its KPM data and decoded image pyramid with
+		features, as an NFT bundle in a new heap block, to be freed with freeNFTBundle(). The size
+		is in the bundle header. Handing the bundle to addNFTMarkerBundle() in a later session
+		restores the page without reading or decoding its dataset. Returns 0 on error.
+	*/
+	intptr_t serializeNFTMarker(int id, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return 0; }
+		arController *arc = &(arControllers[id]);
+
+		if (markerIndex < 0 || arc->nftMarkers.size() <= markerIndex) {
+			return 0;
+		}
+		nft_marker *marker = &(arc->nftMarkers[markerIndex]);
+		if (marker->bundle) {
+			if (marker->bundleAvailable != marker->bundleSize) {
+				return 0;
+			}
+			ARUint8 *data = (ARUint8 *)malloc(marker->bundleSize);
+			if (data) {
+				memcpy(data, marker->bundle, marker->bundleSize);
+			}
+			return (intptr_t)data;
+		}
+
+		AR2SurfaceSetT *surfaceSet = loadNFTSurfaceSet(arc, markerIndex);
+		if (surfaceSet == NULL) {
+			return 0;
+		}
+		size_t size;
+		return (intptr_t)nftBundleCreate(arc->refDataSet, markerIndex, surfaceSet, &size);
+	}
+
+	/**
+		Copies the KPM data of one page of refDataSet into a new data set, to be freed with
+		kpmDeleteRefDataSet(). Returns NULL if the page has no data or memory ran out.
+	*/
+	KpmRefDataSet *copyRefDataSetPage(const KpmRefDataSet *refDataSet, int pageNo) {
+		const KpmPageInfo *pageInfo = NULL;
+		for (int i = 0; i < refDataSet->pageNum; i++) {
+			if (refDataSet->pageInfo[i].pageNo == pageNo) pageInfo = &(refDataSet->pageInfo[i]);
+		}
+		if (pageInfo == NULL) return NULL;
+
+		KpmRefDataSet *page = (KpmRefDataSet *)calloc(1, sizeof(KpmRefDataSet));
+		if (page == NULL) return NULL;
+		for (int i = 0; i < refDataSet->num; i++) {
+			if (refDataSet->refPoint[i].pageNo == pageNo) page->num++;
+		}
+		page->refPoint = (KpmRefData *)malloc(page->num * sizeof(KpmRefData));
+		page->pageInfo = (KpmPageInfo *)calloc(1, sizeof(KpmPageInfo));
+		if (page->pageInfo) {
+			// Only counted once allocated: kpmDeleteRefDataSet() walks pageInfo up to pageNum.
+			page->pageNum = 1;
+			page->pageInfo->imageInfo = (KpmImageInfo *)malloc(pageInfo->imageNum * sizeof(KpmImageInfo));
+		}
+		if ((page->num && !page->refPoint) || !page->pageInfo || (pageInfo->imageNum && !page->pageInfo->imageInfo)) {
+			kpmDeleteRefDataSet(&page);
+			return NULL;
+		}
+		for (int i = 0, j = 0; i < refDataSet->num; i++) {
+			if (refDataSet->refPoint[i].pageNo == pageNo) page->refPoint[j++] = refDataSet->refPoint[i];
+		}
+		page->pageInfo->pageNo = pageNo;
+		page->pageInfo->imageNum = pageInfo->imageNum;
+		memcpy(page->pageInfo->imageInfo, pageInfo->imageInfo, pageInfo->imageNum * sizeof(KpmImageInfo));
+		return page;
+	}
+
+	/**
+		Registers the NFT markers of controller sourceId on controller id, for several controllers
+		(cameras, or frames processed side by side by detectBatch()) to look for the same markers.
+		The image pyramids and features of the markers are shared, not copied: each controller
+		only holds its own KPM data, matcher index and tracking state. The AR2 data of the source
+		markers is read now if it is not in memory yet, and stays there while shared. Returns the
+		number of markers registered, in the order of the source, or -1.
+	*/
+	int shareNFTMarkers(int id, int sourceId) {
+		if (id == sourceId || arControllers.find(id) == arControllers.end() || arControllers.find(sourceId) == arControllers.end()) {
+			return -1;
+		}
+		arController *arc = &(arControllers[id]);
+		arController *source = &(arControllers[sourceId]);
+
+		int count = 0;
+		for (int i = 0; i < source->nftMarkers.size(); i++, count++) {
+			AR2SurfaceSetT *surfaceSet = loadNFTSurfaceSet(source, i);
+			if (surfaceSet == NULL) {
+				ARLOGe("shareNFTMarkers(): Error loading NFT marker %d.\n", i);
+				break;
+			}
+			// Views are shared from the surface set they are a view of.
+			nft_marker *sourceMarker = &(source->nftMarkers[i]);
+			if (sourceMarker->sharedSurfaceSet) surfaceSet = sourceMarker->sharedSurfaceSet;
+
+			KpmRefDataSet *refDataSet2 = copyRefDataSetPage(source->refDataSet, i);
+			if (refDataSet2 == NULL) {
+				ARLOGe("shareNFTMarkers(): Error copying the KPM data of NFT marker %d.\n", i);
+				break;
+			}
+			nft_marker marker;
+			marker.datasetPathname = sourceMarker->datasetPathname;
+			marker.surfaceSet = shareSurfaceSet(surfaceSet, sourceMarker->bundle);
+			marker.sharedSurfaceSet = surfaceSet;
+			marker.surfaceSetBytes = 0; // Counted by the controller that loaded it.
+			if (marker.surfaceSet == NULL) {
+				kpmDeleteRefDataSet(&refDataSet2);
+				break;
+			}
+			if (!registerNFTMarker(arc, arc->nftMarkers.size(), refDataSet2, marker)) {
+				free(marker.surfaceSet->surface);
+				free(marker.surfaceSet);
+				releaseSharedSurfaceSet(surfaceSet);
+				break;
+			}
+		}
+		return count;
+	}
+
+	int addMultiMarker(int id, std::string patt_name) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		// const char *patt_name
+		// Load marker(s).
+		if (!loadMultiMarker(patt_name.c_str(), arc->arhandle, &(arc->arPattHandle), &(arc->arMultiMarkerHandle))) {
+			ARLOGe("ARToolKitJS(): Unable to set up AR multimarker.\n");
+			return -1;
+		}
+
+		int multiMarker_id = arc->multi_markers.size();
+		multi_marker marker = multi_marker();
+		marker.id = multiMarker_id;
+		marker.multiMarkerHandle = arc->arMultiMarkerHandle;
+
+		arc->multi_markers.push_back(marker);
+
+		return marker.id;
+	}
+
+	int getMultiMarkerNum(int id, int multiMarker_id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		int mId = multiMarker_id;
+		if (mId < 0 || arc->multi_markers.size() <= mId) {
+			return -1;
+		}
+		return (arc->multi_markers[mId].multiMarkerHandle)->marker_num;
+	}
+
+	int getMultiMarkerCount(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->multi_markers.size();
+	}
+
+
+
+	/**********************
+	* Setters and getters *
+	**********************/
+
+	void setProjectionNearPlane(int id, const ARdouble projectionNearPlane) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+		arc->nearPlane = projectionNearPlane;
+	}
+
+	ARdouble getProjectionNearPlane(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+		return arc->nearPlane;
+	}
+
+	void setProjectionFarPlane(int id, const ARdouble projectionFarPlane) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+		arc->farPlane = projectionFarPlane;
+	}
+
+	ARdouble getProjectionFarPlane(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+		return arc->farPlane;
+	}
+
+	void setPatternDetectionMode(int id, int mode) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+		if (arSetPatternDetectionMode(arc->arhandle, mode) == 0) {
+			ARLOGi("Pattern detection mode set to %d.\n", mode);
+		}
+	}
+
+	int getPatternDetectionMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
 		int mode;
 		arController *arc = &(arControllers[id]);
-		if (arGetPatternDetectionMode(arc->arhandle, &mode) == 0) {
-			return mode;
+		if (arGetPatternDetectionMode(arc->arhandle, &mode) == 0) {
+			return mode;
+		}
+
+		return -1;
+	}
+
+	void setPattRatio(int id, float ratio) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		if (ratio <= 0.0f || ratio >= 1.0f) return;
+		ARdouble pattRatio = (ARdouble)ratio;
+		if (arc->arhandle) {
+			if (arSetPattRatio(arc->arhandle, pattRatio) == 0) {
+				ARLOGi("Pattern ratio size set to %f.\n", pattRatio);
+			}
+		}
+	}
+
+	ARdouble getPattRatio(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		ARdouble pattRatio;
+		if (arc->arhandle) {
+			if (arGetPattRatio(arc->arhandle, &pattRatio) == 0) {
+				return pattRatio;
+			}
+		}
+
+		return -1;
+	}
+
+	void setMatrixCodeType(int id, int type) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		AR_MATRIX_CODE_TYPE matrixType = (AR_MATRIX_CODE_TYPE)type;
+		arSetMatrixCodeType(arc->arhandle, matrixType);
+	}
+
+	int getMatrixCodeType(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		AR_MATRIX_CODE_TYPE matrixType;
+		arGetMatrixCodeType(arc->arhandle, &matrixType);
+		return matrixType;
+	}
+
+	void setLabelingMode(int id, int mode) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		int labelingMode = mode;
+
+		if (arSetLabelingMode(arc->arhandle, labelingMode) == 0) {
+			ARLOGi("Labeling mode set to %d\n", labelingMode);
+		}
+	}
+
+	int getLabelingMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		int labelingMode;
+
+		if (arGetLabelingMode(arc->arhandle, &labelingMode) == 0) {
+			return labelingMode;
+		}
+
+		return -1;
+	}
+
+	void setThreshold(int id, int threshold) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		if (threshold < 0 || threshold > 255) return;
+		if (arSetLabelingThresh(arc->arhandle, threshold) == 0) {
+			ARLOGi("Threshold set to %d\n", threshold);
+		};
+		// default 100
+		// arSetLabelingThreshMode
+		// AR_LABELING_THRESH_MODE_MANUAL, AR_LABELING_THRESH_MODE_AUTO_MEDIAN, AR_LABELING_THRESH_MODE_AUTO_OTSU, AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE
+	}
+
+	int getThreshold(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		int threshold;
+		if (arGetLabelingThresh(arc->arhandle, &threshold) == 0) {
+			return threshold;
+		};
+
+		return -1;
+	}
+
+	void setThresholdMode(int id, int mode) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		AR_LABELING_THRESH_MODE thresholdMode = (AR_LABELING_THRESH_MODE)mode;
+
+		if (arSetLabelingThreshMode(arc->arhandle, thresholdMode) == 0) {
+			ARLOGi("Threshold mode set to %d\n", (int)thresholdMode);
+		}
+	}
+
+	int getThresholdMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		AR_LABELING_THRESH_MODE thresholdMode;
+
+		if (arGetLabelingThreshMode(arc->arhandle, &thresholdMode) == 0) {
+			return thresholdMode;
+		}
+
+		return -1;
+	}
+
+	int setDebugMode(int id, int enable) {
+		if (arControllers.find(id) == arControllers.end()) { return NULL; }
+		arController *arc = &(arControllers[id]);
+
+		arSetDebugMode(arc->arhandle, enable ? AR_DEBUG_ENABLE : AR_DEBUG_DISABLE);
+		ARLOGi("Debug mode set to %s\n", enable ? "on." : "off.");
+
+		return enable;
+	}
+
+	intptr_t getProcessingImage(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return NULL; }
+		arController *arc = &(arControllers[id]);
+
+		return (intptr_t)arc->arhandle->labelInfo.bwImage;
+	}
+
+	int getDebugMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return NULL; }
+		arController *arc = &(arControllers[id]);
+
+		int enable;
+
+		arGetDebugMode(arc->arhandle, &enable);
+		return enable;
+	}
+
+	void setImageProcMode(int id, int mode) {
+		if (arControllers.find(id) == arControllers.end()) { return; }
+		arController *arc = &(arControllers[id]);
+
+		int imageProcMode = mode;
+		if (arSetImageProcMode(arc->arhandle, mode) == 0) {
+			ARLOGi("Image proc. mode set to %d.\n", imageProcMode);
+		}
+	}
+
+	int getImageProcMode(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return -1; }
+		arController *arc = &(arControllers[id]);
+
+		int imageProcMode;
+		if (arGetImageProcMode(arc->arhandle, &imageProcMode) == 0) {
+			return imageProcMode;
+		}
+
+		return -1;
+	}
+
+
+
+
+	/*
+	 * Marker processing
+	 */
+
+	void matrixCopy(ARdouble src[3][4], ARdouble dst[3][4]) {
+		for (int i=0; i<3; i++) {
+			for (int j=0; j<4; j++) {
+				dst[i][j] = src[i][j];
+			}
+		}
+	}
+
+	int getTransMatSquare(int id, int markerIndex, int markerWidth) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->arhandle->marker_num <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		ARMarkerInfo* marker = markerIndex < 0 ? &(arc->markerInfo) : &((arc->arhandle)->markerInfo[markerIndex]);
+
+		arGetTransMatSquare(arc->ar3DHandle, marker, markerWidth, arc->transform);
+
+		return 0;
+	}
+
+	int getTransMatSquareCont(int id, int markerIndex, int markerWidth) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->arhandle->marker_num <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		ARMarkerInfo* marker = markerIndex < 0 ? &(arc->markerInfo) : &((arc->arhandle)->markerInfo[markerIndex]);
+
+		arGetTransMatSquareCont(arc->ar3DHandle, marker, arc->transform, markerWidth, arc->transform);
+
+		return 0;
+	}
+
+	int setMarkerInfoDir(int id, int markerIndex, int dir) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->arhandle->marker_num <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		ARMarkerInfo* marker = markerIndex < 0 ? &(arc->markerInfo) : &((arc->arhandle)->markerInfo[markerIndex]);
+
+		marker->dir = dir;
+
+		return 0;
+	}
+
+	int setMarkerInfoVertex(int id, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->arhandle->marker_num <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+		ARMarkerInfo* marker = markerIndex < 0 ? &(arc->markerInfo) : &((arc->arhandle)->markerInfo[markerIndex]);
+
+		auto v = marker->vertex;
+
+		v[0][0] = arc->transform[0][0];
+		v[0][1] = arc->transform[0][1];
+		v[1][0] = arc->transform[0][2];
+		v[1][1] = arc->transform[0][3];
+		v[2][0] = arc->transform[1][0];
+		v[2][1] = arc->transform[1][1];
+		v[3][0] = arc->transform[1][2];
+		v[3][1] = arc->transform[1][3];
+
+		marker->pos[0] = (v[0][0] + v[1][0] + v[2][0] + v[3][0]) * 0.25;
+		marker->pos[1] = (v[0][1] + v[1][1] + v[2][1] + v[3][1]) * 0.25;
+
+		return 0;
+	}
+
+	int getTransMatMultiSquareRobust(int id, int multiMarkerId) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
+			return MULTIMARKER_NOT_FOUND;
+		}
+		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
+		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
+
+		arGetTransMatMultiSquareRobust( arc->ar3DHandle, arc->arhandle->markerInfo, arc->arhandle->marker_num, arMulti );
+		matrixCopy(arMulti->trans, arc->transform);
+
+		return 0;
+	}
+
+	int getTransMatMultiSquare(int id, int multiMarkerId) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
+			return MULTIMARKER_NOT_FOUND;
+		}
+		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
+		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
+
+		arGetTransMatMultiSquare( arc->ar3DHandle, arc->arhandle->markerInfo, arc->arhandle->marker_num, arMulti );
+		matrixCopy(arMulti->trans, arc->transform);
+
+		return 0;
+	}
+
+	/**
+		Fills the controller's luma buffer from the RGBA pixels in videoFrame, or from the frame
+		in videoSource after setVideoSource().
+		Call this after writing a new frame to the heap and before any detection.
+		Does nothing for the other pixel formats, whose luma is the Y plane of videoFrame.
+	*/
+	int prepareFrame(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->statsEnabled) arc->stats.frames++;
+
+		if (arc->videoSource) {
+			double start = arc->statsEnabled ? ar2GetTimeMod() : 0;
+			arVideoLumaOrient(arc->videoLuma, arc->videoSource, arc->sourceOrient);
+			if (arc->statsEnabled) arc->stats.lumaMs += ar2GetTimeMod() - start;
+			return 0;
+		}
+
+		if (arc->pixFormat != AR_PIXEL_FORMAT_RGBA) {
+			return 0;
+		}
+
+		double start = arc->statsEnabled ? ar2GetTimeMod() : 0;
+		arVideoLumaRGBAtoL(arc->videoLuma, arc->videoFrame, arc->width * arc->height);
+		if (arc->statsEnabled) arc->stats.lumaMs += ar2GetTimeMod() - start;
+
+		return 0;
+	}
+
+	/**
+		Predicts the regions of the markers found in the last frame: the bounding box of their
+		vertices moved by their last motion and padded, with overlapping boxes merged.
+		Returns false if the full frame has to be scanned instead.
+	*/
+	bool predictSquareROIs(arController *arc) {
+		ARHandle *arhandle = arc->arhandle;
+		arc->rois.clear();
+
+		// The regions are labeled with the last threshold, so modes that compute it per frame scan the full frame.
+		if (arc->roiMarkers.empty() || arhandle->arDebug || arhandle->arImageProcMode != AR_IMAGE_PROC_FRAME_IMAGE
+			|| arhandle->arLabelingThreshMode == AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE
+			|| arhandle->arLabelingThreshMode == AR_LABELING_THRESH_MODE_AUTO_BRACKETING) {
+			return false;
+		}
+
+		std::vector<int> &boxes = arc->roiBoxes; // left, top, right, bottom.
+		boxes.clear();
+		for (int i = 0; i < arc->roiMarkers.size(); i++) {
+			roi_marker *m = &(arc->roiMarkers[i]);
+			ARdouble size = fmax(m->box[2] - m->box[0], m->box[3] - m->box[1]);
+			ARdouble pad = ROI_PADDING_MIN + ROI_PADDING_RATIO * size + fabs(m->vel[0]) + fabs(m->vel[1]);
+			boxes.push_back((int)fmax(0, floor(m->box[0] + m->vel[0] - pad)));
+			boxes.push_back((int)fmax(0, floor(m->box[1] + m->vel[1] - pad)));
+			boxes.push_back((int)fmin(arc->width, ceil(m->box[2] + m->vel[0] + pad)));
+			boxes.push_back((int)fmin(arc->height, ceil(m->box[3] + m->vel[1] + pad)));
+		}
+
+		for (bool merged = true; merged; ) {
+			merged = false;
+			for (int i = 0; i < boxes.size() && !merged; i += 4) {
+				for (int j = i + 4; j < boxes.size(); j += 4) {
+					if (boxes[i] < boxes[j + 2] && boxes[j] < boxes[i + 2] && boxes[i + 1] < boxes[j + 3] && boxes[j + 1] < boxes[i + 3]) {
+						boxes[i] = std::min(boxes[i], boxes[j]);
+						boxes[i + 1] = std::min(boxes[i + 1], boxes[j + 1]);
+						boxes[i + 2] = std::max(boxes[i + 2], boxes[j + 2]);
+						boxes[i + 3] = std::max(boxes[i + 3], boxes[j + 3]);
+						boxes.erase(boxes.begin() + j, boxes.begin() + j + 4);
+						merged = true;
+						break;
+					}
+				}
+			}
+		}
+
+		int area = 0;
+		for (int i = 0; i < boxes.size(); i += 4) {
+			if (boxes[i + 2] <= boxes[i] || boxes[i + 3] <= boxes[i + 1]) continue; // Predicted off the frame.
+			arc->rois.push_back(boxes[i]);
+			arc->rois.push_back(boxes[i + 1]);
+			arc->rois.push_back(boxes[i + 2] - boxes[i]);
+			arc->rois.push_back(boxes[i + 3] - boxes[i + 1]);
+			area += (boxes[i + 2] - boxes[i]) * (boxes[i + 3] - boxes[i + 1]);
+		}
+
+		return !arc->rois.empty() && area <= ROI_MAX_AREA_RATIO * arc->width * arc->height;
+	}
+
+	/**
+		Returns true if a marker found in the last frame is missing from the current results.
+	*/
+	bool lostSquareROIMarker(arController *arc) {
+		ARHandle *arhandle = arc->arhandle;
+		for (int i = 0; i < arc->roiMarkers.size(); i++) {
+			int j = 0;
+			while (j < arhandle->marker_num && arhandle->markerInfo[j].id != arc->roiMarkers[i].id) j++;
+			if (j == arhandle->marker_num) return true;
+		}
+		return false;
+	}
+
+	void updateSquareROIMarkers(arController *arc) {
+		ARHandle *arhandle = arc->arhandle;
+		std::vector<roi_marker> &markers = arc->roiMarkersNext;
+		markers.clear();
+		for (int i = 0; i < arhandle->marker_num; i++) {
+			ARMarkerInfo *markerInfo = &(arhandle->markerInfo[i]);
+			if (markerInfo->id < 0) continue;
+
+			roi_marker m;
+			m.id = markerInfo->id;
+			m.pos[0] = markerInfo->pos[0];
+			m.pos[1] = markerInfo->pos[1];
+			m.vel[0] = m.vel[1] = 0;
+			for (int j = 0; j < arc->roiMarkers.size(); j++) {
+				if (arc->roiMarkers[j].id == m.id) {
+					m.vel[0] = m.pos[0] - arc->roiMarkers[j].pos[0];
+					m.vel[1] = m.pos[1] - arc->roiMarkers[j].pos[1];
+					break;
+				}
+			}
+			m.box[0] = m.box[2] = markerInfo->vertex[0][0];
+			m.box[1] = m.box[3] = markerInfo->vertex[0][1];
+			for (int j = 1; j < 4; j++) {
+				m.box[0] = fmin(m.box[0], markerInfo->vertex[j][0]);
+				m.box[1] = fmin(m.box[1], markerInfo->vertex[j][1]);
+				m.box[2] = fmax(m.box[2], markerInfo->vertex[j][0]);
+				m.box[3] = fmax(m.box[3], markerInfo->vertex[j][1]);
+			}
+			markers.push_back(m);
+		}
+		arc->roiMarkers.swap(markers);
+	}
+
+	/**
+		Runs arDetectMarker() on the full frame, or with regions of interest enabled, on the
+		predicted regions of the markers found in the last frame. Falls back to the full frame
+		every roiFullScanInterval frames, and in the same call when a marker is not found again.
+	*/
+	int detectSquareMarkers(arController *arc, AR2VideoBufferT *buff) {
+		int ret = -1;
+		bool roi = arc->roiFullScanInterval > 0 && arc->roiFramesToFullScan > 0 && predictSquareROIs(arc);
+		if (roi) {
+			arc->roiFramesToFullScan--;
+			ret = arDetectMarkerROI(arc->arhandle, buff, (const int (*)[4])arc->rois.data(), arc->rois.size() / 4, arc->roiLuma);
+			roi = (ret == 0 && !lostSquareROIMarker(arc));
+			if (roi && arc->statsEnabled) arc->stats.squareROIFrames++;
+		}
+		if (!roi) {
+			ret = arDetectMarker(arc->arhandle, buff);
+			arc->roiFramesToFullScan = arc->roiFullScanInterval - 1;
+		}
+		if (ret == 0 && arc->roiFullScanInterval > 0) {
+			updateSquareROIMarkers(arc);
+		}
+		return ret;
+	}
+
+	int detectMarker(int id) {
+		// Run by detect(), so no operator[], which detectBatch() threads must not call at once.
+		auto it = arControllers.find(id);
+		if (it == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(it->second);
+
+		arc->frameTime = ar2GetTimeMod();
+
+		// Convert video frame to AR2VideoBufferT
+    AR2VideoBufferT buff = {0};
+    buff.buff = arc->videoFrame;
+    buff.fillFlag = 1;
+
+    buff.buffLuma = arc->videoLuma;
+
+		if (!arc->statsEnabled) {
+			return detectSquareMarkers(arc, &buff);
+		}
+		double start = ar2GetTimeMod();
+		int ret = detectSquareMarkers(arc, &buff);
+		arc->stats.detectMarkerMs += ar2GetTimeMod() - start;
+		return ret;
+	}
+
+	/**
+		Enables tracking of square markers in regions of interest: once markers are found, the
+		following frames are only thresholded and labeled in padded boxes around their predicted
+		positions. The full frame is scanned every fullScanInterval frames, and whenever a
+		marker is not found in its region. 0 (the default) scans the full frame on every call.
+		Regions are not used with the adaptive or bracketing threshold modes, field image
+		processing or debug mode.
+	*/
+	int setSquareMarkerROI(int id, int fullScanInterval) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (fullScanInterval < 0) {
+			return -1;
+		}
+		if (fullScanInterval > 0 && !arc->roiLuma) {
+			arc->roiLuma = (ARUint8*) malloc(arc->width * arc->height);
+			if (!arc->roiLuma) {
+				return -1;
+			}
+		}
+		arc->roiFullScanInterval = fullScanInterval;
+		arc->roiFramesToFullScan = 0;
+		arc->roiMarkers.clear();
+		// Sized for the most markers a frame can hold, so tracking them never grows the vectors.
+		arc->roiMarkers.reserve(AR_SQUARE_MAX);
+		arc->roiMarkersNext.reserve(AR_SQUARE_MAX);
+		arc->rois.reserve(AR_SQUARE_MAX * 4);
+		arc->roiBoxes.reserve(AR_SQUARE_MAX * 4);
+
+		return 0;
+	}
+
+	int getSquareMarkerROI(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->roiFullScanInterval;
+	}
+
+	/**
+		Enables or disables the accumulation of stage timings and counters (off by default).
+		Enabling resets them.
+	*/
+	int setStatsEnabled(int id, bool enable) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (enable && !arc->statsEnabled) {
+			arc->stats = controller_stats();
+		}
+		arc->statsEnabled = enable;
+
+		return 0;
+	}
+
+	bool getStatsEnabled(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return false; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->statsEnabled;
+	}
+
+	int resetStats(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		arc->stats = controller_stats();
+
+		return 0;
+	}
+
+	/**
+		Returns the address of the controller's stats block (see controller_stats), which stays
+		valid until the controller is torn down.
+	*/
+	intptr_t getStatsPointer(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return 0; }
+		arController *arc = &(arControllers[id]);
+
+		return (intptr_t)&arc->stats;
+	}
+
+
+	int getMarkerNum(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		return arc->arhandle->marker_num;
+	}
+
+	int getMultiEachMarkerInfo(int id, int multiMarkerId, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
+			return MULTIMARKER_NOT_FOUND;
+		}
+		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
+		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
+
+		if (arMulti->marker_num <= markerIndex || markerIndex < 0) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
+		}
+
+		ARMultiEachMarkerInfoT *marker = &(arMulti->marker[markerIndex]);
+		matrixCopy(marker->trans, arc->transform);
+
+		EM_ASM_({
+			if (!artoolkit["multiEachMarkerInfo"]) {
+				artoolkit["multiEachMarkerInfo"] = ({});
+			}
+			var multiEachMarker = artoolkit["multiEachMarkerInfo"];
+			multiEachMarker['visible'] = $0;
+			multiEachMarker['pattId'] = $1;
+			multiEachMarker['pattType'] = $2;
+			multiEachMarker['width'] = $3;
+		},
+			marker->visible,
+			marker->patt_id,
+			marker->patt_type,
+			marker->width
+		);
+
+		return 0;
+	}
+
+	int getMarkerInfo(int id, int markerIndex) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (arc->arhandle->marker_num <= markerIndex) {
+			return MARKER_INDEX_OUT_OF_BOUNDS;
 		}
+		ARMarkerInfo* markerInfo = markerIndex < 0 ? &(arc->markerInfo) : &((arc->arhandle)->markerInfo[markerIndex]);
+
+		EM_ASM_({
+			var $a = arguments;
+			var i = 12;
+			if (!artoolkit["markerInfo"]) {
+				artoolkit["markerInfo"] = ({
+					pos: [0,0],
+					line: [[0,0,0], [0,0,0], [0,0,0], [0,0,0]],
+					vertex: [[0,0], [0,0], [0,0], [0,0]]
+				});
+			}
+			var markerInfo = artoolkit["markerInfo"];
+			markerInfo["area"] = $0;
+			markerInfo["id"] = $1;
+			markerInfo["idPatt"] = $2;
+			markerInfo["idMatrix"] = $3;
+			markerInfo["dir"] = $4;
+			markerInfo["dirPatt"] = $5;
+			markerInfo["dirMatrix"] = $6;
+			markerInfo["cf"] = $7;
+			markerInfo["cfPatt"] = $8;
+			markerInfo["cfMatrix"] = $9;
+			markerInfo["pos"][0] = $10;
+			markerInfo["pos"][1] = $11;
+			markerInfo["line"][0][0] = $a[i++];
+			markerInfo["line"][0][1] = $a[i++];
+			markerInfo["line"][0][2] = $a[i++];
+			markerInfo["line"][1][0] = $a[i++];
+			markerInfo["line"][1][1] = $a[i++];
+			markerInfo["line"][1][2] = $a[i++];
+			markerInfo["line"][2][0] = $a[i++];
+			markerInfo["line"][2][1] = $a[i++];
+			markerInfo["line"][2][2] = $a[i++];
+			markerInfo["line"][3][0] = $a[i++];
+			markerInfo["line"][3][1] = $a[i++];
+			markerInfo["line"][3][2] = $a[i++];
+			markerInfo["vertex"][0][0] = $a[i++];
+			markerInfo["vertex"][0][1] = $a[i++];
+			markerInfo["vertex"][1][0] = $a[i++];
+			markerInfo["vertex"][1][1] = $a[i++];
+			markerInfo["vertex"][2][0] = $a[i++];
+			markerInfo["vertex"][2][1] = $a[i++];
+			markerInfo["vertex"][3][0] = $a[i++];
+			markerInfo["vertex"][3][1] = $a[i++];
+			markerInfo["errorCorrected"] = $a[i++];
+			// markerInfo["globalID"] = $a[i++];
+		},
+			markerInfo->area,
+			markerInfo->id,
+			markerInfo->idPatt,
+			markerInfo->idMatrix,
+			markerInfo->dir,
+			markerInfo->dirPatt,
+			markerInfo->dirMatrix,
+			markerInfo->cf,
+			markerInfo->cfPatt,
+			markerInfo->cfMatrix,
+
+			markerInfo->pos[0],
+			markerInfo->pos[1],
+
+			markerInfo->line[0][0],
+			markerInfo->line[0][1],
+			markerInfo->line[0][2],
 
-		return -1;
-	}
+			markerInfo->line[1][0],
+			markerInfo->line[1][1],
+			markerInfo->line[1][2],
 
-	void setPattRatio(int id, float ratio) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
-		arController *arc = &(arControllers[id]);
+			markerInfo->line[2][0],
+			markerInfo->line[2][1],
+			markerInfo->line[2][2],
 
-		if (ratio <= 0.0f || ratio >= 1.0f) return;
-		ARdouble pattRatio = (ARdouble)ratio;
-		if (arc->arhandle) {
-			if (arSetPattRatio(arc->arhandle, pattRatio) == 0) {
-				ARLOGi("Pattern ratio size set to %f.\n", pattRatio);
-			}
-		}
-	}
+			markerInfo->line[3][0],
+			markerInfo->line[3][1],
+			markerInfo->line[3][2],
 
-	ARdouble getPattRatio(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
+			//
 
-		ARdouble pattRatio;
-		if (arc->arhandle) {
-			if (arGetPattRatio(arc->arhandle, &pattRatio) == 0) {
-				return pattRatio;
-			}
-		}
+			markerInfo->vertex[0][0],
+			markerInfo->vertex[0][1],
 
-		return -1;
-	}
+			markerInfo->vertex[1][0],
+			markerInfo->vertex[1][1],
 
-	void setMatrixCodeType(int id, int type) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
-		arController *arc = &(arControllers[id]);
+			markerInfo->vertex[2][0],
+			markerInfo->vertex[2][1],
 
-		AR_MATRIX_CODE_TYPE matrixType = (AR_MATRIX_CODE_TYPE)type;
-		arSetMatrixCodeType(arc->arhandle, matrixType);
-	}
+			markerInfo->vertex[3][0],
+			markerInfo->vertex[3][1],
 
-	int getMatrixCodeType(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
+			//
 
-		AR_MATRIX_CODE_TYPE matrixType;
-		arGetMatrixCodeType(arc->arhandle, &matrixType);
-		return matrixType;
+			markerInfo->errorCorrected
+
+			// markerInfo->globalID
+		);
+
+		return 0;
 	}
 
-	void setLabelingMode(int id, int mode) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
-		arController *arc = &(arControllers[id]);
 
-		int labelingMode = mode;
+	/*****************
+	* Results arena *
+	*****************/
 
-		if (arSetLabelingMode(arc->arhandle, labelingMode) == 0) {
-			ARLOGi("Labeling mode set to %d\n", labelingMode);
+	/**
+		Returns the number of ARdouble elements the results arena needs for the registered markers.
+	*/
+	int getResultsSize(arController *arc) {
+		int size = RESULTS_HEADER_SIZE + AR_SQUARE_MAX * RESULTS_SQUARE_SIZE + arc->nftMarkers.size() * RESULTS_NFT_SIZE;
+		for (int i = 0; i < arc->multi_markers.size(); i++) {
+			size += RESULTS_MULTI_SIZE + arc->multi_markers[i].multiMarkerHandle->marker_num * RESULTS_MULTI_EACH_SIZE;
 		}
+		return size;
 	}
 
-	int getLabelingMode(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
-
-		int labelingMode;
+	ARdouble *writeTransform(ARdouble *r, ARdouble trans[3][4]) {
+		for (int j = 0; j < 3; j++) {
+			for (int k = 0; k < 4; k++) {
+				*(r++) = trans[j][k];
+			}
+		}
+		return r;
+	}
 
-		if (arGetLabelingMode(arc->arhandle, &labelingMode) == 0) {
-			return labelingMode;
+	ARdouble *writeMarkerInfo(ARdouble *r, ARMarkerInfo *markerInfo) {
+		int j;
+		*(r++) = markerInfo->area;
+		*(r++) = markerInfo->id;
+		*(r++) = markerInfo->idPatt;
+		*(r++) = markerInfo->idMatrix;
+		*(r++) = markerInfo->dir;
+		*(r++) = markerInfo->dirPatt;
+		*(r++) = markerInfo->dirMatrix;
+		*(r++) = markerInfo->cf;
+		*(r++) = markerInfo->cfPatt;
+		*(r++) = markerInfo->cfMatrix;
+		*(r++) = markerInfo->pos[0];
+		*(r++) = markerInfo->pos[1];
+		for (j = 0; j < 4; j++) {
+			*(r++) = markerInfo->line[j][0];
+			*(r++) = markerInfo->line[j][1];
+			*(r++) = markerInfo->line[j][2];
+		}
+		for (j = 0; j < 4; j++) {
+			*(r++) = markerInfo->vertex[j][0];
+			*(r++) = markerInfo->vertex[j][1];
 		}
+		*(r++) = markerInfo->errorCorrected;
+		return r;
+	}
 
-		return -1;
+	square_marker *getSquareMarker(arController *arc, std::unordered_map<int, square_marker> &markers, int markerId) {
+		auto it = markers.find(markerId);
+		if (it == markers.end()) {
+			square_marker marker = square_marker();
+			marker.width = arc->defaultMarkerWidth;
+			it = markers.insert(std::make_pair(markerId, marker)).first;
+		}
+		return &(it->second);
 	}
 
-	void setThreshold(int id, int threshold) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
+	/**
+		Sets the width used for the pose of the given pattern (markerType 0) or barcode (markerType 1) marker by detect().
+	*/
+	int setSquareMarkerWidth(int id, int markerType, int markerId, ARdouble width) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (threshold < 0 || threshold > 255) return;
-		if (arSetLabelingThresh(arc->arhandle, threshold) == 0) {
-			ARLOGi("Threshold set to %d\n", threshold);
-		};
-		// default 100
-		// arSetLabelingThreshMode
-		// AR_LABELING_THRESH_MODE_MANUAL, AR_LABELING_THRESH_MODE_AUTO_MEDIAN, AR_LABELING_THRESH_MODE_AUTO_OTSU, AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE
+		std::unordered_map<int, square_marker> &markers = (markerType == BARCODE_MARKER) ? arc->barcodeMarkers : arc->patternMarkers;
+		getSquareMarker(arc, markers, markerId)->width = width;
+
+		return 0;
 	}
 
-	int getThreshold(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	int setDefaultMarkerWidth(int id, ARdouble width) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		int threshold;
-		if (arGetLabelingThresh(arc->arhandle, &threshold) == 0) {
-			return threshold;
-		};
+		arc->defaultMarkerWidth = width;
 
-		return -1;
+		return 0;
 	}
 
-	void setThresholdMode(int id, int mode) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
+	/**
+		Returns the number of elements the last detect() call wrote to the results arena.
+	*/
+	int getResultsLength(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return 0; }
 		arController *arc = &(arControllers[id]);
 
-		AR_LABELING_THRESH_MODE thresholdMode = (AR_LABELING_THRESH_MODE)mode;
-
-		if (arSetLabelingThreshMode(arc->arhandle, thresholdMode) == 0) {
-			ARLOGi("Threshold mode set to %d\n", (int)thresholdMode);
-		}
+		return arc->results.size();
 	}
 
-	int getThresholdMode(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
+	intptr_t getResultsPointer(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return 0; }
 		arController *arc = &(arControllers[id]);
 
-		AR_LABELING_THRESH_MODE thresholdMode;
-
-		if (arGetLabelingThreshMode(arc->arhandle, &thresholdMode) == 0) {
-			return thresholdMode;
+		if (arc->results.size() != getResultsSize(arc)) {
+			arc->results.resize(getResultsSize(arc));
 		}
-
-		return -1;
+		return (intptr_t)arc->results.data();
 	}
 
-	int setDebugMode(int id, int enable) {
-		if (arControllers.find(id) == arControllers.end()) { return NULL; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Turns low pass filtering of the poses published by detect() and getNFTMarkerInfo() on or off.
+		Each square and NFT marker gets its own filter (arFilterTransMat()), restarted whenever the
+		marker is found again. sampleRate is the detection rate in Hz and cutoffFreq the cutoff
+		frequency of the filter, in Hz; 0 for either keeps the ARToolKit default (30 and 15 Hz).
+		A lower cutoff gives steadier and laggier poses. Multimarker poses are not filtered.
 
-		arSetDebugMode(arc->arhandle, enable ? AR_DEBUG_ENABLE : AR_DEBUG_DISABLE);
-		ARLOGi("Debug mode set to %s\n", enable ? "on." : "off.");
+		The filtered poses also drive predictResults().
+	*/
+	int setPoseFilter(int id, int enable, double sampleRate, double cutoffFreq) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
 
-		return enable;
+		if (sampleRate < 0 || cutoffFreq < 0) {
+			return -1;
+		}
+		arc->poseFilterEnabled = (enable != 0);
+		arc->poseFilterSampleRate = sampleRate > 0 ? sampleRate : AR_FILTER_TRANS_MAT_SAMPLE_RATE_DEFAULT;
+		arc->poseFilterCutoffFreq = cutoffFreq > 0 ? cutoffFreq : AR_FILTER_TRANS_MAT_CUTOFF_FREQ_DEFAULT;
+		// Filters are recreated with the new parameters on the next pose.
+		freePoseFilters(arc);
+		return 0;
 	}
 
-	int getProcessingImage(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return NULL; }
+	int getPoseFilterEnabled(int id) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		return (int)arc->arhandle->labelInfo.bwImage;
+		return arc->poseFilterEnabled;
 	}
 
-	int getDebugMode(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return NULL; }
+	/**
+		Rewrites the poses of the square and NFT markers found by the last detect() in the results
+		arena with their poses predicted at time, for frames rendered between two detections.
+		time is in ms on the clock of performance.now() of the thread running the controller.
+		Needs setPoseFilter(); without it the arena is left as it is. Returns the arena size.
+	*/
+	int predictResults(int id, double time) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		int enable;
+		if (arc->results.empty() || !arc->poseFilterEnabled) {
+			return arc->results.size();
+		}
+		ARdouble *results = arc->results.data();
+		ARdouble trans[3][4];
+		int i;
+
+		ARdouble *r = results + RESULTS_HEADER_SIZE;
+		for (i = 0; i < (int)results[1]; i++, r += RESULTS_SQUARE_SIZE) {
+			int markerType = (int)r[33];
+			std::unordered_map<int, square_marker> &markers = (markerType == BARCODE_MARKER) ? arc->barcodeMarkers : arc->patternMarkers;
+			auto it = markers.find((int)r[34]);
+			if (it != markers.end() && predictPose(&(it->second.filter), time, trans)) {
+				writeTransform(r + 36, trans);
+			}
+		}
 
-		arGetDebugMode(arc->arhandle, &enable);
-		return enable;
-	}
+		r = results + (int)results[4];
+		for (i = 0; i < (int)results[2] && i < arc->nftMarkers.size(); i++, r += RESULTS_NFT_SIZE) {
+			if (r[0] && predictPose(&(arc->nftMarkers[i].filter), time, trans)) {
+				writeTransform(r + 2, trans);
+			}
+		}
 
-	void setImageProcMode(int id, int mode) {
-		if (arControllers.find(id) == arControllers.end()) { return; }
-		arController *arc = &(arControllers[id]);
+		return arc->results.size();
+	}
 
-		int imageProcMode = mode;
-		if (arSetImageProcMode(arc->arhandle, mode) == 0) {
-			ARLOGi("Image proc. mode set to %d.\n", imageProcMode);
+#ifdef AR_SCRATCH_CHECK
+	/**
+		Warns about a detect() call that grew the heap once the controller is warmed up: its
+		per-frame scratch is sized at setup, setCamera() and marker loading, so the steady state
+		only reuses memory. This only checks heap growth, not allocations: a malloc() served from
+		freed blocks goes unnoticed, and as the heap is process-wide, growth by a KPM thread or by
+		another controller of detectBatch() is reported against this one too. The sealed scratch
+		arenas are what asserts.
+	*/
+	void checkScratchHeap(arController *arc, size_t heapBefore) {
+		if (arc->scratchWarmup > 0) {
+			arc->scratchWarmup--;
+			return;
+		}
+		size_t heapAfter = mallinfo().arena;
+		if (heapAfter > heapBefore) {
+			ARLOGw("detect(): Warning: heap grew by %zu bytes after warm-up.\n", heapAfter - heapBefore);
 		}
 	}
+#endif
 
-	int getImageProcMode(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return -1; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Runs square, NFT and multimarker detection on the current frame and writes all results,
+		including poses, into the controller's results arena (see the RESULTS_* layout).
+		Square marker poses use the per-marker widths and continuity state kept by the controller.
+		Returns the arena size in ARdouble elements; the arena is reallocated when the size changes,
+		so its pointer must be fetched again with getResultsPointer().
+	*/
+	int detect(int id) {
+		// detectBatch() runs this on several threads at once, which operator[] does not allow.
+		auto it = arControllers.find(id);
+		if (it == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(it->second);
+
+#ifdef AR_SCRATCH_CHECK
+		size_t heapBefore = mallinfo().arena;
+#endif
+		int size = getResultsSize(arc);
+		if (arc->results.size() != size) {
+			arc->results.resize(size);
+#ifdef AR_SCRATCH_CHECK
+			arc->scratchWarmup = SCRATCH_WARMUP_FRAMES;
+#endif
+		}
+		ARdouble *results = arc->results.data();
+		ARdouble *r;
+		int i, j, k;
+
+		int markerNum = 0;
+		results[0] = detectMarker(id);
+		if (results[0] == 0) {
+			markerNum = arc->arhandle->marker_num;
+		}
 
-		int imageProcMode;
-		if (arGetImageProcMode(arc->arhandle, &imageProcMode) == 0) {
-			return imageProcMode;
+		// Square markers.
+		for (auto it = arc->patternMarkers.begin(); it != arc->patternMarkers.end(); ++it) {
+			it->second.inPrevious = it->second.inCurrent;
+			it->second.inCurrent = false;
+		}
+		for (auto it = arc->barcodeMarkers.begin(); it != arc->barcodeMarkers.end(); ++it) {
+			it->second.inPrevious = it->second.inCurrent;
+			it->second.inCurrent = false;
 		}
 
-		return -1;
-	}
+		r = results + RESULTS_HEADER_SIZE;
+		for (i = 0; i < markerNum; i++, r += RESULTS_SQUARE_SIZE) {
+			ARMarkerInfo *markerInfo = &(arc->arhandle->markerInfo[i]);
+			ARdouble *p = writeMarkerInfo(r, markerInfo);
+
+			int markerType = UNKNOWN_MARKER;
+			int markerId = -1;
+			square_marker *marker;
+			if (markerInfo->idPatt > -1 && (markerInfo->id == markerInfo->idPatt || markerInfo->idMatrix == -1)) {
+				markerType = PATTERN_MARKER;
+				markerId = markerInfo->idPatt;
+				marker = getSquareMarker(arc, arc->patternMarkers, markerId);
+				markerInfo->dir = markerInfo->dirPatt;
+			} else if (markerInfo->idMatrix > -1) {
+				markerType = BARCODE_MARKER;
+				markerId = markerInfo->idMatrix;
+				marker = getSquareMarker(arc, arc->barcodeMarkers, markerId);
+				markerInfo->dir = markerInfo->dirMatrix;
+			} else {
+				marker = getSquareMarker(arc, arc->patternMarkers, -1);
+			}
 
+			ARdouble err;
+			if (markerType != UNKNOWN_MARKER && marker->inPrevious) {
+				err = arGetTransMatSquareCont(arc->ar3DHandle, markerInfo, marker->trans, marker->width, marker->trans);
+			} else {
+				err = arGetTransMatSquare(arc->ar3DHandle, markerInfo, marker->width, marker->trans);
+			}
+			marker->inCurrent = true;
+
+			*(p++) = markerType;
+			*(p++) = markerId;
+			*(p++) = err;
+			if (arc->poseFilterEnabled) {
+				ARdouble trans[3][4];
+				memcpy(trans, marker->trans, sizeof(trans));
+				filterPose(arc, &marker->filter, trans, !marker->inPrevious);
+				writeTransform(p, trans);
+			} else {
+				writeTransform(p, marker->trans);
+			}
+		}
 
+		// NFT markers.
+		r = results + RESULTS_HEADER_SIZE + AR_SQUARE_MAX * RESULTS_SQUARE_SIZE;
+		results[4] = r - results;
+		results[7] = detectNFTMarker(id);
+		for (i = 0; i < arc->nftMarkers.size(); i++, r += RESULTS_NFT_SIZE) {
+			float trans[3][4];
+			float err = -1;
+			int found = trackNFTMarker(arc, i, trans, &err);
+			r[0] = found;
+			r[1] = found ? err : -1;
+			for (j = 0; j < 3; j++) {
+				for (k = 0; k < 4; k++) {
+					r[2 + j * 4 + k] = found ? trans[j][k] : 0;
+				}
+			}
+		}
 
+		// Multimarkers.
+		results[5] = r - results;
+		for (i = 0; i < arc->multi_markers.size(); i++) {
+			ARMultiMarkerInfoT *arMulti = arc->multi_markers[i].multiMarkerHandle;
+			arGetTransMatMultiSquareRobust( arc->ar3DHandle, arc->arhandle->markerInfo, markerNum, arMulti );
+
+			*(r++) = arMulti->marker_num;
+			r = writeTransform(r, arMulti->trans);
+			for (j = 0; j < arMulti->marker_num; j++) {
+				ARMultiEachMarkerInfoT *marker = &(arMulti->marker[j]);
+				*(r++) = marker->visible;
+				*(r++) = marker->patt_id;
+				*(r++) = marker->patt_type;
+				*(r++) = marker->width;
+				r = writeTransform(r, marker->trans);
+			}
+		}
 
-	/*
-	 * Marker processing
-	 */
+		results[1] = markerNum;
+		results[2] = arc->nftMarkers.size();
+		results[3] = arc->multi_markers.size();
+		results[6] = size;
 
-	void matrixCopy(ARdouble src[3][4], ARdouble dst[3][4]) {
-		for (int i=0; i<3; i++) {
-			for (int j=0; j<4; j++) {
-				dst[i][j] = src[i][j];
+#ifdef AR_SCRATCH_CHECK
+		checkScratchHeap(arc, heapBefore);
+#endif
+		return size;
+	}
+
+#ifdef HAVE_THREADS
+	static void *batchThreadMain(THREAD_HANDLE_T *threadHandle) {
+		batch_task *task = (batch_task *)threadGetArg(threadHandle);
+		for (;;) {
+			if (threadStartWait(threadHandle) < 0) break;
+			for (int i = task->first; i < task->count; i += task->stride) {
+				detect(task->ids[i]);
 			}
+			threadEndSignal(threadHandle);
 		}
+		return NULL;
 	}
+#endif
 
-	int getTransMatSquare(int id, int markerIndex, int markerWidth) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Runs detect() on each of the given controllers, whose frames were copied in beforehand.
+		In threaded builds the controllers are spread over a pool of worker threads; otherwise
+		they run in turn. Besides the read-only camera tables, they share the NFT pages of
+		shareNFTMarkers(), whose holds are taken and dropped under sharedSurfaceSetsMutex as the
+		controllers load and evict them. Each controller's results are in its results arena, as
+		after detect(). None may be set up or torn down until this returns. Returns the number of
+		controllers processed, or -1 if one of them does not exist or is listed twice.
+	*/
+	int detectBatch(const std::vector<int> &ids) {
+		for (int i = 0; i < ids.size(); i++) {
+			if (arControllers.find(ids[i]) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+			// Two threads would run detect() on the same controller.
+			if (std::find(ids.begin(), ids.begin() + i, ids[i]) != ids.begin() + i) {
+				ARLOGe("detectBatch(): Error: controller %d listed twice.\n", ids[i]);
+				return -1;
+			}
+		}
+		int count = ids.size();
+
+#ifdef HAVE_THREADS
+		int threadNum = threadGetCPU();
+		if (threadNum > TRACKING_THREAD_POOL_SIZE) threadNum = TRACKING_THREAD_POOL_SIZE;
+		if (batchThreadNum < threadNum - 1) {
+			// Once the controllers hold the whole thread budget, the shares run in turn.
+			int granted = acquireThreads(threadNum - 1 - batchThreadNum);
+			for (; granted > 0; granted--) {
+				THREAD_HANDLE_T *thread = threadInit(batchThreadNum, &batchTasks[batchThreadNum], batchThreadMain);
+				if (thread == NULL) {
+					releaseThreads(granted);
+					break;
+				}
+				batchThreads[batchThreadNum++] = thread;
+			}
+		}
+		// The calling thread takes the first share.
+		int stride = count < batchThreadNum + 1 ? count : batchThreadNum + 1;
+		for (int t = 0; t < stride - 1; t++) {
+			batchTasks[t].ids = ids.data();
+			batchTasks[t].count = count;
+			batchTasks[t].first = t + 1;
+			batchTasks[t].stride = stride;
+			threadStartSignal(batchThreads[t]);
+		}
+		for (int i = 0; i < count; i += (stride > 0 ? stride : 1)) {
+			detect(ids[i]);
+		}
+		for (int t = 0; t < stride - 1; t++) {
+			threadEndWait(batchThreads[t]);
+		}
+#else
+		for (int i = 0; i < count; i++) {
+			detect(ids[i]);
+		}
+#endif
+		return count;
+	}
 
-		if (arc->arhandle->marker_num <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+	/********
+	* Setup *
+	********/
+
+	/**
+		Returns the size in bytes of a width by height frame in the given pixel format,
+		or -1 if the format is not supported.
+	*/
+	int getVideoFrameSize(int width, int height, int format) {
+		int pixelCount = width * height;
+		switch (format) {
+			case AR_PIXEL_FORMAT_RGBA:
+				return pixelCount * 4;
+			case AR_PIXEL_FORMAT_MONO:
+				return pixelCount;
+			case AR_PIXEL_FORMAT_420f:
+			case AR_PIXEL_FORMAT_420v:
+			case AR_PIXEL_FORMAT_NV21:
+				return pixelCount + pixelCount / 2;
+			default:
+				return -1;
+		}
+	}
+
+	/**
+		Sizes the controller's frame buffers for slotNum width by height frames in the given pixel
+		format. The buffers are kept when their sizes are unchanged, so reconfiguring a controller
+		to its current settings allocates nothing.
+	*/
+	int allocFrameBuffers(arController *arc, int width, int height, AR_PIXEL_FORMAT format, int slotNum) {
+		int frameSize = getVideoFrameSize(width, height, format);
+		if (frameSize < 0) {
+			return -1;
+		}
+		bool lumaInPlace = (format != AR_PIXEL_FORMAT_RGBA);
+		bool sameSize = (width == arc->width && height == arc->height);
+
+		if (!arc->videoFrame || !sameSize || frameSize != arc->videoFrameSize || slotNum != arc->frameSlotNum
+				|| lumaInPlace != (arc->videoLuma == arc->videoFrame)) {
+			bool hadROILuma = (arc->roiLuma != NULL);
+			freeFrameBuffers(arc);
+
+			arc->videoFrameSize = frameSize * sizeof(ARUint8);
+			arc->videoFrameSlots = (ARUint8*) malloc(arc->videoFrameSize * slotNum);
+			arc->videoFrame = arc->videoFrameSlots;
+			arc->frameSlotNum = slotNum;
+			// The worker starts on slot 0, the writer on slot 1, and the last slot is ready but not fresh.
+			arc->frameSlot = 0;
+			arc->frameRing[FRAME_RING_READY] = slotNum - 1;
+			arc->frameRing[FRAME_RING_COUNT] = 0;
+			if (lumaInPlace) {
+				arc->videoLuma = arc->videoFrame; // The Y plane.
+			} else {
+				arc->videoLuma = (ARUint8*) malloc(width * height * sizeof(ARUint8));
+			}
+			if (hadROILuma) {
+				arc->roiLuma = (ARUint8*) malloc(width * height);
+			}
+			if (!arc->videoFrame || !arc->videoLuma || (hadROILuma && !arc->roiLuma)) {
+				ARLOGe("allocFrameBuffers(): Error: out of memory.\n");
+				freeFrameBuffers(arc);
+				return -1;
+			}
+			ARLOGi("Allocated videoFrameSize %d\n", arc->videoFrameSize);
 		}
-		ARMarkerInfo* marker = markerIndex < 0 ? &gMarkerInfo : &((arc->arhandle)->markerInfo[markerIndex]);
 
-		arGetTransMatSquare(arc->ar3DHandle, marker, markerWidth, gTransform);
+		arc->width = width;
+		arc->height = height;
+		arc->pixFormat = format;
+		return 0;
+	}
+
+	/**
+		Publishes the controller's frame buffers to JS as artoolkit.frameMalloc. With a video
+		source, framepointer is the source frame, which JS writes, rather than videoFrame.
+	*/
+	void publishFrameMalloc(arController *arc) {
+		EM_ASM_({
+			if (!artoolkit["frameMalloc"]) {
+				artoolkit["frameMalloc"] = ({});
+			}
+			var frameMalloc = artoolkit["frameMalloc"];
+			frameMalloc["framepointer"] = $1;
+			frameMalloc["framesize"] = $2;
+			frameMalloc["camera"] = $3;
+			frameMalloc["transform"] = $4;
+			frameMalloc["videoLumaPointer"] = $5;
+			frameMalloc["results"] = $6;
+			frameMalloc["resultsSize"] = $7;
+			frameMalloc["frameSlots"] = $8;
+			frameMalloc["frameSlotsPointer"] = $9;
+			frameMalloc["frameRing"] = $10;
+		},
+			arc->id,
+			arc->videoSource ? arc->videoSource : arc->videoFrame,
+			arc->videoSource ? arc->videoSourceSize : arc->videoFrameSize,
+			arc->cameraLens,
+			arc->transform,
+			arc->videoLuma,         //$5
+			getResultsPointer(arc->id),
+			(int)arc->results.size(),
+			arc->frameSlotNum,
+			arc->videoFrameSlots,
+			arc->frameRing
+		);
+	}
+
+	/**
+		Gives the controller a ring of FRAME_RING_SLOTS frame buffers, for frames written by
+		another thread sharing the WebAssembly memory, or back a single buffer when enable is 0.
 
-		return 0;
-	}
+		The ring is a triple buffer: the writer owns one slot, this controller another, and the
+		third holds the newest frame. The writer fills its slot and swaps it for the ready one:
+			slot = Atomics.exchange(frameRing, FRAME_RING_READY, slot | FRAME_RING_FRESH) & ~FRAME_RING_FRESH
+		and then counts it in frameRing[FRAME_RING_COUNT] for Atomics.wait(). takeFrameSlot() swaps
+		in the same way on the controller's side, so frames it had no time for are dropped and
+		no frame is copied.
 
-	int getTransMatSquareCont(int id, int markerIndex, int markerWidth) {
+		The frame buffers are reallocated and republished in artoolkit.frameMalloc.
+	*/
+	int setFrameRing(int id, int enable) {
 		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (arc->arhandle->marker_num <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+		if (enable && arc->sourceWidth > 0) {
+			return -1;
+		}
+
+		if (allocFrameBuffers(arc, arc->width, arc->height, arc->pixFormat, enable ? FRAME_RING_SLOTS : 1) < 0) {
+			return -1;
 		}
-		ARMarkerInfo* marker = markerIndex < 0 ? &gMarkerInfo : &((arc->arhandle)->markerInfo[markerIndex]);
 
-		arGetTransMatSquareCont(arc->ar3DHandle, marker, gTransform, markerWidth, gTransform);
+		publishFrameMalloc(arc);
 
 		return 0;
 	}
 
-	int setMarkerInfoDir(int id, int markerIndex, int dir) {
+	/**
+		Makes the newest frame of the ring the controller's videoFrame, giving its current slot
+		back to the writer. Returns the slot of the frame, or -1 if no frame was written since
+		the last call (or the ring is disabled).
+	*/
+	int takeFrameSlot(int id) {
 		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (arc->arhandle->marker_num <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+		if (arc->frameSlotNum == 1 || !(__atomic_load_n(&arc->frameRing[FRAME_RING_READY], __ATOMIC_SEQ_CST) & FRAME_RING_FRESH)) {
+			return -1;
 		}
-		ARMarkerInfo* marker = markerIndex < 0 ? &gMarkerInfo : &((arc->arhandle)->markerInfo[markerIndex]);
-
-		marker->dir = dir;
-
-		return 0;
+		// Only this side clears FRAME_RING_FRESH, so the exchange returns a fresh slot, the newest one.
+		int32_t ready = __atomic_exchange_n(&arc->frameRing[FRAME_RING_READY], arc->frameSlot, __ATOMIC_SEQ_CST);
+		arc->frameSlot = ready & ~FRAME_RING_FRESH;
+		arc->videoFrame = arc->videoFrameSlots + arc->frameSlot * arc->videoFrameSize;
+		if (arc->pixFormat != AR_PIXEL_FORMAT_RGBA) {
+			arc->videoLuma = arc->videoFrame; // The Y plane.
+		}
+		return arc->frameSlot;
 	}
 
-	int setMarkerInfoVertex(int id, int markerIndex) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
-
-		if (arc->arhandle->marker_num <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+	/**
+		Switches the frame buffers and the AR handles to the given pixel format.
+	*/
+	int applyVideoPixelFormat(arController *arc, AR_PIXEL_FORMAT format) {
+		if (getVideoFrameSize(arc->width, arc->height, format) < 0) {
+			ARLOGe("setVideoPixelFormat(): Error: unsupported pixel format %d.\n", format);
+			return -1;
 		}
-		ARMarkerInfo* marker = markerIndex < 0 ? &gMarkerInfo : &((arc->arhandle)->markerInfo[markerIndex]);
 
-		auto v = marker->vertex;
+		if (arc->arhandle && arSetPixelFormat(arc->arhandle, format) < 0) {
+			ARLOGe("setVideoPixelFormat(): Error: arSetPixelFormat.\n");
+			return -1;
+		}
+		if (arc->ar2Handle) {
+			arc->ar2Handle->pixFormat = format;
+		}
 
-		v[0][0] = gTransform[0][0];
-		v[0][1] = gTransform[0][1];
-		v[1][0] = gTransform[0][2];
-		v[1][1] = gTransform[0][3];
-		v[2][0] = gTransform[1][0];
-		v[2][1] = gTransform[1][1];
-		v[3][0] = gTransform[1][2];
-		v[3][1] = gTransform[1][3];
+		return allocFrameBuffers(arc, arc->width, arc->height, format, arc->frameSlotNum);
+	}
 
-		marker->pos[0] = (v[0][0] + v[1][0] + v[2][0] + v[3][0]) * 0.25;
-		marker->pos[1] = (v[0][1] + v[1][1] + v[2][1] + v[3][1]) * 0.25;
+	/**
+		Selects the pixel format of the frames written to videoFrame.
 
-		return 0;
-	}
+		AR_PIXEL_FORMAT_RGBA (the default) frames need prepareFrame() to derive the luma channel.
+		For AR_PIXEL_FORMAT_MONO and the 4:2:0 formats (AR_PIXEL_FORMAT_420f, AR_PIXEL_FORMAT_420v,
+		AR_PIXEL_FORMAT_NV21) the frame starts with the Y plane, which is used as the luma channel
+		in place, without conversion. Only the Y plane is read, so planar I420 frames can be
+		passed as AR_PIXEL_FORMAT_420f too.
 
-	int getTransMatMultiSquareRobust(int id, int multiMarkerId) {
+		The frame buffer is reallocated and republished in artoolkit.frameMalloc.
+	*/
+	int setVideoPixelFormat(int id, int format) {
 		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
-			return MULTIMARKER_NOT_FOUND;
+		// With a video source, its format is set by setVideoSource() and the controller's frames are luma.
+		if (arc->sourceWidth > 0) {
+			return -1;
+		}
+		if (applyVideoPixelFormat(arc, (AR_PIXEL_FORMAT)format) < 0) {
+			return -1;
 		}
-		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
-		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
 
-		arGetTransMatMultiSquareRobust( arc->ar3DHandle, arc->arhandle->markerInfo, arc->arhandle->marker_num, arMulti );
-		matrixCopy(arMulti->trans, gTransform);
+		publishFrameMalloc(arc);
 
 		return 0;
 	}
 
-	int getTransMatMultiSquare(int id, int multiMarkerId) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Rebuilds the sampling tables of the video source for the controller size.
+	*/
+	int updateVideoSource(arController *arc) {
+		arVideoLumaOrientDelete(&arc->sourceOrient);
+		arc->sourceOrient = arVideoLumaOrientCreate(arc->width, arc->height, arc->sourceWidth, arc->sourceHeight,
+			arc->sourceFormat == AR_PIXEL_FORMAT_RGBA, arc->sourceRotation);
+		return arc->sourceOrient ? 0 : -1;
+	}
 
-		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
-			return MULTIMARKER_NOT_FOUND;
+	int detachVideoSource(arController *arc) {
+		if (arc->sourceWidth == 0) {
+			return 0;
 		}
-		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
-		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
-
-		arGetTransMatMultiSquare( arc->ar3DHandle, arc->arhandle->markerInfo, arc->arhandle->marker_num, arMulti );
-		matrixCopy(arMulti->trans, gTransform);
-
+		freeVideoSource(arc);
+		arc->sourceWidth = 0;
+		arc->sourceHeight = 0;
+		if (applyVideoPixelFormat(arc, arc->pixFormatBeforeSource) < 0) {
+			return -1;
+		}
+		publishFrameMalloc(arc);
 		return 0;
 	}
 
-	int detectMarker(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
-
-		// Convert video frame to AR2VideoBufferT
-    AR2VideoBufferT buff = {0};
-    buff.buff = arc->videoFrame;
-    buff.fillFlag = 1;
-
-    buff.buffLuma = arc->videoLuma;
-
-
-		return arDetectMarker( arc->arhandle, &buff);
-	}
-
-
-	int getMarkerNum(int id) {
-		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
-		arController *arc = &(arControllers[id]);
+	/**
+		Takes the frames in camera orientation and resolution: width by height frames in the given
+		pixel format, rotated clockwise by rotation degrees (0, 90, 180 or 270) to the orientation
+		of the controller, are cropped around their centre to its aspect ratio and scaled to its
+		size. prepareFrame() does all of it in the pass that derives the luma channel, so portrait
+		frames need no canvas transform, and the controller's frames become AR_PIXEL_FORMAT_MONO.
+		The camera parameters stay those of the controller size, as for a frame rotated on a canvas.
 
-		return arc->arhandle->marker_num;
-	}
+		width or height 0 detaches the source, back to the pixel format the controller had before.
+		Not available with the frame ring.
 
-	int getMultiEachMarkerInfo(int id, int multiMarkerId, int markerIndex) {
+		The frame buffers are reallocated and republished in artoolkit.frameMalloc.
+	*/
+	int setVideoSource(int id, int width, int height, int rotation, int format) {
 		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (arc->multi_markers.size() <= multiMarkerId || multiMarkerId < 0) {
-			return MULTIMARKER_NOT_FOUND;
+		if (width <= 0 || height <= 0) {
+			return detachVideoSource(arc);
 		}
-		multi_marker *multiMatch = &(arc->multi_markers[multiMarkerId]);
-		ARMultiMarkerInfoT *arMulti = multiMatch->multiMarkerHandle;
 
-		if (arMulti->marker_num <= markerIndex || markerIndex < 0) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
+		int frameSize = getVideoFrameSize(width, height, format);
+		if (frameSize < 0 || (rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270) || arc->frameSlotNum > 1) {
+			return -1;
 		}
-
-		ARMultiEachMarkerInfoT *marker = &(arMulti->marker[markerIndex]);
-		matrixCopy(marker->trans, gTransform);
-
-		EM_ASM_({
-			if (!artoolkit["multiEachMarkerInfo"]) {
-				artoolkit["multiEachMarkerInfo"] = ({});
+		if (arc->sourceWidth == 0) {
+			arc->pixFormatBeforeSource = arc->pixFormat;
+			if (applyVideoPixelFormat(arc, AR_PIXEL_FORMAT_MONO) < 0) {
+				return -1;
 			}
-			var multiEachMarker = artoolkit["multiEachMarkerInfo"];
-			multiEachMarker['visible'] = $0;
-			multiEachMarker['pattId'] = $1;
-			multiEachMarker['pattType'] = $2;
-			multiEachMarker['width'] = $3;
-		},
-			marker->visible,
-			marker->patt_id,
-			marker->patt_type,
-			marker->width
-		);
+		}
+		if (frameSize != arc->videoSourceSize) {
+			free(arc->videoSource);
+			arc->videoSource = (ARUint8*) malloc(frameSize);
+			arc->videoSourceSize = arc->videoSource ? frameSize : 0;
+		}
+		arc->sourceWidth = width;
+		arc->sourceHeight = height;
+		arc->sourceRotation = rotation;
+		arc->sourceFormat = (AR_PIXEL_FORMAT)format;
+#ifdef AR_SCRATCH_CHECK
+		arc->scratchWarmup = SCRATCH_WARMUP_FRAMES;
+#endif
+		if (!arc->videoSource || updateVideoSource(arc) < 0) {
+			ARLOGe("setVideoSource(): Error: out of memory.\n");
+			detachVideoSource(arc);
+			return -1;
+		}
+
+		publishFrameMalloc(arc);
 
 		return 0;
 	}
 
-	int getMarkerInfo(int id, int markerIndex) {
+	int getVideoPixelFormat(int id) {
 		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
 		arController *arc = &(arControllers[id]);
 
-		if (arc->arhandle->marker_num <= markerIndex) {
-			return MARKER_INDEX_OUT_OF_BOUNDS;
-		}
-		ARMarkerInfo* markerInfo = markerIndex < 0 ? &gMarkerInfo : &((arc->arhandle)->markerInfo[markerIndex]);
-
-		EM_ASM_({
-			var $a = arguments;
-			var i = 12;
-			if (!artoolkit["markerInfo"]) {
-				artoolkit["markerInfo"] = ({
-					pos: [0,0],
-					line: [[0,0,0], [0,0,0], [0,0,0], [0,0,0]],
-					vertex: [[0,0], [0,0], [0,0], [0,0]]
-				});
-			}
-			var markerInfo = artoolkit["markerInfo"];
-			markerInfo["area"] = $0;
-			markerInfo["id"] = $1;
-			markerInfo["idPatt"] = $2;
-			markerInfo["idMatrix"] = $3;
-			markerInfo["dir"] = $4;
-			markerInfo["dirPatt"] = $5;
-			markerInfo["dirMatrix"] = $6;
-			markerInfo["cf"] = $7;
-			markerInfo["cfPatt"] = $8;
-			markerInfo["cfMatrix"] = $9;
-			markerInfo["pos"][0] = $10;
-			markerInfo["pos"][1] = $11;
-			markerInfo["line"][0][0] = $a[i++];
-			markerInfo["line"][0][1] = $a[i++];
-			markerInfo["line"][0][2] = $a[i++];
-			markerInfo["line"][1][0] = $a[i++];
-			markerInfo["line"][1][1] = $a[i++];
-			markerInfo["line"][1][2] = $a[i++];
-			markerInfo["line"][2][0] = $a[i++];
-			markerInfo["line"][2][1] = $a[i++];
-			markerInfo["line"][2][2] = $a[i++];
-			markerInfo["line"][3][0] = $a[i++];
-			markerInfo["line"][3][1] = $a[i++];
-			markerInfo["line"][3][2] = $a[i++];
-			markerInfo["vertex"][0][0] = $a[i++];
-			markerInfo["vertex"][0][1] = $a[i++];
-			markerInfo["vertex"][1][0] = $a[i++];
-			markerInfo["vertex"][1][1] = $a[i++];
-			markerInfo["vertex"][2][0] = $a[i++];
-			markerInfo["vertex"][2][1] = $a[i++];
-			markerInfo["vertex"][3][0] = $a[i++];
-			markerInfo["vertex"][3][1] = $a[i++];
-			markerInfo["errorCorrected"] = $a[i++];
-			// markerInfo["globalID"] = $a[i++];
-		},
-			markerInfo->area,
-			markerInfo->id,
-			markerInfo->idPatt,
-			markerInfo->idMatrix,
-			markerInfo->dir,
-			markerInfo->dirPatt,
-			markerInfo->dirMatrix,
-			markerInfo->cf,
-			markerInfo->cfPatt,
-			markerInfo->cfMatrix,
-
-			markerInfo->pos[0],
-			markerInfo->pos[1],
-
-			markerInfo->line[0][0],
-			markerInfo->line[0][1],
-			markerInfo->line[0][2],
-
-			markerInfo->line[1][0],
-			markerInfo->line[1][1],
-			markerInfo->line[1][2],
-
-			markerInfo->line[2][0],
-			markerInfo->line[2][1],
-			markerInfo->line[2][2],
-
-			markerInfo->line[3][0],
-			markerInfo->line[3][1],
-			markerInfo->line[3][2],
-
-			//
-
-			markerInfo->vertex[0][0],
-			markerInfo->vertex[0][1],
-
-			markerInfo->vertex[1][0],
-			markerInfo->vertex[1][1],
-
-			markerInfo->vertex[2][0],
-			markerInfo->vertex[2][1],
-
-			markerInfo->vertex[3][0],
-			markerInfo->vertex[3][1],
-
-			//
-
-			markerInfo->errorCorrected
-
-			// markerInfo->globalID
-		);
-
-		return 0;
+		return arc->pixFormat;
 	}
 
-
-	/********
-	* Setup *
-	********/
-
 	int setup(int width, int height, int cameraID) {
 		int id = gARControllerID++;
 		arController *arc = &(arControllers[id]);
 		arc->id = id;
 
-		arc->width = width;
-		arc->height = height;
-
-		arc->videoFrameSize = width * height * 4 * sizeof(ARUint8);
-		arc->videoFrame = (ARUint8*) malloc(arc->videoFrameSize);
-		arc->videoLuma = (ARUint8*) malloc(arc->videoFrameSize / 4);
+		allocFrameBuffers(arc, width, height, arc->pixFormat, arc->frameSlotNum);
 
 		if ((arc->arPattHandle = arPattCreateHandle()) == NULL) {
 			ARLOGe("setup(): Error: arPattCreateHandle.\n");
@@ -1088,33 +3664,47 @@ extern "C" {
 
 		setCamera(id, cameraID);
 
-		ARLOGi("Allocated videoFrameSize %d\n", arc->videoFrameSize);
+		publishFrameMalloc(arc);
 
-		EM_ASM_({
-			if (!artoolkit["frameMalloc"]) {
-				artoolkit["frameMalloc"] = ({});
+		return arc->id;
+	}
+
+	/**
+		Reconfigures the controller for width by height frames, e.g. for a new scene or camera
+		resolution, without tearing it down. Loaded markers and settings are kept, and the
+		frame buffers and camera tables are only reallocated when the size changes.
+		The frame buffers are republished in artoolkit.frameMalloc.
+	*/
+	int setVideoSize(int id, int width, int height) {
+		if (arControllers.find(id) == arControllers.end()) { return ARCONTROLLER_NOT_FOUND; }
+		arController *arc = &(arControllers[id]);
+
+		if (width <= 0 || height <= 0) {
+			return -1;
+		}
+		if (width != arc->width || height != arc->height) {
+			if (allocFrameBuffers(arc, width, height, arc->pixFormat, arc->frameSlotNum) < 0) {
+				return -1;
 			}
-			var frameMalloc = artoolkit["frameMalloc"];
-			frameMalloc["framepointer"] = $1;
-			frameMalloc["framesize"] = $2;
-			frameMalloc["camera"] = $3;
-			frameMalloc["transform"] = $4;
-			frameMalloc["videoLumaPointer"] = $5;
-		},
-			arc->id,
-			arc->videoFrame,
-			arc->videoFrameSize,
-			arc->cameraLens,
-			gTransform,
-			arc->videoLuma          //$5
-		);
+			// Positions from the previous size say nothing about the next frame.
+			arc->roiMarkers.clear();
+			if (setCamera(id, arc->cameraID) < 0) {
+				return -1;
+			}
+			if (arc->videoSource && updateVideoSource(arc) < 0) {
+				return -1;
+			}
+		}
 
+		publishFrameMalloc(arc);
 
-		return arc->id;
+		return 0;
 	}
 
 
 
 }
 
+#ifdef __EMSCRIPTEN__
 #include "ARBindEM.cpp"
+#endif
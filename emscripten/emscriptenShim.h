@@ -0,0 +1,39 @@
+/*
+ *  emscriptenShim.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __emscriptenShim_H__
+#define __emscriptenShim_H__
+
+#include <stdint.h>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+/*
+ *  Native builds (tools/makenative.js) have no JS side to publish results to, so the EM_ASM
+ *  blocks compile to nothing, arguments included. Native code reads the controller state,
+ *  e.g. the results arena filled by detect(), directly.
+ */
+#define EM_ASM(...)     ((void)0)
+#define EM_ASM_(...)    ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ *  markerROI.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "markerROI.h"
+#include <string.h>
+
+// As applied by arDetectMarker(), which has no constant for it.
+#define ROI_CONFIDENCE_CUTOFF   0.5
+
+// The confidence cutoff arDetectMarker() applies without tracking history.
+static void confidenceCutoff( ARHandle *arHandle )
+{
+    ARMarkerInfo *info;
+    int           cutoff;
+    int           i;
+
+    for( i = 0; i < arHandle->marker_num; i++ ) {
+        info = &(arHandle->markerInfo[i]);
+        switch( arHandle->arPatternDetectionMode ) {
+            case AR_TEMPLATE_MATCHING_COLOR:
+            case AR_TEMPLATE_MATCHING_MONO:
+                if( info->id >= 0 && info->cf < ROI_CONFIDENCE_CUTOFF ) {
+                    info->id = info->idPatt = -1;
+                    info->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_CONFIDENCE;
+                }
+                break;
+            case AR_MATRIX_CODE_DETECTION:
+                if( info->id >= 0 && info->cf < ROI_CONFIDENCE_CUTOFF ) {
+                    info->id = info->idMatrix = -1;
+                    info->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_CONFIDENCE;
+                }
+                break;
+            default:
+                cutoff = 1;
+                if( info->idPatt >= 0 && info->cfPatt < ROI_CONFIDENCE_CUTOFF ) info->idPatt = -1;
+                else cutoff = 0;
+                if( info->idMatrix >= 0 && info->cfMatrix < ROI_CONFIDENCE_CUTOFF ) {
+                    info->idMatrix = -1;
+                    if( cutoff ) info->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_CONFIDENCE;
+                }
+                break;
+        }
+    }
+}
+
+int arDetectMarkerROI( ARHandle *arHandle, AR2VideoBufferT *frame, const int roi[][4], int roiNum, ARUint8 *roiLuma )
+{
+    ARMarkerInfo2 *info2;
+    int            markerNum;
+    int            x, y, xsize, ysize;
+    int            i, j, k;
+
+    if( !arHandle || !frame || !frame->buffLuma || !roiLuma ) return -1;
+    if( arHandle->arImageProcMode != AR_IMAGE_PROC_FRAME_IMAGE ) return -1;
+
+    arHandle->marker_num = 0;
+    for( i = 0; i < roiNum; i++ ) {
+        x = roi[i][0];
+        y = roi[i][1];
+        xsize = roi[i][2];
+        ysize = roi[i][3];
+        if( x < 0 || y < 0 || xsize <= 0 || ysize <= 0 || x + xsize > arHandle->xsize || y + ysize > arHandle->ysize ) return -1;
+
+        for( j = 0; j < ysize; j++ ) {
+            memcpy( roiLuma + j * xsize, frame->buffLuma + (y + j) * arHandle->xsize + x, xsize );
+        }
+
+        if( arLabeling( roiLuma, xsize, ysize, AR_DEBUG_DISABLE, arHandle->arLabelingMode, arHandle->arLabelingThresh,
+                        AR_IMAGE_PROC_FRAME_IMAGE, &(arHandle->labelInfo), NULL ) < 0 ) return -1;
+        if( arDetectMarker2( xsize, ysize, &(arHandle->labelInfo), AR_IMAGE_PROC_FRAME_IMAGE,
+                             AR_AREA_MAX, AR_AREA_MIN, AR_SQUARE_FIT_THRESH, arHandle->markerInfo2, &(arHandle->marker2_num) ) < 0 ) return -1;
+
+        // Move the squares to frame coordinates, where arGetMarkerInfo() undistorts and identifies them.
+        if( arHandle->marker2_num > AR_SQUARE_MAX - arHandle->marker_num ) arHandle->marker2_num = AR_SQUARE_MAX - arHandle->marker_num;
+        for( j = 0; j < arHandle->marker2_num; j++ ) {
+            info2 = &(arHandle->markerInfo2[j]);
+            info2->pos[0] += x;
+            info2->pos[1] += y;
+            for( k = 0; k < info2->coord_num; k++ ) {
+                info2->x_coord[k] += x;
+                info2->y_coord[k] += y;
+            }
+        }
+
+        if( arGetMarkerInfo( frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat,
+                             arHandle->markerInfo2, arHandle->marker2_num, arHandle->pattHandle,
+                             AR_IMAGE_PROC_FRAME_IMAGE, arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf),
+                             arHandle->pattRatio, arHandle->markerInfo + arHandle->marker_num, &markerNum,
+                             arHandle->matrixCodeType ) < 0 ) return -1;
+
+        // markerInfo2 is reused by the next region.
+        for( j = 0; j < markerNum; j++ ) {
+            arHandle->markerInfo[arHandle->marker_num + j].markerInfo2Ptr = NULL;
+        }
+        arHandle->marker_num += markerNum;
+    }
+
+    confidenceCutoff( arHandle );
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ *  markerROI.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __markerROI_H__
+#define __markerROI_H__
+#include <AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Square marker detection of arDetectMarker() restricted to roiNum regions of the frame,
+ *  each given as { x, y, xsize, ysize }. The luma of each region is copied to roiLuma, which
+ *  must hold the largest region, and thresholded and labeled there; the squares found are
+ *  then identified in the full frame, so results match those of a full-frame scan.
+ *
+ *  Results go to arHandle->markerInfo and marker_num with the confidence cutoff of
+ *  AR_NOUSE_TRACKING_HISTORY, and with markerInfo2Ptr set to NULL. The labeling threshold
+ *  is arHandle->arLabelingThresh as last set or computed; the adaptive and bracketing
+ *  threshold modes, field image processing and debug mode are not supported.
+ *  Returns 0, or -1 on error.
+ */
+int arDetectMarkerROI( ARHandle *arHandle, AR2VideoBufferT *frame, const int roi[][4], int roiNum, ARUint8 *roiLuma );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
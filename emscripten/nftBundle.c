@@ -0,0 +1,520 @@
+/*
+ *  nftBundle.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "nftBundle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NFTB_SECTION_MAX        64
+#define NFTB_ALIGN(n)           (((n) + 3) & ~(size_t)3)
+
+static const NFTBundleSectionT *getSections( const ARUint8 *data )
+{
+    return (const NFTBundleSectionT *)(data + sizeof(NFTBundleHeaderT));
+}
+
+static const NFTBundleSectionT *findSection( const ARUint8 *data, uint32_t type )
+{
+    const NFTBundleHeaderT  *header = (const NFTBundleHeaderT *)data;
+    const NFTBundleSectionT *section = getSections( data );
+    uint32_t                 i;
+
+    for( i = 0; i < header->sectionNum; i++ ) {
+        if( section[i].type == type ) return &section[i];
+    }
+    return NULL;
+}
+
+/*
+ *  Returns 1 if the header and section table are valid and within available, 0 if they are
+ *  not all available yet, -1 if they are invalid.
+ */
+static int checkTable( const ARUint8 *data, size_t available )
+{
+    const NFTBundleHeaderT  *header = (const NFTBundleHeaderT *)data;
+    const NFTBundleSectionT *section;
+    size_t                   tableEnd;
+    uint32_t                 i;
+    int                      kpmNum = 0, featuresNum = 0, imageNum = 0;
+
+    if( available < sizeof(NFTBundleHeaderT) ) return 0;
+    if( memcmp( header->magic, NFTB_MAGIC, 4 ) != 0 || header->version != NFTB_VERSION ) return -1;
+    if( header->sectionNum == 0 || header->sectionNum > NFTB_SECTION_MAX ) return -1;
+
+    tableEnd = sizeof(NFTBundleHeaderT) + header->sectionNum * sizeof(NFTBundleSectionT);
+    if( header->size < tableEnd ) return -1;
+    if( available < tableEnd ) return 0;
+
+    section = getSections( data );
+    for( i = 0; i < header->sectionNum; i++ ) {
+        if( section[i].offset % 4 != 0 || section[i].offset < tableEnd
+         || section[i].offset > header->size || section[i].size > header->size - section[i].offset ) return -1;
+        switch( section[i].type ) {
+            case NFTB_SECTION_KPM:
+                kpmNum++;
+                break;
+            case NFTB_SECTION_FEATURES:
+                featuresNum++;
+                break;
+            case NFTB_SECTION_IMAGE:
+                if( section[i].level < 0 || section[i].level >= (int32_t)header->sectionNum
+                 || section[i].xsize <= 0 || section[i].ysize <= 0
+                 || section[i].size != (size_t)section[i].xsize * section[i].ysize ) return -1;
+                imageNum++;
+                break;
+            default:
+                break; // Sections of later versions are skipped.
+        }
+    }
+    if( kpmNum != 1 || featuresNum != 1 || imageNum == 0 ) return -1;
+
+    return 1;
+}
+
+int nftBundleHeadSize( const ARUint8 *data, size_t available )
+{
+    const NFTBundleSectionT *kpm, *features;
+    size_t                   kpmEnd, featuresEnd;
+    int                      result;
+
+    if( (result = checkTable( data, available )) != 1 ) return result;
+
+    kpm = findSection( data, NFTB_SECTION_KPM );
+    features = findSection( data, NFTB_SECTION_FEATURES );
+    kpmEnd = kpm->offset + kpm->size;
+    featuresEnd = features->offset + features->size;
+    return (int)(kpmEnd > featuresEnd ? kpmEnd : featuresEnd);
+}
+
+size_t nftBundleSize( const ARUint8 *data, size_t available )
+{
+    const NFTBundleHeaderT *header = (const NFTBundleHeaderT *)data;
+
+    if( available < sizeof(NFTBundleHeaderT) ) return 0;
+    if( memcmp( header->magic, NFTB_MAGIC, 4 ) != 0 || header->version != NFTB_VERSION ) return 0;
+    return header->size;
+}
+
+KpmRefDataSet *nftBundleReadRefDataSet( const ARUint8 *data, size_t available )
+{
+    const NFTBundleSectionT *section;
+    const NFTBundleKpmT     *kpm;
+    const NFTBundlePageT    *page;
+    const KpmImageInfo      *imageInfo;
+    KpmRefDataSet           *refDataSet;
+    size_t                   size;
+    int                      i;
+
+    if( checkTable( data, available ) != 1 ) return NULL;
+    section = findSection( data, NFTB_SECTION_KPM );
+    if( section->offset + section->size > available || section->size < sizeof(NFTBundleKpmT) ) return NULL;
+
+    kpm = (const NFTBundleKpmT *)(data + section->offset);
+    if( kpm->refPointSize != sizeof(KpmRefData) || kpm->imageInfoSize != sizeof(KpmImageInfo)
+     || kpm->refPointNum < 0 || kpm->pageNum < 0 ) {
+        ARLOGe("NFT bundle KPM data of another layout.\n");
+        return NULL;
+    }
+    size = sizeof(NFTBundleKpmT) + (size_t)kpm->refPointNum * sizeof(KpmRefData) + (size_t)kpm->pageNum * sizeof(NFTBundlePageT);
+    if( size > section->size ) return NULL;
+    page = (const NFTBundlePageT *)((const ARUint8 *)(kpm + 1) + (size_t)kpm->refPointNum * sizeof(KpmRefData));
+    for( i = 0; i < kpm->pageNum; i++ ) {
+        if( page[i].imageNum < 0 ) return NULL;
+        size += (size_t)page[i].imageNum * sizeof(KpmImageInfo);
+    }
+    if( size > section->size ) return NULL;
+    imageInfo = (const KpmImageInfo *)(page + kpm->pageNum);
+
+    if( (refDataSet = (KpmRefDataSet *)calloc( 1, sizeof(KpmRefDataSet) )) == NULL ) return NULL;
+    refDataSet->num = kpm->refPointNum;
+    refDataSet->pageNum = kpm->pageNum;
+    if( kpm->refPointNum > 0 ) {
+        if( (refDataSet->refPoint = (KpmRefData *)malloc( kpm->refPointNum * sizeof(KpmRefData) )) == NULL ) goto bail;
+        memcpy( refDataSet->refPoint, kpm + 1, kpm->refPointNum * sizeof(KpmRefData) );
+    }
+    if( kpm->pageNum > 0 ) {
+        if( (refDataSet->pageInfo = (KpmPageInfo *)calloc( kpm->pageNum, sizeof(KpmPageInfo) )) == NULL ) goto bail;
+        for( i = 0; i < kpm->pageNum; i++ ) {
+            refDataSet->pageInfo[i].pageNo = page[i].pageNo;
+            refDataSet->pageInfo[i].imageNum = page[i].imageNum;
+            if( page[i].imageNum > 0 ) {
+                if( (refDataSet->pageInfo[i].imageInfo = (KpmImageInfo *)malloc( page[i].imageNum * sizeof(KpmImageInfo) )) == NULL ) goto bail;
+                memcpy( refDataSet->pageInfo[i].imageInfo, imageInfo, page[i].imageNum * sizeof(KpmImageInfo) );
+            }
+            imageInfo += page[i].imageNum;
+        }
+    }
+    return refDataSet;
+
+bail:
+    ARLOGe("Out of memory reading NFT bundle KPM data.\n");
+    kpmDeleteRefDataSet( &refDataSet );
+    return NULL;
+}
+
+#if !AR2_CAPABLE_ADAPTIVE_TEMPLATE
+
+static const NFTBundleFeaturePointsT *getFeaturePoints( const ARUint8 *data, const NFTBundleSectionT *section )
+{
+    return (const NFTBundleFeaturePointsT *)(data + section->offset + sizeof(NFTBundleFeaturesT));
+}
+
+AR2SurfaceSetT *nftBundleAdoptSurfaceSet( ARUint8 *data, size_t available )
+{
+    const NFTBundleHeaderT        *header = (const NFTBundleHeaderT *)data;
+    const NFTBundleSectionT       *table, *section;
+    const NFTBundleFeaturesT      *features;
+    const NFTBundleFeaturePointsT *points;
+    AR2SurfaceSetT                *surfaceSet;
+    AR2ImageSetT                  *imageSet;
+    AR2FeatureSetT                *featureSet;
+    ARUint8                       *coord;
+    size_t                         size;
+    uint32_t                       i;
+    int                            imageNum = 0;
+    int                            j, k;
+
+    if( checkTable( data, available ) != 1 ) return NULL;
+    table = getSections( data );
+    section = findSection( data, NFTB_SECTION_FEATURES );
+    if( section->offset + section->size > available || section->size < sizeof(NFTBundleFeaturesT) ) return NULL;
+
+    features = (const NFTBundleFeaturesT *)(data + section->offset);
+    if( features->coordSize != sizeof(AR2FeatureCoordT) || features->listNum <= 0 ) {
+        ARLOGe("NFT bundle features of another layout.\n");
+        return NULL;
+    }
+    for( i = 0; i < header->sectionNum; i++ ) {
+        if( table[i].type == NFTB_SECTION_IMAGE ) imageNum++;
+    }
+    points = getFeaturePoints( data, section );
+    size = sizeof(NFTBundleFeaturesT) + features->listNum * sizeof(NFTBundleFeaturePointsT);
+    if( size > section->size ) return NULL;
+    for( j = 0; j < features->listNum; j++ ) {
+        if( points[j].num < 0 || points[j].scale < 0 || points[j].scale >= imageNum ) return NULL;
+        size += (size_t)points[j].num * sizeof(AR2FeatureCoordT);
+    }
+    if( size > section->size ) return NULL;
+
+    if( (surfaceSet = (AR2SurfaceSetT *)calloc( 1, sizeof(AR2SurfaceSetT) )) == NULL ) return NULL;
+    if( (surfaceSet->surface = (AR2SurfaceT *)calloc( 1, sizeof(AR2SurfaceT) )) == NULL ) goto bail;
+    surfaceSet->num = 1;
+    surfaceSet->contNum = 0;
+    surfaceSet->prevFeature[0].flag = -1;
+    for( j = 0; j < 3; j++ ) {
+        for( k = 0; k < 4; k++ ) {
+            surfaceSet->surface[0].trans[j][k] = surfaceSet->surface[0].itrans[j][k] = (j == k) ? 1.0f : 0.0f;
+        }
+    }
+
+    // Every level is described by the section table; its pixels are added once they arrive.
+    if( (imageSet = (AR2ImageSetT *)calloc( 1, sizeof(AR2ImageSetT) )) == NULL ) goto bail;
+    surfaceSet->surface[0].imageSet = imageSet;
+    if( (imageSet->scale = (AR2ImageT **)calloc( imageNum, sizeof(AR2ImageT *) )) == NULL ) goto bail;
+    imageSet->num = imageNum;
+    for( i = 0; i < header->sectionNum; i++ ) {
+        if( table[i].type != NFTB_SECTION_IMAGE ) continue;
+        if( table[i].level >= imageNum || imageSet->scale[table[i].level] ) goto bail;
+        if( (imageSet->scale[table[i].level] = (AR2ImageT *)calloc( 1, sizeof(AR2ImageT) )) == NULL ) goto bail;
+        imageSet->scale[table[i].level]->xsize = table[i].xsize;
+        imageSet->scale[table[i].level]->ysize = table[i].ysize;
+        imageSet->scale[table[i].level]->dpi = table[i].dpi;
+    }
+
+    if( (featureSet = (AR2FeatureSetT *)calloc( 1, sizeof(AR2FeatureSetT) )) == NULL ) goto bail;
+    surfaceSet->surface[0].featureSet = featureSet;
+    if( (featureSet->list = (AR2FeaturePointsT *)calloc( features->listNum, sizeof(AR2FeaturePointsT) )) == NULL ) goto bail;
+    featureSet->num = features->listNum;
+    coord = (ARUint8 *)(points + features->listNum);
+    for( j = 0; j < features->listNum; j++ ) {
+        featureSet->list[j].coord = (AR2FeatureCoordT *)coord;
+        featureSet->list[j].num = 0; // Until the image level arrives.
+        featureSet->list[j].scale = points[j].scale;
+        featureSet->list[j].maxdpi = points[j].maxdpi;
+        featureSet->list[j].mindpi = points[j].mindpi;
+        coord += points[j].num * sizeof(AR2FeatureCoordT);
+    }
+
+    nftBundleUpdateSurfaceSet( surfaceSet, data, available );
+    return surfaceSet;
+
+bail:
+    ARLOGe("Invalid NFT bundle or out of memory.\n");
+    nftBundleFreeSurfaceSet( &surfaceSet );
+    return NULL;
+}
+
+int nftBundleUpdateSurfaceSet( AR2SurfaceSetT *surfaceSet, ARUint8 *data, size_t available )
+{
+    const NFTBundleHeaderT        *header = (const NFTBundleHeaderT *)data;
+    const NFTBundleSectionT       *table = getSections( data );
+    const NFTBundleFeaturePointsT *points = getFeaturePoints( data, findSection( data, NFTB_SECTION_FEATURES ) );
+    AR2ImageSetT                  *imageSet = surfaceSet->surface[0].imageSet;
+    AR2FeatureSetT                *featureSet = surfaceSet->surface[0].featureSet;
+    uint32_t                       i;
+    int                            j, levels = 0;
+
+    for( i = 0; i < header->sectionNum; i++ ) {
+        if( table[i].type != NFTB_SECTION_IMAGE ) continue;
+        if( !imageSet->scale[table[i].level]->imgBW && table[i].offset + table[i].size <= available ) {
+            imageSet->scale[table[i].level]->imgBW = data + table[i].offset;
+        }
+    }
+    for( j = 0; j < imageSet->num; j++ ) {
+        if( imageSet->scale[j]->imgBW ) levels++;
+    }
+    // AR2 only picks features of the lists with points, so levels still missing are never sampled.
+    for( j = 0; j < featureSet->num; j++ ) {
+        featureSet->list[j].num = imageSet->scale[featureSet->list[j].scale]->imgBW ? points[j].num : 0;
+    }
+
+    return levels;
+}
+
+void nftBundleFreeSurfaceSet( AR2SurfaceSetT **surfaceSet )
+{
+    AR2SurfaceT *surface;
+    int          i;
+
+    if( !surfaceSet || !*surfaceSet ) return;
+    surface = (*surfaceSet)->surface;
+    if( surface ) {
+        // The features and pixels belong to the bundle; only the structures around them are freed.
+        if( surface->imageSet ) {
+            if( surface->imageSet->scale ) {
+                for( i = 0; i < surface->imageSet->num; i++ ) free( surface->imageSet->scale[i] );
+                free( surface->imageSet->scale );
+            }
+            free( surface->imageSet );
+        }
+        if( surface->featureSet ) {
+            free( surface->featureSet->list );
+            free( surface->featureSet );
+        }
+        free( surface );
+    }
+    free( *surfaceSet );
+    *surfaceSet = NULL;
+}
+
+#else
+
+AR2SurfaceSetT *nftBundleAdoptSurfaceSet( ARUint8 *data, size_t available )
+{
+    ARLOGe("NFT bundles hold one image per level, and need AR2_CAPABLE_ADAPTIVE_TEMPLATE off.\n");
+    return NULL;
+}
+
+int nftBundleUpdateSurfaceSet( AR2SurfaceSetT *surfaceSet, ARUint8 *data, size_t available )
+{
+    return -1;
+}
+
+void nftBundleFreeSurfaceSet( AR2SurfaceSetT **surfaceSet )
+{
+}
+
+#endif
+
+static void putBlock( ARUint8 *data, const void *ptr, size_t size, size_t *pos )
+{
+    if( size > 0 && ptr ) memcpy( data + *pos, ptr, size );
+    *pos = NFTB_ALIGN(*pos + size);
+}
+
+static int isBundlePage( const KpmRefDataSet *refDataSet, int i, int pageNo )
+{
+    return pageNo < 0 || refDataSet->pageInfo[i].pageNo == pageNo;
+}
+
+ARUint8 *nftBundleCreate( const KpmRefDataSet *refDataSet, int pageNo, const AR2SurfaceSetT *surfaceSet, size_t *size )
+{
+    AR2ImageSetT            *imageSet;
+    AR2FeatureSetT          *featureSet;
+    NFTBundleHeaderT         header;
+    NFTBundleSectionT       *table;
+    NFTBundleKpmT            kpm;
+    NFTBundleFeaturesT       features;
+    NFTBundleFeaturePointsT  points;
+    NFTBundlePageT           page;
+    ARUint8                 *data;
+    size_t                   offset, pos = 0;
+    uint32_t                 sectionNum, s;
+    int                      refPointNum = 0, pageNum = 0, imageInfoNum = 0, coordNum = 0;
+    int                      i;
+
+    if( surfaceSet->num != 1 ) {
+        ARLOGe("NFT bundles hold a single surface.\n");
+        return NULL;
+    }
+    imageSet = surfaceSet->surface[0].imageSet;
+    featureSet = surfaceSet->surface[0].featureSet;
+
+    for( i = 0; i < refDataSet->num; i++ ) {
+        if( pageNo < 0 || refDataSet->refPoint[i].pageNo == pageNo ) refPointNum++;
+    }
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        if( !isBundlePage( refDataSet, i, pageNo ) ) continue;
+        pageNum++;
+        imageInfoNum += refDataSet->pageInfo[i].imageNum;
+    }
+    if( pageNum == 0 ) {
+        ARLOGe("No KPM data for page %d.\n", pageNo);
+        return NULL;
+    }
+
+    sectionNum = 2 + imageSet->num;
+    if( (table = (NFTBundleSectionT *)calloc( sectionNum, sizeof(NFTBundleSectionT) )) == NULL ) return NULL;
+    offset = NFTB_ALIGN(sizeof(NFTBundleHeaderT) + sectionNum * sizeof(NFTBundleSectionT));
+
+    table[0].type = NFTB_SECTION_KPM;
+    table[0].offset = offset;
+    table[0].size = sizeof(NFTBundleKpmT) + refPointNum * sizeof(KpmRefData)
+                  + pageNum * sizeof(NFTBundlePageT) + imageInfoNum * sizeof(KpmImageInfo);
+    offset = NFTB_ALIGN(offset + table[0].size);
+
+    for( i = 0; i < featureSet->num; i++ ) coordNum += featureSet->list[i].num;
+    table[1].type = NFTB_SECTION_FEATURES;
+    table[1].offset = offset;
+    table[1].size = sizeof(NFTBundleFeaturesT) + featureSet->num * sizeof(NFTBundleFeaturePointsT)
+                  + coordNum * sizeof(AR2FeatureCoordT);
+    offset = NFTB_ALIGN(offset + table[1].size);
+
+    // Coarsest level first, so a streamed bundle is tracked before its finest levels arrive.
+    for( s = 2, i = imageSet->num - 1; i >= 0; s++, i-- ) {
+        table[s].type = NFTB_SECTION_IMAGE;
+        table[s].offset = offset;
+        table[s].size = imageSet->scale[i]->xsize * imageSet->scale[i]->ysize;
+        table[s].level = i;
+        table[s].xsize = imageSet->scale[i]->xsize;
+        table[s].ysize = imageSet->scale[i]->ysize;
+        table[s].dpi = imageSet->scale[i]->dpi;
+        offset = NFTB_ALIGN(offset + table[s].size);
+    }
+
+    // Zeroed, so the padding between blocks is deterministic and equal data hashes equally.
+    if( (data = (ARUint8 *)calloc( offset, 1 )) == NULL ) {
+        free( table );
+        return NULL;
+    }
+
+    memcpy( header.magic, NFTB_MAGIC, 4 );
+    header.version = NFTB_VERSION;
+    header.sectionNum = sectionNum;
+    header.size = offset;
+    putBlock( data, &header, sizeof(header), &pos );
+    putBlock( data, table, sectionNum * sizeof(NFTBundleSectionT), &pos );
+
+    kpm.refPointNum = refPointNum;
+    kpm.refPointSize = sizeof(KpmRefData);
+    kpm.pageNum = pageNum;
+    kpm.imageInfoSize = sizeof(KpmImageInfo);
+    memcpy( data + pos, &kpm, sizeof(kpm) );
+    pos += sizeof(kpm);
+    for( i = 0; i < refDataSet->num; i++ ) {
+        if( pageNo >= 0 && refDataSet->refPoint[i].pageNo != pageNo ) continue;
+        memcpy( data + pos, &refDataSet->refPoint[i], sizeof(KpmRefData) );
+        pos += sizeof(KpmRefData);
+    }
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        if( !isBundlePage( refDataSet, i, pageNo ) ) continue;
+        page.pageNo = refDataSet->pageInfo[i].pageNo;
+        page.imageNum = refDataSet->pageInfo[i].imageNum;
+        memcpy( data + pos, &page, sizeof(page) );
+        pos += sizeof(page);
+    }
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        if( !isBundlePage( refDataSet, i, pageNo ) ) continue;
+        memcpy( data + pos, refDataSet->pageInfo[i].imageInfo, refDataSet->pageInfo[i].imageNum * sizeof(KpmImageInfo) );
+        pos += refDataSet->pageInfo[i].imageNum * sizeof(KpmImageInfo);
+    }
+    pos = NFTB_ALIGN(pos);
+
+    features.listNum = featureSet->num;
+    features.coordSize = sizeof(AR2FeatureCoordT);
+    memcpy( data + pos, &features, sizeof(features) );
+    pos += sizeof(features);
+    for( i = 0; i < featureSet->num; i++ ) {
+        points.num = featureSet->list[i].num;
+        points.scale = featureSet->list[i].scale;
+        points.maxdpi = featureSet->list[i].maxdpi;
+        points.mindpi = featureSet->list[i].mindpi;
+        memcpy( data + pos, &points, sizeof(points) );
+        pos += sizeof(points);
+    }
+    for( i = 0; i < featureSet->num; i++ ) {
+        memcpy( data + pos, featureSet->list[i].coord, featureSet->list[i].num * sizeof(AR2FeatureCoordT) );
+        pos += featureSet->list[i].num * sizeof(AR2FeatureCoordT);
+    }
+    pos = NFTB_ALIGN(pos);
+
+    // Levels freed as unreachable (pruneSurfaceSet() in ARToolKitJS.cpp) have no features, and stay zeroed.
+    for( s = 2; s < sectionNum; s++ ) {
+        putBlock( data, imageSet->scale[table[s].level]->imgBW, table[s].size, &pos );
+    }
+    free( table );
+    if( pos != header.size ) {
+        ARLOGe("NFT bundle size mismatch.\n");
+        free( data );
+        return NULL;
+    }
+
+    *size = header.size;
+    return data;
+}
+
+int nftBundleWrite( const char *datasetPathname, const char *bundlePathname )
+{
+    KpmRefDataSet           *refDataSet = NULL;
+    AR2SurfaceSetT          *surfaceSet = NULL;
+    ARUint8                 *data = NULL;
+    FILE                    *fp = NULL;
+    size_t                   size;
+    int                      ret = -1;
+
+    if( kpmLoadRefDataSet( datasetPathname, "fset3", &refDataSet ) < 0 ) {
+        ARLOGe("Error reading %s.fset3\n", datasetPathname);
+        goto done;
+    }
+    if( (surfaceSet = ar2ReadSurfaceSet( datasetPathname, "fset", NULL )) == NULL ) {
+        ARLOGe("Error reading %s.fset and %s.iset\n", datasetPathname, datasetPathname);
+        goto done;
+    }
+    if( (data = nftBundleCreate( refDataSet, -1, surfaceSet, &size )) == NULL ) goto done;
+
+    if( (fp = fopen( bundlePathname, "wb" )) == NULL ) {
+        ARLOGe("Unable to open %s.\n", bundlePathname);
+        goto done;
+    }
+    if( fwrite( data, 1, size, fp ) != size ) goto done;
+    ret = 0;
+
+done:
+    if( fp ) {
+        if( fclose( fp ) != 0 ) ret = -1;
+        if( ret < 0 ) remove( bundlePathname );
+    }
+    free( data );
+    if( surfaceSet ) ar2FreeSurfaceSet( &surfaceSet );
+    if( refDataSet ) kpmDeleteRefDataSet( &refDataSet );
+    return ret;
+}
@@ -0,0 +1,150 @@
+/*
+ *  nftBundle.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ *  NFT dataset bundle (.nftb): the .fset3, .fset and .iset files of a single page NFT dataset
+ *  in one file, in the in-memory layout of their data, so a bundle read into memory is tracked
+ *  from there without parsing.
+ *
+ *  All fields are little-endian and every block starts 4-byte aligned:
+ *
+ *      NFTBundleHeaderT                             magic "NFTB", version, section count, file size
+ *      NFTBundleSectionT[sectionNum]                section table
+ *      NFTB_SECTION_KPM                             NFTBundleKpmT, KpmRefData[refPointNum],
+ *                                                   NFTBundlePageT[pageNum], KpmImageInfo[imageNum sum]
+ *      NFTB_SECTION_FEATURES                        NFTBundleFeaturesT, NFTBundleFeaturePointsT[listNum],
+ *                                                   AR2FeatureCoordT[num sum]
+ *      NFTB_SECTION_IMAGE, coarsest level first     luma pixels of AR2ImageT level, xsize * ysize
+ *
+ *  As the image levels come last and coarsest first, a bundle being downloaded is tracked as soon
+ *  as the sections before them and one level arrived, with the features of the levels present.
+ */
+
+#ifndef __nftBundle_H__
+#define __nftBundle_H__
+#include <stdint.h>
+#include <AR/ar.h>
+#include <AR2/tracking.h>
+#include <KPM/kpm.h>
+
+#define    NFTB_MAGIC                 "NFTB"
+#define    NFTB_VERSION               1
+
+#define    NFTB_SECTION_KPM           1
+#define    NFTB_SECTION_FEATURES      2
+#define    NFTB_SECTION_IMAGE         3
+
+typedef struct {
+    char      magic[4];
+    uint32_t  version;
+    uint32_t  sectionNum;
+    uint32_t  size;               // Of the whole bundle, in bytes.
+} NFTBundleHeaderT;
+
+typedef struct {
+    uint32_t  type;               // NFTB_SECTION_*.
+    uint32_t  offset;             // From the start of the bundle.
+    uint32_t  size;
+    int32_t   level;              // Image sections: index in AR2ImageSetT scale, 0 is the finest.
+    int32_t   xsize;
+    int32_t   ysize;
+    float     dpi;
+    uint32_t  reserved;
+} NFTBundleSectionT;
+
+typedef struct {
+    int32_t   refPointNum;
+    int32_t   refPointSize;       // sizeof(KpmRefData) of the writer, checked by the reader.
+    int32_t   pageNum;
+    int32_t   imageInfoSize;      // sizeof(KpmImageInfo) of the writer.
+} NFTBundleKpmT;
+
+typedef struct {
+    int32_t   pageNo;
+    int32_t   imageNum;
+} NFTBundlePageT;
+
+typedef struct {
+    int32_t   listNum;
+    int32_t   coordSize;          // sizeof(AR2FeatureCoordT) of the writer.
+} NFTBundleFeaturesT;
+
+typedef struct {
+    int32_t   num;
+    int32_t   scale;
+    float     maxdpi;
+    float     mindpi;
+} NFTBundleFeaturePointsT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Returns the number of bytes from the start of the bundle to the end of its KPM and feature
+ *  sections, the part needed to register the page, once the first available bytes hold the
+ *  whole section table; 0 if they do not yet, or -1 if the bundle is invalid.
+ */
+int             nftBundleHeadSize           ( const ARUint8 *data, size_t available );
+
+/*
+ *  Returns the size of the bundle from its header, or 0 if the header is incomplete or invalid.
+ */
+size_t          nftBundleSize               ( const ARUint8 *data, size_t available );
+
+/*
+ *  Copies the KPM section into a new data set, to be freed with kpmDeleteRefDataSet().
+ */
+KpmRefDataSet  *nftBundleReadRefDataSet     ( const ARUint8 *data, size_t available );
+
+/*
+ *  Builds a surface set whose features and image levels point into data, which must outlive it.
+ *  Only the image levels within the first available bytes, and their features, are used; call
+ *  nftBundleUpdateSurfaceSet() as more of the bundle arrives. Free with nftBundleFreeSurfaceSet(),
+ *  never ar2FreeSurfaceSet().
+ */
+AR2SurfaceSetT *nftBundleAdoptSurfaceSet    ( ARUint8 *data, size_t available );
+
+/*
+ *  Adds the image levels now within the first available bytes of data. Returns the number of
+ *  levels in use, or -1 on error.
+ */
+int             nftBundleUpdateSurfaceSet   ( AR2SurfaceSetT *surfaceSet, ARUint8 *data, size_t available );
+
+void            nftBundleFreeSurfaceSet     ( AR2SurfaceSetT **surfaceSet );
+
+/*
+ *  Lays out the KPM data of page pageNo of refDataSet (all its pages if pageNo < 0) and the
+ *  single surface of surfaceSet as a bundle in a new block of *size bytes, to be freed with
+ *  free(). Padding is zeroed, so the same data always gives the same bytes. Returns NULL on error.
+ */
+ARUint8        *nftBundleCreate             ( const KpmRefDataSet *refDataSet, int pageNo, const AR2SurfaceSetT *surfaceSet, size_t *size );
+
+/*
+ *  Converts the .fset3, .fset and .iset files of datasetPathname (without extension) into
+ *  the bundle bundlePathname. Returns 0, or -1 on error.
+ */
+int             nftBundleWrite              ( const char *datasetPathname, const char *bundlePathname );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,52 @@
+/*
+ *  nftBundleTool.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Converts an NFT dataset (.fset3, .fset and .iset) into a single .nftb bundle, loaded by
+ *  ARController.loadNFTMarkerBundle(). Built with the native benchmark by tools/makenative.js:
+ *      build/native/nft_bundle examples/DataNFT/pinball
+ *  writes examples/DataNFT/pinball.nftb.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "nftBundle.h"
+#include <stdio.h>
+#include <string.h>
+
+int main( int argc, char *argv[] )
+{
+    char  bundlePathname[1024];
+
+    if( argc < 2 || argc > 3 ) {
+        fprintf( stderr, "Usage: %s <dataset, as the path without extension> [<bundle>]\n", argv[0] );
+        return 1;
+    }
+    if( argc == 3 ) {
+        snprintf( bundlePathname, sizeof(bundlePathname), "%s", argv[2] );
+    } else {
+        snprintf( bundlePathname, sizeof(bundlePathname), "%s.nftb", argv[1] );
+    }
+
+    arLogLevel = AR_LOG_LEVEL_ERROR;
+    if( nftBundleWrite( argv[1], bundlePathname ) < 0 ) {
+        fprintf( stderr, "Unable to convert %s.\n", argv[1] );
+        return 1;
+    }
+    printf( "%s\n", bundlePathname );
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *  scratchArena.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "scratchArena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#ifdef AR_SCRATCH_CHECK
+#include <assert.h>
+#endif
+
+ARScratchArenaT *arScratchArenaCreate( size_t size )
+{
+    ARScratchArenaT  *arena;
+
+    if( (arena = (ARScratchArenaT *)calloc(1, sizeof(ARScratchArenaT))) == NULL ) {
+        ARLOGe("Error: malloc\n");
+        return NULL;
+    }
+    if( arScratchArenaReserve(arena, size) < 0 ) {
+        free( arena );
+        return NULL;
+    }
+
+    return arena;
+}
+
+void arScratchArenaDelete( ARScratchArenaT **arena )
+{
+    if( arena == NULL || *arena == NULL ) return;
+
+    free( (*arena)->buf );
+    free( *arena );
+    *arena = NULL;
+}
+
+int arScratchArenaReserve( ARScratchArenaT *arena, size_t size )
+{
+    ARUint8  *buf;
+
+    if( arena == NULL || arena->used != 0 ) return -1;
+    size = AR_SCRATCH_SIZE(size);
+    if( arena->buf && size <= arena->size ) return 0;
+
+    if( (buf = (ARUint8 *)malloc(size + AR_SCRATCH_ALIGN - 1)) == NULL ) {
+        ARLOGe("Error: malloc\n");
+        return -1;
+    }
+    free( arena->buf );
+    arena->buf  = buf;
+    arena->base = (ARUint8 *)AR_SCRATCH_SIZE((uintptr_t)buf);
+    arena->size = size;
+    if( arena->peak < size ) arena->peak = size;
+
+    return 0;
+}
+
+void *arScratchArenaAlloc( ARScratchArenaT *arena, size_t size )
+{
+    void     *block;
+
+    size = AR_SCRATCH_SIZE(size);
+    if( arena->used + size > arena->peak ) arena->peak = arena->used + size;
+    if( arena->size - arena->used < size ) {
+#ifdef AR_SCRATCH_CHECK
+        assert( !arena->sealed );
+#endif
+        return NULL;
+    }
+
+    block = arena->base + arena->used;
+    arena->used += size;
+
+    return block;
+}
+
+size_t arScratchArenaMark( const ARScratchArenaT *arena )
+{
+    return arena->used;
+}
+
+void arScratchArenaRelease( ARScratchArenaT *arena, size_t mark )
+{
+    if( mark < arena->used ) arena->used = mark;
+    // A request that did not fit is served from the next frame on.
+    if( arena->used == 0 && arena->peak > arena->size ) arScratchArenaReserve( arena, arena->peak );
+}
+
+void *arScratchMalloc( ARScratchArenaT *arena, size_t size )
+{
+    void     *block = NULL;
+
+    if( arena ) block = arScratchArenaAlloc( arena, size );
+    if( block == NULL ) block = malloc( size );
+
+    return block;
+}
+
+void arScratchFree( ARScratchArenaT *arena, void *block )
+{
+    if( arena && (ARUint8 *)block >= arena->base && (ARUint8 *)block < arena->base + arena->size ) return;
+    free( block );
+}
+
+void arScratchArenaSeal( ARScratchArenaT *arena, int sealed )
+{
+    arena->sealed = sealed;
+}
@@ -0,0 +1,90 @@
+/*
+ *  scratchArena.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Pre-sized scratch memory for the per-frame path.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __scratchArena_H__
+#define __scratchArena_H__
+#include <stddef.h>
+#include <AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Blocks of an arena are aligned to, and padded to a multiple of, this many bytes.
+#define    AR_SCRATCH_ALIGN            16
+// Space a block of size bytes takes in an arena, for computing the size to reserve.
+#define    AR_SCRATCH_SIZE(size)       (((size_t)(size) + AR_SCRATCH_ALIGN - 1) & ~(size_t)(AR_SCRATCH_ALIGN - 1))
+
+/*
+ *  A bump allocator over one buffer, owned by a single thread at a time. Memory is taken with
+ *  arScratchArenaAlloc() and handed back in bulk by arScratchArenaRelease() to an earlier
+ *  arScratchArenaMark(), so the per-frame path allocates nothing once the buffer is reserved.
+ */
+typedef struct {
+    ARUint8  *buf;                // Allocated buffer, of size + AR_SCRATCH_ALIGN - 1 bytes.
+    ARUint8  *base;               // buf rounded up to AR_SCRATCH_ALIGN.
+    size_t    size;
+    size_t    used;
+    size_t    peak;               // Most ever asked for at once, including what did not fit.
+    int       sealed;             // Set once reserved: with AR_SCRATCH_CHECK, running out asserts.
+} ARScratchArenaT;
+
+/*
+ *  Returns an arena of size bytes (which may be 0), or NULL if out of memory.
+ *  Free with arScratchArenaDelete().
+ */
+ARScratchArenaT *arScratchArenaCreate( size_t size );
+void             arScratchArenaDelete( ARScratchArenaT **arena );
+
+/*
+ *  Grows the buffer of an arena holding no blocks to at least size bytes. Returns 0,
+ *  or -1 if blocks are outstanding or out of memory, leaving the arena as it was.
+ */
+int              arScratchArenaReserve( ARScratchArenaT *arena, size_t size );
+
+/*
+ *  Returns a block of size bytes, or NULL if it does not fit. The shortfall is recorded in
+ *  peak, and the buffer grows to it on the arScratchArenaRelease() that empties the arena.
+ */
+void            *arScratchArenaAlloc( ARScratchArenaT *arena, size_t size );
+size_t           arScratchArenaMark( const ARScratchArenaT *arena );
+void             arScratchArenaRelease( ARScratchArenaT *arena, size_t mark );
+
+/*
+ *  malloc() and free() for code that may run without an arena: arScratchMalloc() takes the block
+ *  from arena, falling back to malloc() if arena is NULL or full, and arScratchFree() frees it if
+ *  it came from malloc(). Blocks from the arena are only handed back by arScratchArenaRelease().
+ */
+void            *arScratchMalloc( ARScratchArenaT *arena, size_t size );
+void             arScratchFree( ARScratchArenaT *arena, void *block );
+
+/*
+ *  Marks the arena as sized for the steady state. Builds with AR_SCRATCH_CHECK defined then
+ *  assert that it never runs out, so a sizing mistake shows instead of a heap allocation.
+ */
+void             arScratchArenaSeal( ARScratchArenaT *arena, int sealed );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
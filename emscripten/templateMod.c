@@ -0,0 +1,411 @@
+/*
+ *  templateMod.c modified version of ar2GetBestMatching()
+ *  from AR2/template.c
+ *  ARToolKit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2015 Daqri, LLC.
+ *  Copyright 2006-2015 ARToolworks, Inc.
+ *
+ *  Author(s): Hirokazu Kato, Philip Lamb
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "templateMod.h"
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#define KEEP_NUM           3
+#define SKIP_INTERVAL      3
+#ifndef AR2_TEMP_SCALE
+#define AR2_TEMP_SCALE     2
+#endif
+
+static int  isLumaFormat( AR_PIXEL_FORMAT pixFormat );
+static void updateCandidate( int x, int y, int wval, int *keep_num, int cx[], int cy[], int cval[] );
+static void ar2GetBestMatchingSubFineMod( ARUint8 *img, int xsize, AR2TemplateT *mtemp, int sx, int sy, int *val );
+static void ar2GetBestMatchingSubFineOptMod( ARUint8 *img, int xsize, int sx, int sy, AR2TemplateT *mtemp,
+                                             int *isum, int *isum2, int cx, int cy, int *val );
+
+int ar2GetBestMatchingMod( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
+                           AR2TemplateT *mtemp, int rx, int ry,
+                           int search[3][2], int *bx, int *by, float *val, ARScratchArenaT *scratch )
+{
+    int        wval, maxval;
+    int        i, j, ii, jj;
+    int        px, py, sx, sy, ex, ey;
+    int        yts1, yts2, xts1, xts2;
+    int        keep_num;
+    int        cx[KEEP_NUM], cy[KEEP_NUM], cval[KEEP_NUM];
+    int       *isum, *isum2;
+    int        isumWidth, isumNum;
+    size_t     mark = 0;
+    int        rowSum[2], rowSum2[2];
+    ARUint8   *p;
+    int       *ps, *ps2, *pw, *pw2;
+    int        flag, ret;
+
+    if( !isLumaFormat(pixFormat) ) {
+        return ar2GetBestMatching( img, mfImage, xsize, ysize, pixFormat, mtemp, rx, ry, search, bx, by, val );
+    }
+
+    yts1 = mtemp->yts1;
+    yts2 = mtemp->yts2;
+    xts1 = mtemp->xts1;
+    xts2 = mtemp->xts2;
+
+    // Clear the visited flags around the search points.
+    for( ii = 0; ii < 3; ii++ ) {
+        if( search[ii][0] < 0 ) break;
+
+        px = (search[ii][0]/(SKIP_INTERVAL+1))*(SKIP_INTERVAL+1) + (SKIP_INTERVAL+1)/2;
+        py = (search[ii][1]/(SKIP_INTERVAL+1))*(SKIP_INTERVAL+1) + (SKIP_INTERVAL+1)/2;
+
+        sx = px - rx;
+        if( sx < 0 ) sx = 0;
+        ex = px + rx;
+        if( ex >= xsize ) ex = xsize-1;
+
+        sy = py - ry;
+        if( sy < 0 ) sy = 0;
+        ey = py + ry;
+        if( ey >= ysize ) ey = ysize-1;
+
+        for( j = sy; j <= ey; j++ ) {
+            p = &mfImage[j*xsize+sx];
+            for( i = sx; i <= ex; i++ ) *(p++) = 0;
+        }
+    }
+
+    // Coarse search on a grid of SKIP_INTERVAL+1 pixels, keeping the best KEEP_NUM candidates.
+    keep_num = 0;
+    flag = 1;
+    for( ii = 0; ii < 3; ii++ ) {
+        if( search[ii][0] < 0 ) {
+            if( flag ) return -1;
+            break;
+        }
+
+        px = (search[ii][0]/(SKIP_INTERVAL+1))*(SKIP_INTERVAL+1) + (SKIP_INTERVAL+1)/2;
+        py = (search[ii][1]/(SKIP_INTERVAL+1))*(SKIP_INTERVAL+1) + (SKIP_INTERVAL+1)/2;
+
+        for( j = py - ry; j <= py + ry; j += SKIP_INTERVAL+1 ) {
+            if( j - yts1*AR2_TEMP_SCALE < 0 ) continue;
+            if( j + yts2*AR2_TEMP_SCALE >= ysize ) break;
+            for( i = px - rx; i <= px + rx; i += SKIP_INTERVAL+1 ) {
+                if( i - xts1*AR2_TEMP_SCALE < 0 ) continue;
+                if( i + xts2*AR2_TEMP_SCALE >= xsize ) break;
+                if( mfImage[j*xsize+i] ) continue;
+                mfImage[j*xsize+i] = 1;
+
+                ar2GetBestMatchingSubFineMod( img, xsize, mtemp, i, j, &wval );
+                updateCandidate( i, j, wval, &keep_num, cx, cy, cval );
+                flag = 0;
+            }
+        }
+    }
+
+    // Fine search in the 7x7 neighbourhood of each candidate.
+    isumWidth = mtemp->xsize*AR2_TEMP_SCALE + 8;
+    isumNum   = isumWidth*(mtemp->ysize*AR2_TEMP_SCALE + 8);
+    if( scratch ) mark = arScratchArenaMark( scratch );
+    isum  = (int *)arScratchMalloc( scratch, sizeof(int)*isumNum );
+    isum2 = (int *)arScratchMalloc( scratch, sizeof(int)*isumNum );
+    if( isum == NULL || isum2 == NULL ) {
+        ARLOGe("Out of memory!!\n");
+        exit(1);
+    }
+
+    maxval = 0;
+    ret = -1;
+    for( ii = 0; ii < keep_num; ii++ ) {
+        sx = cx[ii] - 3 - xts1*AR2_TEMP_SCALE;
+        sy = cy[ii] - 3 - yts1*AR2_TEMP_SCALE;
+        // The integral window spans xsize*AR2_TEMP_SCALE + 6 by ysize*AR2_TEMP_SCALE + 6 pixels from
+        // (sx, sy), AR2_TEMP_SCALE - 1 past the last pixel matched, so it must fit in the frame too.
+        if( mtemp->validNum == mtemp->xsize*mtemp->ysize
+         && sy >= 0 && sy + mtemp->ysize*AR2_TEMP_SCALE + 6 <= ysize
+         && sx >= 0 && sx + mtemp->xsize*AR2_TEMP_SCALE + 6 <= xsize ) {
+            // Template without null pixels: integral images, per pixel parity, of the window
+            // covering the whole neighbourhood, so each position only needs the cross term.
+            for( i = 0; i < isumWidth*2; i++ ) isum[i] = isum2[i] = 0;
+            ps  = isum;
+            ps2 = isum2;
+            pw  = isum  + isumWidth*2;
+            pw2 = isum2 + isumWidth*2;
+            p   = &img[sy*xsize + sx];
+            for( j = 0; j < mtemp->ysize*AR2_TEMP_SCALE + 6; j++ ) {
+                for( i = 0; i < 2; i++ ) {
+                    *(pw++) = *(pw2++) = 0;
+                    rowSum[i] = rowSum2[i] = 0;
+                }
+                ps  += 2;
+                ps2 += 2;
+                for( i = 0; i < mtemp->xsize*AR2_TEMP_SCALE + 6; i++ ) {
+                    rowSum[i&1]  += p[i];
+                    rowSum2[i&1] += p[i] * p[i];
+                    *(pw++)  = *(ps++)  + rowSum[i&1];
+                    *(pw2++) = *(ps2++) + rowSum2[i&1];
+                }
+                p += xsize;
+            }
+
+            for( jj = 0; jj < 7; jj++ ) {
+                for( i = 0; i < 7; i++ ) {
+                    ar2GetBestMatchingSubFineOptMod( img, xsize, sx + i, sy + jj, mtemp, isum, isum2, i + 2, jj + 2, &wval );
+                    if( wval > maxval ) {
+                        maxval = wval;
+                        *bx = cx[ii] + i - 3;
+                        *by = cy[ii] + jj - 3;
+                        *val = (float)wval / 10000;
+                        ret = 0;
+                    }
+                }
+            }
+        }
+        else {
+            for( j = cy[ii] - 3; j <= cy[ii] + 3; j++ ) {
+                if( j - yts1*AR2_TEMP_SCALE < 0 ) continue;
+                if( j + yts2*AR2_TEMP_SCALE >= ysize ) break;
+                for( i = cx[ii] - 3; i <= cx[ii] + 3; i++ ) {
+                    if( i - xts1*AR2_TEMP_SCALE < 0 ) continue;
+                    if( i + xts2*AR2_TEMP_SCALE >= xsize ) break;
+
+                    ar2GetBestMatchingSubFineMod( img, xsize, mtemp, i, j, &wval );
+                    if( wval > maxval ) {
+                        maxval = wval;
+                        *bx = i;
+                        *by = j;
+                        *val = (float)wval / 10000;
+                        ret = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    arScratchFree( scratch, isum );
+    arScratchFree( scratch, isum2 );
+    if( scratch ) arScratchArenaRelease( scratch, mark );
+
+    return ret;
+}
+
+size_t ar2GetBestMatchingScratchSizeMod( const AR2TemplateT *mtemp )
+{
+    size_t     isumNum;
+
+    isumNum = (size_t)(mtemp->xsize*AR2_TEMP_SCALE + 8) * (mtemp->ysize*AR2_TEMP_SCALE + 8);
+    return AR_SCRATCH_SIZE(sizeof(int)*isumNum) * 2;
+}
+
+static int isLumaFormat( AR_PIXEL_FORMAT pixFormat )
+{
+    return( pixFormat == AR_PIXEL_FORMAT_MONO || pixFormat == AR_PIXEL_FORMAT_420v
+         || pixFormat == AR_PIXEL_FORMAT_420f || pixFormat == AR_PIXEL_FORMAT_NV21 );
+}
+
+static void updateCandidate( int x, int y, int wval, int *keep_num, int cx[], int cy[], int cval[] )
+{
+    int    l, m, n;
+
+    if( *keep_num == 0 ) {
+        cx[0] = x;
+        cy[0] = y;
+        cval[0] = wval;
+        *keep_num = 1;
+        return;
+    }
+
+    for( l = 0; l < *keep_num; l++ ) {
+        if( cval[l] < wval ) break;
+    }
+    if( l == *keep_num ) {
+        if( l < KEEP_NUM ) {
+            cx[l] = x;
+            cy[l] = y;
+            cval[l] = wval;
+            (*keep_num)++;
+        }
+        return;
+    }
+
+    if( *keep_num == KEEP_NUM ) {
+        m = KEEP_NUM - 1;
+    }
+    else {
+        m = *keep_num;
+        (*keep_num)++;
+    }
+    for( n = m; n > l; n-- ) {
+        cx[n] = cx[n-1];
+        cy[n] = cy[n-1];
+        cval[n] = cval[n-1];
+    }
+    cx[n] = x;
+    cy[n] = y;
+    cval[n] = wval;
+}
+
+static int matchingValue( AR2TemplateT *mtemp, int sum1, int sum2, int sum3 )
+{
+    int    vlen;
+
+    vlen = sum2 - sum1*sum1/mtemp->validNum;
+    if( vlen == 0 ) return 0;
+
+    return ((sum3 - mtemp->sum*sum1/mtemp->validNum)*100/mtemp->vlen)*100 / (int)sqrt((double)vlen);
+}
+
+#ifdef __wasm_simd128__
+static inline int sumLanes( v128_t v )
+{
+    return wasm_i32x4_extract_lane(v, 0) + wasm_i32x4_extract_lane(v, 1)
+         + wasm_i32x4_extract_lane(v, 2) + wasm_i32x4_extract_lane(v, 3);
+}
+#endif
+
+// Sums over one template row of n pixels, sampled from every AR2_TEMP_SCALE-th byte of p:
+// pixels, squared pixels and pixels times template, skipping the null pixels of the template.
+static inline void rowSums( const ARUint8 *p, const ARUint16 *t, int n, int *sum1, int *sum2, int *sum3 )
+{
+    int    i = 0;
+    int    w;
+
+#ifdef __wasm_simd128__
+    const v128_t lowByte = wasm_i16x8_splat(0xff);
+    const v128_t nullPix = wasm_i16x8_splat(AR2_TEMPLATE_NULL_PIXEL);
+    const v128_t one     = wasm_i16x8_splat(1);
+    v128_t s1 = wasm_i32x4_splat(0);
+    v128_t s2 = wasm_i32x4_splat(0);
+    v128_t s3 = wasm_i32x4_splat(0);
+
+    // Eight pixels per iteration, widened to 16 bits by masking the even bytes, with
+    // the products pairwise added into 32-bit lanes. The 16-byte load reads one byte past
+    // the eighth pixel, so the last pixels of the row are always left to the scalar loop.
+    for( ; i + 8 < n; i += 8 ) {
+        v128_t pv = wasm_v128_and( wasm_v128_load(p + i*AR2_TEMP_SCALE), lowByte );
+        v128_t tv = wasm_v128_load( t + i );
+        v128_t valid = wasm_i16x8_ne( tv, nullPix );
+        pv = wasm_v128_and( pv, valid );
+        tv = wasm_v128_and( tv, valid );
+        s1 = wasm_i32x4_add( s1, wasm_i32x4_dot_i16x8(pv, one) );
+        s2 = wasm_i32x4_add( s2, wasm_i32x4_dot_i16x8(pv, pv) );
+        s3 = wasm_i32x4_add( s3, wasm_i32x4_dot_i16x8(pv, tv) );
+    }
+    *sum1 += sumLanes( s1 );
+    *sum2 += sumLanes( s2 );
+    *sum3 += sumLanes( s3 );
+#endif
+
+    for( ; i < n; i++ ) {
+        if( t[i] != AR2_TEMPLATE_NULL_PIXEL ) {
+            w = p[i*AR2_TEMP_SCALE];
+            *sum1 += w;
+            *sum2 += w * w;
+            *sum3 += w * t[i];
+        }
+    }
+}
+
+// Cross term only, for templates without null pixels.
+static inline int rowSum3( const ARUint8 *p, const ARUint16 *t, int n )
+{
+    int    i = 0;
+    int    sum3 = 0;
+
+#ifdef __wasm_simd128__
+    const v128_t lowByte = wasm_i16x8_splat(0xff);
+    v128_t s3 = wasm_i32x4_splat(0);
+
+    for( ; i + 8 < n; i += 8 ) {
+        v128_t pv = wasm_v128_and( wasm_v128_load(p + i*AR2_TEMP_SCALE), lowByte );
+        s3 = wasm_i32x4_add( s3, wasm_i32x4_dot_i16x8(pv, wasm_v128_load(t + i)) );
+    }
+    sum3 = sumLanes( s3 );
+#endif
+
+    for( ; i < n; i++ ) {
+        sum3 += p[i*AR2_TEMP_SCALE] * t[i];
+    }
+    return sum3;
+}
+
+static void ar2GetBestMatchingSubFineMod( ARUint8 *img, int xsize, AR2TemplateT *mtemp, int sx, int sy, int *val )
+{
+    ARUint8   *p1;
+    ARUint16  *p2;
+    int        sum1, sum2, sum3;
+    int        w, j;
+
+    w  = mtemp->xts1 + mtemp->xts2 + 1;
+    p1 = &img[(sy - mtemp->yts1*AR2_TEMP_SCALE)*xsize + sx - mtemp->xts1*AR2_TEMP_SCALE];
+    p2 = mtemp->img1;
+    sum1 = sum2 = sum3 = 0;
+    for( j = -mtemp->yts1; j <= mtemp->yts2; j++ ) {
+        rowSums( p1, p2, w, &sum1, &sum2, &sum3 );
+        p1 += xsize*AR2_TEMP_SCALE;
+        p2 += w;
+    }
+
+    *val = matchingValue( mtemp, sum1, sum2, sum3 );
+}
+
+static void ar2GetBestMatchingSubFineOptMod( ARUint8 *img, int xsize, int sx, int sy, AR2TemplateT *mtemp,
+                                             int *isum, int *isum2, int cx, int cy, int *val )
+{
+    ARUint8   *p1;
+    ARUint16  *p2;
+    int        sum1, sum2, sum3;
+    int        isumWidth;
+    int        tl, tr, bl, br;
+    int        j;
+
+    p1 = &img[sy*xsize + sx];
+    p2 = mtemp->img1;
+    sum3 = 0;
+    for( j = 0; j < mtemp->ysize; j++ ) {
+        sum3 += rowSum3( p1, p2, mtemp->xsize );
+        p1 += xsize*AR2_TEMP_SCALE;
+        p2 += mtemp->xsize;
+    }
+
+    isumWidth = mtemp->xsize*AR2_TEMP_SCALE + 8;
+    tl = (cy - 2)*isumWidth + cx - 2;
+    tr = tl + mtemp->xsize*AR2_TEMP_SCALE;
+    bl = tl + mtemp->ysize*AR2_TEMP_SCALE*isumWidth;
+    br = bl + mtemp->xsize*AR2_TEMP_SCALE;
+    sum1 = isum[tl]  + isum[br]  - isum[bl]  - isum[tr];
+    sum2 = isum2[tl] + isum2[br] - isum2[bl] - isum2[tr];
+
+    *val = matchingValue( mtemp, sum1, sum2, sum3 );
+}
@@ -0,0 +1,51 @@
+/*
+ *  templateMod.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __templateMod_H__
+#define __templateMod_H__
+#include <AR/ar.h>
+#include <AR2/template.h>
+#include "scratchArena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Drop-in replacement for ar2GetBestMatching() of AR2/template.c, with the same
+ *  arguments and bit-identical results. For the luma pixel formats (MONO, 420v, 420f, NV21)
+ *  the correlation runs on WASM SIMD128 when built with -msimd128; the other
+ *  formats are passed on to ar2GetBestMatching(). The working memory of the fine search is taken
+ *  from scratch, which is released before returning; it is allocated per call if scratch is NULL
+ *  or too small.
+ */
+int ar2GetBestMatchingMod( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
+                           AR2TemplateT *mtemp, int rx, int ry,
+                           int search[3][2], int *bx, int *by, float *val, ARScratchArenaT *scratch );
+/*
+ *  Bytes of scratch ar2GetBestMatchingMod() takes for templates of the size of mtemp.
+ */
+size_t ar2GetBestMatchingScratchSizeMod( const AR2TemplateT *mtemp );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -49,12 +49,41 @@
  #include <AR2/imageSet.h>
  #include <AR2/featureSet.h>
  #include <AR2/template.h>
+ #ifdef __EMSCRIPTEN__
+ #include <emscripten.h>
+ #else
+ #include <time.h>
+ #endif
+ #include "templateMod.h"
+
+// What ar2CreateHandleSubMod() allocates in place of an AR2HandleT, which comes first so the
+// handle can be passed around as an AR2HandleT.
+typedef struct {
+    AR2HandleT        handle;
+    ARScratchArenaT  *matchArena[AR2_THREAD_MAX];  // Template matching scratch of each thread.
+    ARScratchArenaT  *poseArena;                   // Pose estimation scratch, used on the calling thread.
+} AR2HandleModT;
+
+static int    ar2PrepareTemplatesMod( AR2HandleT *ar2Handle );
+static size_t ar2GetPoseScratchSize( int num );
+
+double ar2GetTimeMod( void )
+{
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
 
-AR2HandleT *ar2CreateHandleMod( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat/*, int threadNum*/ )
+AR2HandleT *ar2CreateHandleMod( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat, int threadNum )
 {
     AR2HandleT   *ar2Handle;
 
-    ar2Handle = ar2CreateHandleSubMod( pixFormat, cparamLT->param.xsize, cparamLT->param.ysize/*, threadNum*/ );
+    ar2Handle = ar2CreateHandleSubMod( pixFormat, cparamLT->param.xsize, cparamLT->param.ysize, threadNum );
+    if( ar2Handle == NULL ) return NULL;
 
     ar2Handle->trackingMode      = AR2_TRACKING_6DOF;
     ar2Handle->cparamLT          = cparamLT;
@@ -64,12 +93,18 @@ AR2HandleT *ar2CreateHandleMod( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat/*
     return ar2Handle;
 }
 
-AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int threadNum*/ )
+AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize, int threadNum )
 {
-    AR2HandleT   *ar2Handle;
-    int           i;
-
-    arMalloc(ar2Handle, AR2HandleT, 1);
+    AR2HandleModT *ar2HandleMod;
+    AR2HandleT    *ar2Handle;
+    ARUint8       *mfImages;
+    int            i;
+
+    if( (ar2HandleMod = (AR2HandleModT *)calloc(1, sizeof(AR2HandleModT))) == NULL ) {
+        ARLOGe("Out of memory!!\n");
+        exit(1);
+    }
+    ar2Handle = &(ar2HandleMod->handle);
     ar2Handle->pixFormat         = pixFormat;
     ar2Handle->xsize             = xsize;
     ar2Handle->ysize             = ysize;
@@ -87,24 +122,265 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
     ar2Handle->simThresh         = AR2_DEFAULT_SIM_THRESH;
     ar2Handle->trackingThresh    = AR2_DEFAULT_TRACKING_THRESH;
 
+#ifdef HAVE_THREADS
+    if( threadNum > AR2_THREAD_MAX ) threadNum = AR2_THREAD_MAX;
+    if( threadNum < 1 ) threadNum = 1;
+#else
+    threadNum = 1;
+#endif
+    ar2Handle->threadNum = threadNum;
+    ARLOGi("Tracking thread = %d\n", ar2Handle->threadNum);
 
-    ar2Handle->threadNum = 1;
-
+    // The threads share a single block of match flags, each using its own frame-sized part.
+    arMalloc( mfImages, ARUint8, xsize*ysize*ar2Handle->threadNum );
     for( i = 0; i < ar2Handle->threadNum; i++ ) {
-        arMalloc( ar2Handle->arg[i].mfImage, ARUint8, xsize*ysize );
+        ar2Handle->arg[i].mfImage = mfImages + xsize*ysize*i;
         ar2Handle->arg[i].templ = NULL;
-//        ar2Handle->threadHandle[i] = threadInit(i, &(ar2Handle->arg[i]), ar2Tracking2d);
+        if( (ar2HandleMod->matchArena[i] = arScratchArenaCreate( 0 )) == NULL ) {
+            ARLOGe("Error: unable to create the matching scratch arena of thread %d.\n", i);
+        }
+        ar2Handle->threadHandle[i] = NULL;
+#ifdef HAVE_THREADS
+        // A single thread gains nothing from a worker, so ar2TrackingMod() runs it inline.
+        if( ar2Handle->threadNum > 1 ) {
+            ar2Handle->threadHandle[i] = threadInit(i, &(ar2Handle->arg[i]), ar2Tracking2dMod);
+        }
+#endif
+    }
+    ar2HandleMod->poseArena = arScratchArenaCreate( ar2GetPoseScratchSize(AR2_SEARCH_FEATURE_MAX) );
+    if( ar2HandleMod->poseArena == NULL ) {
+        ARLOGe("Error: unable to create the pose scratch arena.\n");
+        ar2DeleteHandleMod( &ar2Handle );
+        return NULL;
+    }
+    arScratchArenaSeal( ar2HandleMod->poseArena, 1 );
+    // Fails on a missing matching arena too.
+    if( ar2PrepareTemplatesMod( ar2Handle ) < 0 ) {
+        ARLOGe("Error: unable to prepare the tracking templates.\n");
+        ar2DeleteHandleMod( &ar2Handle );
+        return NULL;
     }
 
     return ar2Handle;
 }
 
+int ar2DeleteHandleMod( AR2HandleT **ar2Handle )
+{
+    AR2HandleModT *ar2HandleMod;
+    int            i;
+
+    if( ar2Handle == NULL || *ar2Handle == NULL ) return -1;
+    ar2HandleMod = (AR2HandleModT *)*ar2Handle;
+
+    for( i = 0; i < (*ar2Handle)->threadNum; i++ ) {
+#ifdef HAVE_THREADS
+        if( (*ar2Handle)->threadHandle[i] ) {
+            threadWaitQuit( (*ar2Handle)->threadHandle[i] );
+            threadFree( &((*ar2Handle)->threadHandle[i]) );
+        }
+#endif
+        if( (*ar2Handle)->arg[i].templ ) ar2FreeTemplate( (*ar2Handle)->arg[i].templ );
+        arScratchArenaDelete( &(ar2HandleMod->matchArena[i]) );
+    }
+    free( (*ar2Handle)->arg[0].mfImage );
+    arScratchArenaDelete( &(ar2HandleMod->poseArena) );
+
+    if( (*ar2Handle)->icpHandle ) icpDeleteHandle( &((*ar2Handle)->icpHandle) );
+
+    free( *ar2Handle );
+    *ar2Handle = NULL;
+
+    return 0;
+}
+
+int ar2SetTemplateSizeMod( AR2HandleT *ar2Handle, int templateSize1, int templateSize2 )
+{
+    int           i;
+
+    if( ar2Handle == NULL ) return -1;
+    if( ar2Handle->templateSize1 == templateSize1 && ar2Handle->templateSize2 == templateSize2 ) return 0;
+
+    ar2Handle->templateSize1 = templateSize1;
+    ar2Handle->templateSize2 = templateSize2;
+    for( i = 0; i < ar2Handle->threadNum; i++ ) {
+        if( ar2Handle->arg[i].templ ) {
+            ar2FreeTemplate( ar2Handle->arg[i].templ );
+            ar2Handle->arg[i].templ = NULL;
+        }
+    }
+
+    return ar2PrepareTemplatesMod( ar2Handle );
+}
+
+ARScratchArenaT *ar2GetScratchArenaMod( AR2HandleT *ar2Handle, int thread )
+{
+    if( ar2Handle == NULL || thread < 0 || thread >= ar2Handle->threadNum ) return NULL;
+    return ((AR2HandleModT *)ar2Handle)->matchArena[thread];
+}
+
+// Generates the template of each thread at the current template size, and sizes its scratch
+// arena for matching it, so ar2Tracking2dSub() neither generates nor allocates.
+static int ar2PrepareTemplatesMod( AR2HandleT *ar2Handle )
+{
+    ARScratchArenaT *arena;
+    int              i;
+
+    for( i = 0; i < ar2Handle->threadNum; i++ ) {
+        if( ar2Handle->arg[i].templ == NULL ) {
+            ar2Handle->arg[i].templ = ar2GenTemplate( ar2Handle->templateSize1, ar2Handle->templateSize2 );
+            if( ar2Handle->arg[i].templ == NULL ) return -1;
+        }
+        if( (arena = ((AR2HandleModT *)ar2Handle)->matchArena[i]) == NULL ) return -1;
+        if( arScratchArenaReserve( arena, ar2GetBestMatchingScratchSizeMod(ar2Handle->arg[i].templ) ) < 0 ) return -1;
+        arScratchArenaSeal( arena, 1 );
+    }
+
+    return 0;
+}
+
+// Bytes of the pose arena taken by a fit of num points, the most of ar2GetTransMat(),
+// ar2GetTransMatHomography2() and ar2GetTransMatHomographyRobust().
+static size_t ar2GetPoseScratchSize( int num )
+{
+    size_t     icpSize, homographySize, robustSize;
+
+    icpSize        = AR_SCRATCH_SIZE(sizeof(ICP2DCoordT)*num) + AR_SCRATCH_SIZE(sizeof(ICP3DCoordT)*num);
+    homographySize = AR_SCRATCH_SIZE(sizeof(float)*16*num) + AR_SCRATCH_SIZE(sizeof(float)*2*num);
+    robustSize     = homographySize + AR_SCRATCH_SIZE(sizeof(float)*num)*2;
+
+    if( icpSize > robustSize ) return icpSize;
+    return robustSize;
+}
+
+int ar2SetTrackingModeMod( AR2HandleT *ar2Handle, int trackingMode )
+{
+    if( ar2Handle == NULL ) return -1;
+    if( trackingMode != AR2_TRACKING_6DOF && trackingMode != AR2_TRACKING_HOMOGRAPHY ) return -1;
+    // The homography mode still needs the camera parameters to convert poses.
+    if( ar2Handle->cparamLT == NULL ) return -1;
+
+    ar2Handle->trackingMode = trackingMode;
+
+    return 0;
+}
+
+int ar2PoseToHomographyMod( const ARParamLT *cparamLT, const float  pose[3][4], float  homography[3][4] )
+{
+    float         h[3][4];
+    int           i, j;
+
+    if( cparamLT == NULL ) return -1;
+
+    // H = K [r1 r2 r3 t], of which the homography uses the columns of r1, r2 and t.
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 4; i++ ) {
+            h[j][i] = (float)( cparamLT->param.mat[j][0] * pose[0][i]
+                             + cparamLT->param.mat[j][1] * pose[1][i]
+                             + cparamLT->param.mat[j][2] * pose[2][i] );
+        }
+        h[j][3] += (float)cparamLT->param.mat[j][3];
+    }
+    if( h[2][3] == 0.0F ) return -1;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 4; i++ ) homography[j][i] = h[j][i] / h[2][3];
+    }
+
+    return 0;
+}
+
+int ar2HomographyToPoseMod( const ARParamLT *cparamLT, const float  homography[3][4], float  pose[3][4] )
+{
+    ARdouble      k[3][3], kinv[3][3];
+    ARdouble      col[3][3];        // K^-1 h1, K^-1 h2, K^-1 h3.
+    ARdouble      r1[3], r2[3], r3[3], t[3];
+    ARdouble      det, l1, l2, lambda, d;
+    int           i, j;
+
+    if( cparamLT == NULL ) return -1;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) k[j][i] = cparamLT->param.mat[j][i];
+    }
+    det = k[0][0] * (k[1][1] * k[2][2] - k[1][2] * k[2][1])
+        - k[0][1] * (k[1][0] * k[2][2] - k[1][2] * k[2][0])
+        + k[0][2] * (k[1][0] * k[2][1] - k[1][1] * k[2][0]);
+    if( det == 0.0 ) return -1;
+    kinv[0][0] =  (k[1][1] * k[2][2] - k[1][2] * k[2][1]) / det;
+    kinv[0][1] = -(k[0][1] * k[2][2] - k[0][2] * k[2][1]) / det;
+    kinv[0][2] =  (k[0][1] * k[1][2] - k[0][2] * k[1][1]) / det;
+    kinv[1][0] = -(k[1][0] * k[2][2] - k[1][2] * k[2][0]) / det;
+    kinv[1][1] =  (k[0][0] * k[2][2] - k[0][2] * k[2][0]) / det;
+    kinv[1][2] = -(k[0][0] * k[1][2] - k[0][2] * k[1][0]) / det;
+    kinv[2][0] =  (k[1][0] * k[2][1] - k[1][1] * k[2][0]) / det;
+    kinv[2][1] = -(k[0][0] * k[2][1] - k[0][1] * k[2][0]) / det;
+    kinv[2][2] =  (k[0][0] * k[1][1] - k[0][1] * k[1][0]) / det;
+
+    for( j = 0; j < 3; j++ ) {
+        col[0][j] = kinv[j][0] * homography[0][0] + kinv[j][1] * homography[1][0] + kinv[j][2] * homography[2][0];
+        col[1][j] = kinv[j][0] * homography[0][1] + kinv[j][1] * homography[1][1] + kinv[j][2] * homography[2][1];
+        col[2][j] = kinv[j][0] * (homography[0][3] - cparamLT->param.mat[0][3])
+                  + kinv[j][1] * (homography[1][3] - cparamLT->param.mat[1][3])
+                  + kinv[j][2] * (homography[2][3] - cparamLT->param.mat[2][3]);
+    }
+
+    // The scale is the mean length of the first two columns, with the sign putting the marker
+    // in front of the camera.
+    l1 = sqrt( col[0][0]*col[0][0] + col[0][1]*col[0][1] + col[0][2]*col[0][2] );
+    l2 = sqrt( col[1][0]*col[1][0] + col[1][1]*col[1][1] + col[1][2]*col[1][2] );
+    if( l1 == 0.0 || l2 == 0.0 ) return -1;
+    lambda = 2.0 / (l1 + l2);
+    if( col[2][2] < 0.0 ) lambda = -lambda;
+    for( j = 0; j < 3; j++ ) {
+        r1[j] = col[0][j] * lambda;
+        r2[j] = col[1][j] * lambda;
+        t[j]  = col[2][j] * lambda;
+    }
+
+    // Noise leaves r1 and r2 slightly skewed: split the error between them, which is only exact to
+    // first order, then make the rotation orthonormal: r3 is r1 x r2 normalised, and r2 = r3 x r1.
+    d = (r1[0]*r2[0] + r1[1]*r2[1] + r1[2]*r2[2]) / 2.0;
+    for( j = 0; j < 3; j++ ) {
+        ARdouble a = r1[j] - d * r2[j];
+        ARdouble b = r2[j] - d * r1[j];
+        r1[j] = a;
+        r2[j] = b;
+    }
+    l1 = sqrt( r1[0]*r1[0] + r1[1]*r1[1] + r1[2]*r1[2] );
+    if( l1 == 0.0 ) return -1;
+    for( j = 0; j < 3; j++ ) r1[j] /= l1;
+    r3[0] = r1[1]*r2[2] - r1[2]*r2[1];
+    r3[1] = r1[2]*r2[0] - r1[0]*r2[2];
+    r3[2] = r1[0]*r2[1] - r1[1]*r2[0];
+    l2 = sqrt( r3[0]*r3[0] + r3[1]*r3[1] + r3[2]*r3[2] );
+    if( l2 == 0.0 ) return -1;
+    for( j = 0; j < 3; j++ ) r3[j] /= l2;
+    r2[0] = r3[1]*r1[2] - r3[2]*r1[1];
+    r2[1] = r3[2]*r1[0] - r3[0]*r1[2];
+    r2[2] = r3[0]*r1[1] - r3[1]*r1[0];
+
+    for( j = 0; j < 3; j++ ) {
+        pose[j][0] = (float)r1[j];
+        pose[j][1] = (float)r2[j];
+        pose[j][2] = (float)r3[j];
+        pose[j][3] = (float)t[j];
+    }
+
+    return 0;
+}
+
  static float  ar2GetTransMat            ( ICPHandleT *icpHandle, float  initConv[3][4],
-                                           float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], int robustMode );
+                                           float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], int robustMode,
+                                           ARScratchArenaT *scratch );
  static float  ar2GetTransMatHomography        ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num,
-                                           float  conv[3][4], int robustMode, float inlierProb );
- static float  ar2GetTransMatHomography2       ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4] );
- static float  ar2GetTransMatHomographyRobust  ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], float inlierProb );
+                                           float  conv[3][4], int robustMode, float inlierProb, int maxLoop,
+                                           ARScratchArenaT *scratch );
+ static float  ar2GetTransMatHomography2       ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], int maxLoop,
+                                                 ARScratchArenaT *scratch );
+ static float  ar2GetTransMatHomographyRobust  ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], float inlierProb, int maxLoop,
+                                                 ARScratchArenaT *scratch );
+ static float  getInlierProb                   ( ICPHandleT *icpHandle, float  trans[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  thresh );
+ static float  getInlierProbHomography         ( float  conv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  thresh );
  static int    extractVisibleFeatures    ( const ARParamLT *cparamLT, const float  trans1[][3][4], AR2SurfaceSetT *surfaceSet,
                                            AR2TemplateCandidateT candidate[],
                                            AR2TemplateCandidateT candidate2[] );
@@ -113,7 +389,17 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
                                            AR2TemplateCandidateT candidate2[] );
  static int    getDeltaS( float  H[8], float  dU[], float  J_U_H[][8], int n );
 
+ // Inlier probabilities of the robust passes of AR2_POSE_CASCADE.
+ #define     RETRY_NUM     4
+ static const float  retryInlierProb[RETRY_NUM] = { 0.8F, 0.6F, 0.4F, 0.0F };
+
  int ar2TrackingMod( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr, float  trans[3][4], float  *err )
+ {
+     return ar2TrackingModEx( ar2Handle, surfaceSet, dataPtr, trans, err, NULL, NULL );
+ }
+
+ int ar2TrackingModEx( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr, float  trans[3][4], float  *err,
+                       const AR2PoseParamT *poseParam, AR2TrackingStatsT *stats )
  {
      AR2TemplateCandidateT  *candidatePtr;
      AR2TemplateCandidateT  *cp[AR2_THREAD_MAX];
@@ -122,6 +408,10 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
  #endif
      int                     num, num2;
      int                     i, j, k;
+     double                  t0 = 0.0, t1;
+     int                     poseMode = poseParam ? poseParam->mode : AR2_POSE_CASCADE;
+     int                     maxLoop = (poseParam && poseParam->maxLoop > 0) ? poseParam->maxLoop : ICP_MAX_LOOP;
+     ARScratchArenaT        *poseArena;
 
      if (!ar2Handle || !surfaceSet || !dataPtr || !trans || !err) return (-1);
 
@@ -131,6 +421,8 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      }
 
      *err = 0.0F;
+     poseArena = ((AR2HandleModT *)ar2Handle)->poseArena;
+     if( stats ) t0 = ar2GetTimeMod();
 
      for( i = 0; i < surfaceSet->num; i++ ) {
          arUtilMatMulf( (const float (*)[4])surfaceSet->trans1, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans1[i] );
@@ -145,6 +437,12 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
          extractVisibleFeaturesHomography(ar2Handle->xsize, ar2Handle->ysize, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
      }
 
+     if( stats ) {
+         t1 = ar2GetTimeMod();
+         stats->extractMs += t1 - t0;
+         t0 = t1;
+     }
+
      candidatePtr = ar2Handle->candidate;
  #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
      aveBlur = 0.0F;
@@ -174,7 +472,9 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
              ar2Handle->arg[j].candidate  = &(candidatePtr[k]);
              ar2Handle->arg[j].dataPtr    = dataPtr;
 
-            // threadStartSignal( ar2Handle->threadHandle[j] );
+#ifdef HAVE_THREADS
+             if( ar2Handle->threadHandle[j] ) threadStartSignal( ar2Handle->threadHandle[j] );
+#endif
              num2++;
              if( num2 == 5 ) num2 = num;
              i++;
@@ -183,12 +483,18 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
          if( k == 0 ) break;
 
          for( j = 0; j < k; j++ ) {
+#ifdef HAVE_THREADS
+             if( ar2Handle->threadHandle[j] ) {
+                 threadEndWait( ar2Handle->threadHandle[j] );
+             }
+             else
+#endif
              {
                  AR2Tracking2DParamT* arg = &ar2Handle->arg[j];
                  arg->ret = ar2Tracking2dSub(arg->ar2Handle, arg->surfaceSet, arg->candidate,
-                                             arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->result));
+                                             arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->result),
+                                             ar2GetScratchArenaMod(ar2Handle, j));
              }
-             //threadEndWait( ar2Handle->threadHandle[j] );
 
              if( ar2Handle->arg[j].ret == 0 && ar2Handle->arg[j].result.sim > ar2Handle->simThresh ) {
                  if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
@@ -225,78 +531,76 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
              }
          }
      }
+     if( stats ) stats->featuresAttempted += i;
      for( i = 0; i < num; i++ ) {
          surfaceSet->prevFeature[i] = ar2Handle->usedFeature[i];
      }
      surfaceSet->prevFeature[num].flag = -1;
  //ARLOG("------\nNum = %d\n", num);
+     if( stats ) {
+         t1 = ar2GetTimeMod();
+         stats->matchMs += t1 - t0;
+         stats->featuresAccepted += num;
+         t0 = t1;
+     }
 
+     if( num < 3 ) {
+         surfaceSet->contNum = 0;
+         return -3;
+     }
+
+     // The first pass is a plain least squares fit from the last pose. If its error is too high,
+     // AR2_POSE_CASCADE refits with the robust estimator, letting in fewer inliers each time, while
+     // AR2_POSE_ROBUST runs the robust estimator once, with an inlier probability taken from the
+     // reprojection residuals of the first pass.
      if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
-         if( num < 3 ) {
-             surfaceSet->contNum = 0;
-             return -3;
-         }
-         *err = ar2GetTransMat( ar2Handle->icpHandle, surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0 );
+         icpSetMaxLoop( ar2Handle->icpHandle, maxLoop );
+         *err = ar2GetTransMat( ar2Handle->icpHandle, surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0, poseArena );
  //ARLOG("outlier  0%%: err = %f, num = %d\n", *err, num);
          if( *err > ar2Handle->trackingThresh ) {
-             icpSetInlierProbability( ar2Handle->icpHandle, 0.8F );
-             *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
- //ARLOG("outlier 20%%: err = %f, num = %d\n", *err, num);
-             if( *err > ar2Handle->trackingThresh ) {
-                 icpSetInlierProbability( ar2Handle->icpHandle, 0.6F );
-                 *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
- //ARLOG("outlier 60%%: err = %f, num = %d\n", *err, num);
-                 if( *err > ar2Handle->trackingThresh ) {
-                     icpSetInlierProbability( ar2Handle->icpHandle, 0.4F );
-                     *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
- //ARLOG("outlier 60%%: err = %f, num = %d\n", *err, num);
-                     if( *err > ar2Handle->trackingThresh ) {
-                         icpSetInlierProbability( ar2Handle->icpHandle, 0.0F );
-                         *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
- //ARLOG("outlier Max: err = %f, num = %d\n", *err, num);
-                         if( *err > ar2Handle->trackingThresh ) {
-                             surfaceSet->contNum = 0;
- #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-                             if( ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) ar2Handle->blurLevel = AR2_DEFAULT_BLUR_LEVEL; // Reset the blurLevel.
- #endif
-                             return -4;
-                         }
-                     }
+             if( poseMode == AR2_POSE_ROBUST ) {
+                 icpSetInlierProbability( ar2Handle->icpHandle,
+                                          getInlierProb( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, ar2Handle->trackingThresh ) );
+                 *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, poseArena );
+                 if( stats ) stats->icpRetries++;
+             }
+             else {
+                 for( k = 0; k < RETRY_NUM && *err > ar2Handle->trackingThresh; k++ ) {
+                     icpSetInlierProbability( ar2Handle->icpHandle, retryInlierProb[k] );
+                     *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, poseArena );
+                     if( stats ) stats->icpRetries++;
+ //ARLOG("outlier %2d%%: err = %f, num = %d\n", (int)(100 * (1.0F - retryInlierProb[k])), *err, num);
                  }
              }
          }
      }
      else {
-         if( num < 3 ) {
-             surfaceSet->contNum = 0;
-             return -3;
-         }
-         *err = ar2GetTransMatHomography( surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0, 1.0F );
+         *err = ar2GetTransMatHomography( surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0, 1.0F, maxLoop, poseArena );
  //ARLOG("outlier  0%%: err = %f, num = %d\n", *err, num);
          if( *err > ar2Handle->trackingThresh ) {
-             *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.8F );
- //ARLOG("outlier 20%%: err = %f, num = %d\n", *err, num);
-             if( *err > ar2Handle->trackingThresh ) {
-                 *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.6F );
- //ARLOG("outlier 40%%: err = %f, num = %d\n", *err, num);
-                 if( *err > ar2Handle->trackingThresh ) {
-                     *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.4F );
- //ARLOG("outlier 60%%: err = %f, num = %d\n", *err, num);
-                     if( *err > ar2Handle->trackingThresh ) {
-                         *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.0F );
- //ARLOG("outlier Max: err = %f, num = %d\n", *err, num);
-                         if( *err > ar2Handle->trackingThresh ) {
-                             surfaceSet->contNum = 0;
- #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-                             if( ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) ar2Handle->blurLevel = AR2_DEFAULT_BLUR_LEVEL; // Reset the blurLevel.
- #endif
-                             return -4;
-                         }
-                     }
+             if( poseMode == AR2_POSE_ROBUST ) {
+                 *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1,
+                                                  getInlierProbHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, ar2Handle->trackingThresh ), maxLoop,
+                                                  poseArena );
+                 if( stats ) stats->icpRetries++;
+             }
+             else {
+                 for( k = 0; k < RETRY_NUM && *err > ar2Handle->trackingThresh; k++ ) {
+                     *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, retryInlierProb[k], maxLoop, poseArena );
+                     if( stats ) stats->icpRetries++;
+ //ARLOG("outlier %2d%%: err = %f, num = %d\n", (int)(100 * (1.0F - retryInlierProb[k])), *err, num);
                  }
              }
          }
      }
+     if( *err > ar2Handle->trackingThresh ) {
+         surfaceSet->contNum = 0;
+ #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+         if( ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) ar2Handle->blurLevel = AR2_DEFAULT_BLUR_LEVEL; // Reset the blurLevel.
+ #endif
+         if( stats ) stats->icpMs += ar2GetTimeMod() - t0;
+         return -4;
+     }
 
  #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
      if( ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) {
@@ -307,6 +611,8 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      }
  #endif
 
+     if( stats ) stats->icpMs += ar2GetTimeMod() - t0;
+
      surfaceSet->contNum++;
      for( j = 0; j < 3; j++ ) {
          for( i = 0; i < 4; i++ ) surfaceSet->trans3[j][i] = surfaceSet->trans2[j][i];
@@ -494,16 +800,22 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
  }
 
  static float  ar2GetTransMat( ICPHandleT *icpHandle, float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num,
-                               float  conv[3][4], int robustMode )
+                               float  conv[3][4], int robustMode, ARScratchArenaT *scratch )
  {
      ICPDataT       data;
+     size_t         mark = 0;
      float          dx, dy, dz;
      ARdouble       initMat[3][4], mat[3][4];
      ARdouble       err;
      int            i, j;
 
-     arMalloc( data.screenCoord, ICP2DCoordT, num );
-     arMalloc( data.worldCoord,  ICP3DCoordT, num );
+     if( scratch ) mark = arScratchArenaMark( scratch );
+     data.screenCoord = (ICP2DCoordT *)arScratchMalloc( scratch, sizeof(ICP2DCoordT)*num );
+     data.worldCoord  = (ICP3DCoordT *)arScratchMalloc( scratch, sizeof(ICP3DCoordT)*num );
+     if( data.screenCoord == NULL || data.worldCoord == NULL ) {
+         ARLOGe("Out of memory!!\n");
+         exit(1);
+     }
 
      dx = dy = dz = 0.0;
      for( i = 0; i < num; i++ ) {
@@ -542,8 +854,9 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
          }
      }
 
-     free( data.screenCoord );
-     free( data.worldCoord );
+     arScratchFree( scratch, data.screenCoord );
+     arScratchFree( scratch, data.worldCoord );
+     if( scratch ) arScratchArenaRelease( scratch, mark );
 
      for( j = 0; j < 3; j++ ) {
          for( i = 0; i < 3; i++ ) conv[j][i] = (float)mat[j][i];
@@ -556,17 +869,26 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
  }
 
  static float  ar2GetTransMatHomography( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num,
-                                   float  conv[3][4], int robustMode, float inlierProb )
+                                   float  conv[3][4], int robustMode, float inlierProb, int maxLoop,
+                                   ARScratchArenaT *scratch )
  {
+     float         err;
+     size_t        mark = 0;
+
+     if( scratch ) mark = arScratchArenaMark( scratch );
      if( robustMode == 0 ) {
-         return ar2GetTransMatHomography2( initConv, pos2d, pos3d, num, conv );
+         err = ar2GetTransMatHomography2( initConv, pos2d, pos3d, num, conv, maxLoop, scratch );
      }
      else {
-         return ar2GetTransMatHomographyRobust( initConv, pos2d, pos3d, num, conv, inlierProb );
+         err = ar2GetTransMatHomographyRobust( initConv, pos2d, pos3d, num, conv, inlierProb, maxLoop, scratch );
      }
+     if( scratch ) arScratchArenaRelease( scratch, mark );
+
+     return err;
  }
 
- static float  ar2GetTransMatHomography2( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4] )
+ static float  ar2GetTransMatHomography2( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], int maxLoop,
+                                          ARScratchArenaT *scratch )
  {
      float         err = 100000000.0F;
      float        *J_U_H;
@@ -579,13 +901,13 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      if( num < 4 ) return err;
      if( initConv[2][3] == 0.0F ) return err;
 
-     if( (J_U_H = (float  *)malloc( sizeof(float)*16*num )) == NULL ) {
+     if( (J_U_H = (float  *)arScratchMalloc( scratch, sizeof(float)*16*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
          return -1;
      }
-     if( (dU = (float  *)malloc( sizeof(float)*2*num )) == NULL ) {
+     if( (dU = (float  *)arScratchMalloc( scratch, sizeof(float)*2*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
-         free(J_U_H);
+         arScratchFree(scratch, J_U_H);
          return -1;
      }
      for( j = 0; j < 3; j++ ) {
@@ -599,8 +921,8 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
              hy = conv[1][0] * pos3d[j][0] + conv[1][1] * pos3d[j][1] + conv[1][3];
              h  = conv[2][0] * pos3d[j][0] + conv[2][1] * pos3d[j][1] + 1.0f;
              if( h == 0.0 ) {
-                 free(J_U_H);
-                 free(dU);
+                 arScratchFree(scratch, J_U_H);
+                 arScratchFree(scratch, dU);
                  return err;
              }
              hh = h*h;
@@ -632,12 +954,12 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
          //ARLOG("Loop[%d]: err = %15.10f\n", i, err1);
          if( err1 < ICP_BREAK_LOOP_ERROR_THRESH ) break;
          if( i > 0 && err1 < ICP_BREAK_LOOP_ERROR_THRESH2 && err1/err0 > ICP_BREAK_LOOP_ERROR_RATIO_THRESH ) break;
-         if( i == ICP_MAX_LOOP ) break;
+         if( i == maxLoop ) break;
          err0 = err1;
 
          if( getDeltaS( dH, dU, (float  (*)[8])J_U_H, num*2 ) < 0 ) {
-             free(J_U_H);
-             free(dU);
+             arScratchFree(scratch, J_U_H);
+             arScratchFree(scratch, dU);
              return err;
          }
          //for(j=0;j<8;j++) ARLOG("%f\t", dH[j]); ARLOG("\n");
@@ -654,8 +976,8 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      //ARLOG("*********** %f\n", err1);
      //ARLOG("Loop = %d\n", i);
 
-     free(J_U_H);
-     free(dU);
+     arScratchFree(scratch, J_U_H);
+     arScratchFree(scratch, dU);
 
      return err1;
  }
@@ -671,7 +993,60 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      return 0;
  }
 
- static float  ar2GetTransMatHomographyRobust  ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], float inlierProb )
+ // Fraction of the features whose squared reprojection residual under trans is within the
+ // range a robust pass keeps (K2_FACTOR times the mean error accepted for tracking).
+ static float  getInlierProb( ICPHandleT *icpHandle, float  trans[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  thresh )
+ {
+     ARdouble      m[3][4];
+     ARdouble      hx, hy, h, dx, dy;
+     int           inlierNum;
+     int           i, j;
+
+     for( j = 0; j < 3; j++ ) {
+         for( i = 0; i < 4; i++ ) {
+             m[j][i] = icpHandle->matXc2U[j][0] * trans[0][i]
+                     + icpHandle->matXc2U[j][1] * trans[1][i]
+                     + icpHandle->matXc2U[j][2] * trans[2][i];
+         }
+         m[j][3] += icpHandle->matXc2U[j][3];
+     }
+
+     inlierNum = 0;
+     for( j = 0; j < num; j++ ) {
+         hx = m[0][0] * pos3d[j][0] + m[0][1] * pos3d[j][1] + m[0][2] * pos3d[j][2] + m[0][3];
+         hy = m[1][0] * pos3d[j][0] + m[1][1] * pos3d[j][1] + m[1][2] * pos3d[j][2] + m[1][3];
+         h  = m[2][0] * pos3d[j][0] + m[2][1] * pos3d[j][1] + m[2][2] * pos3d[j][2] + m[2][3];
+         if( h == 0.0 ) continue;
+         dx = pos2d[j][0] - hx / h;
+         dy = pos2d[j][1] - hy / h;
+         if( dx*dx + dy*dy <= thresh * K2_FACTOR ) inlierNum++;
+     }
+
+     return (float)inlierNum / num;
+ }
+
+ static float  getInlierProbHomography( float  conv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  thresh )
+ {
+     float         hx, hy, h, dx, dy;
+     int           inlierNum;
+     int           j;
+
+     inlierNum = 0;
+     for( j = 0; j < num; j++ ) {
+         hx = conv[0][0] * pos3d[j][0] + conv[0][1] * pos3d[j][1] + conv[0][3];
+         hy = conv[1][0] * pos3d[j][0] + conv[1][1] * pos3d[j][1] + conv[1][3];
+         h  = conv[2][0] * pos3d[j][0] + conv[2][1] * pos3d[j][1] + conv[2][3];
+         if( h == 0.0F ) continue;
+         dx = pos2d[j][0] - hx / h;
+         dy = pos2d[j][1] - hy / h;
+         if( dx*dx + dy*dy <= thresh * K2_FACTOR ) inlierNum++;
+     }
+
+     return (float)inlierNum / num;
+ }
+
+ static float  ar2GetTransMatHomographyRobust  ( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], float inlierProb, int maxLoop,
+                                                 ARScratchArenaT *scratch )
  {
      float         err = 100000000.0F;
      float        *J_U_H;
@@ -689,26 +1064,26 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      inlierNum = (int)(num * inlierProb) - 1;
      if( inlierNum < 4 ) inlierNum = 4;
 
-     if( (J_U_H = (float  *)malloc( sizeof(float)*16*num )) == NULL ) {
+     if( (J_U_H = (float  *)arScratchMalloc( scratch, sizeof(float)*16*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
          return -1;
      }
-     if( (dU = (float  *)malloc( sizeof(float)*2*num )) == NULL ) {
+     if( (dU = (float  *)arScratchMalloc( scratch, sizeof(float)*2*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
-         free(J_U_H);
+         arScratchFree(scratch, J_U_H);
          return -1;
      }
-     if( (E = (float  *)malloc( sizeof(float)*num )) == NULL ) {
+     if( (E = (float  *)arScratchMalloc( scratch, sizeof(float)*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
-         free(J_U_H);
-         free(dU);
+         arScratchFree(scratch, J_U_H);
+         arScratchFree(scratch, dU);
          return -1;
      }
-     if( (E2 = (float  *)malloc( sizeof(float)*num )) == NULL ) {
+     if( (E2 = (float  *)arScratchMalloc( scratch, sizeof(float)*num )) == NULL ) {
          ARLOGe("Error: malloc\n");
-         free(J_U_H);
-         free(dU);
-         free(E);
+         arScratchFree(scratch, J_U_H);
+         arScratchFree(scratch, dU);
+         arScratchFree(scratch, E);
          return -1;
      }
 
@@ -722,10 +1097,10 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
              hy = conv[1][0] * pos3d[j][0] + conv[1][1] * pos3d[j][1] + conv[1][3];
              h  = conv[2][0] * pos3d[j][0] + conv[2][1] * pos3d[j][1] + 1.0F;
              if( h == 0.0f ) {
-                 free(J_U_H);
-                 free(dU);
-                 free(E);
-                 free(E2);
+                 arScratchFree(scratch, J_U_H);
+                 arScratchFree(scratch, dU);
+                 arScratchFree(scratch, E);
+                 arScratchFree(scratch, E2);
                  return err;
              }
              hh = h*h;
@@ -767,7 +1142,7 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
          //ARLOG("Loop[%d]: err = %15.10f\n", i, err1);
          if( err1 < ICP_BREAK_LOOP_ERROR_THRESH ) break;
          if( i > 0 && err1 < ICP_BREAK_LOOP_ERROR_THRESH2 && err1/err0 > ICP_BREAK_LOOP_ERROR_RATIO_THRESH ) break;
-         if( i == ICP_MAX_LOOP ) break;
+         if( i == maxLoop ) break;
          err0 = err1;
 
          k = 0;
@@ -796,18 +1171,18 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
              }
          }
          if( k < 6 ) {
-             free(J_U_H);
-             free(dU);
-             free(E);
-             free(E2);
+             arScratchFree(scratch, J_U_H);
+             arScratchFree(scratch, dU);
+             arScratchFree(scratch, E);
+             arScratchFree(scratch, E2);
              return -1;
          }
 
          if( getDeltaS( dH, dU, (float (*)[8])J_U_H, k ) < 0 ) {
-             free(J_U_H);
-             free(dU);
-             free(E);
-             free(E2);
+             arScratchFree(scratch, J_U_H);
+             arScratchFree(scratch, dU);
+             arScratchFree(scratch, E);
+             arScratchFree(scratch, E2);
              return err;
          }
          //for(j=0;j<8;j++) ARLOG("%f\t", dH[j]); ARLOG("\n");
@@ -824,59 +1199,45 @@ AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int th
      //ARLOG("*********** %f\n", err1);
      //ARLOG("Loop = %d\n", i);
 
-     free(J_U_H);
-     free(dU);
-     free(E);
-     free(E2);
+     arScratchFree(scratch, J_U_H);
+     arScratchFree(scratch, dU);
+     arScratchFree(scratch, E);
+     arScratchFree(scratch, E2);
 
      return err1;
  }
 
+ // JtJ and JtU are formed directly, summing over the rows in the order arMatrixMulf() would with
+ // the transpose, so the fit gives the same result without allocating.
  static int getDeltaS( float  H[8], float  dU[], float  J_U_H[][8], int n )
  {
-     ARMatf  matH, matU, matJ;
-     ARMatf *matJt, *matJtJ, *matJtU;
-     int ret = 0;
+     ARMatf  matH, matJtJ, matJtU;
+     float   JtJ[8][8], JtU[8];
+     int     i, j, k;
+
+     for( i = 0; i < 8; i++ ) {
+         for( j = 0; j < 8; j++ ) {
+             JtJ[i][j] = 0.0F;
+             for( k = 0; k < n; k++ ) JtJ[i][j] += J_U_H[k][i] * J_U_H[k][j];
+         }
+         JtU[i] = 0.0F;
+         for( k = 0; k < n; k++ ) JtU[i] += J_U_H[k][i] * dU[k];
+     }
 
      matH.row = 8;
      matH.clm = 1;
      matH.m   = H;
 
-     matU.row = n;
-     matU.clm = 1;
-     matU.m   = dU;
-
-     matJ.row = n;
-     matJ.clm = 8;
-     matJ.m   = &J_U_H[0][0];
-
-     matJt = arMatrixAllocTransf( &matJ );
-     if( matJt == NULL ) {
-         ret = -1;
-         goto bail;
-     }
-     matJtJ = arMatrixAllocMulf( matJt, &matJ );
-     if( matJtJ == NULL ) {
-         ret = -1;
-         goto bail1;
-     }
-     matJtU = arMatrixAllocMulf( matJt, &matU );
-     if( matJtU == NULL ) {
-         ret = -1;
-         goto bail2;
-     }
-     if( arMatrixSelfInvf(matJtJ) < 0 ) {
-         ret = -1;
-         goto bail3;
-     }
-
-     arMatrixMulf( &matH, matJtJ, matJtU );
- bail3:
-     arMatrixFreef( matJtU );
- bail2:
-     arMatrixFreef( matJtJ );
- bail1:
-     arMatrixFreef( matJt );
- bail:
-     return (ret);
+     matJtJ.row = 8;
+     matJtJ.clm = 8;
+     matJtJ.m   = &JtJ[0][0];
+
+     matJtU.row = 8;
+     matJtU.clm = 1;
+     matJtU.m   = JtU;
+
+     if( arMatrixSelfInvf(&matJtJ) < 0 ) return -1;
+     arMatrixMulf( &matH, &matJtJ, &matJtU );
+
+     return 0;
  }
\ No newline at end of file
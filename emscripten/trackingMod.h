@@ -56,23 +56,98 @@
 #include <AR2/template.h>
 #include <AR2/marker.h>
 #include <AR2/tracking.h>
+#include "scratchArena.h"
 
 #define    AR2_TRACKING_6DOF                   1
 #define    AR2_TRACKING_HOMOGRAPHY             2
 
+// Pose estimation modes, for when the least squares fit of a frame misses trackingThresh.
+#define    AR2_POSE_CASCADE                    0    // Up to four robust refits with decreasing inlier probability, as ar2Tracking().
+#define    AR2_POSE_ROBUST                     1    // A single robust refit with the inlier probability estimated from the residuals.
+
+typedef struct {
+    int       mode;               // AR2_POSE_CASCADE or AR2_POSE_ROBUST.
+    int       maxLoop;            // Iteration limit of each pass, ICP_MAX_LOOP if 0.
+} AR2PoseParamT;
+
+/*
+ *  Timings in milliseconds and counters of ar2TrackingModEx(), accumulated over calls.
+ *  A field is a double so the struct can be read from JS as a Float64Array.
+ */
+typedef struct {
+    double    extractMs;          // Visible feature (candidate) extraction.
+    double    matchMs;            // Template selection and matching.
+    double    icpMs;              // Pose estimation, including the robust retries.
+    double    featuresAttempted;  // Templates matched.
+    double    featuresAccepted;   // Matches above simThresh passed to pose estimation.
+    double    icpRetries;         // Robust pose estimation passes after the first.
+} AR2TrackingStatsT;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
-                              AR2Tracking2DResultT *result );
+                              AR2Tracking2DResultT *result, ARScratchArenaT *scratch );
+
+void *ar2Tracking2dMod( THREAD_HANDLE_T *threadHandle );
+
+/*
+ *  The scratch arena of template matching thread number thread (the index of its arg), sized
+ *  for the current template size. Each thread has its own, so they never need locking.
+ */
+ARScratchArenaT *ar2GetScratchArenaMod( AR2HandleT *ar2Handle, int thread );
+
+/*
+ *  Monotonic time in milliseconds, for stage timings.
+ */
+double      ar2GetTimeMod( void );
 
-AR2HandleT *ar2CreateHandleMod( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat/*, int threadNum*/ );
-AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize/*, int threadNum*/ );
+/*
+ *  threadNum is clamped to [1, AR2_THREAD_MAX]. Template matching runs on a persistent
+ *  pool of threadNum worker threads when built with HAVE_THREADS and threadNum > 1,
+ *  and serially on the calling thread otherwise. The templates and the scratch memory
+ *  of matching and pose estimation are allocated with the handle, so ar2TrackingModEx()
+ *  allocates nothing in this module. The ICP fit of AR2_TRACKING_6DOF, icpPoint() and
+ *  icpPointRobust() of ARICP, still allocates its own work arrays.
+ */
+AR2HandleT *ar2CreateHandleMod( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat, int threadNum );
+AR2HandleT *ar2CreateHandleSubMod( int pixFormat, int xsize, int ysize, int threadNum );
+int         ar2DeleteHandleMod( AR2HandleT **ar2Handle );
+/*
+ *  ar2SetTemplateSize1() and ar2SetTemplateSize2() at once, also regenerating the templates
+ *  and scratch arenas of the threads at the new size. Use it to change template sizes.
+ */
+int         ar2SetTemplateSizeMod( AR2HandleT *ar2Handle, int templateSize1, int templateSize2 );
+/*
+ *  Selects AR2_TRACKING_6DOF (the default) or AR2_TRACKING_HOMOGRAPHY. In the homography mode
+ *  the surfaces are tracked as planes in observed screen coordinates, without undistortion or
+ *  ICP: the trans of ar2SetInitTrans() and ar2TrackingModEx() is then a homography, with the
+ *  layout of ar2PoseToHomographyMod(). Reset the tracking of all surface sets after a change.
+ */
+int         ar2SetTrackingModeMod( AR2HandleT *ar2Handle, int trackingMode );
+/*
+ *  Converts a 3x4 marker pose to the homography from marker to screen coordinates of the
+ *  camera parameters, as columns 0, 1 and 3 of homography normalised to homography[2][3] = 1.
+ *  Lens distortion is not modelled.
+ */
+int         ar2PoseToHomographyMod( const ARParamLT *cparamLT, const float  pose[3][4], float  homography[3][4] );
+/*
+ *  The inverse of ar2PoseToHomographyMod(): decomposes a homography into the nearest 3x4 pose
+ *  with an orthonormal rotation and the marker in front of the camera.
+ */
+int         ar2HomographyToPoseMod( const ARParamLT *cparamLT, const float  homography[3][4], float  pose[3][4] );
 
 int             ar2TrackingMod              ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
                                            ARUint8 *dataPtr, float  trans[3][4], float  *err );
+/*
+ *  ar2TrackingMod() with the pose estimation of poseParam (AR2_POSE_CASCADE and ICP_MAX_LOOP
+ *  if NULL), adding its stage timings and counters to stats, which may be NULL.
+ */
+int             ar2TrackingModEx            ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
+                                           ARUint8 *dataPtr, float  trans[3][4], float  *err,
+                                           const AR2PoseParamT *poseParam, AR2TrackingStatsT *stats );
 int             ar2SetInitTrans          ( AR2SurfaceSetT *surfaceSet, float  trans[3][4]    );
 
 #ifdef __cplusplus
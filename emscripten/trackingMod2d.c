@@ -45,25 +45,29 @@
 #include <AR2/template.h>
 #include <AR2/searchPoint.h>
 #include <AR2/tracking.h>
+#include "templateMod.h"
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
 int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
-                              AR2Template2T **templ2, AR2Tracking2DResultT *result );
+                              AR2Template2T **templ2, AR2Tracking2DResultT *result,
+                              ARScratchArenaT *scratch );
 #else
 int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
-                              AR2Tracking2DResultT *result );
+                              AR2Tracking2DResultT *result, ARScratchArenaT *scratch );
 #endif
+ARScratchArenaT *ar2GetScratchArenaMod( AR2HandleT *ar2Handle, int thread );
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
 int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
-                              AR2Template2T **templ2, AR2Tracking2DResultT *result )
+                              AR2Template2T **templ2, AR2Tracking2DResultT *result,
+                              ARScratchArenaT *scratch )
 #else
 int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
-                              AR2Tracking2DResultT *result )
+                              AR2Tracking2DResultT *result, ARScratchArenaT *scratch )
 #endif
 {
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
@@ -72,10 +76,13 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
     int                   snum, level, fnum;
     int                   search[3][2];
     int                   bx, by;
+    const ARParamLT      *cparamLT;
 
     snum  = candidate->snum;
     level = candidate->level;
     fnum  = candidate->num;
+    // In AR2_TRACKING_HOMOGRAPHY mode, wtrans1..3 are homographies to screen coordinates.
+    cparamLT = (handle->trackingMode == AR2_TRACKING_6DOF) ? handle->cparamLT : NULL;
 
     if( *templ == NULL )  *templ = ar2GenTemplate( handle->templateSize1, handle->templateSize2 );
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
@@ -84,7 +91,7 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     if( handle->blurMethod == AR2_CONSTANT_BLUR ) {
-        if( ar2SetTemplateSub( handle->cparamLT,
+        if( ar2SetTemplateSub( cparamLT,
                                (const float (*)[4])handle->wtrans1[snum],
                                surfaceSet->surface[snum].imageSet,
                              &(surfaceSet->surface[snum].featureSet->list[level]),
@@ -99,7 +106,7 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
         }
     }
     else {
-        if( ar2SetTemplate2Sub( handle->cparamLT,
+        if( ar2SetTemplate2Sub( cparamLT,
                                 (const float (*)[4])handle->wtrans1[snum],
                                 surfaceSet->surface[snum].imageSet,
                               &(surfaceSet->surface[snum].featureSet->list[level]),
@@ -114,7 +121,7 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
         }
     }
 #else
-    if( ar2SetTemplateSub( handle->cparamLT,
+    if( ar2SetTemplateSub( cparamLT,
                            (const float (*)[4])handle->wtrans1[snum],
                            surfaceSet->surface[snum].imageSet,
                          &(surfaceSet->surface[snum].featureSet->list[level]),
@@ -130,20 +137,20 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
 
     // Get the screen coordinates for up to three previous positions of this feature into search[][].
     if( surfaceSet->contNum == 1 ) {
-        ar2GetSearchPoint( handle->cparamLT,
+        ar2GetSearchPoint( cparamLT,
                            (const float (*)[4])handle->wtrans1[snum], NULL, NULL,
                          &(surfaceSet->surface[snum].featureSet->list[level].coord[fnum]),
                            search );
     }
     else if( surfaceSet->contNum == 2 ) {
-        ar2GetSearchPoint( handle->cparamLT,
+        ar2GetSearchPoint( cparamLT,
                            (const float (*)[4])handle->wtrans1[snum],
                            (const float (*)[4])handle->wtrans2[snum], NULL,
                          &(surfaceSet->surface[snum].featureSet->list[level].coord[fnum]),
                            search );
     }
     else {
-        ar2GetSearchPoint( handle->cparamLT,
+        ar2GetSearchPoint( cparamLT,
                            (const float (*)[4])handle->wtrans1[snum],
                            (const float (*)[4])handle->wtrans2[snum],
                            (const float (*)[4])handle->wtrans3[snum],
@@ -153,17 +160,18 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     if( handle->blurMethod == AR2_CONSTANT_BLUR ) {
-        if( ar2GetBestMatching( dataPtr,
-                                mfImage,
-                                handle->xsize,
-                                handle->ysize,
-                                handle->pixFormat,
-                               *templ,
-                                handle->searchSize,
-                                handle->searchSize,
-                                search,
-                                &bx, &by,
-                              &(result->sim)) < 0 ) {
+        if( ar2GetBestMatchingMod( dataPtr,
+                                   mfImage,
+                                   handle->xsize,
+                                   handle->ysize,
+                                   handle->pixFormat,
+                                  *templ,
+                                   handle->searchSize,
+                                   handle->searchSize,
+                                   search,
+                                   &bx, &by,
+                                 &(result->sim),
+                                   scratch) < 0 ) {
             return -1;
         }
         result->blurLevel = handle->blurLevel;
@@ -185,17 +193,18 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
         }
     }
 #else
-    if( ar2GetBestMatching( dataPtr,
-                            mfImage,
-                            handle->xsize,
-                            handle->ysize,
-                            handle->pixFormat,
-                           *templ,
-                            handle->searchSize,
-                            handle->searchSize,
-                            search,
-                            &bx, &by,
-                          &(result->sim)) < 0 ) {
+    if( ar2GetBestMatchingMod( dataPtr,
+                               mfImage,
+                               handle->xsize,
+                               handle->ysize,
+                               handle->pixFormat,
+                              *templ,
+                               handle->searchSize,
+                               handle->searchSize,
+                               search,
+                               &bx, &by,
+                             &(result->sim),
+                               scratch) < 0 ) {
         return -1;
     }
 #endif
@@ -214,3 +223,33 @@ int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2Templa
 
     return 0;
 }
+
+#ifdef HAVE_THREADS
+void *ar2Tracking2dMod( THREAD_HANDLE_T *threadHandle )
+{
+    AR2Tracking2DParamT  *arg;
+    int                   ID;
+
+    arg = (AR2Tracking2DParamT *)threadGetArg(threadHandle);
+    ID  = threadGetID(threadHandle);
+
+    ARLOGi("Start tracking thread #%d.\n", ID);
+    for(;;) {
+        if( threadStartWait(threadHandle) < 0 ) break;
+
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
+                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->templ2), &(arg->result),
+                                     ar2GetScratchArenaMod(arg->ar2Handle, ID) );
+#else
+        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
+                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->result),
+                                     ar2GetScratchArenaMod(arg->ar2Handle, ID) );
+#endif
+        threadEndSignal(threadHandle);
+    }
+    ARLOGi("End tracking thread #%d.\n", ID);
+
+    return NULL;
+}
+#endif
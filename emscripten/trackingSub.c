@@ -0,0 +1,149 @@
+/*
+ *  trackingSub.c
+ *  ARToolKit5
+ *
+ *  Background KPM matching thread, adapted from the nftSimple example.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright 2015 Daqri, LLC.
+ *  Copyright 2007-2015 ARToolworks, Inc.
+ *
+ *  Author(s): Hirokazu Kato, Philip Lamb
+ *
+ */
+
+#include "trackingSub.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_THREADS
+
+typedef struct {
+    KpmHandle              *kpmHandle;      // KPM-related data.
+    ARUint8                *imagePtr;       // Pointer to image being matched.
+    int                     imageSize;      // Bytes per image.
+} TrackingInitHandle;
+
+static void *trackingInitMain( THREAD_HANDLE_T *threadHandle );
+
+
+int trackingInitQuit( THREAD_HANDLE_T **threadHandle_p )
+{
+    TrackingInitHandle  *trackingInitHandle;
+
+    if (!threadHandle_p)  {
+        ARLOGe("trackingInitQuit(): Error: NULL threadHandle_p.\n");
+        return (-1);
+    }
+    if (!*threadHandle_p) return 0;
+
+    threadWaitQuit( *threadHandle_p );
+    trackingInitHandle = (TrackingInitHandle *)threadGetArg(*threadHandle_p);
+    if (trackingInitHandle) {
+        free( trackingInitHandle->imagePtr );
+        free( trackingInitHandle );
+    }
+    threadFree( threadHandle_p );
+    return 0;
+}
+
+THREAD_HANDLE_T *trackingInitInit( KpmHandle *kpmHandle )
+{
+    TrackingInitHandle  *trackingInitHandle;
+    THREAD_HANDLE_T     *threadHandle;
+
+    if (!kpmHandle) {
+        ARLOGe("trackingInitInit(): Error: NULL KpmHandle.\n");
+        return (NULL);
+    }
+
+    arMalloc( trackingInitHandle, TrackingInitHandle, 1 );
+    trackingInitHandle->kpmHandle = kpmHandle;
+    trackingInitHandle->imageSize = kpmHandleGetXSize(kpmHandle) * kpmHandleGetYSize(kpmHandle);
+    arMalloc( trackingInitHandle->imagePtr, ARUint8, trackingInitHandle->imageSize );
+
+    threadHandle = threadInit(0, trackingInitHandle, trackingInitMain);
+    return threadHandle;
+}
+
+int trackingInitStart( THREAD_HANDLE_T *threadHandle, ARUint8 *imagePtr )
+{
+    TrackingInitHandle     *trackingInitHandle;
+
+    if (!threadHandle || !imagePtr) {
+        ARLOGe("trackingInitStart(): Error: NULL threadHandle or imagePtr.\n");
+        return (-1);
+    }
+
+    trackingInitHandle = (TrackingInitHandle *)threadGetArg(threadHandle);
+    if (!trackingInitHandle) {
+        ARLOGe("trackingInitStart(): Error: NULL trackingInitHandle.\n");
+        return (-1);
+    }
+    memcpy( trackingInitHandle->imagePtr, imagePtr, trackingInitHandle->imageSize );
+    threadStartSignal( threadHandle );
+
+    return 0;
+}
+
+int trackingInitGetResult( THREAD_HANDLE_T *threadHandle, KpmResult **kpmResult, int *kpmResultNum )
+{
+    TrackingInitHandle     *trackingInitHandle;
+
+    if (!threadHandle || !kpmResult || !kpmResultNum) {
+        ARLOGe("trackingInitGetResult(): Error: NULL threadHandle or kpmResult or kpmResultNum.\n");
+        return (-1);
+    }
+
+    if( threadGetStatus( threadHandle ) == 0 ) return 0;
+    threadEndWait( threadHandle );
+
+    trackingInitHandle = (TrackingInitHandle *)threadGetArg(threadHandle);
+    if (!trackingInitHandle) return (-1);
+
+    kpmGetResult( trackingInitHandle->kpmHandle, kpmResult, kpmResultNum );
+    return 1;
+}
+
+static void *trackingInitMain( THREAD_HANDLE_T *threadHandle )
+{
+    TrackingInitHandle     *trackingInitHandle;
+
+    if (!threadHandle) {
+        ARLOGe("Error starting tracking thread: empty THREAD_HANDLE_T.\n");
+        return (NULL);
+    }
+    trackingInitHandle = (TrackingInitHandle *)threadGetArg(threadHandle);
+    if (!trackingInitHandle) {
+        ARLOGe("Error starting tracking thread: empty trackingInitHandle.\n");
+        return (NULL);
+    }
+    ARLOGi("Start tracking thread.\n");
+
+    for(;;) {
+        if( threadStartWait(threadHandle) < 0 ) break;
+
+        kpmMatching( trackingInitHandle->kpmHandle, trackingInitHandle->imagePtr );
+
+        threadEndSignal(threadHandle);
+    }
+
+    ARLOGi("End tracking thread.\n");
+    return (NULL);
+}
+
+#endif
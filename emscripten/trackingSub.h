@@ -0,0 +1,65 @@
+/*
+ *  trackingSub.h
+ *  ARToolKit5
+ *
+ *  Background KPM matching thread, adapted from the nftSimple example.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright 2015 Daqri, LLC.
+ *  Copyright 2007-2015 ARToolworks, Inc.
+ *
+ *  Author(s): Hirokazu Kato, Philip Lamb
+ *
+ */
+
+#ifndef __trackingSub_H__
+#define __trackingSub_H__
+#include <AR/ar.h>
+#include <AR/arUtil.h>
+#include <KPM/kpm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HAVE_THREADS
+
+/*
+ *  Starts a thread that runs kpmMatching() on kpmHandle against a private copy of the luma frame.
+ *  The kpmHandle must not be used by the caller while a match is running.
+ */
+THREAD_HANDLE_T *trackingInitInit( KpmHandle *kpmHandle );
+
+/*
+ *  Copies the luma frame at imagePtr and starts matching it in the background.
+ */
+int trackingInitStart( THREAD_HANDLE_T *threadHandle, ARUint8 *imagePtr );
+
+/*
+ *  Returns 0 while the match started by trackingInitStart() is running. Otherwise returns 1 and the
+ *  results, which stay owned by the kpmHandle and valid until the next trackingInitStart().
+ */
+int trackingInitGetResult( THREAD_HANDLE_T *threadHandle, KpmResult **kpmResult, int *kpmResultNum );
+
+int trackingInitQuit( THREAD_HANDLE_T **threadHandle_p );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,226 @@
+/*
+ *  videoLuma.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "videoLuma.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#ifdef __wasm_simd128__
+// Luma of the four RGBA pixels held in v, one per 32-bit lane.
+static inline v128_t lumaRGBAx4( v128_t v )
+{
+    const v128_t mask = wasm_i32x4_splat(0xff);
+    v128_t r = wasm_v128_and( v, mask );
+    v128_t g = wasm_v128_and( wasm_u32x4_shr(v, 8), mask );
+    v128_t b = wasm_v128_and( wasm_u32x4_shr(v, 16), mask );
+
+    v128_t sum = wasm_i32x4_add( wasm_i32x4_add(r, wasm_i32x4_shl(r, 1)),
+                                 wasm_i32x4_add(wasm_i32x4_shl(g, 2), b) );
+    return wasm_u32x4_shr( sum, 3 );
+}
+#endif
+
+void arVideoLumaRGBAtoL( ARUint8 *lumaPtr, const ARUint8 *rgbaPtr, int pixelCount )
+{
+    int i = 0;
+
+#ifdef __wasm_simd128__
+    // 16 pixels per iteration: four vectors of 32-bit luma narrowed to one vector of bytes.
+    for( ; i + 16 <= pixelCount; i += 16 ) {
+        v128_t l0 = lumaRGBAx4( wasm_v128_load(rgbaPtr) );
+        v128_t l1 = lumaRGBAx4( wasm_v128_load(rgbaPtr + 16) );
+        v128_t l2 = lumaRGBAx4( wasm_v128_load(rgbaPtr + 32) );
+        v128_t l3 = lumaRGBAx4( wasm_v128_load(rgbaPtr + 48) );
+
+        v128_t l01 = wasm_u16x8_narrow_i32x4( l0, l1 );
+        v128_t l23 = wasm_u16x8_narrow_i32x4( l2, l3 );
+        wasm_v128_store( lumaPtr, wasm_u8x16_narrow_i16x8(l01, l23) );
+
+        rgbaPtr += 64;
+        lumaPtr += 16;
+    }
+#endif
+
+    for( ; i < pixelCount; i++ ) {
+        *(lumaPtr++) = (ARUint8)((rgbaPtr[0] * 3 + rgbaPtr[1] * 4 + rgbaPtr[2]) >> 3);
+        rgbaPtr += 4;
+    }
+}
+
+void arVideoLumaDownscale( ARUint8 *dstPtr, const ARUint8 *srcPtr, int xsize, int ysize, int scale )
+{
+    int dxsize = xsize / scale;
+    int dysize = ysize / scale;
+    int area = scale * scale;
+    int i, j, k, l;
+
+    for( j = 0; j < dysize; j++ ) {
+        const ARUint8 *row = srcPtr + j * scale * xsize;
+        ARUint8 *dst = dstPtr + j * dxsize;
+        i = 0;
+
+#ifdef __wasm_simd128__
+        if( scale == 2 ) {
+            // 16 output pixels per iteration: pairwise sums of two 32 pixel rows, rounded and narrowed.
+            const v128_t round = wasm_i16x8_splat(2);
+            for( ; i + 16 <= dxsize; i += 16 ) {
+                const ARUint8 *p0 = row + i * 2;
+                const ARUint8 *p1 = p0 + xsize;
+                v128_t s0 = wasm_i16x8_add( wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(p0)),
+                                            wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(p1)) );
+                v128_t s1 = wasm_i16x8_add( wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(p0 + 16)),
+                                            wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(p1 + 16)) );
+                s0 = wasm_u16x8_shr( wasm_i16x8_add(s0, round), 2 );
+                s1 = wasm_u16x8_shr( wasm_i16x8_add(s1, round), 2 );
+                wasm_v128_store( dst + i, wasm_u8x16_narrow_i16x8(s0, s1) );
+            }
+        }
+#endif
+
+        for( ; i < dxsize; i++ ) {
+            const ARUint8 *p = row + i * scale;
+            int sum = 0;
+            for( l = 0; l < scale; l++ ) {
+                for( k = 0; k < scale; k++ ) sum += p[k];
+                p += xsize;
+            }
+            dst[i] = (ARUint8)((sum + area / 2) / area);
+        }
+    }
+}
+
+ARVideoLumaOrientT *arVideoLumaOrientCreate( int dstXsize, int dstYsize, int srcXsize, int srcYsize, int srcRGBA, int rotation )
+{
+    ARVideoLumaOrientT *orient;
+    int                 pixelSize = srcRGBA ? 4 : 1;
+    int                 stride = srcXsize * pixelSize;
+    int                 rxsize, rysize;       // Size of the rotated source.
+    long long           step, ox, oy;         // 16.16 fixed point, in rotated source pixels.
+    int                 box, i, j, u, v;
+
+    if( dstXsize <= 0 || dstYsize <= 0 || srcXsize <= 0 || srcYsize <= 0 ) return NULL;
+    if( rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270 ) return NULL;
+
+    arMalloc( orient, ARVideoLumaOrientT, 1 );
+    arMalloc( orient->colOffset, int, dstXsize );
+    arMalloc( orient->rowOffset, int, dstYsize );
+    orient->dstXsize = dstXsize;
+    orient->dstYsize = dstYsize;
+    orient->srcRGBA  = srcRGBA;
+    orient->srcStride = stride;
+    orient->identity = (rotation == 0 && srcXsize == dstXsize && srcYsize == dstYsize);
+
+    rxsize = (rotation == 90 || rotation == 270) ? srcYsize : srcXsize;
+    rysize = (rotation == 90 || rotation == 270) ? srcXsize : srcYsize;
+    // The scale that fills the destination, cropping the centre of the longer side of the source.
+    step = ((long long)rxsize << 16) / dstXsize;
+    if( ((long long)rysize << 16) / dstYsize < step ) step = ((long long)rysize << 16) / dstYsize;
+    ox = (((long long)rxsize << 16) - step * dstXsize) / 2;
+    oy = (((long long)rysize << 16) - step * dstYsize) / 2;
+    // From a downscale by 2, the 2x2 block around each sample is averaged, against aliasing.
+    box = (step >= (2 << 16)) ? 2 : 1;
+    orient->box = box;
+
+    // Pixel (i, j) is sampled at (u, v) of the rotated source, the top left of its box.
+    for( i = 0; i < dstXsize; i++ ) {
+        u = (int)((ox + step * i + step / 2 - (box - 1) * (1 << 15)) >> 16);
+        if( u > rxsize - box ) u = rxsize - box;
+        switch( rotation ) {
+            case 0:   orient->colOffset[i] = u * pixelSize; break;
+            case 90:  orient->colOffset[i] = (srcYsize - box - u) * stride; break;
+            case 180: orient->colOffset[i] = (srcXsize - box - u) * pixelSize; break;
+            default:  orient->colOffset[i] = u * stride; break;
+        }
+    }
+    for( j = 0; j < dstYsize; j++ ) {
+        v = (int)((oy + step * j + step / 2 - (box - 1) * (1 << 15)) >> 16);
+        if( v > rysize - box ) v = rysize - box;
+        switch( rotation ) {
+            case 0:   orient->rowOffset[j] = v * stride; break;
+            case 90:  orient->rowOffset[j] = v * pixelSize; break;
+            case 180: orient->rowOffset[j] = (srcYsize - box - v) * stride; break;
+            default:  orient->rowOffset[j] = (srcXsize - box - v) * pixelSize; break;
+        }
+    }
+
+    return orient;
+}
+
+void arVideoLumaOrientDelete( ARVideoLumaOrientT **orient )
+{
+    if( orient == NULL || *orient == NULL ) return;
+    free( (*orient)->colOffset );
+    free( (*orient)->rowOffset );
+    free( *orient );
+    *orient = NULL;
+}
+
+void arVideoLumaOrient( ARUint8 *dstPtr, const ARUint8 *srcPtr, const ARVideoLumaOrientT *orient )
+{
+    const int  *colOffset = orient->colOffset;
+    int         xsize = orient->dstXsize;
+    int         ysize = orient->dstYsize;
+    int         stride = orient->srcStride;
+    int         i, j;
+
+    if( orient->identity ) {
+        if( orient->srcRGBA ) arVideoLumaRGBAtoL( dstPtr, srcPtr, xsize * ysize );
+        else                  memcpy( dstPtr, srcPtr, xsize * ysize );
+        return;
+    }
+
+    for( j = 0; j < ysize; j++ ) {
+        const ARUint8 *row = srcPtr + orient->rowOffset[j];
+        if( orient->srcRGBA ) {
+            if( orient->box == 1 ) {
+                for( i = 0; i < xsize; i++ ) {
+                    const ARUint8 *p = row + colOffset[i];
+                    *(dstPtr++) = (ARUint8)((p[0] * 3 + p[1] * 4 + p[2]) >> 3);
+                }
+            }
+            else {
+                for( i = 0; i < xsize; i++ ) {
+                    const ARUint8 *p0 = row + colOffset[i];
+                    const ARUint8 *p1 = p0 + stride;
+                    int r = p0[0] + p0[4] + p1[0] + p1[4];
+                    int g = p0[1] + p0[5] + p1[1] + p1[5];
+                    int b = p0[2] + p0[6] + p1[2] + p1[6];
+                    *(dstPtr++) = (ARUint8)((r * 3 + g * 4 + b + 16) >> 5);
+                }
+            }
+        }
+        else {
+            if( orient->box == 1 ) {
+                for( i = 0; i < xsize; i++ ) *(dstPtr++) = row[colOffset[i]];
+            }
+            else {
+                for( i = 0; i < xsize; i++ ) {
+                    const ARUint8 *p0 = row + colOffset[i];
+                    const ARUint8 *p1 = p0 + stride;
+                    *(dstPtr++) = (ARUint8)((p0[0] + p0[1] + p1[0] + p1[1] + 2) >> 2);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ *  videoLuma.h
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Luma extraction from RGBA video frames, with a WASM SIMD128 kernel.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __videoLuma_H__
+#define __videoLuma_H__
+#include <AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Writes pixelCount luma bytes to lumaPtr from the RGBA pixels at rgbaPtr,
+ *  as (3 * r + 4 * g + b) >> 3. Uses WASM SIMD128 when compiled with -msimd128.
+ */
+void arVideoLumaRGBAtoL( ARUint8 *lumaPtr, const ARUint8 *rgbaPtr, int pixelCount );
+
+/*
+ *  Writes the (xsize / scale) x (ysize / scale) luma image at dstPtr, each pixel the rounded
+ *  mean of a scale x scale box of the xsize x ysize image at srcPtr. Uses WASM SIMD128 for
+ *  scale 2 when compiled with -msimd128.
+ */
+void arVideoLumaDownscale( ARUint8 *dstPtr, const ARUint8 *srcPtr, int xsize, int ysize, int scale );
+
+/*
+ *  Sampling tables of arVideoLumaOrient() for one source and destination geometry.
+ */
+typedef struct {
+    int       dstXsize;
+    int       dstYsize;
+    int       srcRGBA;            // RGBA source if non-zero, luma (or the Y plane of a 4:2:0 frame) otherwise.
+    int       srcStride;          // In bytes.
+    int       box;                // 2 to average the 2x2 block of each sample when downscaling by 2 or more, 1 otherwise.
+    int       identity;           // Same size without rotation: plain conversion.
+    int      *colOffset;          // Byte offset of the sample of each destination column in the source...
+    int      *rowOffset;          // ...plus that of each destination row.
+} ARVideoLumaOrientT;
+
+/*
+ *  Prepares arVideoLumaOrient() for a srcXsize x srcYsize source in camera orientation, rotated
+ *  clockwise by rotation (0, 90, 180 or 270) degrees, cropped around its centre to the aspect
+ *  ratio of the dstXsize x dstYsize destination and scaled to it. Returns NULL if a size or the
+ *  rotation is invalid. Free with arVideoLumaOrientDelete().
+ */
+ARVideoLumaOrientT *arVideoLumaOrientCreate( int dstXsize, int dstYsize, int srcXsize, int srcYsize, int srcRGBA, int rotation );
+void                arVideoLumaOrientDelete( ARVideoLumaOrientT **orient );
+
+/*
+ *  Writes the destination luma image of orient at dstPtr from the source frame at srcPtr, in a
+ *  single pass that rotates, crops, scales and converts to luma.
+ */
+void arVideoLumaOrient( ARUint8 *dstPtr, const ARUint8 *srcPtr, const ARVideoLumaOrientT *orient );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -124,7 +124,8 @@ function start2(container, marker, video, input_width, input_height, canvas_draw
 
         renderer.setSize(sw, sh);
 
-        worker.postMessage({type: "load", pw: pw, ph: ph, camera_para: camera_para, marker: '../' + marker.url});
+        // With a shared memory build the frames go through the controller's frame ring instead of messages.
+        worker.postMessage({type: "load", pw: pw, ph: ph, camera_para: camera_para, marker: '../' + marker.url, frameRing: true});
 
         worker.onmessage = function(ev) {
             var msg = ev.data;
@@ -162,14 +163,22 @@ function start2(container, marker, video, input_width, input_height, canvas_draw
                     found(null);
                     break;
                 }
+
+                case "frameRing": {
+                    ring = new ARFrameRing(msg.ring, worker);
+                    return;
+                }
             }
 
             track_update();
-            process();
+            if (!ring) {
+                process();
+            }
         };
     };
 
     var world;
+    var ring = null;
 
     var found = function(msg) {
       if (!msg) {
@@ -213,12 +222,19 @@ function start2(container, marker, video, input_width, input_height, canvas_draw
       context_process.drawImage(video, 0, 0, vw, vh, ox, oy, w, h);
 
       var imageData = context_process.getImageData(0, 0, pw, ph);
+      if (ring) {
+        ring.write(imageData.data);
+        return;
+      }
       worker.postMessage({ type: "process", imagedata: imageData }, [
         imageData.data.buffer
       ]);
     }
     var tick = function() {
         draw();
+        if (ring) {
+            process();
+        }
         requestAnimationFrame(tick);
     };
 
@@ -33,6 +33,10 @@ self.onmessage = function(e) {
             return;
         }
         case "process": {
+            if (frameRing) {
+                processRing();
+                return;
+            }
             next = msg.imagedata;
             process();
             return;
@@ -41,6 +45,7 @@ self.onmessage = function(e) {
 };
 
 var next = null;
+var frameRing = false;
 
 var ar = null;
 var markerResult = null;
@@ -62,6 +67,15 @@ function load(msg) {
         });
 
         postMessage({type: "loaded", proj: JSON.stringify(cameraMatrix)});
+
+        // Frames written by the page straight into the shared memory, see ARFrameRing.
+        if (msg.frameRing && ar.setFrameRing(true) === 0) {
+            frameRing = true;
+            postMessage({type: "frameRing", ring: ar.getFrameRing()});
+            if (typeof Atomics.waitAsync === 'function') {
+                ar.waitFrame(processRing);
+            }
+        }
     };
 }
 
@@ -82,6 +96,16 @@ function process() {
     next = null;
 }
 
+function processRing() {
+    // This takes the newest frame only; the ones written while the last frame was processed are dropped.
+    if (ar.takeFrame()) {
+        process();
+    }
+    if (typeof Atomics.waitAsync === 'function') {
+        ar.waitFrame(processRing);
+    }
+}
+
 window.addEventListener('artoolkit-loaded', function() {
     console.log('artoolkit-loaded');
     Object.assign(self, window);
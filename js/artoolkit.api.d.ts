@@ -48,6 +48,8 @@ export class ARController {
     camera_mat: any;
     marker_transform_mat: any;
     videoLumaPointer: any;
+    pixelFormat: number;
+    results: Float64Array;
 
     constructor(width: number, height: number, cameraData: string | ARCameraParam);
 
@@ -56,6 +58,10 @@ export class ARController {
     process(image: any): void;
     getCameraMatrix(): ArrayLike<number>;
     detectMarker(videoNative): void;
+    detect(image?: any): Float64Array;
+    setVideoPixelFormat(format: number): number;
+    getVideoPixelFormat(): number;
+    copyVideoFrame(videoFrame: any): Promise<void>;
     debugDraw(): void;
     getMarkerNum(): number;
     getMarker(index: number): ARMarkerInfo;
@@ -35,7 +35,8 @@
                 console.log('wasm download finished, begin instantiating');
                 var wasmInstantiate = WebAssembly.instantiate(new Uint8Array(wasmBinary), imports).then(function (output) {
                     console.log('wasm instantiation succeeded');
-                    successCallback(output.instance);
+                    // The module is passed on for the pthread workers of threaded builds.
+                    successCallback(output.instance, output.module);
                 }).catch(function (e) {
                     console.log('wasm instantiation failed! ' + e);
                 });
@@ -44,6 +45,28 @@
         }
     }
 
+    // Layout of the results arena filled by artoolkit.detect(), in Float64 elements.
+    // Keep in sync with the RESULTS_* defines in ARToolKitJS.cpp.
+    var RESULTS_HEADER_SIZE = 8;
+    var RESULTS_SQUARE_SIZE = 48;
+    var RESULTS_NFT_SIZE = 14;
+    var RESULTS_MULTI_SIZE = 13;
+    var RESULTS_MULTI_EACH_SIZE = 16;
+
+    // Words of the frame ring control block, see setFrameRing().
+    // Keep in sync with the FRAME_RING_* defines in ARToolKitJS.cpp and artoolkit.frame_ring.js.
+    var FRAME_RING_READY = 0;
+    var FRAME_RING_COUNT = 1;
+    var FRAME_RING_FRESH = 0x100;
+
+    // Fields of the stats block of a controller, in Float64 elements.
+    // Keep in sync with controller_stats in ARToolKitJS.cpp and AR2TrackingStatsT in trackingMod.h.
+    var STATS_FIELDS = [
+        'frames', 'lumaMs', 'detectMarkerMs', 'kpmMs',
+        'ar2ExtractMs', 'ar2MatchMs', 'ar2IcpMs', 'featuresAttempted', 'featuresAccepted', 'icpRetries',
+        'relocalizations', 'trackingLosses', 'squareROIFrames'
+    ];
+
 	/**
 		The ARController is the main object for doing AR marker detection with JSARToolKit.
 
@@ -113,6 +136,10 @@
         this.camera_mat = null;
         this.marker_transform_mat = null;
         this.videoLumaPointer = null;
+        this.cameraPointer = null;
+        this.transformPointer = null;
+        this.pixelFormat = undefined;
+        this.videoSource = null;
         this._bwpointer = undefined;
         this._lumaCtx = undefined;
 
@@ -189,13 +216,25 @@
 		@param {ImageElement | VideoElement} image The image to process [optional].
 	*/
     ARController.prototype.process = function (image) {
-        var result = this.detectMarker(image);
-        if (result != 0) {
-            console.error("detectMarker error: " + result);
+        this._dispatchResults(this.detect(image));
+    };
+
+	/**
+		Dispatches the marker events of the results of detect().
+
+		@param {Float64Array} results The results arena, undefined if detection failed.
+	*/
+    ARController.prototype._dispatchResults = function (results) {
+        if (!results) {
+            console.error("detectMarker error: " + -99);
+            return;
+        }
+        if (results[0] != 0) {
+            console.error("detectMarker error: " + results[0]);
         }
 
         // get markers
-        var markerNum = this.getMarkerNum();
+        var markerNum = results[1];
         var k, o;
         for (k in this.patternMarkers) {
             o = this.patternMarkers[k]
@@ -214,35 +253,22 @@
         }
 
         // detect fiducial (aka squared) markers
-        for (var i = 0; i < markerNum; i++) {
-            var markerInfo = this.getMarker(i);
-
-            var markerType = artoolkit.UNKNOWN_MARKER;
-            var visible = this.trackPatternMarkerId(-1);
+        var offset = RESULTS_HEADER_SIZE;
+        for (var i = 0; i < markerNum; i++, offset += RESULTS_SQUARE_SIZE) {
+            var markerInfo = this._readMarkerInfo(results, offset);
 
-            if (markerInfo.idPatt > -1 && (markerInfo.id === markerInfo.idPatt || markerInfo.idMatrix === -1)) {
+            var markerType = results[offset + 33];
+            var visible;
+            if (markerType === artoolkit.PATTERN_MARKER) {
                 visible = this.trackPatternMarkerId(markerInfo.idPatt);
-                markerType = artoolkit.PATTERN_MARKER;
-
-                if (markerInfo.dir !== markerInfo.dirPatt) {
-                    this.setMarkerInfoDir(i, markerInfo.dirPatt);
-                }
-
-            } else if (markerInfo.idMatrix > -1) {
+            } else if (markerType === artoolkit.BARCODE_MARKER) {
                 visible = this.trackBarcodeMarkerId(markerInfo.idMatrix);
-                markerType = artoolkit.BARCODE_MARKER;
-
-                if (markerInfo.dir !== markerInfo.dirMatrix) {
-                    this.setMarkerInfoDir(i, markerInfo.dirMatrix);
-                }
-            }
-
-            if (markerType !== artoolkit.UNKNOWN_MARKER && visible.inPrevious) {
-                this.getTransMatSquareCont(i, visible.markerWidth, visible.matrix, visible.matrix);
             } else {
-                this.getTransMatSquare(i, visible.markerWidth, visible.matrix);
+                visible = this.trackPatternMarkerId(-1);
             }
 
+            // The pose was computed by detect(), continuing from the previous frame when possible.
+            visible.matrix.set(results.subarray(offset + 36, offset + 48));
             visible.inCurrent = true;
             this.transMatToGLMat(visible.matrix, this.transform_mat);
             this.transformGL_RH = this.arglCameraViewRHf(this.transform_mat);
@@ -260,14 +286,14 @@
         }
 
         // detect NFT markers
-        var nftMarkerCount = this.nftMarkerCount;
-        this.detectNFTMarker();
+        var nftMarkerCount = results[2];
 
         // in ms
         var MARKER_LOST_TIME = 200;
 
-        for (var i = 0; i < nftMarkerCount; i++) {
-            var nftMarkerInfo = this.getNFTMarker(i);
+        offset = results[4];
+        for (var i = 0; i < nftMarkerCount; i++, offset += RESULTS_NFT_SIZE) {
+            var nftMarkerInfo = this._readNFTMarkerInfo(results, offset, i);
             var markerType = artoolkit.NFT_MARKER;
 
             if (nftMarkerInfo.found) {
@@ -314,18 +340,18 @@
         }
 
         // detect multiple markers
-        var multiMarkerCount = this.getMultiMarkerCount();
+        var multiMarkerCount = results[3];
+        offset = results[5];
         for (var i = 0; i < multiMarkerCount; i++) {
-            var subMarkerCount = this.getMultiMarkerPatternCount(i);
+            var subMarkerCount = results[offset];
+            var subOffset = offset + RESULTS_MULTI_SIZE;
             var visible = false;
 
-            artoolkit.getTransMatMultiSquareRobust(this.id, i);
-            this.transMatToGLMat(this.marker_transform_mat, this.transform_mat);
+            this.transMatToGLMat(results.subarray(offset + 1, offset + 13), this.transform_mat);
             this.transformGL_RH = this.arglCameraViewRHf(this.transform_mat);
 
             for (var j = 0; j < subMarkerCount; j++) {
-                var multiEachMarkerInfo = this.getMultiEachMarker(i, j);
-                if (multiEachMarkerInfo.visible >= 0) {
+                if (results[subOffset + j * RESULTS_MULTI_EACH_SIZE] >= 0) {
                     visible = true;
                     this.dispatchEvent({
                         name: 'getMultiMarker',
@@ -341,8 +367,8 @@
             }
             if (visible) {
                 for (var j = 0; j < subMarkerCount; j++) {
-                    var multiEachMarkerInfo = this.getMultiEachMarker(i, j);
-                    this.transMatToGLMat(this.marker_transform_mat, this.transform_mat);
+                    var multiEachMarkerInfo = this._readMultiEachMarkerInfo(results, subOffset + j * RESULTS_MULTI_EACH_SIZE);
+                    this.transMatToGLMat(results.subarray(subOffset + j * RESULTS_MULTI_EACH_SIZE + 4, subOffset + (j + 1) * RESULTS_MULTI_EACH_SIZE), this.transform_mat);
                     this.transformGL_RH = this.arglCameraViewRHf(this.transform_mat);
                     this.dispatchEvent({
                         name: 'getMultiMarkerSub',
@@ -357,20 +383,752 @@
                     });
                 }
             }
+            offset = subOffset + subMarkerCount * RESULTS_MULTI_EACH_SIZE;
         }
 
         if (this._bwpointer) {
             this.debugDraw();
         }
     };
+	/**
+		Runs process() on the image and returns the path the NFT pipeline took for it. Without the
+		frame scheduler (see setFrameScheduler()) that is AR_FRAME_PATH_FULL while KPM looks for more
+		NFT markers and AR_FRAME_PATH_TRACK once all trackable markers are tracked.
+
+		@param {ImageElement | VideoElement} image The image to process [optional].
+		@return {number} artoolkit.AR_FRAME_PATH_FULL, AR_FRAME_PATH_TRACK or AR_FRAME_PATH_PREDICT.
+	*/
+    ARController.prototype.processFrame = function (image) {
+        this.process(image);
+        return artoolkit.getFramePath(this.id);
+    };
+
+	/**
+		Copies the image to the heap and runs square, NFT and multimarker detection on it in a single call.
+		All results, including marker poses, are written to the controller's results arena,
+		which is returned as a Float64Array view (see the RESULTS_* layout). The view is only valid
+		until the next call.
+
+		@param {ImageElement | VideoElement} image The image to process [optional].
+		@return {Float64Array} The results arena, or undefined if the image could not be copied to the heap.
+	*/
+    ARController.prototype.detect = function (image) {
+        if (!this._copyImageToHeap(image)) {
+            return;
+        }
+        return this._getResults(artoolkit.detect(this.id));
+    };
+
+	/**
+		Runs process() for several controllers at once, each on its own image: the images are
+		copied to the heap, then all controllers are detected in a single call, spread over worker
+		threads in threaded builds, and their events dispatched in turn. Use it for cameras
+		processed side by side, or to score stills against markers shared with shareNFTMarkers().
+
+		ARController.processBatch([leftController, rightController], [leftVideo, rightVideo]);
+
+		@param {ARController[]} controllers The controllers, each listed once.
+		@param {Array} images The image of each controller; a missing one defaults to its image [optional].
+		@return {Float64Array[]} The results arena of each controller (see detect()), undefined for
+			controllers whose image could not be copied to the heap.
+	*/
+    ARController.processBatch = function (controllers, images) {
+        var batch = [], ids = [];
+        controllers.forEach(function (controller, i) {
+            if (controller._copyImageToHeap(images && images[i])) {
+                batch.push(controller);
+                ids.push(controller.id);
+            }
+        });
+        var sizes = artoolkit.detectBatch(ids);
+        var results = controllers.map(function (controller) {
+            var k = batch.indexOf(controller);
+            return k < 0 ? undefined : controller._getResults(sizes[k]);
+        });
+        controllers.forEach(function (controller, i) {
+            controller._dispatchResults(results[i]);
+        });
+        return results;
+    };
+
+	/**
+		Returns the results arena, of size elements, as a Float64Array view.
+	*/
+    ARController.prototype._getResults = function (size) {
+        this._updateHeapViews();
+        if (!this.results || this.results.length !== size || this.results.buffer !== Module.HEAPU8.buffer) {
+            // The arena is reallocated when markers are added.
+            this.results = new Float64Array(Module.HEAPU8.buffer, artoolkit.getResultsPointer(this.id), size);
+        }
+        return this.results;
+    };
+
+	/**
+		Turns low pass filtering of the marker poses on or off. Every square and NFT marker is filtered
+		on its own (see arFilterTransMat()), from the pose it was found at. Multimarker poses are not filtered.
+
+		@param {boolean} enable Whether poses are filtered.
+		@param {number} sampleRate The detection rate in Hz, 0 for the default (30) [optional].
+		@param {number} cutoffFreq The cutoff frequency of the filter in Hz, 0 for the default (15).
+			Lower is steadier and laggier [optional].
+		@return {number} 0 on success, -1 for a negative rate or frequency.
+	*/
+    ARController.prototype.setPoseFilter = function (enable, sampleRate, cutoffFreq) {
+        return artoolkit.setPoseFilter(this.id, enable ? 1 : 0, sampleRate || 0, cutoffFreq || 0);
+    };
+
+	/**
+		@return {boolean} Whether marker poses are filtered.
+	*/
+    ARController.prototype.getPoseFilterEnabled = function () {
+        return !!artoolkit.getPoseFilterEnabled(this.id);
+    };
+
+	/**
+		Extrapolates the square and NFT marker poses of the last detect() from their last two filtered
+		poses, for the frames rendered between two detections. The poses in the results arena are
+		overwritten, so call it before reading them. Needs setPoseFilter(true).
+
+		@param {number} time The time to predict the poses at, in ms on the performance.now() clock of the
+			thread running the controller. Defaults to now; predictions are capped 250 ms ahead [optional].
+		@return {Float64Array} The results arena, as returned by detect().
+	*/
+    ARController.prototype.predict = function (time) {
+        var size = artoolkit.predictResults(this.id, time === undefined ? performance.now() : time);
+        this._updateHeapViews();
+        if (!this.results || this.results.length !== size || this.results.buffer !== Module.HEAPU8.buffer) {
+            this.results = new Float64Array(Module.HEAPU8.buffer, artoolkit.getResultsPointer(this.id), size);
+        }
+        return this.results;
+    };
+
+    ARController.prototype._readMarkerInfo = function (results, offset) {
+        var markerInfo = this._markerInfo;
+        if (!markerInfo) {
+            this._markerInfo = markerInfo = {
+                pos: [0,0],
+                line: [[0,0,0], [0,0,0], [0,0,0], [0,0,0]],
+                vertex: [[0,0], [0,0], [0,0], [0,0]]
+            };
+        }
+        var i = offset;
+        markerInfo.area = results[i++];
+        markerInfo.id = results[i++];
+        markerInfo.idPatt = results[i++];
+        markerInfo.idMatrix = results[i++];
+        markerInfo.dir = results[i++];
+        markerInfo.dirPatt = results[i++];
+        markerInfo.dirMatrix = results[i++];
+        markerInfo.cf = results[i++];
+        markerInfo.cfPatt = results[i++];
+        markerInfo.cfMatrix = results[i++];
+        markerInfo.pos[0] = results[i++];
+        markerInfo.pos[1] = results[i++];
+        for (var j = 0; j < 4; j++) {
+            markerInfo.line[j][0] = results[i++];
+            markerInfo.line[j][1] = results[i++];
+            markerInfo.line[j][2] = results[i++];
+        }
+        for (var j = 0; j < 4; j++) {
+            markerInfo.vertex[j][0] = results[i++];
+            markerInfo.vertex[j][1] = results[i++];
+        }
+        markerInfo.errorCorrected = results[i++];
+        return markerInfo;
+    };
+
+    ARController.prototype._readNFTMarkerInfo = function (results, offset, markerIndex) {
+        var markerInfo = this._NFTMarkerInfo;
+        if (!markerInfo) {
+            this._NFTMarkerInfo = markerInfo = {
+                id: 0,
+                error: -1,
+                found: 0,
+                pose: [0,0,0,0, 0,0,0,0, 0,0,0,0]
+            };
+        }
+        markerInfo.id = markerIndex;
+        markerInfo.found = results[offset];
+        markerInfo.error = results[offset + 1];
+        for (var j = 0; j < 12; j++) {
+            markerInfo.pose[j] = results[offset + 2 + j];
+        }
+        return markerInfo;
+    };
+
+    ARController.prototype._readMultiEachMarkerInfo = function (results, offset) {
+        var markerInfo = this._multiEachMarkerInfo;
+        if (!markerInfo) {
+            this._multiEachMarkerInfo = markerInfo = {};
+        }
+        markerInfo.visible = results[offset];
+        markerInfo.pattId = results[offset + 1];
+        markerInfo.pattType = results[offset + 2];
+        markerInfo.width = results[offset + 3];
+        return markerInfo;
+    };
+
   /**
     Detects the NFT markers in the process() function,
     with the given tracked id.
+
+    KPM matching runs once per frame for all loaded NFT markers;
+    call getNFTMarker(i) afterwards to read the result for each marker.
+
+    @return {number} The number of KPM matching results, or -1 if no matching was run.
   */
     ARController.prototype.detectNFTMarker = function () {
-        artoolkit.detectNFTMarker(this.id);
+        return artoolkit.detectNFTMarker(this.id);
+    }
+
+  /**
+    Rebuilds the NFT matcher index with all NFT markers added so far.
+    Calling this once after registering a batch of markers avoids paying
+    the index build on the first processed frame; otherwise it runs lazily
+    in detectNFTMarker().
+
+    @return {number} 0 on success, a negative value on error.
+  */
+    ARController.prototype.commitNFTMarkers = function () {
+        return artoolkit.commitNFTMarkers(this.id);
+    }
+
+  /**
+    Runs NFT relocalization (KPM matching) on a background thread, so frames keep
+    their pace while no NFT marker is tracked. Markers are found a few frames later
+    than with blocking matching. Only available in builds with thread support.
+
+    @param {boolean} enable Whether to match asynchronously.
+    @return {number} 0 on success, -1 if the build has no thread support.
+  */
+    ARController.prototype.setNFTAsyncMatching = function (enable) {
+        return artoolkit.setNFTAsyncMatching(this.id, enable ? 1 : 0);
+    }
+
+  /**
+    @return {boolean} Whether NFT matching runs on a background thread.
+  */
+    ARController.prototype.getNFTAsyncMatching = function () {
+        return artoolkit.getNFTAsyncMatching(this.id) === 1;
+    }
+
+  /**
+    Sets the factor by which the frame is downscaled for NFT marker matching. Matching cost
+    follows the pixel count, so a scale of 2 finds markers about four times faster, while
+    markers that are already found are still tracked at full resolution. Very small or
+    distant markers may need a scale of 1.
+
+    @param {number} scale The downscale factor, 1 (the default) to 4.
+    @return {number} 0 on success, -1 if scale is out of range.
+  */
+    ARController.prototype.setNFTMatchingScale = function (scale) {
+        return artoolkit.setNFTMatchingScale(this.id, scale);
+    }
+
+  /**
+    @return {number} The factor by which the frame is downscaled for NFT marker matching.
+  */
+    ARController.prototype.getNFTMatchingScale = function () {
+        return artoolkit.getNFTMatchingScale(this.id);
+    }
+
+  /**
+    Sets how many NFT markers can be tracked at the same time. While fewer markers
+    are tracked, KPM matching keeps looking for the others.
+
+    @param {number} maxPages The number of simultaneously tracked NFT markers (1 by default).
+    @return {number} 0 on success, -1 if maxPages is out of range.
+  */
+    ARController.prototype.setNFTMaxPages = function (maxPages) {
+        return artoolkit.setNFTMaxPages(this.id, maxPages);
+    }
+
+  /**
+    @return {number} The number of simultaneously tracked NFT markers.
+  */
+    ARController.prototype.getNFTMaxPages = function () {
+        return artoolkit.getNFTMaxPages(this.id);
+    }
+
+  /**
+    Sets how NFT tracking refits a pose that the plain least squares fit of a frame
+    leaves with too high an error. artoolkit.AR2_POSE_CASCADE (the default) runs up to
+    four robust ICP passes, each keeping fewer features. artoolkit.AR2_POSE_ROBUST runs a
+    single robust pass, keeping the features the first fit already explains, which bounds
+    the pose cost of difficult frames.
+
+    @param {number} mode AR2_POSE_CASCADE or AR2_POSE_ROBUST.
+    @param {number} maxIterations Iteration limit of each ICP pass, 0 (the default) for the ICP default.
+    @return {number} 0 on success, -1 if mode or maxIterations is invalid.
+  */
+    ARController.prototype.setNFTPoseEstimation = function (mode, maxIterations) {
+        return artoolkit.setNFTPoseEstimation(this.id, mode, maxIterations || 0);
+    }
+
+  /**
+    @return {number} The NFT pose estimation mode, AR2_POSE_CASCADE or AR2_POSE_ROBUST.
+  */
+    ARController.prototype.getNFTPoseMode = function () {
+        return artoolkit.getNFTPoseMode(this.id);
+    }
+
+  /**
+    @return {number} The iteration limit of each NFT ICP pass, 0 for the ICP default.
+  */
+    ARController.prototype.getNFTPoseMaxIterations = function () {
+        return artoolkit.getNFTPoseMaxIterations(this.id);
+    }
+
+  /**
+    Sets how NFT markers are tracked between KPM matches. artoolkit.AR2_TRACKING_6DOF (the
+    default) undistorts the matched features and fits a pose to them with ICP.
+    artoolkit.AR2_TRACKING_HOMOGRAPHY fits a homography to the features as observed, which is
+    cheaper but assumes a flat marker and a camera with little lens distortion. Poses are
+    reported as 3x4 matrices in both modes. Tracked markers are found again in the new mode.
+
+    @param {number} mode AR2_TRACKING_6DOF or AR2_TRACKING_HOMOGRAPHY.
+    @return {number} 0 on success, -1 if mode is invalid.
+  */
+    ARController.prototype.setNFTTrackingMode = function (mode) {
+        return artoolkit.setNFTTrackingMode(this.id, mode);
+    }
+
+  /**
+    @return {number} The NFT tracking mode, AR2_TRACKING_6DOF or AR2_TRACKING_HOMOGRAPHY.
+  */
+    ARController.prototype.getNFTTrackingMode = function () {
+        return artoolkit.getNFTTrackingMode(this.id);
+    }
+
+  /**
+    Sets the NFT tracking time per frame, in milliseconds, that the quality governor aims for.
+    The governor measures the time tracking takes and moves the NFT quality level one step at
+    a time: down when tracking takes longer than the budget, up when it takes well under it.
+    Slow devices keep their frame rate, fast devices get steadier poses.
+
+    @param {number} budgetMs The tracking time per frame, 0 (the default) to turn the governor off.
+    @return {number} 0 on success, -1 if budgetMs is negative.
+  */
+    ARController.prototype.setNFTTrackingBudget = function (budgetMs) {
+        return artoolkit.setNFTTrackingBudget(this.id, budgetMs);
+    }
+
+  /**
+    @return {number} The NFT tracking time per frame the governor aims for, 0 when it is off.
+  */
+    ARController.prototype.getNFTTrackingBudget = function () {
+        return artoolkit.getNFTTrackingBudget(this.id);
+    }
+
+  /**
+    Adds to the NFT tracking time of the current frame, which the governor takes into account
+    in the next process() call. Use it for tracking the controller does not time itself, in a
+    worker for example.
+
+    @param {number} frameMs The tracking time to add, in milliseconds.
+    @return {number} 0 on success, -1 if frameMs is negative.
+  */
+    ARController.prototype.addNFTTrackingTime = function (frameMs) {
+        return artoolkit.addNFTTrackingTime(this.id, frameMs);
+    }
+
+  /**
+    Sets the NFT quality level: how many features are tracked and how large the search and
+    template windows are. Levels go from 0 (cheapest) to 4 (steadiest), 2 by default.
+    With a tracking budget set the governor moves on from the given level.
+
+    @param {number} level The quality level.
+    @return {number} 0 on success, -1 if the level is out of range.
+  */
+    ARController.prototype.setNFTQualityLevel = function (level) {
+        return artoolkit.setNFTQualityLevel(this.id, level);
+    }
+
+  /**
+    @return {number} The current NFT quality level, as chosen by the governor when a budget is set.
+  */
+    ARController.prototype.getNFTQualityLevel = function () {
+        return artoolkit.getNFTQualityLevel(this.id);
+    }
+
+  /**
+    Turns the frame scheduler on or off. It picks one of three paths for the NFT pipeline in
+    each frame: KPM matching and AR2 tracking (artoolkit.AR_FRAME_PATH_FULL), AR2 tracking of
+    the tracked markers only (AR_FRAME_PATH_TRACK), or extrapolating the poses of the tracked
+    markers from their motion without looking at the frame (AR_FRAME_PATH_PREDICT).
+    Poses are only predicted after frames tracked with a low error and most features found,
+    for at most maxSkip frames in a row, and only as often as needed to keep the mean NFT time
+    per frame within budgetMs. Square markers are detected in every frame.
+
+    @param {boolean} enable Whether the scheduler runs.
+    @param {number} budgetMs The NFT time per frame to aim for, 0 (the default) to predict
+        maxSkip frames after every tracked one while tracking is steady [optional].
+    @param {number} maxSkip The most frames predicted in a row, 2 by default [optional].
+    @return {number} 0 on success, -1 if budgetMs or maxSkip is negative.
+  */
+    ARController.prototype.setFrameScheduler = function (enable, budgetMs, maxSkip) {
+        return artoolkit.setFrameScheduler(this.id, enable ? 1 : 0, budgetMs || 0, maxSkip === undefined ? 2 : maxSkip);
+    }
+
+  /**
+    @return {boolean} Whether the frame scheduler runs.
+  */
+    ARController.prototype.getFrameSchedulerEnabled = function () {
+        return !!artoolkit.getFrameSchedulerEnabled(this.id);
+    }
+
+  /**
+    @return {number} The path the NFT pipeline took in the last frame, see processFrame().
+  */
+    ARController.prototype.getFramePath = function () {
+        return artoolkit.getFramePath(this.id);
     }
 
+  /**
+    Sets the memory budget for the image data of NFT markers. Only the compact matching data
+    of every marker stays loaded; the image data of a marker is read when it is first recognized,
+    and the least recently seen markers that are not tracked are unloaded to stay within the budget.
+
+    @param {number} bytes The budget in bytes, 0 (the default) for no limit.
+    @return {number} 0 on success, -1 if bytes is negative.
+  */
+    ARController.prototype.setNFTMemoryBudget = function (bytes) {
+        return artoolkit.setNFTMemoryBudget(this.id, bytes);
+    }
+
+  /**
+    @return {number} The memory budget for the image data of NFT markers, in bytes.
+  */
+    ARController.prototype.getNFTMemoryBudget = function () {
+        return artoolkit.getNFTMemoryBudget(this.id);
+    }
+
+  /**
+    @return {number} The estimated size in bytes of the NFT image data currently loaded.
+  */
+    ARController.prototype.getNFTResidentBytes = function () {
+        return artoolkit.getNFTResidentBytes(this.id);
+    }
+
+  /**
+    Returns the size in bytes of the image data of an NFT marker currently loaded.
+
+    @param {number} markerIndex The id of the NFT marker.
+    @return {number} The size, 0 while the marker is not loaded.
+  */
+    ARController.prototype.getNFTMarkerResidentBytes = function (markerIndex) {
+        return artoolkit.getNFTMarkerResidentBytes(this.id, markerIndex);
+    }
+
+  /**
+    Sets the range of camera distances NFT markers are tracked at, in the units of the marker
+    size (mm for the usual datasets). The image levels of a marker too fine or too coarse to be
+    used within it are not kept in memory, so markers only seen from afar take a fraction of
+    their full size. Markers not tracked are reloaded with the new range when next recognized.
+
+    @param {number} nearDistance The nearest distance, 0 with farDistance 0 (the default) for any.
+    @param {number} farDistance The farthest distance.
+    @return {number} 0 on success, -1 if the range is invalid.
+  */
+    ARController.prototype.setNFTTrackingDistance = function (nearDistance, farDistance) {
+        return artoolkit.setNFTTrackingDistance(this.id, nearDistance, farDistance);
+    }
+
+  /**
+    @return {number} The nearest distance NFT markers are tracked at, 0 for any.
+  */
+    ARController.prototype.getNFTNearDistance = function () {
+        return artoolkit.getNFTNearDistance(this.id);
+    }
+
+  /**
+    @return {number} The farthest distance NFT markers are tracked at, 0 for any.
+  */
+    ARController.prototype.getNFTFarDistance = function () {
+        return artoolkit.getNFTFarDistance(this.id);
+    }
+
+  /**
+    Enables or disables the collection of per-stage timings and counters (off by default).
+    Enabling resets them. See getStats().
+
+    @param {boolean} enable Whether to collect stats.
+  */
+    ARController.prototype.setStatsEnabled = function (enable) {
+        return artoolkit.setStatsEnabled(this.id, enable);
+    }
+
+  /**
+    @return {boolean} Whether stats are collected.
+  */
+    ARController.prototype.getStatsEnabled = function () {
+        return artoolkit.getStatsEnabled(this.id);
+    }
+
+  /**
+    Sets all stats back to zero.
+  */
+    ARController.prototype.resetStats = function () {
+        return artoolkit.resetStats(this.id);
+    }
+
+  /**
+    Returns the timings, in milliseconds, and counters accumulated since stats were enabled
+    or reset, as a plain object that can be posted from a worker:
+    frames, lumaMs (RGBA to luma), detectMarkerMs (square markers), kpmMs (blocking NFT matching),
+    ar2ExtractMs, ar2MatchMs and ar2IcpMs (NFT tracking stages), featuresAttempted and
+    featuresAccepted (NFT template matches), icpRetries (robust pose passes), relocalizations
+    (NFT pages initialised from matching), trackingLosses and squareROIFrames (square marker
+    detections that scanned regions of interest only, see setSquareMarkerROI()).
+
+    @return {object} The stats.
+  */
+    ARController.prototype.getStats = function () {
+        var buffer = Module.HEAPU8.buffer;
+        if (!this._statsView || this._statsView.buffer !== buffer) {
+            this._statsView = new Float64Array(buffer, artoolkit.getStatsPointer(this.id), STATS_FIELDS.length);
+        }
+        var stats = {};
+        for (var i = 0; i < STATS_FIELDS.length; i++) {
+            stats[STATS_FIELDS[i]] = this._statsView[i];
+        }
+        return stats;
+    }
+
+	/**
+		Sets the pixel format of the frames passed to process().
+
+		With artoolkit.AR_PIXEL_FORMAT_RGBA (the default) frames come from an image, video,
+		canvas or ImageData. With artoolkit.AR_PIXEL_FORMAT_MONO, AR_PIXEL_FORMAT_420f,
+		AR_PIXEL_FORMAT_420v or AR_PIXEL_FORMAT_NV21 the frame is a byte array starting with
+		the Y plane, which is used as luma without conversion. Pass it to process(), or write
+		it into dataHeap (e.g. with copyVideoFrame()) and call process(null).
+
+		Reallocates the frame buffer, so dataHeap and videoLuma are replaced.
+
+		@param {number} format The pixel format.
+		@return {number} 0 on success, a negative value if the format is not supported.
+	*/
+    ARController.prototype.setVideoPixelFormat = function (format) {
+        var ret = artoolkit.setVideoPixelFormat(this.id, format);
+        if (ret === 0) {
+            this.pixelFormat = format;
+            this._readFrameMalloc();
+        }
+        return ret;
+    };
+
+	/**
+		Passes frames to process() in the orientation and resolution the camera delivers them,
+		instead of drawing them rotated onto a canvas of the ARController size. Each frame is
+		rotated clockwise by rotation degrees, cropped around its centre to the aspect ratio of
+		the ARController and scaled to its size natively, in the pass that computes the luma channel.
+
+		Frames are byte arrays in pixelFormat, or with AR_PIXEL_FORMAT_RGBA also images, videos,
+		canvases or ImageData at the source size. To skip the canvas readback as well, write a
+		VideoFrame with copyVideoFrame() (e.g. 'NV12' as AR_PIXEL_FORMAT_420f) and call process(null).
+		getUserMediaARController() sets a source for portrait videos.
+
+		Not available with setFrameRing(). Reallocates the frame buffer, so dataHeap (then the
+		source frame) and videoLuma are replaced.
+
+		@param {number} width The width of the camera frames, 0 to go back to frames of the ARController size.
+		@param {number} height The height of the camera frames.
+		@param {number} rotation 0, 90, 180 or 270 [optional].
+		@param {number} pixelFormat The pixel format of the camera frames, AR_PIXEL_FORMAT_RGBA by default [optional].
+		@return {number} 0 on success, -1 on error.
+	*/
+    ARController.prototype.setVideoSource = function (width, height, rotation, pixelFormat) {
+        if (pixelFormat === undefined) {
+            pixelFormat = artoolkit.AR_PIXEL_FORMAT_RGBA;
+        }
+        var ret = artoolkit.setVideoSource(this.id, width, height, rotation || 0, pixelFormat);
+        if (ret === 0) {
+            this.videoSource = width > 0 && height > 0 ? {
+                width: width,
+                height: height,
+                rotation: rotation || 0,
+                pixelFormat: pixelFormat
+            } : null;
+            this._readFrameMalloc();
+        }
+        return ret;
+    };
+
+	/**
+		Returns the pixel format of the frames passed to process().
+		@return {number} The pixel format.
+	*/
+    ARController.prototype.getVideoPixelFormat = function () {
+        return artoolkit.getVideoPixelFormat(this.id);
+    };
+
+	/**
+		Reconfigures the ARController for frames of a new size, e.g. when the app switches to
+		another scene or camera resolution, instead of disposing it and making a new one.
+		Loaded markers and settings are kept. The frame buffer is only reallocated when the
+		size changes, in which case dataHeap and videoLuma are replaced.
+
+		@param {number} width The frame width.
+		@param {number} height The frame height.
+		@return {number} 0 on success, a negative value on error.
+	*/
+    ARController.prototype.setVideoSize = function (width, height) {
+        var ret = artoolkit.setVideoSize(this.id, width, height);
+        if (ret === 0) {
+            this.width = this.videoWidth = width;
+            this.height = this.videoHeight = height;
+            this.videoSize = width * height;
+            if (this.canvas) {
+                this.canvas.width = width;
+                this.canvas.height = height;
+            }
+            this._readFrameMalloc();
+        }
+        return ret;
+    };
+
+	/**
+		Copies a WebCodecs VideoFrame straight into the frame buffer, without a canvas readback.
+		The VideoFrame format must match the format set with setVideoPixelFormat()
+		(e.g. 'NV12' or 'I420' for AR_PIXEL_FORMAT_420f). Call process(null) once the promise resolves.
+
+		@param {VideoFrame} videoFrame The frame to copy.
+		@return {Promise} Resolves when the frame has been copied.
+	*/
+    ARController.prototype.copyVideoFrame = function (videoFrame) {
+        this._updateHeapViews();
+        return videoFrame.copyTo(this.dataHeap);
+    };
+
+	/**
+		Moves the frame buffer into a ring of three slots that another thread writes frames into
+		directly, e.g. the main thread of a page running this ARController in a worker. This needs
+		a build whose memory is a SharedArrayBuffer (the perf build, on a cross-origin isolated page).
+
+		Post getFrameRing() to the writing thread and make an ARFrameRing (artoolkit.frame_ring.js)
+		of it there. Each frame it writes replaces the newest one; takeFrame() picks that one up,
+		after which process(null) or detect(null) process it. Frames the controller had no time for
+		are dropped rather than queued, and no frame is copied on the way.
+
+		Reallocates the frame buffer, so dataHeap and videoLuma are replaced.
+
+		@param {boolean} enable Whether to use the ring.
+		@return {number} 0 on success, -1 if the memory is not shared.
+	*/
+    ARController.prototype.setFrameRing = function (enable) {
+        if (enable && !(typeof SharedArrayBuffer !== 'undefined' && Module.HEAPU8.buffer instanceof SharedArrayBuffer)) {
+            return -1;
+        }
+        var ret = artoolkit.setFrameRing(this.id, enable ? 1 : 0);
+        if (ret === 0) {
+            this._readFrameMalloc();
+        }
+        return ret;
+    };
+
+	/**
+		Returns what the writing thread needs to make an ARFrameRing of the frame ring,
+		or null if setFrameRing() is off. The object can be posted to another thread.
+		Call it again after the frame buffer is reallocated (setVideoPixelFormat(), setVideoSize()).
+
+		@return {object} The shared buffer, frame layout and control block of the ring.
+	*/
+    ARController.prototype.getFrameRing = function () {
+        if (!(this.frameSlots > 1)) {
+            return null;
+        }
+        return {
+            buffer: Module.HEAPU8.buffer,
+            framePointer: this.frameSlotsPointer,
+            frameSize: this.framesize,
+            slots: this.frameSlots,
+            writeSlot: 1,
+            controlPointer: this.frameRingPointer,
+            width: this.videoWidth,
+            height: this.videoHeight,
+            pixelFormat: this.getVideoPixelFormat(),
+            waitAsync: typeof Atomics.waitAsync === 'function'
+        };
+    };
+
+	/**
+		Takes the newest frame written to the frame ring for the next process(null) or detect(null).
+		@return {boolean} false if no frame was written since the last call.
+	*/
+    ARController.prototype.takeFrame = function () {
+        var slot = artoolkit.takeFrameSlot(this.id);
+        if (slot < 0) {
+            return false;
+        }
+        this.framepointer = this.frameSlotsPointer + slot * this.framesize;
+        if (this.pixelFormat !== undefined && this.pixelFormat !== artoolkit.AR_PIXEL_FORMAT_RGBA) {
+            this.videoLumaPointer = this.framepointer; // The Y plane.
+        }
+        this.dataHeap = null;
+        this._updateHeapViews();
+        return true;
+    };
+
+	/**
+		Calls callback once a frame newer than the last taken one was written to the frame ring,
+		without blocking the thread. Needs Atomics.waitAsync(); where it is missing, the writer posts
+		a message for each frame instead (see ARFrameRing).
+
+		@param {function} callback Called without arguments.
+	*/
+    ARController.prototype.waitFrame = function (callback) {
+        if (!this.frameRingControl || this.frameRingControl.buffer !== Module.HEAPU8.buffer) {
+            this.frameRingControl = new Int32Array(Module.HEAPU8.buffer, this.frameRingPointer, 2);
+        }
+        var control = this.frameRingControl;
+        if (Atomics.load(control, FRAME_RING_READY) & FRAME_RING_FRESH) {
+            setTimeout(callback, 0);
+            return;
+        }
+        var wait = Atomics.waitAsync(control, FRAME_RING_COUNT, Atomics.load(control, FRAME_RING_COUNT));
+        if (wait.async) {
+            wait.value.then(function () { callback(); });
+        } else {
+            setTimeout(callback, 0);
+        }
+    };
+
+	/**
+		Sets the width used for square markers that were not given a width in
+		trackPatternMarkerId() or trackBarcodeMarkerId().
+
+		@param {number} markerWidth The default marker width.
+	*/
+    ARController.prototype.setDefaultMarkerWidth = function (markerWidth) {
+        this.defaultMarkerWidth = markerWidth;
+        artoolkit.setDefaultMarkerWidth(this.id, markerWidth);
+    };
+
+	/**
+		Enables region of interest tracking of square markers. Once markers are found, the
+		following frames are only thresholded and labeled in padded boxes around their
+		predicted positions, which is much cheaper than a full-frame scan for a few markers.
+		The full frame is still scanned every fullScanInterval frames, and whenever a marker
+		is not found in its region, so new markers are picked up with that delay.
+
+		Regions are not used with AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE or
+		AR_LABELING_THRESH_MODE_AUTO_BRACKETING, field image processing or debug mode.
+
+		@param {number} fullScanInterval Frames between full-frame scans, 0 (the default) to disable.
+		@return {number} 0 on success, -1 if fullScanInterval is negative.
+	*/
+    ARController.prototype.setSquareMarkerROI = function (fullScanInterval) {
+        return artoolkit.setSquareMarkerROI(this.id, fullScanInterval);
+    };
+
+	/**
+		@return {number} The frames between full-frame square marker scans, 0 if regions of interest are disabled.
+	*/
+    ARController.prototype.getSquareMarkerROI = function () {
+        return artoolkit.getSquareMarkerROI(this.id);
+    };
+
 	/**
 		Adds the given pattern marker ID to the index of tracked IDs.
 		Sets the markerWidth for the pattern marker to markerWidth.
@@ -393,9 +1151,11 @@
                 matrixGL_RH: new Float64Array(12),
                 markerWidth: markerWidth || this.defaultMarkerWidth
             };
+            artoolkit.setSquareMarkerWidth(this.id, artoolkit.PATTERN_MARKER, id, obj.markerWidth);
         }
-        if (markerWidth) {
+        if (markerWidth && markerWidth !== obj.markerWidth) {
             obj.markerWidth = markerWidth;
+            artoolkit.setSquareMarkerWidth(this.id, artoolkit.PATTERN_MARKER, id, markerWidth);
         }
         return obj;
     };
@@ -422,9 +1182,11 @@
                 matrixGL_RH: new Float64Array(12),
                 markerWidth: markerWidth || this.defaultMarkerWidth
             };
+            artoolkit.setSquareMarkerWidth(this.id, artoolkit.BARCODE_MARKER, id, obj.markerWidth);
         }
-        if (markerWidth) {
+        if (markerWidth && markerWidth !== obj.markerWidth) {
             obj.markerWidth = markerWidth;
+            artoolkit.setSquareMarkerWidth(this.id, artoolkit.BARCODE_MARKER, id, markerWidth);
         }
         return obj;
     };
@@ -567,6 +1329,138 @@
         }
     };
 
+	/**
+		Loads an NFT marker from a single .nftb bundle, made from the .fset3, .fset and .iset files
+		of a marker by build/native/nft_bundle (see tools/makenative.js). The bundle streams into
+		the heap as it downloads, and the marker is found and tracked before the whole of it arrived:
+		onSuccess is called once it can be matched, and onProgress each time a finer image level
+		arrives for tracking, from the coarsest.
+
+		arController.loadNFTMarkerBundle(bundleURL, onSuccess, onError, onProgress);
+
+		@param {string} bundleURL - The URL of the bundle.
+		@param {function} onSuccess - Called with the id of the marker once it is registered.
+		@param {function} onError - Called with the error if the bundle cannot be loaded [optional].
+		@param {function} onProgress - Called with the id of the marker and the number of its image levels in use [optional].
+	*/
+    ARController.prototype.loadNFTMarkerBundle = function (bundleURL, onSuccess, onError, onProgress) {
+        var self = this;
+        artoolkit.addNFTMarkerBundle(this.id, bundleURL, function (id) {
+            self.nftMarkerCount = id + 1;
+            if (onSuccess) onSuccess(id);
+        }, function (error) {
+            if (onError) {
+                onError(error);
+            } else {
+                console.error("Unable to load NFT bundle " + bundleURL + ": " + error);
+            }
+        }, onProgress);
+    };
+
+	/**
+		Returns the prepared data of a loaded NFT marker, its matching data and decoded image
+		pyramid with features, as the bytes of an NFT bundle, for loadNFTMarkerData() to restore
+		in a later session. The image data of a marker not matched yet is read and decoded first.
+
+		@param {number} markerIndex - The id of the NFT marker.
+		@return {Uint8Array} The bundle, or null if the marker has no prepared data.
+	*/
+    ARController.prototype.serializeNFTMarker = function (markerIndex) {
+        return artoolkit.serializeNFTMarker(this.id, markerIndex);
+    };
+
+	/**
+		Registers an NFT marker from bundle bytes in memory, as returned by serializeNFTMarker()
+		or read from a .nftb file. The bytes are copied into the heap once and tracked from there.
+
+		@param {Uint8Array | ArrayBuffer} data - The bundle.
+		@param {function} onSuccess - Called with the id of the marker.
+		@param {function} onError - Called with the error if the bundle is invalid [optional].
+	*/
+    ARController.prototype.loadNFTMarkerData = function (data, onSuccess, onError) {
+        var id = artoolkit.addNFTMarkerData(this.id, data);
+        if (id < 0) {
+            if (onError) {
+                onError('Invalid NFT bundle');
+            } else {
+                console.error('Invalid NFT bundle');
+            }
+            return;
+        }
+        this.nftMarkerCount = id + 1;
+        if (onSuccess) onSuccess(id);
+    };
+
+	/**
+		Loads an NFT marker as loadNFTMarker() does, keeping its prepared data in Cache Storage so
+		later sessions restore it with loadNFTMarkerData() instead of downloading and decoding the
+		dataset. The data is stored under its SHA-256 hash, found from the marker URL and version,
+		and checked against the hash when restored. Without Cache Storage or Web Crypto, this is
+		loadNFTMarker().
+
+		arController.loadNFTMarkerCached(markerURL, onSuccess, onError, version);
+
+		@param {string} markerURL - The URL prefix of the NFT marker.
+		@param {function} onSuccess - Called with the id of the marker.
+		@param {function} onError - Called with the error if the marker cannot be loaded.
+		@param {string} version - Changed to stop using data cached for an updated dataset [optional].
+	*/
+    ARController.prototype.loadNFTMarkerCached = function (markerURL, onSuccess, onError, version) {
+        var self = this;
+        if (typeof caches === 'undefined' || typeof crypto === 'undefined' || !crypto.subtle || !markerURL) {
+            return this.loadNFTMarker(markerURL, onSuccess, onError);
+        }
+        var indexKey = markerURL + '.nftcache?v=' + encodeURIComponent(version || '');
+
+        var load = function (cache) {
+            self.loadNFTMarker(markerURL, function (id) {
+                var data = self.serializeNFTMarker(id);
+                if (cache && data) {
+                    artoolkit.hashNFTData(data).then(function (hash) {
+                        return cache.put(NFT_CACHE_PREFIX + hash, new Response(data)).then(function () {
+                            return cache.put(indexKey, new Response(hash));
+                        });
+                    }).catch(function (error) {
+                        console.warn('Unable to cache NFT marker ' + markerURL + ': ' + error);
+                    });
+                }
+                onSuccess(id);
+            }, onError);
+        };
+
+        var lookup = function (cache) {
+            return cache.match(indexKey).then(function (index) {
+                if (!index) return null;
+                return index.text().then(function (hash) {
+                    return cache.match(NFT_CACHE_PREFIX + hash).then(function (entry) {
+                        if (!entry) return null;
+                        return entry.arrayBuffer().then(function (buffer) {
+                            return artoolkit.hashNFTData(buffer).then(function (check) {
+                                return check === hash ? buffer : null;
+                            });
+                        });
+                    });
+                });
+            });
+        };
+
+        caches.open(NFT_CACHE_NAME).then(function (cache) {
+            return lookup(cache).catch(function () {
+                return null;
+            }).then(function (buffer) {
+                var id = buffer ? artoolkit.addNFTMarkerData(self.id, buffer) : -1;
+                if (id < 0) {
+                    load(cache);
+                    return;
+                }
+                self.nftMarkerCount = id + 1;
+                onSuccess(id);
+            });
+        }, function () {
+            load(null);
+        });
+    };
+
 	/**
 		Loads an NFT marker from the given URL prefix and calls the onSuccess callback with the UID of the marker.
 
@@ -592,6 +1486,23 @@
           }
         }
 
+    };
+
+	/**
+		Registers the NFT markers of another controller on this one, sharing their image data
+		instead of loading it again, so several controllers (one per camera, or per still in
+		processBatch()) look for the same markers at the memory cost of one. The markers keep the
+		order and ids they have on the source controller when this one has no NFT markers yet.
+
+		@param {ARController} source The controller the markers were loaded on.
+		@return {number} The number of markers registered, or -1 on error.
+	*/
+    ARController.prototype.shareNFTMarkers = function (source) {
+        var count = artoolkit.shareNFTMarkers(this.id, source.id);
+        if (count > 0) {
+            this.nftMarkerCount = (this.nftMarkerCount || 0) + count;
+        }
+        return count;
     };
 
 	/**
@@ -618,6 +1529,7 @@
 	 */
     ARController.prototype.getTransMatSquare = function (markerUID, markerWidth, dst) {
         artoolkit.getTransMatSquare(this.id, markerUID, markerWidth);
+        this._updateHeapViews();
         dst.set(this.marker_transform_mat);
         return dst;
     };
@@ -634,8 +1546,10 @@
 	 * @return	{Float64Array} The dst array.
 	 */
     ARController.prototype.getTransMatSquareCont = function (markerUID, markerWidth, previousMarkerTransform, dst) {
+        this._updateHeapViews();
         this.marker_transform_mat.set(previousMarkerTransform);
         artoolkit.getTransMatSquareCont(this.id, markerUID, markerWidth);
+        this._updateHeapViews();
         dst.set(this.marker_transform_mat);
         return dst;
     };
@@ -651,6 +1565,7 @@
 	 */
     ARController.prototype.getTransMatMultiSquare = function (markerUID, dst) {
         artoolkit.getTransMatMultiSquare(this.id, markerUID);
+        this._updateHeapViews();
         dst.set(this.marker_transform_mat);
         return dst;
     };
@@ -665,6 +1580,7 @@
 	 */
     ARController.prototype.getTransMatMultiSquareRobust = function (markerUID, dst) {
         artoolkit.getTransMatMultiSquare(this.id, markerUID);
+        this._updateHeapViews();
         dst.set(this.marker_transform_mat);
         return dst;
     };
@@ -856,6 +1772,7 @@
 	 	@param {*} vertexData
 	*/
     ARController.prototype.setMarkerInfoVertex = function (markerIndex, vertexData) {
+        this._updateHeapViews();
         for (var i = 0; i < vertexData.length; i++) {
             this.marker_transform_mat[i * 2 + 0] = vertexData[i][0];
             this.marker_transform_mat[i * 2 + 1] = vertexData[i][1];
@@ -917,6 +1834,7 @@
 	 * @return {Float64Array} The 16-element WebGL camera matrix for the ARController camera parameters.
 	 */
     ARController.prototype.getCameraMatrix = function () {
+        this._updateHeapViews();
         return this.camera_mat;
     };
 
@@ -927,6 +1845,7 @@
 		@return {Float64Array} The 12-element 3x4 row-major marker transformation matrix used by ARToolKit.
 	*/
     ARController.prototype.getMarkerTransformationMatrix = function () {
+        this._updateHeapViews();
         return this.marker_transform_mat;
     };
 
@@ -1301,15 +2220,10 @@
         this._initNFT();
 
         var params = artoolkit.frameMalloc;
-        this.framepointer = params.framepointer;
-        this.framesize = params.framesize;
-        this.videoLumaPointer = params.videoLumaPointer;
-
-        this.dataHeap = new Uint8Array(Module.HEAPU8.buffer, this.framepointer, this.framesize);
-        this.videoLuma = new Uint8Array(Module.HEAPU8.buffer, this.videoLumaPointer, this.framesize / 4);
+        this.cameraPointer = params.camera;
+        this.transformPointer = params.transform;
 
-        this.camera_mat = new Float64Array(Module.HEAPU8.buffer, params.camera, 16);
-        this.marker_transform_mat = new Float64Array(Module.HEAPU8.buffer, params.transform, 12);
+        this._readFrameMalloc();
 
         this.setProjectionNearPlane(0.1)
         this.setProjectionFarPlane(1000);
@@ -1325,6 +2239,41 @@
         }.bind(this), 1);
     };
 
+  /**
+    Reads the frame buffer pointers of the controller from artoolkit.frameMalloc, after
+    setup() or a call that reallocates them.
+    @return {number} 0 (void)
+  */
+    ARController.prototype._readFrameMalloc = function () {
+        var params = artoolkit.frameMalloc;
+        this.framepointer = params.framepointer;
+        this.framesize = params.framesize;
+        this.videoLumaPointer = params.videoLumaPointer;
+        this.frameSlots = params.frameSlots;
+        this.frameSlotsPointer = params.frameSlotsPointer;
+        this.frameRingPointer = params.frameRing;
+        this.frameRingControl = null;
+        this.dataHeap = null;
+        this._updateHeapViews();
+    };
+
+  /**
+    Creates the typed array views on the frame buffer and matrices in the Emscripten heap,
+    and recreates them when the heap has grown (builds with ALLOW_MEMORY_GROWTH replace
+    Module.HEAPU8.buffer when they grow, which detaches the old views).
+    @return {number} 0 (void)
+  */
+    ARController.prototype._updateHeapViews = function () {
+        var buffer = Module.HEAPU8.buffer;
+        if (!this.framepointer || (this.dataHeap && this.dataHeap.buffer === buffer)) {
+            return;
+        }
+        this.dataHeap = new Uint8Array(buffer, this.framepointer, this.framesize);
+        this.videoLuma = new Uint8Array(buffer, this.videoLumaPointer, this.videoSize);
+        this.camera_mat = new Float64Array(buffer, this.cameraPointer, 16);
+        this.marker_transform_mat = new Float64Array(buffer, this.transformPointer, 12);
+    };
+
   /**
     Init the necessary kpm handle for NFT and the settings for the CPU.
     @return {number} 0 (void)
@@ -1338,6 +2287,24 @@
     @return {number} 0 (void)
   */
     ARController.prototype._copyImageToHeap = function (image) {
+        this._updateHeapViews();
+        if (this.frameSlots > 1) {
+            // The frame taken by takeFrame() is already in the heap.
+            if (this.pixelFormat === undefined || this.pixelFormat === artoolkit.AR_PIXEL_FORMAT_RGBA) {
+                artoolkit.prepareFrame(this.id);
+            }
+            return !!this.dataHeap;
+        }
+        if (this.videoSource) {
+            return this._copySourceToHeap(image);
+        }
+        if (this.pixelFormat !== undefined && this.pixelFormat !== artoolkit.AR_PIXEL_FORMAT_RGBA) {
+            // Planar frames are either passed as a byte array or already written to dataHeap by the caller.
+            if (image && image.byteLength !== undefined && this.dataHeap) {
+                this.dataHeap.set(image);
+            }
+            return !!this.dataHeap;
+        }
         if (!image) {
             image = this.image;
         }
@@ -1362,26 +2329,48 @@
         }
         var data = imageData.data;  // this is of type Uint8ClampedArray: The Uint8ClampedArray typed array represents an array of 8-bit unsigned integers clamped to 0-255 (https://developer.mozilla.org/en-US/docs/Web/JavaScript/Reference/Global_Objects/Uint8ClampedArray)
 
-        //Here we have access to the unmodified video image. We now need to add the videoLuma chanel to be able to serve the underlying ARTK API
-        if (this.videoLuma) {
-            var q = 0;
-            //Create luma from video data assuming Pixelformat AR_PIXEL_FORMAT_RGBA (ARToolKitJS.cpp L: 43)
-
-            for (var p = 0; p < this.videoSize; p++) {
-                var r = data[q + 0], g = data[q + 1], b = data[q + 2];
-                // videoLuma[p] = (r+r+b+g+g+g)/6;         // https://stackoverflow.com/a/596241/5843642
-                this.videoLuma[p] = (r + r + r + b + g + g + g + g) >> 3;
-                q += 4;
-            }
-        }
-
         if (this.dataHeap) {
             this.dataHeap.set(data);
+            // The luma channel used by the underlying ARTK API is computed natively from the RGBA frame.
+            artoolkit.prepareFrame(this.id);
             return true;
         }
         return false;
     };
 
+  /**
+    Copies a frame in camera orientation to the source frame of setVideoSource(), and rotates
+    and scales it to the luma channel.
+    @return {boolean} false if the frame could not be copied.
+  */
+    ARController.prototype._copySourceToHeap = function (image) {
+        var source = this.videoSource;
+        if (!this.dataHeap) {
+            return false;
+        }
+        if (image && image.byteLength !== undefined) {
+            this.dataHeap.set(image);
+        } else if (source.pixelFormat === artoolkit.AR_PIXEL_FORMAT_RGBA) {
+            // Drawn at its own size, so the canvas neither rotates nor resamples it.
+            image = image || this.image;
+            if (!image.data) {
+                if (!this._sourceCtx) {
+                    this._sourceCtx = document.createElement('canvas').getContext('2d');
+                }
+                var ctx = this._sourceCtx;
+                if (ctx.canvas.width !== source.width || ctx.canvas.height !== source.height) {
+                    ctx.canvas.width = source.width;
+                    ctx.canvas.height = source.height;
+                }
+                ctx.drawImage(image, 0, 0);
+                image = ctx.getImageData(0, 0, source.width, source.height);
+            }
+            this.dataHeap.set(image.data);
+        }
+        artoolkit.prepareFrame(this.id);
+        return true;
+    };
+
     /**
       Draw a square black border around the detect marker with
       red circle in the center. Used for debugging porpouse in debugSetup.
@@ -1628,7 +2617,8 @@
 
 		The orientation attribute of the returned ARController is set to "portrait" if the userMedia video has larger
 		height than width. Otherwise it's set to "landscape". The videoWidth and videoHeight attributes of the arController
-		are set to be always in landscape configuration so that width is larger than height.
+		are set to be always in landscape configuration so that width is larger than height. Portrait frames
+		are rotated natively, see setVideoSource().
 
 		@param {object} configuration The configuration object.
 		@return {HTMLVideoElement} Returns the created video element.
@@ -1662,6 +2652,8 @@
                     arController.orientation = 'portrait';
                     arController.videoWidth = video.videoHeight;
                     arController.videoHeight = video.videoWidth;
+                    // Rotated natively rather than on the canvas.
+                    arController.setVideoSource(video.videoWidth, video.videoHeight, 90);
                 } else {
                     arController.orientation = 'landscape';
                     arController.videoWidth = video.videoWidth;
@@ -1791,10 +2783,19 @@
 
         addMarker: addMarker,
         addMultiMarker: addMultiMarker,
-        addNFTMarker: addNFTMarker
+        addNFTMarker: addNFTMarker,
+        addNFTMarkerBundle: addNFTMarkerBundle,
+        addNFTMarkerData: addNFTMarkerData,
+        serializeNFTMarker: serializeNFTMarker,
+        hashNFTData: hashNFTData,
+        detectBatch: detectBatch
 
     };
 
+    // Cache Storage of NFT marker data, see ARController.loadNFTMarkerCached().
+    var NFT_CACHE_NAME = 'artoolkit-nft';
+    var NFT_CACHE_PREFIX = '/artoolkit-nft/';
+
     var FUNCTIONS = [
         'setup',
         'teardown',
@@ -1821,10 +2822,61 @@
         'getMultiMarkerNum',
         'getMultiMarkerCount',
 
+        'setVideoPixelFormat',
+        'setVideoSource',
+        'getVideoPixelFormat',
+        'setVideoSize',
+        'setFrameRing',
+        'takeFrameSlot',
+
+        'prepareFrame',
         'detectMarker',
         'getMarkerNum',
+        'setSquareMarkerROI',
+        'getSquareMarkerROI',
+
+        'setStatsEnabled',
+        'getStatsEnabled',
+        'resetStats',
+        'getStatsPointer',
+
+        'detect',
+        'shareNFTMarkers',
+        'getResultsPointer',
+        'setPoseFilter',
+        'getPoseFilterEnabled',
+        'predictResults',
+        'setSquareMarkerWidth',
+        'setDefaultMarkerWidth',
 
         'detectNFTMarker',
+        'commitNFTMarkers',
+        'setNFTAsyncMatching',
+        'getNFTAsyncMatching',
+        'setNFTMatchingScale',
+        'getNFTMatchingScale',
+        'setNFTMaxPages',
+        'getNFTMaxPages',
+        'setNFTPoseEstimation',
+        'getNFTPoseMode',
+        'getNFTPoseMaxIterations',
+        'setNFTTrackingMode',
+        'getNFTTrackingMode',
+        'setNFTTrackingBudget',
+        'getNFTTrackingBudget',
+        'addNFTTrackingTime',
+        'setNFTQualityLevel',
+        'getNFTQualityLevel',
+        'setFrameScheduler',
+        'getFrameSchedulerEnabled',
+        'getFramePath',
+        'setNFTMemoryBudget',
+        'getNFTMemoryBudget',
+        'getNFTResidentBytes',
+        'getNFTMarkerResidentBytes',
+        'setNFTTrackingDistance',
+        'getNFTNearDistance',
+        'getNFTFarDistance',
 
         'getNFTMarker',
         'getMarker',
@@ -1894,6 +2946,184 @@
         }, function (errorNumber) { if (onError) onError(errorNumber) });
     }
 
+    /*
+        Streams an NFT bundle (.nftb, see emscripten/nftBundle.h) straight into the heap, without
+        going through the file system. The page is registered, and callback called with its id,
+        once its matching data and features have arrived; onProgress is then called with the id
+        and the number of image levels in use each time the next coarsest level arrives.
+    */
+    function addNFTMarkerBundle(arId, url, callback, onError, onProgress) {
+        var done = false;
+        var fail = function (error) {
+            if (done) return;
+            done = true;
+            if (onError) onError(error);
+        };
+
+        var bundle = 0, size = 0, received = 0;
+        var markerId = -1, levels = 0;
+        var pending = [], pendingBytes = 0; // Chunks read before the size in the header.
+
+        var write = function (chunk) {
+            Module.HEAPU8.set(chunk, bundle + received);
+            received += chunk.length;
+        };
+
+        var consume = function (chunk) {
+            if (!bundle) {
+                pending.push(chunk);
+                pendingBytes += chunk.length;
+                if (pendingBytes < 16) return true;
+                var head = new Uint8Array(16), n = 0;
+                pending.forEach(function (c) {
+                    head.set(c.subarray(0, Math.min(c.length, 16 - n)), n);
+                    n += Math.min(c.length, 16 - n);
+                });
+                size = new DataView(head.buffer).getUint32(12, true);
+                if (bytesToString(head.subarray(0, 4)) !== 'NFTB' || size < 16 || size < pendingBytes || !(bundle = Module._allocNFTBundle(size))) {
+                    fail('Invalid NFT bundle');
+                    return false;
+                }
+                pending.forEach(write);
+                pending = null;
+            } else {
+                if (received + chunk.length > size) {
+                    fail('Invalid NFT bundle');
+                    return false;
+                }
+                write(chunk);
+            }
+
+            if (markerId < 0) {
+                var headSize = Module._getNFTBundleHeadSize(bundle, received);
+                if (headSize < 0) {
+                    fail('Invalid NFT bundle');
+                    return false;
+                }
+                if (headSize > 0 && received >= headSize) {
+                    markerId = Module._addNFTMarkerBundle(arId, bundle, size, received);
+                    if (markerId < 0) {
+                        fail('Invalid NFT bundle');
+                        return false;
+                    }
+                    if (callback) callback(markerId);
+                }
+            }
+            if (markerId >= 0) {
+                var levelNum = Module._updateNFTMarkerBundle(arId, markerId, received);
+                if (levelNum < 0) {
+                    fail(levelNum); // The controller was disposed of.
+                    return false;
+                }
+                if (levelNum !== levels) {
+                    levels = levelNum;
+                    if (onProgress) onProgress(markerId, levels);
+                }
+            }
+            return true;
+        };
+
+        var finish = function () {
+            if (received !== size || markerId < 0) {
+                fail('Truncated NFT bundle');
+            }
+            // Until registered, the bundle belongs to this loader.
+            if (markerId < 0 && bundle) {
+                Module._freeNFTBundle(bundle);
+            }
+            done = true;
+        };
+
+        fetch(url).then(function (response) {
+            if (!response.ok) {
+                fail(response.status);
+                finish();
+                return;
+            }
+            if (!response.body || !response.body.getReader) {
+                return response.arrayBuffer().then(function (buffer) {
+                    consume(new Uint8Array(buffer));
+                    finish();
+                });
+            }
+            var reader = response.body.getReader();
+            var pump = function () {
+                return reader.read().then(function (result) {
+                    if (result.done) {
+                        finish();
+                    } else if (consume(result.value)) {
+                        return pump();
+                    } else {
+                        reader.cancel();
+                        finish();
+                    }
+                });
+            };
+            return pump();
+        }).catch(function (error) {
+            fail(error);
+            finish();
+        });
+    }
+
+    /*
+        Copies the NFT bundle of a loaded marker out of the heap (see serializeNFTMarker() in
+        ARToolKitJS.cpp), or returns null.
+    */
+    function serializeNFTMarker(arId, markerIndex) {
+        var bundle = Module._serializeNFTMarker(arId, markerIndex);
+        if (!bundle) return null;
+        var size = new DataView(Module.HEAPU8.buffer, bundle + 12, 4).getUint32(0, true);
+        var data = Module.HEAPU8.slice(bundle, bundle + size);
+        Module._freeNFTBundle(bundle);
+        return data;
+    }
+
+    /*
+        Registers an NFT bundle held in memory, all of it available. Returns the marker id, or -1.
+    */
+    function addNFTMarkerData(arId, data) {
+        var bytes = data instanceof Uint8Array ? data : new Uint8Array(data);
+        if (bytes.length < 16 || bytesToString(bytes.subarray(0, 4)) !== 'NFTB') return -1;
+        var bundle = Module._allocNFTBundle(bytes.length);
+        if (!bundle) return -1;
+        Module.HEAPU8.set(bytes, bundle);
+        var id = Module._addNFTMarkerBundle(arId, bundle, bytes.length, bytes.length);
+        if (id < 0) {
+            Module._freeNFTBundle(bundle);
+        }
+        return id;
+    }
+
+    /*
+        Resolves to the hex SHA-256 of NFT bundle bytes, the key of their Cache Storage entry.
+    */
+    function hashNFTData(data) {
+        return crypto.subtle.digest('SHA-256', data).then(function (digest) {
+            return Array.prototype.map.call(new Uint8Array(digest), function (b) {
+                return (b < 16 ? '0' : '') + b.toString(16);
+            }).join('');
+        });
+    }
+
+    /*
+        Runs Module._detectBatch() on the controllers and returns the size of each one's results.
+    */
+    function detectBatch(ids) {
+        var vector = new Module.VectorInt();
+        ids.forEach(function (id) {
+            vector.push_back(id);
+        });
+        var ret = Module._detectBatch(vector);
+        vector.delete();
+        if (ret < 0) {
+            console.error('detectBatch error: ' + ret);
+        }
+        return ids.map(function (id) {
+            return ret < 0 ? 0 : Module.getResultsLength(id);
+        });
+    }
+
     function bytesToString(array) {
         return String.fromCharCode.apply(String, array);
     }
@@ -0,0 +1,87 @@
+; (function () {
+    'use strict'
+
+    /*
+        Writing side of the frame ring of an ARController running in a worker
+        (see ARController.setFrameRing()). Needs no other JSARToolKit script, so it can be
+        included by the page that owns the camera.
+
+            // In the worker:
+            ar.setFrameRing(true);
+            postMessage({type: 'frameRing', ring: ar.getFrameRing()});
+
+            // On the page:
+            var ring = new ARFrameRing(msg.ring, worker);
+            ring.write(context.getImageData(0, 0, width, height).data);
+
+        Frames go straight into the WebAssembly memory shared with the worker. A frame written
+        before the worker took the previous one replaces it, so a slow worker drops frames
+        instead of queueing them.
+    */
+
+    var scope;
+    if (typeof window !== 'undefined') {
+        scope = window;
+    } else {
+        scope = self;
+    };
+
+    // Keep in sync with the FRAME_RING_* defines in ARToolKitJS.cpp.
+    var FRAME_RING_READY = 0;
+    var FRAME_RING_COUNT = 1;
+    var FRAME_RING_FRESH = 0x100;
+
+    /**
+        @param {object} ring The result of ARController.getFrameRing() in the worker.
+        @param {Worker} worker The worker, posted a "process" message after each frame when it
+            cannot wait on the ring with Atomics.waitAsync() [optional].
+    */
+    var ARFrameRing = function (ring, worker) {
+        this.width = ring.width;
+        this.height = ring.height;
+        this.pixelFormat = ring.pixelFormat;
+        this.frameSize = ring.frameSize;
+        this.frames = [];
+        for (var i = 0; i < ring.slots; i++) {
+            this.frames.push(new Uint8Array(ring.buffer, ring.framePointer + i * ring.frameSize, ring.frameSize));
+        }
+        this.control = new Int32Array(ring.buffer, ring.controlPointer, 2);
+        this.slot = ring.writeSlot;
+        this.worker = ring.waitAsync ? null : worker;
+    };
+
+    /**
+        Returns the slot the next frame is written to, e.g. for VideoFrame.copyTo().
+        Call publish() once it is filled.
+        @return {Uint8Array} The frame buffer.
+    */
+    ARFrameRing.prototype.getFrame = function () {
+        return this.frames[this.slot];
+    };
+
+    /**
+        Copies a frame (RGBA pixels, or the planes of the controller's pixel format) into the
+        ring and publishes it.
+        @param {Uint8Array | Uint8ClampedArray} data The frame.
+    */
+    ARFrameRing.prototype.write = function (data) {
+        this.frames[this.slot].set(data);
+        this.publish();
+    };
+
+    /**
+        Makes the frame in getFrame() the newest one, and takes the slot of the previous
+        newest frame if the worker has not picked it up.
+    */
+    ARFrameRing.prototype.publish = function () {
+        this.slot = Atomics.exchange(this.control, FRAME_RING_READY, this.slot | FRAME_RING_FRESH) & ~FRAME_RING_FRESH;
+        Atomics.add(this.control, FRAME_RING_COUNT, 1);
+        Atomics.notify(this.control, FRAME_RING_COUNT);
+        if (this.worker) {
+            this.worker.postMessage({type: "process"});
+        }
+    };
+
+    scope.ARFrameRing = ARFrameRing;
+
+})();
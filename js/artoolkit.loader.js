@@ -0,0 +1,53 @@
+; (function () {
+    'use strict'
+
+    /*
+        Loads the fastest wasm build of JSARToolKit the browser can run.
+
+        The perf flavor (build/artoolkit_wasm.perf.js) needs WebAssembly SIMD and, as it uses
+        pthreads on SharedArrayBuffer, a cross-origin isolated page (served with
+        Cross-Origin-Opener-Policy: same-origin and Cross-Origin-Embedder-Policy: require-corp).
+        Other browsers get build/artoolkit_wasm.js. Either way artoolkit-loaded is dispatched
+        once the runtime is ready.
+
+        Set artoolkit_build_path before including this script if the build directory is not
+        at ../build/ relative to the page (or to the worker script).
+    */
+
+    var scope;
+    if (typeof window !== 'undefined') {
+        scope = window;
+    } else {
+        scope = self;
+    };
+
+    // Smallest module using a SIMD128 instruction (i8x16.popcnt), from wasm-feature-detect.
+    var SIMD_TEST_MODULE = new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11]);
+
+    var supportsSimd = function () {
+        try {
+            return typeof WebAssembly === 'object' && WebAssembly.validate(SIMD_TEST_MODULE);
+        } catch (e) {
+            return false;
+        }
+    };
+
+    var supportsThreads = function () {
+        return !!scope.crossOriginIsolated && typeof SharedArrayBuffer !== 'undefined';
+    };
+
+    var buildPath = scope.artoolkit_build_path || '../build/';
+    var buildName = (supportsSimd() && supportsThreads()) ? 'artoolkit_wasm.perf' : 'artoolkit_wasm';
+
+    scope.artoolkit_build = buildName;
+    scope.artoolkit_wasm_url = buildPath + buildName + '.wasm';
+
+    if (typeof document !== 'undefined') {
+        var script = document.createElement('script');
+        script.src = buildPath + buildName + '.js';
+        document.head.appendChild(script);
+    } else {
+        importScripts(buildPath + buildName + '.js');
+    }
+
+})();
@@ -8,14 +8,23 @@ self.onmessage = function(e) {
             return;
         }
         case "process": {
+            if (frameRing) {
+                processRing();
+                return;
+            }
             next = msg.imagedata;
             process();
             return;
         }
+        case "stats": {
+            postMessage({type: "stats", stats: ar ? ar.getStats() : null});
+            return;
+        }
     }
 };
 
 var next = null;
+var frameRing = false;
 
 var ar = null;
 var markerResult = null;
@@ -26,6 +35,13 @@ function load(msg) {
 
     param.onload = function () {
         ar = new ARController(msg.pw, msg.ph, param);
+        if (msg.stats) {
+            ar.setStatsEnabled(true);
+        }
+        // Predict NFT poses between tracked frames, see ARController.setFrameScheduler().
+        if (msg.frameScheduler) {
+            ar.setFrameScheduler(true, msg.frameScheduler.budgetMs, msg.frameScheduler.maxSkip);
+        }
         var cameraMatrix = ar.getCameraMatrix();
 
         ar.addEventListener('getNFTMarker', function (ev) {
@@ -39,6 +55,15 @@ function load(msg) {
         });
 
         postMessage({type: "loaded", proj: JSON.stringify(cameraMatrix)});
+
+        // Frames written by the page straight into the shared memory, see ARFrameRing.
+        if (msg.frameRing && ar.setFrameRing(true) === 0) {
+            frameRing = true;
+            postMessage({type: "frameRing", ring: ar.getFrameRing()});
+            if (typeof Atomics.waitAsync === 'function') {
+                ar.waitFrame(processRing);
+            }
+        }
     };
 }
 
@@ -46,15 +71,27 @@ function process() {
 
     markerResult = null;
 
+    var path = -1;
     if (ar) {
-        ar.process(next);
+        path = ar.processFrame(next);
     }
 
     if (markerResult) {
+        markerResult.path = path;
         postMessage(markerResult);
     } else {
-        postMessage({type: "not found"});
+        postMessage({type: "not found", path: path});
     }
 
     next = null;
 }
+
+function processRing() {
+    // This takes the newest frame only; the ones written while the last frame was processed are dropped.
+    if (ar.takeFrame()) {
+        process();
+    }
+    if (typeof Atomics.waitAsync === 'function') {
+        ar.waitFrame(processRing);
+    }
+}
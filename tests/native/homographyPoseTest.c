@@ -0,0 +1,142 @@
+/*
+ *  homographyPoseTest.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Checks that ar2HomographyToPoseMod() (emscripten/trackingMod.c) gives back the tilted poses
+ *  passed to ar2PoseToHomographyMod(), and that its rotation is orthonormal, also when the
+ *  homography is perturbed and skewed well past what a first order correction can fix.
+ *  Built and run by tools/makenative.js.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <AR/ar.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trackingMod.h"
+
+#define ORTHONORMAL_TOLERANCE    1.0e-5
+#define ROTATION_TOLERANCE       1.0e-4
+#define TRANSLATION_TOLERANCE    1.0e-4    // Relative to the distance to the camera.
+#define NOISE                    2.0e-3    // Relative perturbation of the homography.
+#define SHEAR                    0.3       // Share of the first column added to the second, skewing r1 and r2.
+
+// Rotation of angles ax, ay and az in degrees about x, then y, then z.
+static void makePose( double ax, double ay, double az, double tx, double ty, double tz, float pose[3][4] )
+{
+    double     cx = cos(ax*M_PI/180.0), sx = sin(ax*M_PI/180.0);
+    double     cy = cos(ay*M_PI/180.0), sy = sin(ay*M_PI/180.0);
+    double     cz = cos(az*M_PI/180.0), sz = sin(az*M_PI/180.0);
+
+    pose[0][0] = (float)(cz*cy); pose[0][1] = (float)(cz*sy*sx - sz*cx); pose[0][2] = (float)(cz*sy*cx + sz*sx);
+    pose[1][0] = (float)(sz*cy); pose[1][1] = (float)(sz*sy*sx + cz*cx); pose[1][2] = (float)(sz*sy*cx - cz*sx);
+    pose[2][0] = (float)(-sy);   pose[2][1] = (float)(cy*sx);            pose[2][2] = (float)(cy*cx);
+    pose[0][3] = (float)tx;
+    pose[1][3] = (float)ty;
+    pose[2][3] = (float)tz;
+}
+
+// Largest deviation of R^T R from the identity, or 1 if R is a reflection.
+static double orthonormalError( const float pose[3][4] )
+{
+    double     err = 0.0, dot, det;
+    int        i, j, k;
+
+    for( i = 0; i < 3; i++ ) {
+        for( j = 0; j < 3; j++ ) {
+            dot = 0.0;
+            for( k = 0; k < 3; k++ ) dot += (double)pose[k][i] * pose[k][j];
+            if( fabs(dot - (i == j)) > err ) err = fabs(dot - (i == j));
+        }
+    }
+    det = pose[0][0] * (pose[1][1] * pose[2][2] - pose[1][2] * pose[2][1])
+        - pose[0][1] * (pose[1][0] * pose[2][2] - pose[1][2] * pose[2][0])
+        + pose[0][2] * (pose[1][0] * pose[2][1] - pose[1][1] * pose[2][0]);
+    if( det < 0.0 ) return 1.0;
+
+    return err;
+}
+
+int main( int argc, char *argv[] )
+{
+    ARParamLT        cparamLT;
+    float            pose[3][4], pose2[3][4], homography[3][4];
+    double           angles[][3] = { { 0, 0, 0 }, { 30, 0, 0 }, { 50, 20, 30 }, { -60, 35, -120 }, { 10, -70, 175 } };
+    double           err, rotErr, transErr;
+    int              n, noisy, i, j;
+    int              checked = 0, failed = 0;
+
+    (void)argc; (void)argv;
+
+    // A 640x480 camera without lens distortion.
+    memset( &cparamLT, 0, sizeof(cparamLT) );
+    cparamLT.param.xsize = 640;
+    cparamLT.param.ysize = 480;
+    cparamLT.param.mat[0][0] = 660.0; cparamLT.param.mat[0][2] = 318.0;
+    cparamLT.param.mat[1][1] = 655.0; cparamLT.param.mat[1][2] = 242.0;
+    cparamLT.param.mat[2][2] = 1.0;
+
+    srand( 1 );
+    for( n = 0; n < (int)(sizeof(angles)/sizeof(angles[0])); n++ ) {
+        for( noisy = 0; noisy <= 1; noisy++ ) {
+            makePose( angles[n][0], angles[n][1], angles[n][2], 25.0, -40.0, 450.0, pose );
+            checked++;
+            if( ar2PoseToHomographyMod(&cparamLT, pose, homography) < 0 ) {
+                fprintf( stderr, "ar2PoseToHomographyMod() failed for pose %d.\n", n );
+                failed++;
+                continue;
+            }
+            if( noisy ) {
+                for( j = 0; j < 3; j++ ) {
+                    for( i = 0; i < 4; i++ ) {
+                        homography[j][i] *= (float)(1.0 + NOISE * (2.0 * rand() / RAND_MAX - 1.0));
+                    }
+                    homography[j][1] += (float)SHEAR * homography[j][0];
+                }
+            }
+            if( ar2HomographyToPoseMod(&cparamLT, homography, pose2) < 0 ) {
+                fprintf( stderr, "ar2HomographyToPoseMod() failed for pose %d.\n", n );
+                failed++;
+                continue;
+            }
+
+            err = orthonormalError( pose2 );
+            if( err > ORTHONORMAL_TOLERANCE ) {
+                fprintf( stderr, "Pose %d%s: rotation is off orthonormal by %g.\n", n, noisy ? " with noise" : "", err );
+                failed++;
+            }
+            if( noisy ) continue;
+
+            rotErr = transErr = 0.0;
+            for( j = 0; j < 3; j++ ) {
+                for( i = 0; i < 3; i++ ) {
+                    if( fabs(pose2[j][i] - pose[j][i]) > rotErr ) rotErr = fabs(pose2[j][i] - pose[j][i]);
+                }
+                if( fabs(pose2[j][3] - pose[j][3]) > transErr ) transErr = fabs(pose2[j][3] - pose[j][3]);
+            }
+            if( rotErr > ROTATION_TOLERANCE || transErr > TRANSLATION_TOLERANCE * pose[2][3] ) {
+                fprintf( stderr, "Pose %d: round trip is off by %g in rotation and %g in translation.\n", n, rotErr, transErr );
+                failed++;
+            }
+        }
+    }
+
+    printf( "homographyPoseTest: %d poses, %d failed.\n", checked, failed );
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+ *  templateMatchTest.c
+ *  artoolkit5 jsartoolkit5
+ *
+ *  Checks that ar2GetBestMatchingMod() (emscripten/templateMod.c) returns the same match as
+ *  ar2GetBestMatching() of AR2/template.c, for search points all over the frame and up to its
+ *  edges. The frame ends at a guard page, so a read past its last row faults.
+ *  Built and run by tools/makenative.js, and by tools/makem.js with the WebAssembly SIMD
+ *  kernels of the perf flavor under node, where mprotect() does not enforce the guard page.
+ *
+ *  This file is part of ARToolKit.
+ *
+ *  ARToolKit is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ARToolKit is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with ARToolKit.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <AR/ar.h>
+#include <AR2/template.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "templateMod.h"
+
+#ifndef AR2_TEMP_SCALE
+#define AR2_TEMP_SCALE     2
+#endif
+
+#define XSIZE              160
+#define YSIZE              120
+#define SEARCH_SIZE        12
+
+// A frame of xsize * ysize bytes ending right before an inaccessible page.
+static ARUint8 *allocGuardedFrame( int xsize, int ysize, void **map, size_t *mapSize )
+{
+    size_t     page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t     size = (size_t)xsize * ysize;
+    size_t     dataSize = (size + page - 1) / page * page;
+    ARUint8   *base;
+
+    *mapSize = dataSize + page;
+    base = (ARUint8 *)mmap( NULL, *mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED ) return NULL;
+    if( mprotect(base + dataSize, page, PROT_NONE) != 0 ) {
+        munmap( base, *mapSize );
+        return NULL;
+    }
+    *map = base;
+    return base + dataSize - size;
+}
+
+// Samples the template around (cx, cy) of img as ar2SetTemplateSub() does. With holes, every
+// seventh pixel is made a null pixel so the matcher takes its general path.
+static void setTemplate( AR2TemplateT *templ, const ARUint8 *img, int xsize, int cx, int cy, int holes )
+{
+    ARUint16  *p = templ->img1;
+    int        sum = 0, sum2 = 0, validNum = 0;
+    int        i, j, v;
+
+    for( j = -templ->yts1; j <= templ->yts2; j++ ) {
+        for( i = -templ->xts1; i <= templ->xts2; i++, p++ ) {
+            if( holes && (p - templ->img1) % 7 == 3 ) {
+                *p = AR2_TEMPLATE_NULL_PIXEL;
+                continue;
+            }
+            v = img[(cy + j*AR2_TEMP_SCALE)*xsize + cx + i*AR2_TEMP_SCALE];
+            *p = (ARUint16)v;
+            sum += v;
+            sum2 += v*v;
+            validNum++;
+        }
+    }
+    templ->sum = sum;
+    templ->validNum = validNum;
+    templ->vlen = (int)sqrtf((float)(sum2 - sum*sum/validNum));
+}
+
+int main( int argc, char *argv[] )
+{
+    ARUint8          *img, *mfImage, *mfImage2;
+    void             *map;
+    size_t            mapSize;
+    AR2TemplateT     *templ;
+    ARScratchArenaT  *scratch;
+    int               search[3][2];
+    int               px[] = { 0, 1, 5, 13, 40, 80, XSIZE - 14, XSIZE - 6, XSIZE - 2, XSIZE - 1 };
+    int               py[] = { 0, 1, 5, 13, 30, 60, YSIZE - 14, YSIZE - 6, YSIZE - 2, YSIZE - 1 };
+    int               ts, holes, useScratch, i, j, k;
+    int               checked = 0, failed = 0;
+
+    (void)argc; (void)argv;
+
+    if( (img = allocGuardedFrame(XSIZE, YSIZE, &map, &mapSize)) == NULL ) {
+        fprintf( stderr, "Error: unable to map the frame.\n" );
+        return 1;
+    }
+    // Smooth texture with some noise, so that matches are unique but not trivial.
+    srand( 1 );
+    for( j = 0; j < YSIZE; j++ ) {
+        for( i = 0; i < XSIZE; i++ ) {
+            img[j*XSIZE + i] = (ARUint8)(128 + 60*sin(i*0.21 + j*0.05) + 40*cos(j*0.17 - i*0.03) + rand() % 17 - 8);
+        }
+    }
+    arMalloc( mfImage,  ARUint8, XSIZE*YSIZE );
+    arMalloc( mfImage2, ARUint8, XSIZE*YSIZE );
+    scratch = arScratchArenaCreate( 0 );
+
+    for( ts = 3; ts <= 6; ts += 3 ) {
+        templ = ar2GenTemplate( ts, ts );
+        for( holes = 0; holes <= 1; holes++ ) {
+            setTemplate( templ, img, XSIZE, XSIZE/2, YSIZE/2, holes );
+            for( useScratch = 0; useScratch <= 1; useScratch++ ) {
+                for( j = 0; j < (int)(sizeof(py)/sizeof(py[0])); j++ ) {
+                    for( i = 0; i < (int)(sizeof(px)/sizeof(px[0])); i++ ) {
+                        int    bx = -1, by = -1, bx2 = -1, by2 = -1;
+                        float  val = 0.0F, val2 = 0.0F;
+                        int    ret, ret2;
+
+                        search[0][0] = px[i];
+                        search[0][1] = py[j];
+                        search[1][0] = search[1][1] = -1;
+                        search[2][0] = search[2][1] = -1;
+                        memset( mfImage,  0, XSIZE*YSIZE );
+                        memset( mfImage2, 0, XSIZE*YSIZE );
+                        ret  = ar2GetBestMatching( img, mfImage, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, templ,
+                                                   SEARCH_SIZE, SEARCH_SIZE, search, &bx, &by, &val );
+                        ret2 = ar2GetBestMatchingMod( img, mfImage2, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, templ,
+                                                      SEARCH_SIZE, SEARCH_SIZE, search, &bx2, &by2, &val2,
+                                                      useScratch ? scratch : NULL );
+                        checked++;
+                        if( ret != ret2 || (ret == 0 && (bx != bx2 || by != by2 || val != val2)) ) {
+                            fprintf( stderr, "Mismatch at (%d, %d), template size %d%s: ar2GetBestMatching() %d (%d, %d) %f, "
+                                     "ar2GetBestMatchingMod() %d (%d, %d) %f\n", px[i], py[j], ts, holes ? " with null pixels" : "",
+                                     ret, bx, by, val, ret2, bx2, by2, val2 );
+                            failed++;
+                        }
+                        for( k = 0; k < XSIZE*YSIZE; k++ ) if( mfImage[k] != mfImage2[k] ) break;
+                        if( k < XSIZE*YSIZE ) {
+                            fprintf( stderr, "Visited flags differ at (%d, %d), template size %d.\n", px[i], py[j], ts );
+                            failed++;
+                        }
+                    }
+                }
+            }
+        }
+        ar2FreeTemplate( templ );
+    }
+
+    arScratchArenaDelete( &scratch );
+    free( mfImage );
+    free( mfImage2 );
+    munmap( map, mapSize );
+
+    printf( "templateMatchTest: %d searches, %d failed.\n", checked, failed );
+    return failed ? 1 : 0;
+}
@@ -205,6 +205,742 @@ window.addEventListener('artoolkit-loaded', () => {
 
     });
 
+    QUnit.test("Process a Y plane with AR_PIXEL_FORMAT_420f", assert => {
+        const videoWidth = 640, videoHeight = 480;
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(videoWidth, videoHeight, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.deepEqual(arController.setVideoPixelFormat(artoolkit.AR_PIXEL_FORMAT_420f), 0, "Pixel format set");
+                assert.deepEqual(arController.getVideoPixelFormat(), artoolkit.AR_PIXEL_FORMAT_420f, "Pixel format read back");
+                assert.deepEqual(arController.framesize, videoWidth * videoHeight * 3 / 2, "Frame buffer holds a 4:2:0 frame");
+                assert.deepEqual(arController.videoLumaPointer, arController.framepointer, "Luma is the Y plane of the frame");
+
+                const frame = new Uint8Array(arController.framesize).fill(128);
+                assert.deepEqual(arController.detectMarker(frame), 0, "Detect marker ran successfully");
+                assert.deepEqual(arController.videoLuma[0], 128, "Y plane is used as luma");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Detect image into the results arena", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+
+                const results = arController.detect(v1);
+                assert.ok(results instanceof Float64Array, "Results arena is a Float64Array");
+                assert.deepEqual(results[0], 0, "Detect marker ran successfully");
+                assert.deepEqual(results[6], results.length, "Arena size is stored in the header");
+                assert.deepEqual(results[2], 0, "No NFT markers registered");
+                assert.strictEqual(arController.detect(v1), results, "Arena view is reused while its size is unchanged");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Collect per-stage stats", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.notOk(arController.getStatsEnabled(), "Stats are off by default");
+                arController.detect(v1);
+                assert.deepEqual(arController.getStats().frames, 0, "No frames counted while off");
+
+                arController.setStatsEnabled(true);
+                arController.detect(v1);
+                arController.detect(v1);
+                const stats = arController.getStats();
+                assert.deepEqual(stats.frames, 2, "Frames counted");
+                assert.ok(stats.detectMarkerMs >= 0, "Square detection timed");
+                assert.deepEqual(stats.relocalizations, 0, "No NFT markers registered");
+
+                arController.resetStats();
+                assert.deepEqual(arController.getStats().frames, 0, "Stats reset");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Set the NFT pose estimation mode", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.deepEqual(arController.getNFTPoseMode(), artoolkit.AR2_POSE_CASCADE, "Cascade by default");
+                assert.deepEqual(arController.setNFTPoseEstimation(artoolkit.AR2_POSE_ROBUST, 8), 0, "Robust mode set");
+                assert.deepEqual(arController.getNFTPoseMode(), artoolkit.AR2_POSE_ROBUST, "Mode read back");
+                assert.deepEqual(arController.getNFTPoseMaxIterations(), 8, "Iteration limit read back");
+                assert.deepEqual(arController.setNFTPoseEstimation(42), -1, "Unknown mode rejected");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Track square markers in regions of interest", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                arController.loadMarker('./patt.hiro', (markerId) => {
+                    assert.ok(markerId >= 0, "Marker loaded");
+                    // The identified squares of the last detect(), by id.
+                    const found = () => {
+                        const markers = {};
+                        const markerNum = arController.detect(v1)[1];
+                        for (let i = 0; i < markerNum; i++) {
+                            const marker = arController.getMarker(i);
+                            if (marker.id >= 0) markers[marker.id] = { pos: [marker.pos[0], marker.pos[1]], dir: marker.dir };
+                        }
+                        return markers;
+                    };
+                    assert.deepEqual(arController.getSquareMarkerROI(), 0, "Disabled by default");
+                    const fullFrame = found();
+                    assert.ok(fullFrame[markerId], "The full-frame scan finds the marker");
+
+                    assert.deepEqual(arController.setSquareMarkerROI(10), 0, "Regions of interest enabled");
+                    assert.deepEqual(arController.getSquareMarkerROI(), 10, "Full scan interval read back");
+                    assert.deepEqual(arController.setSquareMarkerROI(-1), -1, "Negative interval rejected");
+                    arController.setStatsEnabled(true);
+                    for (let i = 0; i < 3; i++) {
+                        const markers = found();
+                        assert.deepEqual(Object.keys(markers), Object.keys(fullFrame), "Same markers as a full-frame scan");
+                        assert.deepEqual(markers[markerId].dir, fullFrame[markerId].dir, "Same direction as a full-frame scan");
+                        assert.ok(Math.abs(markers[markerId].pos[0] - fullFrame[markerId].pos[0]) < 0.5
+                            && Math.abs(markers[markerId].pos[1] - fullFrame[markerId].pos[1]) < 0.5, "Same position as a full-frame scan");
+                    }
+                    assert.deepEqual(arController.getStats().squareROIFrames, 2, "The frames after the first scan regions of interest only");
+
+                    setTimeout(() => {
+                        arController.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+    QUnit.test("Share a camera between controllers", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        let loaded = 0;
+        const success = () => {
+            if (++loaded < 2) return;
+            assert.deepEqual(cameraPara2.id, cameraPara.id, "A camera loaded again gets its first id back");
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                const arController2 = new ARController(v1, cameraPara2);
+                arController2.onload = (err) => {
+                    assert.notOk(err, "no error");
+                    const markerNum = arController.detect(v1)[1];
+                    arController.dispose();
+                    assert.deepEqual(arController2.detect(v1)[1], markerNum, "Shared lookup table outlives the first controller");
+
+                    setTimeout(() => {
+                        arController2.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                };
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+        const cameraPara2 = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Reconfigure the frame size", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                const width = arController.videoWidth;
+                const height = arController.videoHeight;
+                const framepointer = arController.framepointer;
+                const halfWidth = Math.floor(width / 2);
+                const halfHeight = Math.floor(height / 2);
+                assert.deepEqual(arController.setVideoSize(width, height), 0, "Same size");
+                assert.deepEqual(arController.framepointer, framepointer, "Frame buffer kept for the same size");
+
+                assert.deepEqual(arController.setVideoSize(halfWidth, halfHeight), 0, "Half size");
+                assert.deepEqual(arController.framesize, halfWidth * halfHeight * 4, "Frame buffer resized");
+                assert.deepEqual(arController.setVideoSize(0, height), -1, "Empty size rejected");
+                arController.detect(v1);
+
+                assert.deepEqual(arController.setVideoSize(width, height), 0, "Back to full size");
+                assert.deepEqual(arController.videoLuma.length, width * height, "Luma view resized");
+                arController.detect(v1);
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Set the NFT tracking budget", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.deepEqual(arController.getNFTTrackingBudget(), 0, "Governor off by default");
+                assert.deepEqual(arController.getNFTQualityLevel(), 2, "Default quality level");
+                assert.deepEqual(arController.setNFTTrackingBudget(8.5), 0, "Budget set");
+                assert.deepEqual(arController.getNFTTrackingBudget(), 8.5, "Budget read back");
+                assert.deepEqual(arController.setNFTTrackingBudget(-1), -1, "Negative budget rejected");
+                assert.deepEqual(arController.setNFTQualityLevel(4), 0, "Quality level set");
+                assert.deepEqual(arController.getNFTQualityLevel(), 4, "Quality level read back");
+                assert.deepEqual(arController.setNFTQualityLevel(5), -1, "Out of range level rejected");
+                arController.detect(v1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 4, "Level kept while nothing is tracked");
+
+                // Drive the governor with tracking times around a 10 ms budget. The hold between two
+                // changes is 30 tracked frames, and the level goes up under 6 ms.
+                const track = (ms, frames) => {
+                    for (let i = 0; i < frames; i++) {
+                        arController.addNFTTrackingTime(ms);
+                        arController.detect(v1);
+                    }
+                };
+                assert.deepEqual(arController.addNFTTrackingTime(-1), -1, "Negative time rejected");
+                assert.deepEqual(arController.setNFTTrackingBudget(10), 0, "Budget set");
+                arController.setNFTQualityLevel(2);
+                track(20, 1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 1, "Level lowered over the budget");
+                track(20, 30);
+                assert.deepEqual(arController.getNFTQualityLevel(), 1, "Level held after a change");
+                arController.detect(v1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 1, "Frames without tracking not counted");
+                track(20, 1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 0, "Level lowered again after the hold");
+                track(20, 1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 0, "Level kept at the cheapest");
+
+                arController.setNFTQualityLevel(2);
+                track(8, 40);
+                assert.deepEqual(arController.getNFTQualityLevel(), 2, "Level kept inside the band");
+                arController.setNFTQualityLevel(2);
+                track(2, 1);
+                assert.deepEqual(arController.getNFTQualityLevel(), 3, "Level raised under the budget");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Frame ring needs shared memory", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.deepEqual(arController.getFrameRing(), null, "No ring by default");
+                assert.notOk(arController.takeFrame(), "Nothing to take without a ring");
+                if (typeof SharedArrayBuffer === "undefined" || !(Module.HEAPU8.buffer instanceof SharedArrayBuffer)) {
+                    assert.deepEqual(arController.setFrameRing(true), -1, "Refused without shared memory");
+                } else {
+                    assert.deepEqual(arController.setFrameRing(true), 0, "Ring enabled");
+                    const ring = new ARFrameRing(arController.getFrameRing());
+                    assert.notOk(arController.takeFrame(), "Nothing written yet");
+                    ring.write(new Uint8Array(ring.frameSize));
+                    assert.ok(arController.takeFrame(), "Frame taken");
+                    assert.notOk(arController.takeFrame(), "Frame taken once");
+                    assert.ok(arController.detect(null), "Frame detected");
+                }
+                assert.ok(arController.detect(v1), "Detects with the plain frame buffer");
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Filter and predict poses", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                assert.notOk(arController.getPoseFilterEnabled(), "Off by default");
+                assert.deepEqual(arController.setPoseFilter(true, 30, -1), -1, "Negative cutoff refused");
+                assert.deepEqual(arController.setPoseFilter(true, 60, 5), 0, "Filter enabled");
+                assert.ok(arController.getPoseFilterEnabled(), "Filter on");
+
+                const results = arController.detect(v1);
+                assert.ok(results, "Detects with the filter");
+                const predicted = arController.predict();
+                assert.deepEqual(predicted.length, results.length, "Prediction keeps the arena");
+
+                arController.loadMarker('./patt.hiro', (markerId) => {
+                    // The pose of the hiro marker in the arena (RESULTS_HEADER_SIZE 8, RESULTS_SQUARE_SIZE 48,
+                    // transform at 36), row major, so its translation is at 3, 7 and 11.
+                    const pose = (results) => {
+                        for (let i = 0; i < results[1]; i++) {
+                            const r = 8 + i * 48;
+                            if (results[r + 34] === markerId) return Array.from(results.subarray(r + 36, r + 48));
+                        }
+                    };
+                    const offset = (a, b) => [a[3] - b[3], a[7] - b[7], a[11] - b[11]];
+                    const canvas = (dx) => {
+                        const c = document.createElement('canvas');
+                        c.width = v1.width;
+                        c.height = v1.height;
+                        if (dx !== undefined) c.getContext('2d').drawImage(v1, dx, 0);
+                        return c;
+                    };
+                    const moved = canvas(8);
+                    const blank = canvas();
+
+                    arController.setPoseFilter(false);
+                    const rawA = pose(arController.detect(v1));
+                    const rawB = pose(arController.detect(moved));
+                    assert.ok(rawA && rawB, "Marker found in both frames");
+                    assert.notDeepEqual(rawA[3], rawB[3], "Marker moved between the frames");
+
+                    // A low cutoff, restarted by a frame without the marker.
+                    arController.setPoseFilter(true, 60, 1);
+                    arController.detect(blank);
+                    const filteredA = pose(arController.detect(v1));
+                    assert.ok(Math.abs(filteredA[3] - rawA[3]) < 1e-3, "A restarted filter starts at the detected pose");
+                    const filteredB = pose(arController.detect(moved));
+                    assert.ok((filteredB[3] - rawA[3]) * (rawB[3] - filteredB[3]) > 0, "Filtered pose lags between the detected ones");
+
+                    const step = offset(filteredB, filteredA);
+                    const ahead = offset(pose(arController.predict(performance.now() + 100)), filteredB);
+                    const dot = step[0] * ahead[0] + step[1] * ahead[1] + step[2] * ahead[2];
+                    assert.ok(dot > 0.999 * Math.hypot(...step) * Math.hypot(...ahead), "Prediction moves on along the last two poses");
+                    assert.deepEqual(pose(arController.predict(0)), filteredB, "No prediction before the last detection");
+
+                    assert.deepEqual(arController.setPoseFilter(false), 0, "Filter disabled");
+                    assert.notOk(arController.getPoseFilterEnabled(), "Filter off");
+                    setTimeout(() => {
+                        arController.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Schedule the NFT pipeline per frame", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                assert.notOk(arController.getFrameSchedulerEnabled(), "Off by default");
+                assert.deepEqual(arController.setFrameScheduler(true, -1), -1, "Negative budget refused");
+                assert.deepEqual(arController.setFrameScheduler(true, 8, -1), -1, "Negative skip count refused");
+                assert.deepEqual(arController.setFrameScheduler(true, 8, 2), 0, "Scheduler enabled");
+                assert.ok(arController.getFrameSchedulerEnabled(), "Scheduler on");
+
+                // Nothing is tracked, so every frame looks for markers.
+                assert.deepEqual(arController.processFrame(v1), artoolkit.AR_FRAME_PATH_FULL, "Full path without tracking");
+                assert.deepEqual(arController.getFramePath(), artoolkit.AR_FRAME_PATH_FULL, "Path of the last frame");
+                assert.notDeepEqual(artoolkit.AR_FRAME_PATH_TRACK, artoolkit.AR_FRAME_PATH_PREDICT, "Distinct paths");
+
+                assert.deepEqual(arController.setFrameScheduler(false), 0, "Scheduler disabled");
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Reject an invalid NFT bundle", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                const bundleURL = URL.createObjectURL(new Blob([new Uint8Array(64)]));
+                arController.loadNFTMarkerBundle(bundleURL, (markerId) => {
+                    assert.ok(false, "Registered an invalid bundle");
+                    arController.dispose();
+                    done();
+                }, (error) => {
+                    assert.ok(error, "Invalid bundle refused");
+                    assert.notOk(arController.nftMarkerCount, "No marker registered");
+                    URL.revokeObjectURL(bundleURL);
+                    setTimeout(() => {
+                        arController.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Serialize and restore an NFT marker", assert => {
+        const done = assert.async();
+        assert.timeout(10000);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                assert.deepEqual(arController.serializeNFTMarker(0), null, "No data without a marker");
+                arController.loadNFTMarker('../examples/DataNFT/pinball', (markerId) => {
+                    const data = arController.serializeNFTMarker(markerId);
+                    assert.ok(data && data.length > 16, "Prepared data serialized");
+                    assert.deepEqual(String.fromCharCode.apply(String, data.subarray(0, 4)), "NFTB", "Serialized as an NFT bundle");
+                    arController.loadNFTMarkerData(data, (restoredId) => {
+                        assert.deepEqual(restoredId, markerId + 1, "Marker restored from the data");
+                        assert.deepEqual(arController.nftMarkerCount, markerId + 2, "Both markers registered");
+                        arController.loadNFTMarkerData(new Uint8Array(64), (id) => {
+                            assert.ok(false, "Registered invalid data");
+                        }, (error) => {
+                            assert.ok(error, "Invalid data refused");
+                        });
+                        setTimeout(() => {
+                            arController.dispose();
+                            done();
+                        }
+                        ,this.cleanUpTimeout);
+                    });
+                }, (error) => {
+                    assert.notOk(error, "Unable to load the NFT marker");
+                    arController.dispose();
+                    done();
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Keep the NFT image levels of the tracking distances", assert => {
+        const done = assert.async();
+        assert.timeout(10000);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+            arController.onload = (err) => {
+                assert.deepEqual(arController.getNFTNearDistance(), 0, "Any distance by default");
+                assert.deepEqual(arController.getNFTFarDistance(), 0, "Any distance by default");
+                assert.deepEqual(arController.setNFTTrackingDistance(500, 100), -1, "Inverted range rejected");
+                assert.deepEqual(arController.setNFTTrackingDistance(500, 0), -1, "Open range rejected");
+                assert.deepEqual(arController.getNFTMarkerResidentBytes(0), -3, "No marker registered");
+                arController.loadNFTMarker('../examples/DataNFT/pinball', (markerId) => {
+                    assert.deepEqual(arController.getNFTMarkerResidentBytes(markerId), 0, "Image data read on first match");
+                    arController.serializeNFTMarker(markerId);
+                    const fullBytes = arController.getNFTMarkerResidentBytes(markerId);
+                    assert.ok(fullBytes > 0, "All image levels loaded");
+                    assert.deepEqual(arController.getNFTResidentBytes(), fullBytes, "Marker bytes in the total");
+
+                    assert.deepEqual(arController.setNFTTrackingDistance(1000, 3000), 0, "Range set");
+                    assert.deepEqual(arController.getNFTNearDistance(), 1000, "Near distance read back");
+                    assert.deepEqual(arController.getNFTFarDistance(), 3000, "Far distance read back");
+                    assert.deepEqual(arController.getNFTMarkerResidentBytes(markerId), 0, "Untracked marker unloaded");
+                    arController.serializeNFTMarker(markerId);
+                    const bytes = arController.getNFTMarkerResidentBytes(markerId);
+                    assert.ok(bytes > 0 && bytes < fullBytes, "Only the coarse levels kept");
+                    setTimeout(() => {
+                        arController.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                }, (error) => {
+                    assert.notOk(error, "Unable to load the NFT marker");
+                    arController.dispose();
+                    done();
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Share NFT markers and detect a batch of controllers", assert => {
+        const done = assert.async();
+        assert.timeout(10000);
+        const success = () => {
+            const source = new ARController(v1, cameraPara);
+            source.onload = (err) => {
+                const other = new ARController(v1, cameraPara);
+                other.onload = (err) => {
+                    assert.deepEqual(other.shareNFTMarkers(other), -1, "Sharing with itself rejected");
+                    assert.deepEqual(other.shareNFTMarkers(source), 0, "Nothing to share yet");
+                    source.loadNFTMarker('../examples/DataNFT/pinball', (markerId) => {
+                        assert.deepEqual(other.shareNFTMarkers(source), 1, "Marker shared");
+                        assert.deepEqual(other.nftMarkerCount, 1, "Marker registered");
+                        assert.deepEqual(other.getNFTMarkerResidentBytes(0), 0, "Image data not copied");
+                        assert.ok(source.getNFTMarkerResidentBytes(markerId) > 0, "Image data loaded once");
+
+                        const results = ARController.processBatch([source, other], [v1, v1]);
+                        assert.deepEqual(results.length, 2, "Results of each controller");
+                        assert.deepEqual(results[0][2], 1, "NFT marker of the source reported");
+                        assert.deepEqual(results[1][2], 1, "Shared NFT marker reported");
+                        assert.notEqual(results[0].byteOffset, results[1].byteOffset, "Separate results arenas");
+
+                        // The shared data outlives its source.
+                        source.dispose();
+                        other.process(v1);
+                        setTimeout(() => {
+                            other.dispose();
+                            done();
+                        }
+                        ,this.cleanUpTimeout);
+                    }, (error) => {
+                        assert.notOk(error, "Unable to load the NFT marker");
+                        source.dispose();
+                        other.dispose();
+                        done();
+                    });
+                };
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Set the NFT tracking mode", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                assert.deepEqual(arController.getNFTTrackingMode(), artoolkit.AR2_TRACKING_6DOF, "6DOF by default");
+                assert.deepEqual(arController.setNFTTrackingMode(artoolkit.AR2_TRACKING_HOMOGRAPHY), 0, "Homography mode set");
+                assert.deepEqual(arController.getNFTTrackingMode(), artoolkit.AR2_TRACKING_HOMOGRAPHY, "Mode read back");
+                arController.loadNFTMarker('../examples/DataNFT/pinball', (markerId) => {
+                    arController.process(v1);
+                    assert.deepEqual(arController.getNFTTrackingMode(), artoolkit.AR2_TRACKING_HOMOGRAPHY, "Mode kept while detecting");
+                    assert.deepEqual(arController.setNFTTrackingMode(42), -1, "Unknown mode rejected");
+                    assert.deepEqual(arController.setNFTTrackingMode(artoolkit.AR2_TRACKING_6DOF), 0, "6DOF mode set back");
+
+                    setTimeout(() => {
+                        arController.dispose();
+                        done();
+                    }
+                    ,this.cleanUpTimeout);
+                }, () => {
+                    assert.ok(false, "NFT marker not loaded");
+                    done();
+                });
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Take frames in camera orientation", assert => {
+        const done = assert.async();
+        assert.timeout(this.timeout);
+        const success = () => {
+            const arController = new ARController(v1, cameraPara);
+
+            arController.onload = (err) => {
+                assert.notOk(err, "no error");
+                const w = arController.width;
+                const h = arController.height;
+                // A portrait frame, h wide and w high, rotated clockwise to the landscape controller.
+                assert.deepEqual(arController.setVideoSource(h, w, 90, artoolkit.AR_PIXEL_FORMAT_MONO), 0, "Source set");
+                assert.deepEqual(arController.getVideoPixelFormat(), artoolkit.AR_PIXEL_FORMAT_MONO, "Controller frames are luma");
+                assert.deepEqual(arController.setVideoPixelFormat(artoolkit.AR_PIXEL_FORMAT_RGBA), -1, "Pixel format kept with a source");
+
+                const frame = new Uint8Array(w * h);
+                for (let y = 0; y < w; y++) {
+                    for (let x = 0; x < h; x++) {
+                        frame[y * h + x] = (x + 3 * y) & 0xff;
+                    }
+                }
+                arController.process(frame);
+                const expected = (i, j) => (j + 3 * (w - 1 - i)) & 0xff;
+                assert.deepEqual(arController.videoLuma[0], expected(0, 0), "Top left");
+                assert.deepEqual(arController.videoLuma[w - 1], expected(w - 1, 0), "Top right");
+                assert.deepEqual(arController.videoLuma[(h - 1) * w + 5], expected(5, h - 1), "Bottom row");
+
+                assert.deepEqual(arController.setVideoSource(0, 0), 0, "Source detached");
+                assert.deepEqual(arController.getVideoPixelFormat(), artoolkit.AR_PIXEL_FORMAT_RGBA, "Pixel format restored");
+                arController.process(v1);
+
+                setTimeout(() => {
+                    arController.dispose();
+                    done();
+                }
+                ,this.cleanUpTimeout);
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
+    QUnit.test("Detect a batch of controllers with background matching", assert => {
+        const done = assert.async();
+        assert.timeout(20000);
+        const success = () => {
+            const first = new ARController(v1, cameraPara);
+            first.onload = (err) => {
+                const second = new ARController(v1, cameraPara);
+                second.onload = (err) => {
+                    // Each controller asks for its own tracking and KPM threads; those the build's
+                    // thread pool cannot hold run on the calling thread instead of blocking it.
+                    first.setNFTAsyncMatching(true);
+                    second.setNFTAsyncMatching(true);
+                    first.loadNFTMarker('../examples/DataNFT/pinball', (markerId) => {
+                        assert.deepEqual(second.shareNFTMarkers(first), 1, "Marker shared");
+
+                        let results;
+                        for (let i = 0; i < 5; i++) {
+                            results = ARController.processBatch([first, second], [v1, v1]);
+                        }
+                        assert.deepEqual(results.length, 2, "Results of each controller");
+                        assert.deepEqual(results[0][2], 1, "NFT marker of the first controller reported");
+                        assert.deepEqual(results[1][2], 1, "NFT marker of the second controller reported");
+                        assert.deepEqual(artoolkit.detectBatch([first.id, first.id]), [0, 0], "A controller listed twice is rejected");
+
+                        first.dispose();
+                        second.dispose();
+                        done();
+                    }, (error) => {
+                        assert.notOk(error, "Unable to load the NFT marker");
+                        first.dispose();
+                        second.dispose();
+                        done();
+                    });
+                };
+            };
+        }
+        const error = function () {
+            assert.ok(false);
+            done();
+        }
+        const cameraPara = new ARCameraParam(this.cParaUrl, success, error);
+    });
+
     /* #### ARController.getUserMedia module #### */ 
     QUnit.module("ARController.getUserMedia", {
         afterEach : assert => {
@@ -15,6 +15,23 @@ var
 const platform = os.platform();
 
 var HAVE_NFT = 1;
+// Opt-in pthreads build: NFT template matching runs on a pool of worker threads.
+// The page must be served cross-origin isolated to get SharedArrayBuffer.
+var HAVE_THREADS = 0;
+var THREAD_POOL_SIZE = 4;
+// NFT controllers that get their own tracking and KPM threads; further ones run them inline.
+var THREADED_CONTROLLERS = 2;
+// Per threaded controller THREAD_POOL_SIZE pthreads for AR2 tracking and one for background KPM
+// matching, plus THREAD_POOL_SIZE - 1 for detectBatch(). The pool is preallocated and cannot grow
+// while the main thread waits on a worker, so the controllers never start more than it holds.
+var PTHREAD_POOL_SIZE = THREADED_CONTROLLERS * (THREAD_POOL_SIZE + 1) + THREAD_POOL_SIZE - 1;
+// Opt-in WASM SIMD128 kernels for the wasm build; the asm.js builds always use the scalar code.
+var HAVE_SIMD = 0;
+// Frame-time tuned wasm flavor built next to the -Oz one: -O3, SIMD128 and a growable heap.
+// js/artoolkit.loader.js picks it on browsers with SIMD and cross-origin isolation.
+var HAVE_PERF = 1;
+var PERF_THREADS = 1; // pthreads in the perf flavor, independent of HAVE_THREADS.
+var PERF_MEM = 64 * 1024 * 1024; // Initial heap of the perf flavor, grown on demand.
 
 var EMSCRIPTEN_ROOT = process.env.EMSCRIPTEN;
 var ARTOOLKIT5_ROOT = process.env.ARTOOLKIT5_ROOT || path.resolve(__dirname, "../emscripten/artoolkit5");
@@ -36,11 +53,18 @@ var OUTPUT_PATH = path.resolve(__dirname, '../build/') + '/';
 var BUILD_DEBUG_FILE = 'artoolkit.debug.js';
 var BUILD_WASM_FILE = 'artoolkit_wasm.js';
 var BUILD_MIN_FILE = 'artoolkit.min.js';
+var BUILD_WASM_PERF_FILE = 'artoolkit_wasm.perf.js';
 
 var MAIN_SOURCES = [
 	'ARToolKitJS.cpp',
 	'trackingMod.c',
 	'trackingMod2d.c',
+	'templateMod.c',
+	'videoLuma.c',
+	'trackingSub.c',
+	'markerROI.c',
+	'nftBundle.c',
+	'scratchArena.c',
 ];
 
 if (!fs.existsSync(path.resolve(ARTOOLKIT5_ROOT, 'include/AR/config.h'))) {
@@ -148,8 +172,22 @@ if (HAVE_NFT) {
   .concat(kpm_sources);
 }
 
+if (HAVE_THREADS) {
+  ar_sources = ar_sources.concat([
+    path.resolve(__dirname, ARTOOLKIT5_ROOT + '/lib/SRC/ARUtil/thread_sub.c'),
+  ]);
+}
+
+var perf_sources = ar_sources;
+if (PERF_THREADS && !HAVE_THREADS) {
+  perf_sources = perf_sources.concat([
+    path.resolve(__dirname, ARTOOLKIT5_ROOT + '/lib/SRC/ARUtil/thread_sub.c'),
+  ]);
+}
+
 var DEFINES = ' ';
 if (HAVE_NFT) DEFINES += ' -D HAVE_NFT ';
+if (HAVE_THREADS) DEFINES += ' -D HAVE_THREADS -D TRACKING_THREAD_POOL_SIZE=' + THREAD_POOL_SIZE + ' -D TRACKING_PTHREAD_POOL_SIZE=' + PTHREAD_POOL_SIZE + ' ';
 
 var FLAGS = '' + OPTIMIZE_FLAGS;
 FLAGS += ' -Wno-warn-absolute-paths ';
@@ -157,8 +195,21 @@ FLAGS += ' -s TOTAL_MEMORY=' + MEM + ' ';
 FLAGS += ' -s USE_ZLIB=1';
 FLAGS += ' -s USE_LIBJPEG';
 FLAGS += ' --memory-init-file 0 '; // for memless file
+if (HAVE_THREADS) FLAGS += ' -s USE_PTHREADS=1 -s PTHREAD_POOL_SIZE=' + PTHREAD_POOL_SIZE + ' ';
 
 var WASM_FLAGS = ' -s BINARYEN_TRAP_MODE=clamp'
+if (HAVE_SIMD) WASM_FLAGS += ' -msimd128 ';
+
+var PERF_DEFINES = DEFINES;
+if (PERF_THREADS && !HAVE_THREADS) PERF_DEFINES += ' -D HAVE_THREADS -D TRACKING_THREAD_POOL_SIZE=' + THREAD_POOL_SIZE + ' -D TRACKING_PTHREAD_POOL_SIZE=' + PTHREAD_POOL_SIZE + ' ';
+
+var PERF_FLAGS = ' -O3 -msimd128 ';
+PERF_FLAGS += ' -Wno-warn-absolute-paths ';
+PERF_FLAGS += ' -s TOTAL_MEMORY=' + PERF_MEM + ' -s ALLOW_MEMORY_GROWTH=1 ';
+PERF_FLAGS += ' -s USE_ZLIB=1';
+PERF_FLAGS += ' -s USE_LIBJPEG';
+if (PERF_THREADS) PERF_FLAGS += ' -pthread -s SHARED_MEMORY=1 -s PTHREAD_POOL_SIZE=' + PTHREAD_POOL_SIZE + ' ';
+PERF_FLAGS += ' --bind ';
 
 var PRE_FLAGS = ' --pre-js ' + path.resolve(__dirname, '../js/artoolkit.api.js') +' ';
 
@@ -172,6 +223,8 @@ DEBUG_FLAGS += ' --profiling '
 // DEBUG_FLAGS += ' -s EMTERPRETIFY_ADVISE=1 '
 DEBUG_FLAGS += ' -s ALLOW_MEMORY_GROWTH=1';
 DEBUG_FLAGS += '  -s DEMANGLE_SUPPORT=1 ';
+// Assert that the per-frame scratch arenas never run out, and log heap growth after warm-up.
+DEBUG_FLAGS += ' -D AR_SCRATCH_CHECK ';
 
 var INCLUDES = [
     path.resolve(__dirname, ARTOOLKIT5_ROOT + '/include'),
@@ -216,6 +269,11 @@ var compile_kpm = format(EMCC + ' ' + INCLUDES + ' '
     + FLAGS + ' ' + DEFINES + ' -o {OUTPUT_PATH}libkpm.bc ',
     OUTPUT_PATH);
 
+var compile_arlib_perf = format(EMCC + ' ' + INCLUDES + ' '
+    + perf_sources.join(' ')
+    + PERF_FLAGS + ' ' + PERF_DEFINES + ' -o {OUTPUT_PATH}libar_perf.bc ',
+    OUTPUT_PATH);
+
 var ALL_BC = " {OUTPUT_PATH}libar.bc ";
 
 var compile_combine = format(EMCC + ' ' + INCLUDES + ' '
@@ -233,6 +291,31 @@ var compile_wasm = format(EMCC + ' ' + INCLUDES + ' '
     + FLAGS + WASM_FLAGS + DEFINES + PRE_FLAGS + ' -o {OUTPUT_PATH}{BUILD_FILE} ',
     OUTPUT_PATH, OUTPUT_PATH, BUILD_WASM_FILE);
 
+var compile_wasm_perf = format(EMCC + ' ' + INCLUDES + ' '
+    + ' {OUTPUT_PATH}libar_perf.bc ' + MAIN_SOURCES
+    + PERF_FLAGS + PERF_DEFINES + PRE_FLAGS + ' -o {OUTPUT_PATH}{BUILD_FILE} ',
+    OUTPUT_PATH, OUTPUT_PATH, BUILD_WASM_PERF_FILE);
+
+// The template matching test of tools/makenative.js, built as the perf flavor is, so
+// ar2GetBestMatchingMod() runs its WebAssembly SIMD kernels, and run under node.
+var TEST_OUTPUT_PATH = OUTPUT_PATH + 'test/';
+var PERF_TEST_FLAGS = ' -O3 -msimd128 -Wno-warn-absolute-paths -s ALLOW_MEMORY_GROWTH=1 -s USE_ZLIB=1 -s USE_LIBJPEG -s EXIT_RUNTIME=1 ';
+if (PERF_THREADS) PERF_TEST_FLAGS += ' -pthread -s SHARED_MEMORY=1 ';
+
+function make_test_dir() {
+    if (!fs.existsSync(TEST_OUTPUT_PATH)) fs.mkdirSync(TEST_OUTPUT_PATH);
+}
+
+var compile_template_test_perf = format(EMCC + ' ' + INCLUDES + ' '
+    + ' {OUTPUT_PATH}libar_perf.bc '
+    + path.resolve(__dirname, '../tests/native/templateMatchTest.c') + ' '
+    + path.resolve(SOURCE_PATH, 'templateMod.c') + ' '
+    + path.resolve(SOURCE_PATH, 'scratchArena.c') + ' '
+    + PERF_TEST_FLAGS + PERF_DEFINES + ' -o {OUTPUT_PATH}templateMatchTest.perf.js ',
+    OUTPUT_PATH, TEST_OUTPUT_PATH);
+
+var run_template_test_perf = 'node ' + TEST_OUTPUT_PATH + 'templateMatchTest.perf.js';
+
 var compile_all = format(EMCC + ' ' + INCLUDES + ' '
     + ar_sources.join(' ')
     + FLAGS + ' ' + DEFINES + ' -o {OUTPUT_PATH}{BUILD_FILE} ',
@@ -283,6 +366,13 @@ addJob(compile_arlib);
 addJob(compile_combine);
 addJob(compile_wasm);
 addJob(compile_combine_min);
+if (HAVE_PERF) {
+  addJob(compile_arlib_perf);
+  addJob(compile_wasm_perf);
+  addJob(make_test_dir);
+  addJob(compile_template_test_perf);
+  addJob(run_template_test_perf);
+}
 // addJob(compile_all);
 
 runJob();
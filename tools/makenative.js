@@ -0,0 +1,266 @@
+/*
+ * Native (non-Emscripten) build of the controller code in emscripten/ARToolKitJS.cpp,
+ * linked into the build/native/artoolkit_bench benchmark driver (emscripten/ARToolKitBench.cpp),
+ * and of the build/native/nft_bundle NFT dataset converter (emscripten/nftBundleTool.c).
+ * The tests in tests/native/ are linked the same way and run last; the build fails if one does.
+ * Needs a C/C++ compiler (CC and CXX, cc and c++ by default), zlib and libjpeg.
+ */
+
+
+var
+	exec = require('child_process').exec,
+	path = require('path'),
+	fs = require('fs');
+
+var HAVE_NFT = 1;
+// KPM matching and AR2 template matching on threads, as in the HAVE_THREADS wasm build.
+var HAVE_THREADS = 1;
+var THREAD_POOL_SIZE = 4;
+
+var CC = process.env.CC || 'cc';
+var CXX = process.env.CXX || 'c++';
+var OPTIMIZE_FLAGS = ' -O3 -g ';
+
+var ARTOOLKIT5_ROOT = process.env.ARTOOLKIT5_ROOT || path.resolve(__dirname, "../emscripten/artoolkit5");
+var SOURCE_PATH = path.resolve(__dirname, '../emscripten/') + '/';
+var OUTPUT_PATH = path.resolve(__dirname, '../build/native/') + '/';
+var OBJ_PATH = OUTPUT_PATH + 'obj/';
+
+var BUILD_BENCH_FILE = 'artoolkit_bench';
+var BUILD_BUNDLE_TOOL_FILE = 'nft_bundle';
+var TEST_PATH = path.resolve(__dirname, '../tests/native/') + '/';
+
+// Native tests of the emscripten/ modules, one program each.
+var NATIVE_TESTS = [
+	'templateMatchTest',
+	'homographyPoseTest',
+];
+
+// ARToolKitJS.cpp is compiled as part of the benchmark driver, which includes it.
+var MAIN_SOURCES = [
+	'ARToolKitBench.cpp',
+	'trackingMod.c',
+	'trackingMod2d.c',
+	'templateMod.c',
+	'videoLuma.c',
+	'trackingSub.c',
+	'markerROI.c',
+	'nftBundle.c',
+	'scratchArena.c',
+].map(function(src) {
+	return path.resolve(SOURCE_PATH, src);
+});
+
+if (!fs.existsSync(path.resolve(ARTOOLKIT5_ROOT, 'include/AR/config.h'))) {
+	console.log("Renaming and moving config.h.in to config.h");
+	fs.copyFileSync(
+		path.resolve(ARTOOLKIT5_ROOT, 'include/AR/config.h.in'),
+		path.resolve(ARTOOLKIT5_ROOT, 'include/AR/config.h')
+	);
+	console.log("Done!");
+}
+
+function sources(dir, files) {
+	return files.map(function(src) {
+		return path.resolve(ARTOOLKIT5_ROOT, 'lib/SRC/', dir, src);
+	});
+}
+
+// As in makem.js, without Video/video.c: frames are fed from memory.
+var ar_sources = sources('', [
+	'AR/arLabelingSub/*.c',
+	'AR/*.c',
+	'ARICP/*.c',
+	'ARMulti/*.c',
+	'ARUtil/log.c',
+	'ARUtil/file_utils.c',
+]);
+
+var ar2_sources = sources('AR2', [
+	'handle.c',
+	'imageSet.c',
+	'jpeg.c',
+	'marker.c',
+	'featureMap.c',
+	'featureSet.c',
+	'selectTemplate.c',
+	'surface.c',
+	'tracking.c',
+	'tracking2d.c',
+	'matching.c',
+	'matching2.c',
+	'template.c',
+	'searchPoint.c',
+	'coord.c',
+	'util.c',
+]);
+
+var kpm_sources = sources('KPM', [
+	'kpmHandle.cpp',
+	'kpmRefDataSet.cpp',
+	'kpmMatching.cpp',
+	'kpmResult.cpp',
+	'kpmUtil.cpp',
+	'kpmFopen.c',
+	'FreakMatcher/detectors/DoG_scale_invariant_detector.cpp',
+	'FreakMatcher/detectors/gaussian_scale_space_pyramid.cpp',
+	'FreakMatcher/detectors/gradients.cpp',
+	'FreakMatcher/detectors/harris.cpp',
+	'FreakMatcher/detectors/orientation_assignment.cpp',
+	'FreakMatcher/detectors/pyramid.cpp',
+	'FreakMatcher/facade/visual_database_facade.cpp',
+	'FreakMatcher/matchers/hough_similarity_voting.cpp',
+	'FreakMatcher/matchers/freak.cpp',
+	'FreakMatcher/framework/date_time.cpp',
+	'FreakMatcher/framework/image.cpp',
+	'FreakMatcher/framework/logger.cpp',
+	'FreakMatcher/framework/timers.cpp',
+]);
+
+if (HAVE_NFT) {
+	ar_sources = ar_sources
+	.concat(ar2_sources)
+	.concat(kpm_sources);
+}
+
+if (HAVE_THREADS) {
+	ar_sources = ar_sources.concat(sources('ARUtil', ['thread_sub.c']));
+}
+
+var DEFINES = ' ';
+if (HAVE_NFT) DEFINES += ' -D HAVE_NFT ';
+if (HAVE_THREADS) DEFINES += ' -D HAVE_THREADS -D TRACKING_THREAD_POOL_SIZE=' + THREAD_POOL_SIZE + ' ';
+
+var INCLUDES = [
+	path.resolve(ARTOOLKIT5_ROOT, 'include'),
+	SOURCE_PATH,
+	path.resolve(ARTOOLKIT5_ROOT, 'lib/SRC/KPM/FreakMatcher'),
+].map(function(s) { return '-I' + s }).join(' ');
+
+var LIBS = ' -lz -ljpeg -lm ';
+if (HAVE_THREADS) LIBS += ' -lpthread ';
+
+function isCpp(src) {
+	return /\.cpp$/.test(src);
+}
+
+// Expands a single * in the file name of a source path, as the shell would.
+function expand(src) {
+	var dir = path.dirname(src), name = path.basename(src);
+	if (name.indexOf('*') == -1 || !fs.existsSync(dir)) return [src];
+	var re = new RegExp('^' + name.split('*').map(function(s) { return s.replace(/[.]/g, '\\.'); }).join('.*') + '$');
+	return fs.readdirSync(dir).filter(function(f) { return re.test(f); }).sort().map(function(f) {
+		return path.resolve(dir, f);
+	});
+}
+
+// Objects are named after their source path relative to the upstream or emscripten/ source root,
+// e.g. AR2_template.o, so that sources with the same name in different directories do not collide.
+var UPSTREAM_SOURCE_PATH = path.resolve(ARTOOLKIT5_ROOT, 'lib/SRC') + '/';
+
+function objectFile(src) {
+	var root = src.indexOf(UPSTREAM_SOURCE_PATH) == 0 ? UPSTREAM_SOURCE_PATH : SOURCE_PATH;
+	return OBJ_PATH + path.relative(root, src).replace(/\.[^.\/]*$/, '').replace(/[\/\\]/g, '_') + '.o';
+}
+
+function compile(compiler, srcs) {
+	return srcs.map(function(src) {
+		return compiler + ' -c ' + OPTIMIZE_FLAGS + INCLUDES + DEFINES + ' ' + src + ' -o ' + objectFile(src);
+	}).join(' && ');
+}
+
+// Objects of an earlier build may have other names, and everything in OBJ_PATH is linked.
+function make_dirs() {
+	[OUTPUT_PATH, OBJ_PATH].forEach(function(dir) {
+		if (!fs.existsSync(dir)) fs.mkdirSync(dir, { recursive: true });
+	});
+	fs.readdirSync(OBJ_PATH).filter(function(f) { return /\.o$/.test(f); }).forEach(function(f) {
+		fs.unlinkSync(OBJ_PATH + f);
+	});
+}
+
+ar_sources = [].concat.apply([], ar_sources.map(expand));
+
+// Upstream sources are compiled into OBJ_PATH, C and C++ separately.
+var compile_arlib_c = compile(CC, ar_sources.filter(function(src) { return !isCpp(src); }));
+
+var compile_arlib_cpp = compile(CXX + ' -std=c++11', ar_sources.filter(isCpp));
+
+var compile_main_c = compile(CC, MAIN_SOURCES.filter(function(src) { return !isCpp(src); }));
+
+// The converter's main() is compiled outside OBJ_PATH, which the benchmark links whole.
+var compile_bundle_tool = 'cd ' + OUTPUT_PATH + ' && ' + CC + ' -c ' + OPTIMIZE_FLAGS + INCLUDES + DEFINES + ' '
+	+ path.resolve(SOURCE_PATH, 'nftBundleTool.c');
+
+var link_bundle_tool = CXX + ' ' + OPTIMIZE_FLAGS + OUTPUT_PATH + 'nftBundleTool.o ' + OBJ_PATH + '*.o ' + LIBS
+	+ ' -o ' + OUTPUT_PATH + BUILD_BUNDLE_TOOL_FILE;
+
+// Each test's main() is compiled into OUTPUT_PATH too, and the test is run from there.
+var native_tests = NATIVE_TESTS.map(function(test) {
+	return {
+		compile: 'cd ' + OUTPUT_PATH + ' && ' + CC + ' -c ' + OPTIMIZE_FLAGS + INCLUDES + DEFINES + ' '
+			+ TEST_PATH + test + '.c',
+		link: CXX + ' ' + OPTIMIZE_FLAGS + OUTPUT_PATH + test + '.o ' + OBJ_PATH + '*.o ' + LIBS
+			+ ' -o ' + OUTPUT_PATH + test,
+		run: OUTPUT_PATH + test,
+	};
+});
+
+var link_bench = CXX + ' -std=c++11 ' + OPTIMIZE_FLAGS + INCLUDES + DEFINES + ' '
+	+ MAIN_SOURCES.filter(isCpp).join(' ') + ' ' + OBJ_PATH + '*.o ' + LIBS
+	+ ' -o ' + OUTPUT_PATH + BUILD_BENCH_FILE;
+
+/*
+ * Run commands
+ */
+
+function onExec(error, stdout, stderr) {
+	if (stdout) console.log('stdout: ' + stdout);
+	if (stderr) console.log('stderr: ' + stderr);
+	if (error !== null) {
+		console.log('exec error: ' + error.code);
+		process.exit(error.code);
+	} else {
+		runJob();
+	}
+}
+
+function runJob() {
+	if (!jobs.length) {
+		console.log('Jobs completed');
+		return;
+	}
+	var cmd = jobs.shift();
+
+	if (typeof cmd === 'function') {
+		cmd();
+		runJob();
+		return;
+	}
+
+	console.log('\nRunning command: ' + cmd + '\n');
+	exec(cmd, { maxBuffer: 64 * 1024 * 1024 }, onExec);
+}
+
+var jobs = [];
+
+function addJob(job) {
+	jobs.push(job);
+}
+
+addJob(make_dirs);
+addJob(compile_arlib_c);
+addJob(compile_arlib_cpp);
+addJob(compile_main_c);
+addJob(link_bench);
+addJob(compile_bundle_tool);
+addJob(link_bundle_tool);
+native_tests.forEach(function(test) {
+	addJob(test.compile);
+	addJob(test.link);
+});
+native_tests.forEach(function(test) {
+	addJob(test.run);
+});
+
+runJob();